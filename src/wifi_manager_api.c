@@ -8,15 +8,121 @@
 
 #include "wifi_manager_private.h"
 
+#ifdef CONFIG_WIFI_MANAGER_LEGACY_API
+// Instance backing the legacy global API (first instance created, or the one
+// created by wifi_manager_init). Never used by the event or HTTP handlers.
+static wifi_manager_t *legacy_wm = NULL;
+#endif
+
+// WiFi driver and default netifs are process-wide; instances share them and the
+// last instance to be destroyed tears them down again.
+static int wifi_driver_refs = 0;
+static esp_netif_t *shared_sta_netif = NULL;
+static esp_netif_t *shared_ap_netif = NULL;
+
+static bool scan_for_networks(wifi_manager_t *wm);
+static esp_err_t connect_to_candidate(wifi_manager_t *wm, const stored_network_t *network,
+                                      const network_candidate_t *candidate);
+static bool wait_for_connection(wifi_manager_t *wm, int timeout_ms);
+
 /* ==========================================
  *          TZAPU-STYLE API FUNCTIONS
  * ========================================== */
 
+/**
+ * @brief Take a reference on the WiFi driver and default netifs, initializing them on first use
+ * @param wm WiFiManager instance receiving the netif handles
+ * @return ESP_OK on success
+ */
+static esp_err_t wifi_driver_acquire(wifi_manager_t *wm)
+{
+    if (wifi_driver_refs == 0)
+    {
+        // Create network interfaces
+        shared_sta_netif = esp_netif_create_default_wifi_sta();
+        shared_ap_netif = esp_netif_create_default_wifi_ap();
+        if (!shared_sta_netif || !shared_ap_netif)
+        {
+            ESP_LOGE(TAG, "Failed to create network interfaces");
+            goto fail;
+        }
+
+        // Initialize WiFi
+        wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+        esp_err_t ret = esp_wifi_init(&cfg);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to initialize WiFi: %s", esp_err_to_name(ret));
+            goto fail;
+        }
+    }
+
+    wifi_driver_refs++;
+    wm->sta_netif = shared_sta_netif;
+    wm->ap_netif = shared_ap_netif;
+    return ESP_OK;
+
+fail:
+    if (shared_ap_netif)
+    {
+        esp_netif_destroy_default_wifi(shared_ap_netif);
+        shared_ap_netif = NULL;
+    }
+    if (shared_sta_netif)
+    {
+        esp_netif_destroy_default_wifi(shared_sta_netif);
+        shared_sta_netif = NULL;
+    }
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Drop a reference on the WiFi driver, deinitializing it with the last instance
+ * @param wm WiFiManager instance releasing its netif handles
+ */
+static void wifi_driver_release(wifi_manager_t *wm)
+{
+    if (!wm->sta_netif && !wm->ap_netif)
+    {
+        return; // Never acquired
+    }
+
+    wm->sta_netif = NULL;
+    wm->ap_netif = NULL;
+
+    if (--wifi_driver_refs > 0)
+    {
+        return;
+    }
+
+    esp_wifi_stop();
+    esp_err_t ret = esp_wifi_deinit();
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to deinitialize WiFi: %s", esp_err_to_name(ret));
+    }
+
+    esp_netif_destroy_default_wifi(shared_ap_netif);
+    esp_netif_destroy_default_wifi(shared_sta_netif);
+    shared_ap_netif = NULL;
+    shared_sta_netif = NULL;
+}
+
 /**
  * @brief Create a new WiFiManager instance (tzapu-style API)
  * @return Pointer to WiFiManager instance or NULL on failure
  */
 wifi_manager_t *wifi_manager_create(void)
+{
+    return wifi_manager_create_with_config(NULL);
+}
+
+/**
+ * @brief Create a new WiFiManager instance with custom web server settings
+ * @param http_config Web server settings, NULL for defaults
+ * @return Pointer to WiFiManager instance or NULL on failure
+ */
+wifi_manager_t *wifi_manager_create_with_config(const wifi_manager_http_config_t *http_config)
 {
     wifi_manager_t *wm = malloc(sizeof(wifi_manager_t));
     if (!wm)
@@ -34,20 +140,86 @@ wifi_manager_t *wifi_manager_create(void)
     wm->debug_output = true;
     wm->ap_callback = NULL;
     wm->save_callback = NULL;
+    wm->status_callback = NULL;
     wm->sta_netif = NULL;
     wm->ap_netif = NULL;
     wm->server = NULL;
+    wm->httpd_task = NULL;
+    wm->http_sessions = 0;
+    wm->http_requests = 0;
+    wm->http_open = 0;
+    wm->http_open_peak = 0;
+    if (http_config)
+    {
+        wm->http_config = *http_config;
+    }
+    else
+    {
+        wm->http_config = (wifi_manager_http_config_t)WIFI_MANAGER_HTTP_CONFIG_DEFAULT();
+    }
+    wm->restart_timer = NULL;
+    wm->restart_disconnect = false;
+    wm->wifi_event_instance = NULL;
+    wm->ip_event_instance = NULL;
     wm->current_status = WIFI_STATUS_DISCONNECTED;
     memset(wm->ip_address, 0, sizeof(wm->ip_address));
     wm->retry_count = 0;
+    wm->suppress_reconnect = false;
+    wm->last_disconnect_reason = 0;
     wm->timeout_timer = NULL;
+    wm->dhcp_renew_timer = NULL;
+    wm->using_cached_lease = false;
+    wm->lease_probe_pending = false;
+    wm->lease_timer = NULL;
+    wm->connect_started_us = 0;
     wm->portal_aborted = false;
     wm->config_saved = false;
+    wm->portal_blocking = true;
+    wm->portal_active = false;
+    wm->portal_task = NULL;
+    wm->portal_task_exited = NULL;
+    wm->portal_task_started = false;
+    wm->portal_task_destroyed = NULL;
+    wm->portal_wakeup = NULL;
+    wm->portal_scan_timer = NULL;
+    wm->portal_ap_timer = NULL;
+    wm->portal_connect_attempted = false;
+    wm->portal_done_callback = NULL;
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+    {
+        wm->event_fds[i] = -1;
+    }
+    wm->event_client_count = 0;
+    wm->event_pending = 0;
+    wm->event_work_queued = false;
+    wm->event_id = 0;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        wm->ws_fds[i] = -1;
+    }
+    wm->ws_client_count = 0;
+    wm->dns_task = NULL;
+    wm->dns_task_exited = NULL;
+    wm->dns_task_started = false;
+    wm->dns_socket = -1;
+    wm->dns_running = false;
+
+    // Initialize connection state snapshot
+    wm->state_seq = 0;
+    memset(&wm->state, 0, sizeof(wm->state));
+    wm->state.status = WIFI_STATUS_DISCONNECTED;
+    wm->state.state_since_us = esp_timer_get_time();
+    portMUX_INITIALIZE(&wm->state_lock);
+
+    // Initialize link monitoring and roaming
+    link_init(wm);
+    roam_init(wm);
 
     // Initialize WiFi scan fields
     wm->scanned_count = 0;
     wm->scan_completed = false;
     wm->scan_task_handle = NULL;
+    wm->scan_task_exited = NULL;
     memset(wm->scanned_networks, 0, sizeof(wm->scanned_networks));
 
     // Initialize configuration parameters
@@ -57,291 +229,315 @@ wifi_manager_t *wifi_manager_create(void)
     esp_err_t ret = esp_netif_init();
     if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
         ESP_LOGE(TAG, "Failed to initialize network interface: %s", esp_err_to_name(ret));
-        free(wm);
-        return NULL;
+        goto fail;
     }
 
     ret = esp_event_loop_create_default();
     if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
         ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(ret));
-        free(wm);
-        return NULL;
+        goto fail;
     }
 
-    // Create network interfaces
-    wm->sta_netif = esp_netif_create_default_wifi_sta();
-    wm->ap_netif = esp_netif_create_default_wifi_ap();
+    // Create network interfaces and initialize WiFi (shared between instances)
+    if (wifi_driver_acquire(wm) != ESP_OK) {
+        goto fail;
+    }
 
-    // Initialize WiFi
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ret = esp_wifi_init(&cfg);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize WiFi: %s", esp_err_to_name(ret));
-        free(wm);
-        return NULL;
+    wm->portal_wakeup = xSemaphoreCreateBinary();
+    if (!wm->portal_wakeup)
+    {
+        ESP_LOGE(TAG, "Failed to create portal semaphore");
+        goto fail;
     }
 
-    // Register event handlers
-    ret = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL);
-    if (ret != ESP_OK && ret != ESP_ERR_INVALID_ARG) {
+    wm->portal_task_exited = xSemaphoreCreateBinary();
+    if (!wm->portal_task_exited)
+    {
+        ESP_LOGE(TAG, "Failed to create portal task semaphore");
+        goto fail;
+    }
+
+    wm->dns_task_exited = xSemaphoreCreateBinary();
+    if (!wm->dns_task_exited)
+    {
+        ESP_LOGE(TAG, "Failed to create DNS task semaphore");
+        goto fail;
+    }
+
+    // Register event handlers - the instance is the handler argument so several
+    // managers can coexist and each one can unregister exactly its own handlers
+    ret = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, wm,
+                                              &wm->wifi_event_instance);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register WiFi event handler: %s", esp_err_to_name(ret));
+        goto fail;
     }
-    
-    ret = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL);
-    if (ret != ESP_OK && ret != ESP_ERR_INVALID_ARG) {
+
+    ret = esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, wm,
+                                              &wm->ip_event_instance);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register IP event handler: %s", esp_err_to_name(ret));
+        goto fail;
+    }
+
+    wm->dhcp_renew_timer = xTimerCreate("wm_dhcp_renew", pdMS_TO_TICKS(WIFI_MANAGER_DHCP_RENEW_TIMEOUT_MS),
+                                        pdFALSE, wm, dhcp_renew_timer_callback);
+    if (!wm->dhcp_renew_timer)
+    {
+        ESP_LOGE(TAG, "Failed to create DHCP renew timer");
+        goto fail;
+    }
+
+    wm->lease_timer = xTimerCreate("wm_lease", pdMS_TO_TICKS(WIFI_MANAGER_ARP_PROBE_WAIT_MS),
+                                   pdFALSE, wm, lease_timer_callback);
+    if (!wm->lease_timer)
+    {
+        ESP_LOGE(TAG, "Failed to create lease timer");
+        goto fail;
+    }
+
+#ifdef CONFIG_WIFI_MANAGER_PORTAL
+    wm->restart_timer = xTimerCreate("wm_restart", pdMS_TO_TICKS(WIFI_MANAGER_RESTART_DELAY_MS),
+                                     pdFALSE, wm, restart_timer_callback);
+    if (!wm->restart_timer)
+    {
+        ESP_LOGE(TAG, "Failed to create restart timer");
+        goto fail;
+    }
+#endif
+
+    wm->link_timer = xTimerCreate("wm_link", pdMS_TO_TICKS(WIFI_MANAGER_LINK_SAMPLE_INTERVAL_MS),
+                                  pdTRUE, wm, link_timer_callback);
+    if (!wm->link_timer || xTimerStart(wm->link_timer, 0) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create link sampling timer");
+        goto fail;
+    }
+
+#ifdef CONFIG_WIFI_MANAGER_SCAN_TASK
+    wm->scan_task_exited = xSemaphoreCreateBinary();
+    if (!wm->scan_task_exited)
+    {
+        ESP_LOGE(TAG, "Failed to create scan task semaphore");
+        goto fail;
     }
 
     // Create the WiFi scan task
     BaseType_t task_result = xTaskCreate(
         wifi_scan_task,
         "wifi_scan_task",
-        4096, // Stack size - sufficient for WiFi operations
-        wm,   // Parameters - pass WiFiManager instance
-        3,    // Priority - lower than main task but higher than idle
+        SCAN_TASK_STACK_SIZE,
+        wm, // Parameters - pass WiFiManager instance
+        3,  // Priority - lower than main task but higher than idle
         &wm->scan_task_handle);
 
     if (task_result != pdPASS)
     {
         ESP_LOGE(TAG, "Failed to create WiFi scan task");
-        free(wm);
-        return NULL;
+        wm->scan_task_handle = NULL;
+        goto fail;
     }
+#endif
 
     if (wm->debug_output)
     {
         ESP_LOGI(TAG, "WiFiManager created");
     }
 
-    // Set global reference for event handler
-    g_wm = wm;
+#ifdef CONFIG_WIFI_MANAGER_LEGACY_API
+    // First instance also serves the legacy global API
+    if (!legacy_wm)
+    {
+        legacy_wm = wm;
+    }
+#endif
 
     return wm;
+
+fail:
+    // Everything acquired so far is released by the same path as destroy
+    wifi_manager_destroy(wm);
+    return NULL;
 }
 
 /**
  * @brief Destroy WiFiManager instance and cleanup resources
+ *
+ * Releases everything wifi_manager_create() acquired, in reverse order. Safe to
+ * call on a partially constructed instance.
  */
 void wifi_manager_destroy(wifi_manager_t *wm)
 {
     if (!wm)
         return;
 
+    // A non-blocking portal task must not outlive the instance (waits for it to finish the portal)
+    stop_portal_task(wm);
+    wm->portal_active = false;
+
     if (wm->timeout_timer)
     {
+        xTimerStop(wm->timeout_timer, 0);
         xTimerDelete(wm->timeout_timer, portMAX_DELAY);
+        wm->timeout_timer = NULL;
     }
 
-    // Clean up scan task
-    if (wm->scan_task_handle)
+    if (wm->portal_scan_timer)
     {
-        vTaskDelete(wm->scan_task_handle);
-        wm->scan_task_handle = NULL;
+        xTimerStop(wm->portal_scan_timer, 0);
+        xTimerDelete(wm->portal_scan_timer, portMAX_DELAY);
+        wm->portal_scan_timer = NULL;
     }
 
-    // Stop web server
-    stop_webserver();
-
-    // Clear global reference
-    if (g_wm == wm)
+    if (wm->portal_ap_timer)
     {
-        g_wm = NULL;
+        xTimerStop(wm->portal_ap_timer, 0);
+        xTimerDelete(wm->portal_ap_timer, portMAX_DELAY);
+        wm->portal_ap_timer = NULL;
     }
 
-    free(wm);
-}
+    // Stop web server and captive DNS (waits for the DNS task, it references the instance)
+    stop_webserver(wm);
+    stop_dns_server(wm, true);
 
-/**
- * @brief Auto-connect to saved WiFi or start config portal
- */
-bool wifi_manager_auto_connect(wifi_manager_t *wm, const char *ap_name, const char *ap_password)
-{
-    if (!wm)
-        return false;
-
-    ESP_LOGI(TAG, "Starting WiFiManager auto-connect...");
-
-    // Try to load and connect to saved WiFi first
-    char saved_ssid[32] = {0};
-    char saved_password[64] = {0};
-
-    if (load_wifi_credentials(saved_ssid, saved_password) == ESP_OK && strlen(saved_ssid) > 0)
+    // Unregister event handlers first so no event can reach the instance or its scan task
+    if (wm->wifi_event_instance)
     {
-        ESP_LOGI(TAG, "Found saved WiFi credentials for: %s", saved_ssid);
-
-        // Try to connect using the legacy start function which handles STA mode
-        esp_err_t ret = wifi_manager_start();
-        if (ret == ESP_OK)
-        {
-            // Give time for connection attempt with retries (max 3 retries * ~5s each = ~15s + buffer)
-            const int max_wait_time_ms = 20000; // 20 seconds
-            const int check_interval_ms = 500;  // Check every 500ms
-            int elapsed_time_ms = 0;
-
-            while (elapsed_time_ms < max_wait_time_ms && current_status != WIFI_STATUS_CONNECTED && current_status != WIFI_STATUS_DISCONNECTED)
-            {
-                vTaskDelay(pdMS_TO_TICKS(check_interval_ms));
-                elapsed_time_ms += check_interval_ms;
-            }
-
-            // Check if we successfully connected
-            if (current_status == WIFI_STATUS_CONNECTED)
-            {
-                ESP_LOGI(TAG, "Successfully connected to saved WiFi after %d ms", elapsed_time_ms);
-                return true;
-            }
-            else
-            {
-                ESP_LOGW(TAG, "Connection failed or timed out after %d ms (status: %d)", elapsed_time_ms, current_status);
-            }
-        }
-        ESP_LOGW(TAG, "Failed to connect to saved WiFi, starting config portal");
+        esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wm->wifi_event_instance);
+        wm->wifi_event_instance = NULL;
     }
-    else
+    if (wm->ip_event_instance)
     {
-        ESP_LOGI(TAG, "No saved WiFi credentials found, starting config portal");
+        esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, wm->ip_event_instance);
+        wm->ip_event_instance = NULL;
     }
 
-    // Start configuration portal using legacy implementation
-    return wifi_manager_start_config_portal(wm, ap_name ? ap_name : wm->ap_ssid,
-                                            ap_password ? ap_password : (strlen(wm->ap_password) > 0 ? wm->ap_password : NULL));
-}
-
-/**
- * @brief Start configuration portal with specified AP credentials
- */
-bool wifi_manager_start_config_portal(wifi_manager_t *wm, const char *ap_name, const char *ap_password)
-{
-    if (!wm)
-        return false;
-
-    ESP_LOGI(TAG, "Starting config portal: %s", ap_name ? ap_name : wm->ap_ssid);
-
-    wm->portal_aborted = false;
-    wm->config_saved = false;
-    wm->current_status = WIFI_STATUS_CONFIG_PORTAL;
-
-    // Call config mode callback if set
-    if (wm->ap_callback)
+    if (wm->dhcp_renew_timer)
     {
-        wm->ap_callback(wm);
+        xTimerStop(wm->dhcp_renew_timer, 0);
+        xTimerDelete(wm->dhcp_renew_timer, portMAX_DELAY);
+        wm->dhcp_renew_timer = NULL;
     }
 
-    // Stop any existing WiFi and start in AP mode using legacy implementation
-    esp_wifi_stop();
+    if (wm->lease_timer)
+    {
+        xTimerStop(wm->lease_timer, 0);
+        xTimerDelete(wm->lease_timer, portMAX_DELAY);
+        wm->lease_timer = NULL;
+    }
 
-    // Configure AP mode with the provided credentials
-    wifi_config_t wifi_config = {
-        .ap = {
-            .ssid_len = 0,
-            .channel = 1,
-            .max_connection = 4,
-            .authmode = WIFI_AUTH_OPEN,
-            .pmf_cfg = {
-                .required = false,
-            },
-        },
-    };
+    if (wm->restart_timer)
+    {
+        xTimerStop(wm->restart_timer, 0);
+        xTimerDelete(wm->restart_timer, portMAX_DELAY);
+        wm->restart_timer = NULL;
+    }
 
-    // Set SSID
-    const char *ssid = ap_name ? ap_name : wm->ap_ssid;
-    strncpy((char *)wifi_config.ap.ssid, ssid, sizeof(wifi_config.ap.ssid) - 1);
-    wifi_config.ap.ssid[sizeof(wifi_config.ap.ssid) - 1] = '\0';
-    wifi_config.ap.ssid_len = strlen((char *)wifi_config.ap.ssid);
+    if (wm->link_timer)
+    {
+        xTimerStop(wm->link_timer, 0);
+        xTimerDelete(wm->link_timer, portMAX_DELAY);
+        wm->link_timer = NULL;
+    }
 
-    // Set password if provided
-    const char *password = ap_password ? ap_password : (strlen(wm->ap_password) > 0 ? wm->ap_password : NULL);
-    if (password && strlen(password) >= 8)
+    if (wm->roam_timer)
     {
-        strncpy((char *)wifi_config.ap.password, password, sizeof(wifi_config.ap.password) - 1);
-        wifi_config.ap.password[sizeof(wifi_config.ap.password) - 1] = '\0';
-        wifi_config.ap.authmode = WIFI_AUTH_WPA2_PSK;
+        xTimerStop(wm->roam_timer, 0);
+        xTimerDelete(wm->roam_timer, portMAX_DELAY);
+        wm->roam_timer = NULL;
     }
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
+    // Clean up scan task (joined, it may be copying scan results)
+    if (wm->scan_task_handle)
+    {
+        esp_wifi_scan_stop();
+    }
+    stop_scan_task(wm);
 
-    // Ensure STA interface is disconnected before starting scan
-    esp_wifi_disconnect();
-    ESP_ERROR_CHECK(esp_wifi_start());
+    // Stop and deinitialize WiFi, destroy netifs (last instance only)
+    wifi_driver_release(wm);
 
-    // Start web server for configuration
-    start_webserver();
-    update_status(WIFI_STATUS_AP_MODE);
+#ifdef CONFIG_WIFI_MANAGER_LEGACY_API
+    if (legacy_wm == wm)
+    {
+        legacy_wm = NULL;
+    }
+#endif
 
-    ESP_LOGI(TAG, "AP mode started. SSID: %s", ssid);
-    if (password && strlen(password) >= 8)
+    if (wm->portal_wakeup)
     {
-        ESP_LOGI(TAG, "AP Password: %s", password);
+        vSemaphoreDelete(wm->portal_wakeup);
     }
-    else
+    if (wm->portal_task_exited)
     {
-        ESP_LOGI(TAG, "AP is open (no password)");
+        vSemaphoreDelete(wm->portal_task_exited);
+    }
+    if (wm->dns_task_exited)
+    {
+        vSemaphoreDelete(wm->dns_task_exited);
     }
-    ESP_LOGI(TAG, "Connect to WiFi network '%s' and go to http://192.168.4.1", ssid);
 
-    // Only schedule WiFi scan if we're truly in config portal mode
-    // and not auto-connecting to saved credentials
-    ESP_LOGI(TAG, "Config portal started - starting WiFi scanning with new task-based approach");
+    free(wm);
+}
 
-    // Trigger initial scan after a short delay to let AP mode stabilize
-    vTaskDelay(pdMS_TO_TICKS(2000)); // 2 second delay
-    trigger_wifi_scan(wm);
+/**
+ * @brief Auto-connect to saved WiFi or start config portal
+ *
+ * Scans once, ranks all saved networks against the results and tries them in
+ * order before falling back to the config portal.
+ */
+bool wifi_manager_auto_connect(wifi_manager_t *wm, const char *ap_name, const char *ap_password)
+{
+    if (!wm)
+        return false;
 
-    // Set up timeout timer if configured
-    if (wm->config_portal_timeout > 0)
-    {
-        wm->timeout_timer = xTimerCreate("wm_timeout",
-                                         pdMS_TO_TICKS(wm->config_portal_timeout * 1000),
-                                         pdFALSE, wm, timeout_timer_callback);
-        if (wm->timeout_timer)
-        {
-            xTimerStart(wm->timeout_timer, 0);
-        }
-    }
+    ESP_LOGI(TAG, "Starting WiFiManager auto-connect...");
+
+    // Try to connect to the saved networks first
+    network_store_t store;
+    network_candidate_t candidates[WIFI_MANAGER_MAX_NETWORKS];
 
-    // Wait for configuration or timeout
-    while (!wm->portal_aborted && !wm->config_saved)
+    if (load_network_store(&store) == ESP_OK && store.count > 0)
     {
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Check every second instead of 100ms
+        ESP_LOGI(TAG, "Found %d saved network(s)", store.count);
 
-        // Check for timeout
-        if (wm->timeout_timer && !xTimerIsTimerActive(wm->timeout_timer))
-        {
-            ESP_LOGW(TAG, "Config portal timeout reached");
-            break;
-        }
+        int64_t started_us = esp_timer_get_time();
+        scan_for_networks(wm);
+        int candidate_count = select_network_candidates(wm, &store, candidates);
 
-        // Check if we got a successful connection through the web interface
-        if (current_status == WIFI_STATUS_CONNECTED)
+        for (int i = 0; i < candidate_count; i++)
         {
-            wm->config_saved = true;
-            break;
-        }
-    }
+            const stored_network_t *network = &store.entries[candidates[i].store_index];
 
-    // Clean up timer
-    if (wm->timeout_timer)
-    {
-        xTimerStop(wm->timeout_timer, 0);
-        xTimerDelete(wm->timeout_timer, portMAX_DELAY);
-        wm->timeout_timer = NULL;
-    }
+            // Give time for connection attempt with retries (max 3 retries * ~5s each = ~15s + buffer)
+            if (connect_to_candidate(wm, network, &candidates[i]) == ESP_OK && wait_for_connection(wm, 20000))
+            {
+                wifi_manager_state_t state;
+                state_read(wm, &state);
+                record_connection_result(network->ssid, true, state.bssid, state.channel);
 
-    if (wm->config_saved)
-    {
-        ESP_LOGI(TAG, "Configuration saved, attempting to connect");
-        if (wm->save_callback)
-        {
-            wm->save_callback();
+                ESP_LOGI(TAG, "Successfully connected to '%s' (candidate %d/%d) after %lld ms", network->ssid,
+                         i + 1, candidate_count, (long long)((esp_timer_get_time() - started_us) / 1000));
+                return true;
+            }
+
+            ESP_LOGW(TAG, "Connection to '%s' failed or timed out (status: %d)", network->ssid, wm->current_status);
+            record_connection_result(network->ssid, false, NULL, 0);
+
+            // Abort this attempt without triggering the retry logic
+            wm->suppress_reconnect = true;
+            esp_wifi_disconnect();
         }
-        return true;
+        ESP_LOGW(TAG, "Failed to connect to saved WiFi, starting config portal");
     }
     else
     {
-        ESP_LOGW(TAG, "Config portal timeout or aborted");
-        return false;
+        ESP_LOGI(TAG, "No saved WiFi credentials found, starting config portal");
     }
+
+    // Start configuration portal using legacy implementation
+    return wifi_manager_start_config_portal(wm, ap_name ? ap_name : wm->ap_ssid,
+                                            ap_password ? ap_password : (strlen(wm->ap_password) > 0 ? wm->ap_password : NULL));
 }
 
 /* ==========================================
@@ -414,6 +610,28 @@ const char *wifi_manager_get_ip_address(wifi_manager_t *wm)
     return NULL;
 }
 
+esp_err_t wifi_manager_get_snapshot(wifi_manager_t *wm, wifi_manager_snapshot_t *out)
+{
+    if (!wm || !out)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    wifi_manager_state_t state;
+    state_read(wm, &state);
+
+    out->status = state.status;
+    out->ip = state.ip;
+    out->gateway = state.gateway;
+    out->netmask = state.netmask;
+    out->rssi = state.rssi;
+    memcpy(out->bssid, state.bssid, sizeof(out->bssid));
+    out->channel = state.channel;
+    out->uptime_in_state_ms = (uint32_t)((esp_timer_get_time() - state.state_since_us) / 1000);
+
+    return ESP_OK;
+}
+
 const char *wifi_manager_get_config_portal_ssid(wifi_manager_t *wm)
 {
     return wm ? wm->ap_ssid : NULL;
@@ -461,183 +679,202 @@ esp_err_t wifi_manager_erase_config(wifi_manager_t *wm)
 }
 
 /* ==========================================
- *          LEGACY API FUNCTIONS
+ *          CONNECTION HELPERS
  * ========================================== */
 
-esp_err_t wifi_manager_init(wifi_event_callback_t callback)
+/**
+ * @brief Start STA mode and run a scan (through the scan task if there is one)
+ * @param wm WiFiManager instance
+ * @return true if the scan completed in time
+ */
+static bool scan_for_networks(wifi_manager_t *wm)
 {
-    user_callback = callback;
+    // Set to STA mode and start WiFi
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
 
-    // Initialize NVS
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-    {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
+    ESP_LOGI(TAG, "Scanning for networks...");
 
-    // Initialize TCP/IP stack
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    // Reset scan state
+    wm->scan_completed = false;
+    wm->scanned_count = 0;
 
-    // Create network interfaces
-    sta_netif = esp_netif_create_default_wifi_sta();
-    ap_netif = esp_netif_create_default_wifi_ap();
+    // Hand the scan to the scan task, or run it right here without one
+    trigger_wifi_scan(wm);
 
-    // Initialize WiFi
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    // Wait for scan completion with timeout
+    int scan_wait_ms = 0;
+    const int scan_timeout_ms = 15000; // 15 second timeout for scan
+    const int poll_interval_ms = 100;
 
-    // Register event handlers
-    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+    while (!wm->scan_completed && scan_wait_ms < scan_timeout_ms)
+    {
+        vTaskDelay(pdMS_TO_TICKS(poll_interval_ms));
+        scan_wait_ms += poll_interval_ms;
+    }
 
-    ESP_LOGI(TAG, "WiFi Manager initialized");
-    return ESP_OK;
+    if (!wm->scan_completed)
+    {
+        ESP_LOGW(TAG, "Scan timeout after %d ms", scan_timeout_ms);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Scan completed. Found %d networks", wm->scanned_count);
+    return true;
 }
 
-esp_err_t wifi_manager_start(void)
+/**
+ * @brief Start a STA connection attempt to a ranked candidate
+ * @param wm WiFiManager instance
+ * @param network Saved network
+ * @param candidate Scan match for the network (AP and channel to use)
+ * @return ESP_OK if the connection attempt was started
+ */
+static esp_err_t connect_to_candidate(wifi_manager_t *wm, const stored_network_t *network,
+                                      const network_candidate_t *candidate)
 {
-    char ssid[33] = {0};
-    char password[65] = {0};
+    wifi_config_t wifi_config = {0};
+    strncpy((char *)wifi_config.sta.ssid, network->ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, network->password, sizeof(wifi_config.sta.password));
 
-    // Try to load saved credentials
-    if (load_wifi_credentials(ssid, password) == ESP_OK && strlen(ssid) > 0)
+    if (candidate->visible)
     {
-        ESP_LOGI(TAG, "Found saved WiFi credentials, attempting to connect to: %s", ssid);
-
-        // Set to STA mode and start WiFi
-        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-        ESP_ERROR_CHECK(esp_wifi_start());
-
-        // Use the scan task instead of direct scan to avoid conflicts
-        wifi_manager_t *wm = g_wm;
-        if (!wm)
-        {
-            ESP_LOGE(TAG, "WiFi Manager not initialized");
-            return ESP_ERR_INVALID_STATE;
-        }
-
-        ESP_LOGI(TAG, "Using scan task to find networks...");
+        // Lock onto the strongest AP seen in the scan
+        ESP_LOGI(TAG, "Connecting to strongest AP for '%s': " MACSTR " (RSSI: %d dBm, channel %d)",
+                 network->ssid, MAC2STR(candidate->bssid), candidate->rssi, candidate->channel);
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, candidate->bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = candidate->channel;
+    }
+    else
+    {
+        // Not in the scan (hidden or out of range) - start on the last known channel
+        ESP_LOGW(TAG, "No AP found with SSID %s, attempting connection anyway", network->ssid);
+        wifi_config.sta.channel = candidate->channel;
+    }
 
-        // Reset scan state
-        wm->scan_completed = false;
-        wm->scanned_count = 0;
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    apply_ip_config(wm);
+    wm->retry_count = 0;
+    wm->suppress_reconnect = false;
+    update_status(wm, WIFI_STATUS_CONNECTING);
 
-        // Trigger scan using the scan task
-        trigger_wifi_scan(wm);
+    // Start connection attempt
+    esp_err_t connect_result = esp_wifi_connect();
+    if (connect_result == ESP_OK)
+    {
+        ESP_LOGI(TAG, "WiFi connection initiated successfully");
+        return ESP_OK;
+    }
 
-        // Wait for scan completion with timeout
-        int scan_wait_ms = 0;
-        const int scan_timeout_ms = 15000; // 15 second timeout for scan
-        const int poll_interval_ms = 100;
+    ESP_LOGE(TAG, "Failed to initiate WiFi connection: %s", esp_err_to_name(connect_result));
+    return connect_result;
+}
 
-        while (!wm->scan_completed && scan_wait_ms < scan_timeout_ms)
-        {
-            vTaskDelay(pdMS_TO_TICKS(poll_interval_ms));
-            scan_wait_ms += poll_interval_ms;
-        }
+/**
+ * @brief Wait until the current attempt connects or gives up
+ * @param wm WiFiManager instance
+ * @param timeout_ms Maximum time to wait
+ * @return true if connected
+ */
+static bool wait_for_connection(wifi_manager_t *wm, int timeout_ms)
+{
+    const int check_interval_ms = 500; // Check every 500ms
+    int elapsed_time_ms = 0;
 
-        if (!wm->scan_completed)
-        {
-            ESP_LOGW(TAG, "Scan timeout after %d ms", scan_timeout_ms);
-        }
-        else
-        {
-            ESP_LOGI(TAG, "Scan completed via scan task. Found %d networks", wm->scanned_count);
-        }
+    while (elapsed_time_ms < timeout_ms && wm->current_status != WIFI_STATUS_CONNECTED &&
+           wm->current_status != WIFI_STATUS_DISCONNECTED)
+    {
+        vTaskDelay(pdMS_TO_TICKS(check_interval_ms));
+        elapsed_time_ms += check_interval_ms;
+    }
 
-        // Look for the saved SSID in scan results
-        int strongest_index = -1;
-        int8_t strongest_rssi = -128;
+    return wm->current_status == WIFI_STATUS_CONNECTED;
+}
 
-        if (wm->scanned_count > 0)
-        {
-            for (int i = 0; i < wm->scanned_count && i < MAX_SCANNED_NETWORKS; i++)
-            {
-                ESP_LOGI(TAG, "Scan result %d: SSID='%s', RSSI=%d", i, wm->scanned_networks[i].ssid, wm->scanned_networks[i].rssi);
-                if (strcmp(wm->scanned_networks[i].ssid, ssid) == 0)
-                {
-                    if (wm->scanned_networks[i].rssi > strongest_rssi)
-                    {
-                        strongest_rssi = wm->scanned_networks[i].rssi;
-                        strongest_index = i;
-                    }
-                }
-            }
-        }
+#ifdef CONFIG_WIFI_MANAGER_LEGACY_API
+/* ==========================================
+ *          LEGACY API FUNCTIONS
+ * ========================================== */
 
-        // Configure STA mode with strongest AP
-        wifi_config_t wifi_config = {0};
-        strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid) - 1);
-        strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password) - 1);
+esp_err_t wifi_manager_init(wifi_event_callback_t callback)
+{
+    // Initialize NVS
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
 
-        if (strongest_index >= 0)
-        {
-            ESP_LOGI(TAG, "Found saved network '%s' with RSSI: %d dBm", ssid, strongest_rssi);
-            ESP_LOGI(TAG, "Connecting to strongest AP: %s (RSSI: %d dBm)",
-                     ssid, wm->scanned_networks[strongest_index].rssi);
-        }
-        else
-        {
-            ESP_LOGW(TAG, "No AP found with SSID %s, attempting connection anyway", ssid);
-        }
+    // The legacy API runs on a regular instance (which initializes netif, event
+    // loop, WiFi driver and event handlers)
+    if (!legacy_wm && !wifi_manager_create())
+    {
+        ESP_LOGE(TAG, "Failed to create WiFi Manager instance");
+        return ESP_FAIL;
+    }
+    legacy_wm->status_callback = callback;
 
-        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-        update_status(WIFI_STATUS_CONNECTING);
+    ESP_LOGI(TAG, "WiFi Manager initialized");
+    return ESP_OK;
+}
 
-        // Start connection attempt
-        esp_err_t connect_result = esp_wifi_connect();
-        if (connect_result == ESP_OK)
-        {
-            ESP_LOGI(TAG, "WiFi connection initiated successfully");
-            return ESP_OK;
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Failed to initiate WiFi connection: %s", esp_err_to_name(connect_result));
-            return connect_result;
-        }
+esp_err_t wifi_manager_start(void)
+{
+    wifi_manager_t *wm = legacy_wm;
+    if (!wm)
+    {
+        ESP_LOGE(TAG, "WiFi Manager not initialized");
+        return ESP_ERR_INVALID_STATE;
     }
-    else
+
+    // Try the best ranked saved network
+    network_store_t store;
+    if (load_network_store(&store) == ESP_OK && store.count > 0)
     {
-        ESP_LOGI(TAG, "No saved WiFi credentials, starting AP mode for setup");
+        network_candidate_t candidates[WIFI_MANAGER_MAX_NETWORKS];
+        scan_for_networks(wm);
+        select_network_candidates(wm, &store, candidates);
+        return connect_to_candidate(wm, &store.entries[candidates[0].store_index], &candidates[0]);
+    }
 
-        // Configure AP mode
-        wifi_config_t wifi_config = {
-            .ap = {
-                .ssid = WIFI_MANAGER_AP_SSID,
-                .password = WIFI_MANAGER_AP_PASS,
-                .ssid_len = strlen(WIFI_MANAGER_AP_SSID),
-                .channel = 1,
-                .max_connection = 4,
-                .authmode = WIFI_AUTH_WPA_WPA2_PSK},
-        };
+    ESP_LOGI(TAG, "No saved WiFi credentials, starting AP mode for setup");
 
-        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
-        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
-        ESP_ERROR_CHECK(esp_wifi_start());
+    // Configure AP mode
+    wifi_config_t wifi_config = {
+        .ap = {
+            .ssid = WIFI_MANAGER_AP_SSID,
+            .password = WIFI_MANAGER_AP_PASS,
+            .ssid_len = strlen(WIFI_MANAGER_AP_SSID),
+            .channel = 1,
+            .max_connection = 4,
+            .authmode = WIFI_AUTH_WPA_WPA2_PSK},
+    };
 
-        // Start web server for configuration
-        start_webserver();
-        update_status(WIFI_STATUS_AP_MODE);
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
 
-        ESP_LOGI(TAG, "AP mode started. SSID: %s, Password: %s", WIFI_MANAGER_AP_SSID, WIFI_MANAGER_AP_PASS);
-        ESP_LOGI(TAG, "Connect to this network and go to http://192.168.4.1 to configure WiFi");
-    }
+    // Start web server for configuration
+    start_webserver(wm);
+    update_status(wm, WIFI_STATUS_AP_MODE);
+
+    ESP_LOGI(TAG, "AP mode started. SSID: %s, Password: %s", WIFI_MANAGER_AP_SSID, WIFI_MANAGER_AP_PASS);
+    ESP_LOGI(TAG, "Connect to this network and go to http://192.168.4.1 to configure WiFi");
 
     return ESP_OK;
 }
 
 wifi_status_t wifi_manager_get_current_status(void)
 {
-    return current_status;
+    return wifi_manager_get_status(legacy_wm);
 }
 
 const char *wifi_manager_get_current_ip(void)
 {
-    return (current_status == WIFI_STATUS_CONNECTED) ? ip_address : NULL;
+    return wifi_manager_get_ip_address(legacy_wm);
 }
 
 esp_err_t wifi_manager_reset_credentials(void)
@@ -657,11 +894,17 @@ esp_err_t wifi_manager_reset_credentials(void)
 
 esp_err_t wifi_manager_stop(void)
 {
-    stop_webserver();
+    if (!legacy_wm)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    stop_webserver(legacy_wm);
     esp_wifi_stop();
-    update_status(WIFI_STATUS_DISCONNECTED);
+    update_status(legacy_wm, WIFI_STATUS_DISCONNECTED);
     return ESP_OK;
 }
+#endif // CONFIG_WIFI_MANAGER_LEGACY_API
 
 /* ==========================================
  *      CONFIGURATION MANAGEMENT API
@@ -732,6 +975,7 @@ esp_err_t wifi_manager_reset_config(wifi_manager_t *wm)
         return ESP_ERR_INVALID_ARG;
     }
 
+#ifdef CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
     // Reset all parameters to their default values
     for (int i = 0; i < wm->config_param_count; i++)
     {
@@ -742,4 +986,7 @@ esp_err_t wifi_manager_reset_config(wifi_manager_t *wm)
 
     ESP_LOGI(TAG, "Configuration parameters reset to defaults");
     return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
  */
 
 #include "wifi_manager_private.h"
+
+#ifdef CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
 #include "cJSON.h"
 
 /**
@@ -20,6 +22,7 @@ void init_default_config_parameters(wifi_manager_t *wm)
     wm->config_param_count = 0;
     wm->config_portal_enabled = true;
 
+#ifdef CONFIG_WIFI_MANAGER_MQTT_DEFAULT_PARAMS
     // Add default MQTT configuration parameters
     add_config_parameter(wm, "mqtt_broker", "MQTT Broker", CONFIG_TYPE_STRING,
                          "broker.mqtt.cool", true, "mqtt.example.com");
@@ -44,6 +47,10 @@ void init_default_config_parameters(wifi_manager_t *wm)
 
     add_config_parameter(wm, "enable_debug", "Enable Debug Logging", CONFIG_TYPE_BOOL,
                          "false", false, "");
+#endif
+
+    // Station addressing (DHCP, static IP or cached lease)
+    init_ip_config_parameters(wm);
 }
 
 /**
@@ -247,6 +254,9 @@ esp_err_t save_config_parameters(wifi_manager_t *wm)
         return ESP_ERR_INVALID_ARG;
     }
 
+    perf_mark_t perf;
+    perf_begin(&perf);
+
     nvs_handle_t nvs_handle;
     esp_err_t err = nvs_open(WIFI_MANAGER_CONFIG_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK)
@@ -304,6 +314,8 @@ esp_err_t save_config_parameters(wifi_manager_t *wm)
         ESP_LOGE(TAG, "Failed to convert JSON to string");
         return ESP_ERR_NO_MEM;
     }
+    size_t json_size = strlen(json_string) + 1;
+    mem_account(MEM_CONFIG, json_size);
 
     // Save to NVS
     err = nvs_set_str(nvs_handle, "config_json", json_string);
@@ -313,6 +325,7 @@ esp_err_t save_config_parameters(wifi_manager_t *wm)
     }
 
     // Cleanup
+    mem_account(MEM_CONFIG, -(ssize_t)json_size);
     free(json_string);
     cJSON_Delete(json);
     nvs_close(nvs_handle);
@@ -320,6 +333,7 @@ esp_err_t save_config_parameters(wifi_manager_t *wm)
     if (err == ESP_OK)
     {
         ESP_LOGI(TAG, "Configuration parameters saved to NVS");
+        perf_end(&perf, "config save");
     }
     else
     {
@@ -339,6 +353,9 @@ esp_err_t load_config_parameters(wifi_manager_t *wm)
         return ESP_ERR_INVALID_ARG;
     }
 
+    perf_mark_t perf;
+    perf_begin(&perf);
+
     nvs_handle_t nvs_handle;
     esp_err_t err = nvs_open(WIFI_MANAGER_CONFIG_NAMESPACE, NVS_READONLY, &nvs_handle);
     if (err != ESP_OK)
@@ -358,7 +375,7 @@ esp_err_t load_config_parameters(wifi_manager_t *wm)
     }
 
     // Allocate buffer and read JSON string
-    char *json_string = malloc(required_size);
+    char *json_string = mem_alloc(MEM_CONFIG, required_size);
     if (!json_string)
     {
         nvs_close(nvs_handle);
@@ -371,14 +388,14 @@ esp_err_t load_config_parameters(wifi_manager_t *wm)
 
     if (err != ESP_OK)
     {
-        free(json_string);
+        mem_free(MEM_CONFIG, json_string);
         ESP_LOGE(TAG, "Failed to read config JSON: %s", esp_err_to_name(err));
         return err;
     }
 
     // Parse JSON
     cJSON *json = cJSON_Parse(json_string);
-    free(json_string);
+    mem_free(MEM_CONFIG, json_string);
 
     if (!json)
     {
@@ -429,6 +446,7 @@ esp_err_t load_config_parameters(wifi_manager_t *wm)
 
     cJSON_Delete(json);
     ESP_LOGI(TAG, "Configuration parameters loaded from NVS");
+    perf_end(&perf, "config load");
     return ESP_OK;
 }
 
@@ -481,4 +499,53 @@ esp_err_t reset_config_parameters(wifi_manager_t *wm)
 
     ESP_LOGI(TAG, "Configuration parameters reset to defaults successfully");
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+#else
+/*
+ * Custom parameters compiled out (CONFIG_WIFI_MANAGER_CUSTOM_PARAMS). Nothing is
+ * stored, lookups fail, so the IP configuration falls back to DHCP and the
+ * portal config page shows an empty list.
+ */
+
+void init_default_config_parameters(wifi_manager_t *wm)
+{
+    if (wm)
+    {
+        wm->config_param_count = 0;
+        wm->config_portal_enabled = true;
+    }
+}
+
+esp_err_t add_config_parameter(wifi_manager_t *wm, const char *key, const char *label,
+                               config_param_type_t type, const char *default_value,
+                               bool required, const char *placeholder)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t set_config_parameter(wifi_manager_t *wm, const char *key, const char *value)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t get_config_parameter(wifi_manager_t *wm, const char *key, char *value, size_t value_len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t save_config_parameters(wifi_manager_t *wm)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t load_config_parameters(wifi_manager_t *wm)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t reset_config_parameters(wifi_manager_t *wm)
+{
+    return wm ? ESP_OK : ESP_ERR_INVALID_ARG; // Nothing to reset, keeps the portal reset working
+}
+#endif // CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
@@ -8,35 +8,105 @@
 
 #include "wifi_manager_private.h"
 
-// Global variables (declared in private header)
-esp_netif_t *sta_netif = NULL;
-esp_netif_t *ap_netif = NULL;
-wifi_event_callback_t user_callback = NULL;
-wifi_status_t current_status = WIFI_STATUS_DISCONNECTED;
-char ip_address[16] = {0};
-int retry_count = 0;
-wifi_manager_t *g_wm = NULL; // Global reference for event handler
-
 const char *TAG = "wifi_manager";
 
+/**
+ * @brief Start publishing a state update (sequence becomes odd)
+ *
+ * Writers are serialized with a spinlock so updates from the event loop and from
+ * application/httpd tasks cannot interleave. Must be paired with state_write_end().
+ */
+void state_write_begin(wifi_manager_t *wm)
+{
+    portENTER_CRITICAL(&wm->state_lock);
+    __atomic_store_n(&wm->state_seq, wm->state_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Finish publishing a state update (sequence becomes even again)
+ */
+void state_write_end(wifi_manager_t *wm)
+{
+    __atomic_store_n(&wm->state_seq, wm->state_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&wm->state_lock);
+}
+
+/**
+ * @brief Copy the published state without blocking writers
+ *
+ * Retries until it reads a copy that was not torn by a concurrent update.
+ */
+void state_read(wifi_manager_t *wm, wifi_manager_state_t *out)
+{
+    uint32_t seq_before;
+    uint32_t seq_after;
+
+    do
+    {
+        seq_before = __atomic_load_n(&wm->state_seq, __ATOMIC_ACQUIRE);
+        *out = wm->state;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq_after = __atomic_load_n(&wm->state_seq, __ATOMIC_RELAXED);
+    } while ((seq_before & 1) || seq_before != seq_after);
+}
+
+/**
+ * @brief Log the duration and heap delta of an operation started with perf_begin()
+ * @param mark Mark set by perf_begin()
+ * @param what Operation name for the log line
+ */
+void perf_end(const perf_mark_t *mark, const char *what)
+{
+    int64_t elapsed_us = esp_timer_get_time() - mark->start_us;
+    long heap_used = (long)mark->free_heap - (long)heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+
+    ESP_LOGD(TAG, "perf: %s took %lld us, heap %+ld bytes", what, (long long)elapsed_us, heap_used);
+}
+
 /**
  * @brief Update WiFi status and notify if callback registered
  */
-void update_status(wifi_status_t status)
+void update_status(wifi_manager_t *wm, wifi_status_t status)
 {
-    current_status = status;
-    if (g_wm)
+    wm->current_status = status;
+
+    state_write_begin(wm);
+    if (wm->state.status != status)
     {
-        g_wm->current_status = status;
+        wm->state.state_since_us = esp_timer_get_time();
     }
+    wm->state.status = status;
+    if (status == WIFI_STATUS_NO_IP)
+    {
+        // Still associated - keep the link details, only the lease is gone
+        wm->state.ip = 0;
+        wm->state.gateway = 0;
+        wm->state.netmask = 0;
+    }
+    else if (status != WIFI_STATUS_CONNECTED && status != WIFI_STATUS_CONNECTING)
+    {
+        // Association is gone, drop link details so readers don't see stale data
+        wm->state.ip = 0;
+        wm->state.gateway = 0;
+        wm->state.netmask = 0;
+        wm->state.rssi = 0;
+        wm->state.channel = 0;
+        memset(wm->state.bssid, 0, sizeof(wm->state.bssid));
+    }
+    state_write_end(wm);
 
     ESP_LOGI(TAG, "Status updated to: %d", status);
 
     // Call user callback if registered
-    if (user_callback)
+    if (wm->status_callback)
     {
-        user_callback(status, (status == WIFI_STATUS_CONNECTED) ? ip_address : NULL);
+        wm->status_callback(status, (status == WIFI_STATUS_CONNECTED) ? wm->ip_address : NULL);
     }
+
+    // A running config portal waits for CONNECTED
+    portal_notify(wm);
+    events_publish(wm, EVENT_PENDING_STATUS);
 }
 
 /**
@@ -49,14 +119,65 @@ void timeout_timer_callback(TimerHandle_t xTimer)
     {
         ESP_LOGI(TAG, "Configuration portal timeout reached");
         wm->portal_aborted = true;
+        portal_notify(wm);
+    }
+}
+
+/**
+ * @brief DHCP renewal window expired without a new lease - fall back to reassociation
+ */
+void dhcp_renew_timer_callback(TimerHandle_t xTimer)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvTimerGetTimerID(xTimer);
+    if (wm && wm->current_status == WIFI_STATUS_NO_IP)
+    {
+        ESP_LOGW(TAG, "DHCP renewal timed out, reassociating");
+        // STA_DISCONNECTED then runs the normal retry path
+        esp_wifi_disconnect();
+    }
+}
+
+/**
+ * @brief Try to get a new lease on the existing association
+ *
+ * Restarting the DHCP client sends a DISCOVER immediately instead of waiting for
+ * the association to be torn down and rebuilt.
+ */
+void start_dhcp_renew(wifi_manager_t *wm)
+{
+    update_status(wm, WIFI_STATUS_NO_IP);
+
+    esp_err_t err = esp_netif_dhcpc_stop(wm->sta_netif);
+    if (err == ESP_OK || err == ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED)
+    {
+        err = esp_netif_dhcpc_start(wm->sta_netif);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "DHCP renew failed (%s), reassociating", esp_err_to_name(err));
+        esp_wifi_disconnect();
+        return;
+    }
+
+    ESP_LOGI(TAG, "Link still up, renewing DHCP lease");
+    if (wm->dhcp_renew_timer)
+    {
+        xTimerReset(wm->dhcp_renew_timer, 0);
     }
 }
 
 /**
  * @brief Main WiFi event handler
+ * @param arg WiFiManager instance the handler was registered for
  */
 void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
+    wifi_manager_t *wm = (wifi_manager_t *)arg;
+    if (!wm)
+    {
+        return;
+    }
+
     if (event_base == WIFI_EVENT)
     {
         switch (event_id)
@@ -69,7 +190,13 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
         {
             wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
             ESP_LOGI(TAG, "Connected to WiFi network: %s", event->ssid);
-            update_status(WIFI_STATUS_CONNECTING);
+
+            state_write_begin(wm);
+            memcpy(wm->state.bssid, event->bssid, sizeof(wm->state.bssid));
+            wm->state.channel = event->channel;
+            state_write_end(wm);
+            link_on_connected(wm);
+            update_status(wm, WIFI_STATUS_CONNECTING);
             break;
         }
 
@@ -77,39 +204,49 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
         {
             wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
             ESP_LOGI(TAG, "Disconnected from WiFi (reason: %d)", event->reason);
+            link_on_disconnected(wm, event->reason);
+            wm->last_disconnect_reason = event->reason;
+
+            if (wm->dhcp_renew_timer)
+            {
+                xTimerStop(wm->dhcp_renew_timer, 0);
+            }
+            if (wm->lease_timer)
+            {
+                // Probed again when the cached address comes back with the link
+                xTimerStop(wm->lease_timer, 0);
+                wm->lease_probe_pending = false;
+            }
 
-            if (g_wm)
+            if (wm->suppress_reconnect)
             {
-                g_wm->retry_count++;
-                if (g_wm->retry_count < WIFI_MANAGER_MAX_RETRY)
-                {
-                    ESP_LOGI(TAG, "Retrying connection... (%d/%d)", g_wm->retry_count, WIFI_MANAGER_MAX_RETRY);
-                    esp_wifi_connect();
-                    update_status(WIFI_STATUS_CONNECTING);
-                }
-                else
-                {
-                    ESP_LOGW(TAG, "Max connection retries reached");
-                    update_status(WIFI_STATUS_DISCONNECTED);
-                    g_wm->retry_count = 0;
-                }
+                // Disconnect requested by the manager (switching network)
+                wm->suppress_reconnect = false;
+                wm->retry_count = 0;
+                update_status(wm, WIFI_STATUS_DISCONNECTED);
+                break;
+            }
+
+            if (wm->current_status == WIFI_STATUS_AP_MODE || wm->current_status == WIFI_STATUS_CONFIG_PORTAL)
+            {
+                // No station connection of ours, e.g. the stop of a previous instance
+                break;
+            }
+
+            roam_on_disconnected(wm);
+
+            wm->retry_count++;
+            if (wm->retry_count < WIFI_MANAGER_MAX_RETRY)
+            {
+                ESP_LOGI(TAG, "Retrying connection... (%d/%d)", wm->retry_count, WIFI_MANAGER_MAX_RETRY);
+                esp_wifi_connect();
+                update_status(wm, WIFI_STATUS_CONNECTING);
             }
             else
             {
-                // Legacy global variable handling
-                retry_count++;
-                if (retry_count < WIFI_MANAGER_MAX_RETRY)
-                {
-                    ESP_LOGI(TAG, "Retrying connection... (%d/%d)", retry_count, WIFI_MANAGER_MAX_RETRY);
-                    esp_wifi_connect();
-                    update_status(WIFI_STATUS_CONNECTING);
-                }
-                else
-                {
-                    ESP_LOGW(TAG, "Max connection retries reached");
-                    update_status(WIFI_STATUS_DISCONNECTED);
-                    retry_count = 0;
-                }
+                ESP_LOGW(TAG, "Max connection retries reached");
+                update_status(wm, WIFI_STATUS_DISCONNECTED);
+                wm->retry_count = 0;
             }
             break;
         }
@@ -140,7 +277,7 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
 
         case WIFI_EVENT_SCAN_DONE:
             ESP_LOGI(TAG, "WiFi scan completed");
-            wifi_scan_done_handler();
+            wifi_scan_done_handler(wm);
             break;
         }
     }
@@ -152,34 +289,55 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
         {
             ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
 
-            // Format IP address
-            snprintf(ip_address, sizeof(ip_address), IPSTR, IP2STR(&event->ip_info.ip));
-
-            if (g_wm)
+            if (wm->dhcp_renew_timer)
             {
-                strncpy(g_wm->ip_address, ip_address, sizeof(g_wm->ip_address) - 1);
-                g_wm->ip_address[sizeof(g_wm->ip_address) - 1] = '\0';
-                g_wm->retry_count = 0;
+                xTimerStop(wm->dhcp_renew_timer, 0);
             }
-            else
+
+            // Format IP address
+            snprintf(wm->ip_address, sizeof(wm->ip_address), IPSTR, IP2STR(&event->ip_info.ip));
+            wm->retry_count = 0;
+
+            wifi_ap_record_t ap_info;
+            bool have_ap_info = (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK);
+
+            state_write_begin(wm);
+            wm->state.ip = event->ip_info.ip.addr;
+            wm->state.gateway = event->ip_info.gw.addr;
+            wm->state.netmask = event->ip_info.netmask.addr;
+            if (have_ap_info)
             {
-                retry_count = 0;
+                wm->state.rssi = ap_info.rssi;
+                wm->state.channel = ap_info.primary;
+                memcpy(wm->state.bssid, ap_info.bssid, sizeof(wm->state.bssid));
             }
+            state_write_end(wm);
 
-            ESP_LOGI(TAG, "Got IP address: %s", ip_address);
-            update_status(WIFI_STATUS_CONNECTED);
+            ESP_LOGI(TAG, "Got IP address: %s", wm->ip_address);
+            ip_config_on_got_ip(wm, event);
+            roam_on_got_ip(wm);
+            update_status(wm, WIFI_STATUS_CONNECTED);
             break;
         }
 
         case IP_EVENT_STA_LOST_IP:
+        {
             ESP_LOGI(TAG, "Lost IP address");
-            memset(ip_address, 0, sizeof(ip_address));
-            if (g_wm)
+            // The string buffers are left intact: readers may still hold a pointer to
+            // them, and the status change below already hides them from the getters.
+
+            // Link up but no IP: renew on the current association instead of a full reconnect
+            wifi_ap_record_t ap_info;
+            if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
             {
-                memset(g_wm->ip_address, 0, sizeof(g_wm->ip_address));
+                start_dhcp_renew(wm);
+            }
+            else
+            {
+                update_status(wm, WIFI_STATUS_DISCONNECTED);
             }
-            update_status(WIFI_STATUS_DISCONNECTED);
             break;
         }
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,224 @@
+/**
+ * @file wifi_manager_dns.c
+ * @brief Captive portal DNS responder - resolves every name to the soft-AP address
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+#include "lwip/sockets.h"
+
+#define DNS_PORT 53
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_A 1
+#define DNS_TYPE_ANY 255
+#define DNS_CLASS_IN 1
+#define DNS_TTL_SECONDS 60
+#define DNS_RECV_TIMEOUT_MS 500 // Bounds how long the task takes to notice a stop request
+
+/**
+ * @brief Turn a query in place into the captive portal reply
+ *
+ * The reply keeps the header and the first question, drops any other sections
+ * and appends the prebuilt A record for A/ANY questions. Other types get an
+ * empty NOERROR answer so clients fall back to A quickly.
+ * @param packet Query on input, reply on output (DNS_MAX_PACKET_SIZE bytes)
+ * @param len Length of the query
+ * @param answer Prebuilt answer record (DNS_ANSWER_SIZE bytes)
+ * @return Reply length, or 0 if the packet is not a query we answer
+ */
+int build_dns_reply(uint8_t *packet, int len, const uint8_t *answer)
+{
+    if (len < DNS_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    // Only standard queries (QR = 0, opcode = 0) with at least one question
+    if ((packet[2] & 0xF8) != 0 || ((packet[4] << 8) | packet[5]) == 0)
+    {
+        return 0;
+    }
+
+    // Walk the name of the first question
+    int offset = DNS_HEADER_SIZE;
+    while (offset < len && packet[offset] != 0)
+    {
+        if (packet[offset] & 0xC0)
+        {
+            return 0; // No compression in questions
+        }
+        offset += packet[offset] + 1;
+    }
+    offset += 1 + 4; // Terminating zero, QTYPE, QCLASS
+    if (offset > len || offset + DNS_ANSWER_SIZE > DNS_MAX_PACKET_SIZE)
+    {
+        return 0;
+    }
+
+    uint16_t qtype = (packet[offset - 4] << 8) | packet[offset - 3];
+    bool answer_a = (qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY);
+
+    packet[2] = 0x84 | (packet[2] & 0x01); // QR, AA, keep RD
+    packet[3] = 0x80;                      // RA, RCODE = NOERROR
+    packet[4] = 0;
+    packet[5] = 1; // QDCOUNT
+    packet[6] = 0;
+    packet[7] = answer_a ? 1 : 0; // ANCOUNT
+    memset(&packet[8], 0, 4);     // NSCOUNT, ARCOUNT
+
+    if (!answer_a)
+    {
+        return offset;
+    }
+
+    memcpy(&packet[offset], answer, DNS_ANSWER_SIZE);
+    return offset + DNS_ANSWER_SIZE;
+}
+
+/**
+ * @brief DNS responder task
+ *
+ * One fixed packet buffer on the task stack is reused for every query and reply,
+ * nothing is allocated per packet.
+ * @param pvParameters Pointer to WiFiManager instance
+ */
+static void dns_server_task(void *pvParameters)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvParameters;
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+
+    ESP_LOGI(TAG, "Captive DNS server started");
+
+    while (wm->dns_running)
+    {
+        struct sockaddr_in client;
+        socklen_t client_len = sizeof(client);
+
+        int len = recvfrom(wm->dns_socket, packet, sizeof(packet), 0, (struct sockaddr *)&client, &client_len);
+        if (len <= 0)
+        {
+            continue; // Receive timeout - re-check the running flag
+        }
+
+        int reply_len = build_dns_reply(packet, len, wm->dns_answer);
+        if (reply_len > 0)
+        {
+            sendto(wm->dns_socket, packet, reply_len, 0, (struct sockaddr *)&client, client_len);
+        }
+    }
+
+    close(wm->dns_socket);
+    wm->dns_socket = -1;
+    ESP_LOGI(TAG, "Captive DNS server stopped");
+
+    mem_task_exiting(&wm->dns_task);
+    xSemaphoreGive(wm->dns_task_exited); // Last use of the instance
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Wait until a stopping DNS task has exited
+ *
+ * No time limit: the task uses the instance until it gives dns_task_exited,
+ * so the instance must not be freed before.
+ */
+static void wait_dns_server_exit(wifi_manager_t *wm)
+{
+    if (wm->dns_task_started)
+    {
+        xSemaphoreTake(wm->dns_task_exited, portMAX_DELAY);
+        wm->dns_task_started = false;
+    }
+}
+
+/**
+ * @brief Start the captive DNS responder on the soft-AP address
+ * @param wm WiFiManager instance
+ * @return ESP_OK on success
+ */
+esp_err_t start_dns_server(wifi_manager_t *wm)
+{
+    if (wm->dns_running)
+    {
+        return ESP_OK;
+    }
+    wait_dns_server_exit(wm);
+
+    esp_netif_ip_info_t ip_info;
+    if (!wm->ap_netif || esp_netif_get_ip_info(wm->ap_netif, &ip_info) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "No soft-AP address for the DNS server");
+        return ESP_FAIL;
+    }
+
+    // Prebuilt answer: name pointer to the question, type A, class IN, TTL, AP address
+    const uint8_t answer[DNS_ANSWER_SIZE] = {
+        0xC0, DNS_HEADER_SIZE,
+        0x00, DNS_TYPE_A,
+        0x00, DNS_CLASS_IN,
+        0x00, 0x00, 0x00, DNS_TTL_SECONDS,
+        0x00, 0x04,
+        esp_ip4_addr1(&ip_info.ip), esp_ip4_addr2(&ip_info.ip),
+        esp_ip4_addr3(&ip_info.ip), esp_ip4_addr4(&ip_info.ip),
+    };
+    memcpy(wm->dns_answer, answer, sizeof(answer));
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Failed to create DNS socket");
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct timeval timeout = {
+        .tv_sec = 0,
+        .tv_usec = DNS_RECV_TIMEOUT_MS * 1000,
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed to bind DNS socket");
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    wm->dns_socket = sock;
+    wm->dns_running = true;
+    wm->dns_task_started = true;
+    if (xTaskCreate(dns_server_task, "wm_dns", DNS_TASK_STACK_SIZE, wm, 4, &wm->dns_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create DNS server task");
+        wm->dns_running = false;
+        wm->dns_task_started = false;
+        wm->dns_task = NULL;
+        close(sock);
+        wm->dns_socket = -1;
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Ask the captive DNS responder to stop
+ *
+ * The task exits within one receive timeout. Without waiting this is safe to
+ * call from timer callbacks.
+ * @param wm WiFiManager instance
+ * @param wait true to block until the task has exited, however long that takes (required before freeing wm)
+ */
+void stop_dns_server(wifi_manager_t *wm, bool wait)
+{
+    wm->dns_running = false;
+    if (wait)
+    {
+        wait_dns_server_exit(wm);
+    }
+}
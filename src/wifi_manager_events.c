@@ -0,0 +1,285 @@
+/**
+ * @file wifi_manager_events.c
+ * @brief Server-sent events (/events) and /ws pushes of status changes and scan completions
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+#include "lwip/sockets.h"
+
+static const char event_stream_headers[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "retry: 2000\n\n";
+
+/**
+ * @brief Format one event for the pending bits
+ * @return Length written to buf
+ */
+static int format_event(wifi_manager_t *wm, uint32_t event, char *buf, size_t size)
+{
+    uint32_t id = ++wm->event_id;
+
+    if (event == EVENT_PENDING_STATUS)
+    {
+        // Status and address from one snapshot, never from two different updates
+        wifi_manager_state_t state;
+        state_read(wm, &state);
+        char ip[16] = "";
+        if (state.status == WIFI_STATUS_CONNECTED)
+        {
+            esp_ip4_addr_t addr = {.addr = state.ip};
+            snprintf(ip, sizeof(ip), IPSTR, IP2STR(&addr));
+        }
+        return snprintf(buf, size, "id: %lu\nevent: status\ndata: {\"status\":%d,\"ip\":\"%s\"}\n\n",
+                        (unsigned long)id, state.status, ip);
+    }
+
+    // Scan results themselves are fetched from /wifi, the event only says they changed
+    return snprintf(buf, size, "id: %lu\nevent: scan\ndata: {\"count\":%d}\n\n", (unsigned long)id,
+                    wm->scanned_count);
+}
+
+/**
+ * @brief Send to one event stream client, dropping it on error
+ */
+static void send_to_client(wifi_manager_t *wm, int slot, const char *buf, int len)
+{
+    int fd = wm->event_fds[slot];
+    if (httpd_socket_send(wm->server, fd, buf, len, 0) < 0)
+    {
+        ESP_LOGD(TAG, "Event stream client %d gone", fd);
+        wm->event_fds[slot] = -1;
+        wm->event_client_count--;
+        httpd_sess_trigger_close(wm->server, fd);
+    }
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/**
+ * @brief Push one event to the /ws clients, in the control channel message format
+ */
+static void push_to_ws_clients(wifi_manager_t *wm, uint32_t event)
+{
+    const char *type = (event == EVENT_PENDING_STATUS) ? "status " : "wifi ";
+    size_t prefix = strlen(type);
+    size_t size = (event == EVENT_PENDING_STATUS) ? STATUS_JSON_SIZE : WIFI_LIST_JSON_SIZE;
+
+    char *buf = mem_alloc(MEM_WEB, prefix + size);
+    if (!buf)
+    {
+        return;
+    }
+    memcpy(buf, type, prefix);
+    int len = prefix + (event == EVENT_PENDING_STATUS ? format_portal_status(wm, buf + prefix, size)
+                                                      : format_wifi_list(wm, buf + prefix, size));
+
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)buf,
+        .len = len,
+    };
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        int fd = wm->ws_fds[i];
+        if (fd >= 0 && httpd_ws_send_frame_async(wm->server, fd, &frame) != ESP_OK)
+        {
+            ESP_LOGD(TAG, "WebSocket client %d gone", fd);
+            wm->ws_fds[i] = -1;
+            wm->ws_client_count--;
+            httpd_sess_trigger_close(wm->server, fd);
+        }
+    }
+    mem_free(MEM_WEB, buf);
+}
+#endif
+
+/**
+ * @brief Deliver pending events - runs in the httpd task via httpd_queue_work()
+ *
+ * The client tables are only touched from the httpd task (this work item, the
+ * /events and /ws handlers and the session close hook), so they need no lock.
+ */
+static void events_work(void *arg)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)arg;
+
+    __atomic_store_n(&wm->event_work_queued, false, __ATOMIC_RELEASE);
+    uint32_t pending = __atomic_exchange_n(&wm->event_pending, 0, __ATOMIC_ACQ_REL);
+    if (!wm->server)
+    {
+        return;
+    }
+
+    char buf[128];
+    for (uint32_t event = EVENT_PENDING_STATUS; event <= EVENT_PENDING_SCAN; event <<= 1)
+    {
+        if (!(pending & event))
+        {
+            continue;
+        }
+
+        int len = format_event(wm, event, buf, sizeof(buf));
+        for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+        {
+            if (wm->event_fds[i] >= 0)
+            {
+                send_to_client(wm, i, buf, len);
+            }
+        }
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        if (wm->ws_client_count > 0)
+        {
+            push_to_ws_clients(wm, event);
+        }
+#endif
+    }
+}
+
+/**
+ * @brief Queue events for the connected /events and /ws clients
+ *
+ * Safe from any task. Bursts collapse into a single httpd work item that sends
+ * the latest state, so nothing is allocated per event.
+ * @param wm WiFiManager instance
+ * @param events EVENT_PENDING_* bits
+ */
+void events_publish(wifi_manager_t *wm, uint32_t events)
+{
+    if (!wm->server || (wm->event_client_count == 0 && wm->ws_client_count == 0))
+    {
+        return;
+    }
+
+    __atomic_fetch_or(&wm->event_pending, events, __ATOMIC_ACQ_REL);
+    if (!__atomic_exchange_n(&wm->event_work_queued, true, __ATOMIC_ACQ_REL))
+    {
+        if (httpd_queue_work(wm->server, events_work, wm) != ESP_OK)
+        {
+            __atomic_store_n(&wm->event_work_queued, false, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/**
+ * @brief Check whether another long-lived client (/events or /ws) may keep a socket
+ *
+ * Streams hold their socket for as long as the page is open. With several
+ * phones on the portal they would otherwise take every socket and the page
+ * loads of the next phone would stall, so HTTP_RESERVED_SOCKETS always stay
+ * free for ordinary requests.
+ */
+bool events_stream_allowed(wifi_manager_t *wm)
+{
+    int streams = wm->event_client_count + wm->ws_client_count;
+    return streams + HTTP_RESERVED_SOCKETS < wm->http_config.max_open_sockets;
+}
+
+/**
+ * @brief Make the admitted /events and /ws sockets the most recently used
+ *
+ * Called whenever a connection opens. LRU purge then closes an idle
+ * keep-alive connection, which the browser simply reopens, instead of a
+ * stream the page would lose.
+ */
+void events_keep_streams(wifi_manager_t *wm, httpd_handle_t hd)
+{
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+    {
+        if (wm->event_fds[i] >= 0)
+        {
+            httpd_sess_update_lru_counter(hd, wm->event_fds[i]);
+        }
+    }
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (wm->ws_fds[i] >= 0)
+        {
+            httpd_sess_update_lru_counter(hd, wm->ws_fds[i]);
+        }
+    }
+}
+
+/**
+ * @brief Session close hook - forgets /events and /ws clients whose socket closes, counts open connections
+ */
+void events_on_close(httpd_handle_t hd, int sockfd)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)httpd_get_global_user_ctx(hd);
+
+    if (wm && wm->http_open > 0)
+    {
+        wm->http_open--;
+        ESP_LOGD(TAG, "Connection %d closed, %lu requests on %lu connections so far", sockfd,
+                 (unsigned long)wm->http_requests, (unsigned long)wm->http_sessions);
+    }
+    for (int i = 0; wm && i < EVENTS_MAX_CLIENTS; i++)
+    {
+        if (wm->event_fds[i] == sockfd)
+        {
+            wm->event_fds[i] = -1;
+            wm->event_client_count--;
+        }
+    }
+    for (int i = 0; wm && i < WS_MAX_CLIENTS; i++)
+    {
+        if (wm->ws_fds[i] == sockfd)
+        {
+            wm->ws_fds[i] = -1;
+            wm->ws_client_count--;
+        }
+    }
+
+    // Setting close_fn makes closing the socket our job
+    close(sockfd);
+}
+
+/**
+ * @brief Handler for the /events stream
+ *
+ * Writes the stream headers straight to the socket and keeps only the socket
+ * descriptor, so no httpd worker or request is held per client. Events are
+ * pushed later with httpd_socket_send().
+ */
+esp_err_t events_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
+    int slot = -1;
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+    {
+        if (wm->event_fds[i] < 0)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0 || !events_stream_allowed(wm))
+    {
+        // Clients fall back to polling
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    int fd = httpd_req_to_sockfd(req);
+    if (httpd_socket_send(req->handle, fd, event_stream_headers, sizeof(event_stream_headers) - 1, 0) < 0)
+    {
+        return ESP_FAIL;
+    }
+
+    wm->event_fds[slot] = fd;
+    wm->event_client_count++;
+    ESP_LOGI(TAG, "Event stream client connected (%d/%d)", wm->event_client_count, EVENTS_MAX_CLIENTS);
+
+    // Start the client with the current state
+    char buf[128];
+    send_to_client(wm, slot, buf, format_event(wm, EVENT_PENDING_STATUS, buf, sizeof(buf)));
+    return ESP_OK;
+}
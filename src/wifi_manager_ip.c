@@ -0,0 +1,329 @@
+/**
+ * @file wifi_manager_ip.c
+ * @brief Station IP configuration - DHCP, static addressing and cached leases
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/etharp.h"
+
+/**
+ * @brief Parse a dotted-quad IPv4 string
+ * @return true if the string holds a valid address
+ */
+static bool parse_ipv4(const char *str, uint32_t *addr)
+{
+    esp_ip4_addr_t ip;
+    if (!str || strlen(str) == 0 || esp_netif_str_to_ip4(str, &ip) != ESP_OK)
+    {
+        return false;
+    }
+    *addr = ip.addr;
+    return true;
+}
+
+/**
+ * @brief Get the SSID the station is configured for
+ */
+static void get_sta_ssid(char *ssid, size_t len)
+{
+    wifi_config_t wifi_config = {0};
+    ssid[0] = '\0';
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK)
+    {
+        strncpy(ssid, (const char *)wifi_config.sta.ssid, MIN(len - 1, sizeof(wifi_config.sta.ssid)));
+        ssid[len - 1] = '\0';
+    }
+}
+
+/**
+ * @brief Get the configured IP mode from the portal parameters
+ */
+static ip_mode_t get_ip_mode(wifi_manager_t *wm)
+{
+    char mode[16];
+    if (get_config_parameter(wm, "ip_mode", mode, sizeof(mode)) != ESP_OK)
+    {
+        return IP_MODE_DHCP;
+    }
+    if (strcmp(mode, "static") == 0)
+    {
+        return IP_MODE_STATIC;
+    }
+    if (strcmp(mode, "cached") == 0)
+    {
+        return IP_MODE_CACHED;
+    }
+    return IP_MODE_DHCP;
+}
+
+/**
+ * @brief Stop the DHCP client and assign a fixed address to the STA interface
+ *
+ * With the DHCP client stopped, esp_netif posts IP_EVENT_STA_GOT_IP as soon as the
+ * station associates instead of after a DHCP exchange.
+ */
+static esp_err_t set_fixed_address(wifi_manager_t *wm, const cached_lease_t *lease)
+{
+    esp_err_t err = esp_netif_dhcpc_stop(wm->sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED)
+    {
+        ESP_LOGW(TAG, "Failed to stop DHCP client: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    esp_netif_ip_info_t ip_info = {0};
+    ip_info.ip.addr = lease->ip;
+    ip_info.gw.addr = lease->gateway;
+    ip_info.netmask.addr = lease->netmask;
+
+    err = esp_netif_set_ip_info(wm->sta_netif, &ip_info);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to set IP info: %s", esp_err_to_name(err));
+        esp_netif_dhcpc_start(wm->sta_netif);
+        return err;
+    }
+
+    if (lease->dns)
+    {
+        esp_netif_dns_info_t dns = {0};
+        dns.ip.u_addr.ip4.addr = lease->dns;
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        esp_netif_set_dns_info(wm->sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief ARP probe for the station address (runs in the TCP/IP task)
+ *
+ * An RFC 5227 probe: sender IP 0.0.0.0, so no neighbour's ARP cache takes the
+ * address from it. The holder answers to the station and any ARP sent from the
+ * address lands in the ARP table, where arp_probe_answered() finds it.
+ */
+static esp_err_t arp_probe_send(void *ctx)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)ctx;
+    esp_netif_ip_info_t ip_info;
+    if (esp_netif_get_ip_info(wm->sta_netif, &ip_info) != ESP_OK || ip_info.ip.addr == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct netif *netif = esp_netif_get_netif_impl(wm->sta_netif);
+    ip4_addr_t ip = {.addr = ip_info.ip.addr};
+#if LWIP_ACD
+    return etharp_acd_probe(netif, &ip) == ERR_OK ? ESP_OK : ESP_FAIL;
+#elif LWIP_AUTOIP
+    return etharp_raw(netif, (struct eth_addr *)netif->hwaddr, &ethbroadcast, (struct eth_addr *)netif->hwaddr,
+                      IP4_ADDR_ANY4, &ethzero, &ip, ARP_REQUEST) == ERR_OK
+               ? ESP_OK
+               : ESP_FAIL;
+#else
+    // Without ACD or AutoIP lwIP keeps its raw ARP sender private
+    (void)netif;
+    (void)ip;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Whether another host answered the probe (runs in the TCP/IP task)
+ * @return ESP_OK if answered, ESP_ERR_NOT_FOUND if not
+ */
+static esp_err_t arp_probe_answered(void *ctx)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)ctx;
+    esp_netif_ip_info_t ip_info;
+    if (esp_netif_get_ip_info(wm->sta_netif, &ip_info) != ESP_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    ip4_addr_t ip = {.addr = ip_info.ip.addr};
+    struct eth_addr *mac;
+    const ip4_addr_t *found;
+    return etharp_find_addr(esp_netif_get_netif_impl(wm->sta_netif), &ip, &mac, &found) >= 0 ? ESP_OK
+                                                                                             : ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief ARP probe wait or renewal period of a cached lease ended
+ *
+ * An answered probe means another host got the address since the lease was
+ * cached; DHCP then runs at once. Otherwise the address is kept until the
+ * renewal period ends and DHCP takes over.
+ */
+void lease_timer_callback(TimerHandle_t xTimer)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvTimerGetTimerID(xTimer);
+    if (!wm || !wm->using_cached_lease || wm->current_status != WIFI_STATUS_CONNECTED)
+    {
+        return;
+    }
+
+    if (wm->lease_probe_pending)
+    {
+        wm->lease_probe_pending = false;
+        if (esp_netif_tcpip_exec(arp_probe_answered, wm) != ESP_OK)
+        {
+            ESP_LOGI(TAG, "Cached address is free, DHCP renews it in %d min",
+                     WIFI_MANAGER_CACHED_LEASE_RENEW_MS / 60000);
+            xTimerChangePeriod(xTimer, pdMS_TO_TICKS(WIFI_MANAGER_CACHED_LEASE_RENEW_MS), 0);
+            return;
+        }
+        ESP_LOGW(TAG, "Cached address is in use by another host, requesting a new lease");
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Cached lease due for renewal");
+    }
+
+    // The lease DHCP hands out replaces the cached one (ip_config_on_got_ip)
+    wm->using_cached_lease = false;
+    start_dhcp_renew(wm);
+}
+
+/**
+ * @brief Register the IP configuration parameters shown in the config portal
+ */
+void init_ip_config_parameters(wifi_manager_t *wm)
+{
+    add_config_parameter(wm, "ip_mode", "IP Mode (dhcp, static, cached)", CONFIG_TYPE_STRING,
+                         "dhcp", true, "dhcp");
+
+    add_config_parameter(wm, "static_ip", "Static IP", CONFIG_TYPE_STRING,
+                         "", false, "192.168.1.50");
+
+    add_config_parameter(wm, "static_gateway", "Gateway", CONFIG_TYPE_STRING,
+                         "", false, "192.168.1.1");
+
+    add_config_parameter(wm, "static_netmask", "Netmask", CONFIG_TYPE_STRING,
+                         "", false, "255.255.255.0");
+
+    add_config_parameter(wm, "static_dns", "DNS Server", CONFIG_TYPE_STRING,
+                         "", false, "192.168.1.1");
+}
+
+/**
+ * @brief Configure STA addressing before a connection attempt
+ *
+ * - dhcp: make sure the DHCP client runs
+ * - static: assign the configured address, DHCP stays off
+ * - cached: assign the last DHCP lease from NVS now; once the link is up an ARP
+ *   probe checks the address is free, and DHCP only runs on a conflict or when
+ *   the lease is due for renewal (see lease_timer_callback)
+ */
+void apply_ip_config(wifi_manager_t *wm)
+{
+    wm->using_cached_lease = false;
+    wm->lease_probe_pending = false;
+    if (wm->lease_timer)
+    {
+        xTimerStop(wm->lease_timer, 0);
+    }
+    wm->connect_started_us = esp_timer_get_time();
+
+    ip_mode_t mode = get_ip_mode(wm);
+
+    if (mode == IP_MODE_STATIC)
+    {
+        char value[MAX_CONFIG_STRING_LEN];
+        cached_lease_t lease = {0};
+        bool valid = true;
+
+        get_config_parameter(wm, "static_ip", value, sizeof(value));
+        valid &= parse_ipv4(value, &lease.ip);
+        get_config_parameter(wm, "static_gateway", value, sizeof(value));
+        valid &= parse_ipv4(value, &lease.gateway);
+        get_config_parameter(wm, "static_netmask", value, sizeof(value));
+        valid &= parse_ipv4(value, &lease.netmask);
+        get_config_parameter(wm, "static_dns", value, sizeof(value));
+        parse_ipv4(value, &lease.dns); // Optional
+
+        if (valid && set_fixed_address(wm, &lease) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "Using static IP configuration");
+            return;
+        }
+        ESP_LOGW(TAG, "Invalid static IP configuration, falling back to DHCP");
+    }
+    else if (mode == IP_MODE_CACHED)
+    {
+        cached_lease_t lease;
+        char ssid[33];
+        get_sta_ssid(ssid, sizeof(ssid));
+
+        // A lease is only reused on the network it came from
+        if (load_cached_lease(&lease) == ESP_OK && strcmp(lease.ssid, ssid) == 0 &&
+            set_fixed_address(wm, &lease) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "Using cached DHCP lease, probing it after association");
+            wm->using_cached_lease = true;
+            return;
+        }
+        ESP_LOGI(TAG, "No cached lease available, using DHCP");
+    }
+
+    esp_err_t err = esp_netif_dhcpc_start(wm->sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED)
+    {
+        ESP_LOGW(TAG, "Failed to start DHCP client: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Bookkeeping for IP_EVENT_STA_GOT_IP - time-to-IP and lease caching
+ */
+void ip_config_on_got_ip(wifi_manager_t *wm, const ip_event_got_ip_t *event)
+{
+    if (wm->connect_started_us)
+    {
+        ESP_LOGI(TAG, "Time to IP: %lld ms%s", (long long)((esp_timer_get_time() - wm->connect_started_us) / 1000),
+                 wm->using_cached_lease ? " (cached lease)" : "");
+        wm->connect_started_us = 0;
+    }
+
+    if (get_ip_mode(wm) != IP_MODE_CACHED)
+    {
+        return;
+    }
+
+    if (wm->using_cached_lease)
+    {
+        // The address stays in use while the probe runs. Starting the DHCP client
+        // here would reset it (esp_netif_dhcpc_start clears the address) and cost
+        // the full exchange the cached lease is there to skip.
+        esp_err_t err = esp_netif_tcpip_exec(arp_probe_send, wm);
+        if (err != ESP_OK)
+        {
+            // An unchecked address is not kept for the renewal period
+            ESP_LOGW(TAG, "ARP probe of the cached address failed (%s), requesting a new lease",
+                     esp_err_to_name(err));
+            wm->using_cached_lease = false;
+            start_dhcp_renew(wm);
+            return;
+        }
+        wm->lease_probe_pending = true;
+        xTimerChangePeriod(wm->lease_timer, pdMS_TO_TICKS(WIFI_MANAGER_ARP_PROBE_WAIT_MS), 0);
+        return;
+    }
+
+    cached_lease_t lease;
+    memset(&lease, 0, sizeof(lease));
+    get_sta_ssid(lease.ssid, sizeof(lease.ssid));
+    lease.ip = event->ip_info.ip.addr;
+    lease.gateway = event->ip_info.gw.addr;
+    lease.netmask = event->ip_info.netmask.addr;
+
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(wm->sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK)
+    {
+        lease.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    save_cached_lease(&lease);
+}
@@ -0,0 +1,185 @@
+/**
+ * @file wifi_manager_link.c
+ * @brief RSSI sampling and smoothed link quality metrics
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+
+#define LINK_EWMA_WEIGHT 8       // EWMA weight 1/8 - about the last 8 samples dominate
+#define LINK_EWMA_SCALE 16       // Fixed point scale of the EWMA accumulator
+#define LINK_LOW_PERCENTILE 10   // Reported low percentile of the sample window
+#define LINK_MIN_UPTIME_MS 60000 // Beacon loss rate is computed over at least one minute
+
+/**
+ * @brief Put the link metrics of a new instance in place - the timer starts with the event loop
+ */
+void link_init(wifi_manager_t *wm)
+{
+    memset(&wm->link, 0, sizeof(wm->link));
+    portMUX_INITIALIZE(&wm->link.lock);
+    wm->link_timer = NULL;
+}
+
+/**
+ * @brief Sampling timer callback - reads the RSSI of the current AP
+ *
+ * Runs in the timer task. esp_wifi_sta_get_ap_info() does not block, so the
+ * sample is taken here directly.
+ */
+void link_timer_callback(TimerHandle_t xTimer)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvTimerGetTimerID(xTimer);
+    if (!wm || wm->current_status != WIFI_STATUS_CONNECTED)
+    {
+        return;
+    }
+
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+    {
+        return;
+    }
+
+    link_monitor_t *link = &wm->link;
+
+    portENTER_CRITICAL(&link->lock);
+    if (!link->ewma_valid)
+    {
+        link->ewma = ap_info.rssi * LINK_EWMA_SCALE;
+        link->ewma_valid = true;
+    }
+    else
+    {
+        link->ewma += (ap_info.rssi * LINK_EWMA_SCALE - link->ewma) / LINK_EWMA_WEIGHT;
+    }
+    link->last_rssi = ap_info.rssi;
+    link->window[link->window_head] = ap_info.rssi;
+    link->window_head = (link->window_head + 1) % LINK_WINDOW_SIZE;
+    if (link->window_count < LINK_WINDOW_SIZE)
+    {
+        link->window_count++;
+    }
+    portEXIT_CRITICAL(&link->lock);
+
+    state_write_begin(wm);
+    wm->state.rssi = ap_info.rssi;
+    state_write_end(wm);
+}
+
+/**
+ * @brief Called on STA_CONNECTED - starts a new connected period
+ */
+void link_on_connected(wifi_manager_t *wm)
+{
+    link_monitor_t *link = &wm->link;
+
+    portENTER_CRITICAL(&link->lock);
+    link->connected_since_us = esp_timer_get_time();
+    // Possibly a different AP, don't blend its samples with the old one
+    link->ewma_valid = false;
+    link->window_count = 0;
+    link->window_head = 0;
+    portEXIT_CRITICAL(&link->lock);
+}
+
+/**
+ * @brief Called on STA_DISCONNECTED - counts the disconnect and its cause
+ * @param wm WiFiManager instance
+ * @param reason wifi_err_reason_t from the disconnect event
+ */
+void link_on_disconnected(wifi_manager_t *wm, uint8_t reason)
+{
+    link_monitor_t *link = &wm->link;
+
+    portENTER_CRITICAL(&link->lock);
+    if (link->connected_since_us)
+    {
+        link->connected_us += esp_timer_get_time() - link->connected_since_us;
+        link->connected_since_us = 0;
+        link->disconnect_count++;
+        if (reason == WIFI_REASON_BEACON_TIMEOUT)
+        {
+            link->beacon_loss_count++;
+        }
+    }
+    portEXIT_CRITICAL(&link->lock);
+}
+
+/* ==========================================
+ *          PUBLIC API
+ * ========================================== */
+
+/**
+ * @brief Get smoothed RSSI statistics and the link quality score
+ */
+esp_err_t wifi_manager_get_link_stats(wifi_manager_t *wm, wifi_manager_link_stats_t *out)
+{
+    if (!wm || !out)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    link_monitor_t *link = &wm->link;
+    int8_t window[LINK_WINDOW_SIZE];
+    int32_t ewma;
+    bool ewma_valid;
+    uint16_t count;
+    int64_t connected_us;
+
+    memset(out, 0, sizeof(*out));
+
+    // Copy under the lock, do the sorting and math outside of it
+    portENTER_CRITICAL(&link->lock);
+    memcpy(window, link->window, sizeof(window));
+    count = link->window_count;
+    ewma = link->ewma;
+    ewma_valid = link->ewma_valid;
+    out->rssi_last = link->last_rssi;
+    out->disconnect_count = link->disconnect_count;
+    out->beacon_loss_count = link->beacon_loss_count;
+    connected_us = link->connected_us;
+    if (link->connected_since_us)
+    {
+        connected_us += esp_timer_get_time() - link->connected_since_us;
+    }
+    portEXIT_CRITICAL(&link->lock);
+
+    out->sample_count = count;
+    out->connected_ms = (uint32_t)(connected_us / 1000);
+
+    int64_t uptime_ms = MAX(connected_us / 1000, LINK_MIN_UPTIME_MS);
+    out->beacon_loss_per_hour = (float)out->beacon_loss_count * 3600000.0f / (float)uptime_ms;
+
+    if (count == 0 || !ewma_valid)
+    {
+        return ESP_OK;
+    }
+
+    out->rssi_avg = (int8_t)(ewma / LINK_EWMA_SCALE);
+
+    // Sort the (small) window for min/max/percentile; the order of samples doesn't matter here
+    for (int i = 1; i < count; i++)
+    {
+        int8_t value = window[i];
+        int j = i - 1;
+        while (j >= 0 && window[j] > value)
+        {
+            window[j + 1] = window[j];
+            j--;
+        }
+        window[j + 1] = value;
+    }
+    out->rssi_min = window[0];
+    out->rssi_max = window[count - 1];
+    out->rssi_p10 = window[(count - 1) * LINK_LOW_PERCENTILE / 100];
+
+    // Weighted towards the average, pulled down by dips and by beacon loss disconnects
+    int score = (3 * rssi_to_quality(out->rssi_avg) + rssi_to_quality(out->rssi_p10)) / 4;
+    score -= MIN((int)(out->beacon_loss_per_hour * 10.0f), 50);
+    out->link_quality = (uint8_t)MAX(score, 0);
+
+    return ESP_OK;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file wifi_manager_mem.c
+ * @brief Per-subsystem heap accounting and task stack high-water marks
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+#include <stddef.h>
+
+// Size prefix in front of every accounted block, keeps the payload aligned like malloc()
+typedef union
+{
+    size_t size;
+    max_align_t align;
+} mem_header_t;
+
+static portMUX_TYPE mem_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_manager_mem_usage_t mem_usage[MEM_SUBSYSTEM_COUNT];
+
+/**
+ * @brief Add or remove bytes from a subsystem counter
+ *
+ * For buffers the component did not allocate itself, e.g. strings returned by
+ * cJSON_Print(): account the length when received and subtract it before free().
+ * @param subsystem Bucket to charge
+ * @param delta Bytes allocated (positive) or released (negative)
+ */
+void mem_account(mem_subsystem_t subsystem, ssize_t delta)
+{
+    wifi_manager_mem_usage_t *usage = &mem_usage[subsystem];
+
+    portENTER_CRITICAL(&mem_lock);
+    usage->current_bytes += delta;
+    if (delta > 0)
+    {
+        usage->alloc_count++;
+        if (usage->current_bytes > usage->peak_bytes)
+        {
+            usage->peak_bytes = usage->current_bytes;
+        }
+    }
+    portEXIT_CRITICAL(&mem_lock);
+}
+
+/**
+ * @brief malloc() charged to a subsystem
+ * @return Block of at least size bytes, or NULL
+ */
+void *mem_alloc(mem_subsystem_t subsystem, size_t size)
+{
+    mem_header_t *header = malloc(sizeof(mem_header_t) + size);
+    if (!header)
+    {
+        return NULL;
+    }
+
+    header->size = size;
+    mem_account(subsystem, size);
+    return header + 1;
+}
+
+/**
+ * @brief Free a block from mem_alloc() charged to the same subsystem
+ */
+void mem_free(mem_subsystem_t subsystem, void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    mem_header_t *header = (mem_header_t *)ptr - 1;
+    mem_account(subsystem, -(ssize_t)header->size);
+    free(header);
+}
+
+/**
+ * @brief Clear the handle of a task that is about to exit
+ *
+ * Taken under the same lock as task_stack_free(), so the stack of a task that
+ * has started exiting is never queried.
+ * @param handle Handle the task is published in
+ */
+void mem_task_exiting(TaskHandle_t *handle)
+{
+    portENTER_CRITICAL(&mem_lock);
+    __atomic_store_n(handle, NULL, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&mem_lock);
+}
+
+/**
+ * @brief Least free stack a task has had, 0 if it does not exist or is exiting
+ * @param handle Handle the task is published in, see mem_task_exiting()
+ */
+static uint32_t task_stack_free(TaskHandle_t *handle)
+{
+    uint32_t stack_free = 0;
+
+    portENTER_CRITICAL(&mem_lock);
+    TaskHandle_t task = __atomic_load_n(handle, __ATOMIC_ACQUIRE);
+    if (task)
+    {
+        // ESP-IDF reports the high-water mark in bytes
+        stack_free = (uint32_t)uxTaskGetStackHighWaterMark(task);
+    }
+    portEXIT_CRITICAL(&mem_lock);
+
+    return stack_free;
+}
+
+/* ==========================================
+ *          PUBLIC API
+ * ========================================== */
+
+/**
+ * @brief Get heap and stack usage of the manager
+ */
+esp_err_t wifi_manager_get_mem_stats(wifi_manager_t *wm, wifi_manager_mem_stats_t *out)
+{
+    if (!wm || !out)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->instance_bytes = sizeof(wifi_manager_t);
+
+    portENTER_CRITICAL(&mem_lock);
+    out->scan = mem_usage[MEM_SCAN];
+    out->web = mem_usage[MEM_WEB];
+    out->config = mem_usage[MEM_CONFIG];
+    portEXIT_CRITICAL(&mem_lock);
+
+    out->scan_task_stack_free = task_stack_free(&wm->scan_task_handle);
+    out->portal_task_stack_free = task_stack_free(&wm->portal_task);
+    out->dns_task_stack_free = task_stack_free(&wm->dns_task);
+    out->httpd_task_stack_free = wm->server ? task_stack_free(&wm->httpd_task) : 0;
+    out->heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    out->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+
+    return ESP_OK;
+}
@@ -0,0 +1,307 @@
+/**
+ * @file wifi_manager_networks.c
+ * @brief Multi-network credential store and ranked network selection
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+#include <time.h>
+
+/**
+ * @brief Find a stored network by SSID
+ * @return Index in the store, or -1 if not found
+ */
+int network_store_find(const network_store_t *store, const char *ssid)
+{
+    for (int i = 0; i < store->count; i++)
+    {
+        if (strcmp(store->entries[i].ssid, ssid) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Add or update a network in the store
+ *
+ * A stored SSID is updated in place and keeps its history. A new SSID takes a
+ * free slot or, when the store is full, replaces the entry with the lowest
+ * priority (oldest success on a tie), so newly provisioned networks are never
+ * rejected.
+ * @param priority Priority for the network, or -1 to keep the existing one (0 for new entries)
+ */
+esp_err_t network_store_upsert(network_store_t *store, const char *ssid, const char *password, int priority)
+{
+    if (!ssid || strlen(ssid) == 0 || strlen(ssid) > 32 || (password && strlen(password) > 64))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int index = network_store_find(store, ssid);
+    if (index < 0)
+    {
+        if (store->count < WIFI_MANAGER_MAX_NETWORKS)
+        {
+            index = store->count++;
+        }
+        else
+        {
+            index = 0;
+            for (int i = 1; i < store->count; i++)
+            {
+                const stored_network_t *a = &store->entries[i];
+                const stored_network_t *b = &store->entries[index];
+                if (a->priority < b->priority || (a->priority == b->priority && a->last_success < b->last_success))
+                {
+                    index = i;
+                }
+            }
+            ESP_LOGW(TAG, "Network store full, replacing '%s'", store->entries[index].ssid);
+        }
+
+        memset(&store->entries[index], 0, sizeof(store->entries[index]));
+        strncpy(store->entries[index].ssid, ssid, sizeof(store->entries[index].ssid) - 1);
+    }
+    else if (strcmp(store->entries[index].password, password ? password : "") != 0)
+    {
+        // New password - previous failures say nothing about it, the cached AP still applies
+        store->entries[index].failure_count = 0;
+    }
+
+    stored_network_t *entry = &store->entries[index];
+    strncpy(entry->password, password ? password : "", sizeof(entry->password) - 1);
+    entry->password[sizeof(entry->password) - 1] = '\0';
+    if (priority >= 0)
+    {
+        entry->priority = (uint8_t)MIN(priority, UINT8_MAX);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Remove a network from the store
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the SSID is not stored
+ */
+esp_err_t network_store_remove(network_store_t *store, const char *ssid)
+{
+    int index = network_store_find(store, ssid);
+    if (index < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    memmove(&store->entries[index], &store->entries[index + 1],
+            (store->count - index - 1) * sizeof(store->entries[0]));
+    store->count--;
+    memset(&store->entries[store->count], 0, sizeof(store->entries[0]));
+    return ESP_OK;
+}
+
+/**
+ * @brief Candidate ordering: visible first, then priority, fewer recent failures,
+ *        stronger signal and most recent success
+ * @return true if a should be tried before b
+ */
+static bool candidate_before(const network_store_t *store, const network_candidate_t *a, const network_candidate_t *b)
+{
+    const stored_network_t *na = &store->entries[a->store_index];
+    const stored_network_t *nb = &store->entries[b->store_index];
+
+    if (a->visible != b->visible)
+        return a->visible;
+    if (na->priority != nb->priority)
+        return na->priority > nb->priority;
+    if (na->failure_count != nb->failure_count)
+        return na->failure_count < nb->failure_count;
+    if (a->rssi != b->rssi)
+        return a->rssi > b->rssi;
+    return na->last_success > nb->last_success;
+}
+
+/**
+ * @brief Rank stored networks against the latest scan results
+ *
+ * Makes one pass over the scan results, matching each against every stored SSID
+ * and keeping the strongest AP per network, then orders the candidates. Stored
+ * networks that were not seen (hidden, out of range) are kept at the end so they
+ * are still tried, using their cached BSSID/channel.
+ * @param wm WiFiManager instance holding the scan results
+ * @param store Credential store
+ * @param candidates Output array with room for store->count entries
+ * @return Number of candidates
+ */
+int select_network_candidates(wifi_manager_t *wm, const network_store_t *store, network_candidate_t *candidates)
+{
+    for (int i = 0; i < store->count; i++)
+    {
+        candidates[i].store_index = i;
+        candidates[i].visible = false;
+        candidates[i].rssi = INT8_MIN;
+        memcpy(candidates[i].bssid, store->entries[i].bssid, sizeof(candidates[i].bssid));
+        candidates[i].channel = store->entries[i].channel;
+    }
+
+    for (int i = 0; i < wm->scanned_count && i < MAX_SCANNED_NETWORKS; i++)
+    {
+        const scanned_network_t *ap = &wm->scanned_networks[i];
+        int index = network_store_find(store, ap->ssid);
+        if (index >= 0 && (!candidates[index].visible || ap->rssi > candidates[index].rssi))
+        {
+            candidates[index].visible = true;
+            candidates[index].rssi = ap->rssi;
+            memcpy(candidates[index].bssid, ap->bssid, sizeof(candidates[index].bssid));
+            candidates[index].channel = ap->channel;
+        }
+    }
+
+    // Insertion sort - the store holds a handful of entries
+    for (int i = 1; i < store->count; i++)
+    {
+        network_candidate_t current = candidates[i];
+        int j = i - 1;
+        while (j >= 0 && candidate_before(store, &current, &candidates[j]))
+        {
+            candidates[j + 1] = candidates[j];
+            j--;
+        }
+        candidates[j + 1] = current;
+    }
+
+    for (int i = 0; i < store->count; i++)
+    {
+        const stored_network_t *net = &store->entries[candidates[i].store_index];
+        ESP_LOGI(TAG, "Candidate %d: '%s' priority=%d %s rssi=%d failures=%d", i + 1, net->ssid, net->priority,
+                 candidates[i].visible ? "visible" : "not seen", candidates[i].rssi, net->failure_count);
+    }
+
+    return store->count;
+}
+
+/**
+ * @brief Update the counters of a stored network after a connection attempt
+ * @param ssid Network that was tried
+ * @param success Whether the attempt got an IP
+ * @param bssid AP that was used (only stored on success, may be NULL)
+ * @param channel Channel of that AP
+ */
+void record_connection_result(const char *ssid, bool success, const uint8_t *bssid, uint8_t channel)
+{
+    network_store_t store;
+    if (load_network_store(&store) != ESP_OK)
+    {
+        return;
+    }
+
+    int index = network_store_find(&store, ssid);
+    if (index < 0)
+    {
+        return;
+    }
+
+    stored_network_t *entry = &store.entries[index];
+    if (success)
+    {
+        entry->success_count = MIN(entry->success_count + 1, UINT16_MAX);
+        entry->failure_count = 0;
+        entry->last_success = (uint32_t)time(NULL);
+        if (bssid)
+        {
+            memcpy(entry->bssid, bssid, sizeof(entry->bssid));
+            entry->channel = channel;
+        }
+    }
+    else
+    {
+        entry->failure_count = MIN(entry->failure_count + 1, UINT16_MAX);
+    }
+
+    save_network_store(&store);
+}
+
+/* ==========================================
+ *          PUBLIC API
+ * ========================================== */
+
+esp_err_t wifi_manager_add_network(wifi_manager_t *wm, const char *ssid, const char *password, uint8_t priority)
+{
+    if (!wm || !ssid)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    network_store_t store;
+    esp_err_t err = load_network_store(&store);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = network_store_upsert(&store, ssid, password, priority);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    return save_network_store(&store);
+}
+
+esp_err_t wifi_manager_remove_network(wifi_manager_t *wm, const char *ssid)
+{
+    if (!wm || !ssid)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    network_store_t store;
+    esp_err_t err = load_network_store(&store);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = network_store_remove(&store, ssid);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    return save_network_store(&store);
+}
+
+esp_err_t wifi_manager_list_networks(wifi_manager_t *wm, wifi_manager_network_info_t *networks,
+                                     size_t max_networks, size_t *count)
+{
+    if (!wm || !count || (max_networks > 0 && !networks))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    network_store_t store;
+    esp_err_t err = load_network_store(&store);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    *count = MIN((size_t)store.count, max_networks);
+    for (size_t i = 0; i < *count; i++)
+    {
+        const stored_network_t *entry = &store.entries[i];
+        wifi_manager_network_info_t *info = &networks[i];
+
+        memcpy(info->ssid, entry->ssid, sizeof(info->ssid));
+        info->priority = entry->priority;
+        info->last_success = entry->last_success;
+        info->success_count = entry->success_count;
+        info->failure_count = entry->failure_count;
+        memcpy(info->bssid, entry->bssid, sizeof(info->bssid));
+        info->channel = entry->channel;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,449 @@
+/**
+ * @file wifi_manager_portal.c
+ * @brief Configuration portal lifecycle (blocking and non-blocking)
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+
+#ifdef CONFIG_WIFI_MANAGER_PORTAL
+#define PORTAL_SCAN_DELAY_MS 2000 // Let AP mode stabilize before the first scan
+#define PORTAL_POLL_MS 1000       // Fallback wake-up, normally woken by portal_notify()
+
+/**
+ * @brief Wake whoever runs the portal lifecycle (blocked caller or portal task)
+ */
+void portal_notify(wifi_manager_t *wm)
+{
+    if (wm->portal_active && wm->portal_wakeup)
+    {
+        xSemaphoreGive(wm->portal_wakeup);
+    }
+}
+
+/**
+ * @brief Deferred initial scan - runs in the timer task
+ */
+static void portal_scan_timer_callback(TimerHandle_t xTimer)
+{
+    trigger_wifi_scan((wifi_manager_t *)pvTimerGetTimerID(xTimer));
+}
+
+/**
+ * @brief Grace period after a portal connect expired - close the soft-AP
+ *
+ * The web server keeps running and stays reachable on the STA address.
+ */
+static void portal_ap_timer_callback(TimerHandle_t xTimer)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvTimerGetTimerID(xTimer);
+
+    wifi_mode_t mode;
+    if (wm->current_status == WIFI_STATUS_CONNECTED && esp_wifi_get_mode(&mode) == ESP_OK &&
+        mode == WIFI_MODE_APSTA)
+    {
+        ESP_LOGI(TAG, "Closing config portal access point");
+        stop_dns_server(wm, false);
+        esp_wifi_set_mode(WIFI_MODE_STA);
+    }
+}
+
+/**
+ * @brief Delete a portal timer if it exists
+ */
+static void delete_timer(TimerHandle_t *timer)
+{
+    if (*timer)
+    {
+        xTimerStop(*timer, 0);
+        xTimerDelete(*timer, portMAX_DELAY);
+        *timer = NULL;
+    }
+}
+
+/**
+ * @brief Bring up the soft-AP, web server and portal timers
+ */
+static esp_err_t portal_begin(wifi_manager_t *wm, const char *ap_name, const char *ap_password)
+{
+    ESP_LOGI(TAG, "Starting config portal: %s", ap_name ? ap_name : wm->ap_ssid);
+
+    wm->portal_aborted = false;
+    wm->config_saved = false;
+    wm->portal_connect_attempted = false;
+    delete_timer(&wm->portal_ap_timer);
+    update_status(wm, WIFI_STATUS_CONFIG_PORTAL);
+
+    // Call config mode callback if set
+    if (wm->ap_callback)
+    {
+        wm->ap_callback(wm);
+    }
+
+    // Stop any existing WiFi and start in AP mode using legacy implementation
+    esp_wifi_stop();
+
+    // Configure AP mode with the provided credentials
+    wifi_config_t wifi_config = {
+        .ap = {
+            .ssid_len = 0,
+            .channel = 1,
+            .max_connection = 4,
+            .authmode = WIFI_AUTH_OPEN,
+            .pmf_cfg = {
+                .required = false,
+            },
+        },
+    };
+
+    // Set SSID
+    const char *ssid = ap_name ? ap_name : wm->ap_ssid;
+    strncpy((char *)wifi_config.ap.ssid, ssid, sizeof(wifi_config.ap.ssid) - 1);
+    wifi_config.ap.ssid[sizeof(wifi_config.ap.ssid) - 1] = '\0';
+    wifi_config.ap.ssid_len = strlen((char *)wifi_config.ap.ssid);
+
+    // Set password if provided
+    const char *password = ap_password ? ap_password : (strlen(wm->ap_password) > 0 ? wm->ap_password : NULL);
+    if (password && strlen(password) >= 8)
+    {
+        strncpy((char *)wifi_config.ap.password, password, sizeof(wifi_config.ap.password) - 1);
+        wifi_config.ap.password[sizeof(wifi_config.ap.password) - 1] = '\0';
+        wifi_config.ap.authmode = WIFI_AUTH_WPA2_PSK;
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
+
+    // Ensure STA interface is disconnected before starting scan
+    esp_wifi_disconnect();
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+    // Start web server for configuration, and the DNS responder that points every name at it
+    start_webserver(wm);
+    start_dns_server(wm);
+    update_status(wm, WIFI_STATUS_AP_MODE);
+
+    ESP_LOGI(TAG, "AP mode started. SSID: %s", ssid);
+    if (password && strlen(password) >= 8)
+    {
+        ESP_LOGI(TAG, "AP Password: %s", password);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "AP is open (no password)");
+    }
+    ESP_LOGI(TAG, "Connect to WiFi network '%s' and go to http://192.168.4.1", ssid);
+
+    // Trigger initial scan after a short delay to let AP mode stabilize, without holding the caller
+    wm->portal_scan_timer = xTimerCreate("wm_portal_scan", pdMS_TO_TICKS(PORTAL_SCAN_DELAY_MS),
+                                         pdFALSE, wm, portal_scan_timer_callback);
+    if (wm->portal_scan_timer)
+    {
+        xTimerStart(wm->portal_scan_timer, 0);
+    }
+
+    // Set up timeout timer if configured
+    if (wm->config_portal_timeout > 0)
+    {
+        wm->timeout_timer = xTimerCreate("wm_timeout",
+                                         pdMS_TO_TICKS(wm->config_portal_timeout * 1000),
+                                         pdFALSE, wm, timeout_timer_callback);
+        if (wm->timeout_timer)
+        {
+            xTimerStart(wm->timeout_timer, 0);
+        }
+    }
+
+    wm->portal_active = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Tear down after the portal ended and report the result
+ * @param wm WiFiManager instance
+ * @param connected true if the station connected through the portal
+ */
+static void portal_finish(wifi_manager_t *wm, bool connected)
+{
+    delete_timer(&wm->portal_scan_timer);
+    delete_timer(&wm->timeout_timer);
+
+    wm->config_saved = connected;
+    if (connected)
+    {
+        ESP_LOGI(TAG, "Configuration saved, attempting to connect");
+        if (wm->save_callback)
+        {
+            wm->save_callback();
+        }
+
+        // Keep the soft-AP up for a while so the success page can show the result
+        wm->portal_ap_timer = xTimerCreate("wm_portal_ap", pdMS_TO_TICKS(WIFI_MANAGER_PORTAL_AP_GRACE_MS),
+                                           pdFALSE, wm, portal_ap_timer_callback);
+        if (!wm->portal_ap_timer || xTimerStart(wm->portal_ap_timer, 0) != pdPASS)
+        {
+            stop_dns_server(wm, false);
+            esp_wifi_set_mode(WIFI_MODE_STA);
+        }
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Config portal timeout or aborted");
+
+        // Close the portal: web server and soft-AP go away, the STA side stays usable
+        stop_dns_server(wm, false);
+        stop_webserver(wm);
+        wifi_mode_t mode;
+        if (esp_wifi_get_mode(&mode) == ESP_OK && mode == WIFI_MODE_APSTA)
+        {
+            esp_wifi_set_mode(WIFI_MODE_STA);
+        }
+        if (wm->current_status == WIFI_STATUS_AP_MODE || wm->current_status == WIFI_STATUS_CONFIG_PORTAL)
+        {
+            update_status(wm, WIFI_STATUS_DISCONNECTED);
+        }
+    }
+
+    if (wm->portal_done_callback)
+    {
+        wm->portal_done_callback(wm, connected);
+    }
+}
+
+/**
+ * @brief Check whether the portal has ended and finish it exactly once
+ *
+ * Called by the blocked caller, the portal task, wifi_manager_process() and
+ * wifi_manager_stop_config_portal(); whichever gets there first finishes.
+ * @return true if the portal is no longer running
+ */
+static bool portal_check(wifi_manager_t *wm)
+{
+    if (!wm->portal_active)
+    {
+        return true;
+    }
+
+    bool connected = (wm->current_status == WIFI_STATUS_CONNECTED);
+    if (!connected && !wm->portal_aborted)
+    {
+        return false;
+    }
+
+    if (!__atomic_exchange_n(&wm->portal_active, false, __ATOMIC_ACQ_REL))
+    {
+        return true; // Finished by someone else
+    }
+
+    portal_finish(wm, connected);
+    return true;
+}
+
+/**
+ * @brief Wait until the portal ends
+ */
+static void portal_run(wifi_manager_t *wm)
+{
+    while (!portal_check(wm))
+    {
+        xSemaphoreTake(wm->portal_wakeup, pdMS_TO_TICKS(PORTAL_POLL_MS));
+    }
+}
+
+/**
+ * @brief Portal task for non-blocking mode
+ *
+ * The done callback runs in this task. When it starts the next portal, that
+ * portal runs here as well; when it destroys the instance, the task exits
+ * without touching the instance again.
+ * @param pvParameters Pointer to WiFiManager instance
+ */
+static void portal_task(void *pvParameters)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvParameters;
+    bool destroyed = false;
+    wm->portal_task_destroyed = &destroyed;
+
+    do
+    {
+        portal_run(wm);
+    } while (!destroyed && wm->portal_active);
+
+    if (!destroyed)
+    {
+        wm->portal_task_destroyed = NULL;
+        mem_task_exiting(&wm->portal_task);
+        xSemaphoreGive(wm->portal_task_exited); // Last use of the instance
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Whether the caller runs in the portal task, i.e. in the done callback
+ */
+static bool in_portal_task(wifi_manager_t *wm)
+{
+    return wm->portal_task_started && xTaskGetCurrentTaskHandle() == wm->portal_task;
+}
+
+/**
+ * @brief Wait until a portal task that was started has exited
+ */
+static void join_portal_task(wifi_manager_t *wm)
+{
+    if (wm->portal_task_started)
+    {
+        xSemaphoreTake(wm->portal_task_exited, portMAX_DELAY);
+        wm->portal_task_started = false;
+    }
+}
+
+/**
+ * @brief End a non-blocking portal and wait until its task has exited
+ *
+ * The task tears the portal down itself (web server, DNS, soft-AP and the done
+ * callback); deleting it from outside would cut that teardown short. Called
+ * from the done callback, the task is already past the portal: it is told
+ * that the instance goes away and exits once the callback returns.
+ */
+void stop_portal_task(wifi_manager_t *wm)
+{
+    if (in_portal_task(wm))
+    {
+        *wm->portal_task_destroyed = true;
+        wm->portal_task_started = false;
+        return;
+    }
+
+    if (wm->portal_task_started)
+    {
+        wm->portal_aborted = true;
+        xSemaphoreGive(wm->portal_wakeup);
+        join_portal_task(wm);
+    }
+}
+
+/* ==========================================
+ *          PUBLIC API
+ * ========================================== */
+
+/**
+ * @brief Start configuration portal with specified AP credentials
+ */
+bool wifi_manager_start_config_portal(wifi_manager_t *wm, const char *ap_name, const char *ap_password)
+{
+    if (!wm)
+        return false;
+
+    if (wm->portal_active)
+    {
+        ESP_LOGW(TAG, "Config portal already running");
+        return false;
+    }
+
+    // The task of the previous portal may still be returning from its done callback
+    bool in_task = in_portal_task(wm);
+    if (!in_task)
+    {
+        join_portal_task(wm);
+    }
+
+    // Drain a wake-up left over from a previous portal
+    xSemaphoreTake(wm->portal_wakeup, 0);
+
+    if (portal_begin(wm, ap_name, ap_password) != ESP_OK)
+    {
+        return false;
+    }
+
+    if (!wm->portal_blocking)
+    {
+        if (in_task)
+        {
+            return false; // Started from the done callback, the portal task runs it next
+        }
+
+        // Lifecycle runs in its own task, completion is reported via the portal done callback
+        wm->portal_task_started = true;
+        if (xTaskCreate(portal_task, "wm_portal", PORTAL_TASK_STACK_SIZE, wm, 3, &wm->portal_task) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create portal task");
+            wm->portal_task_started = false;
+            wm->portal_task = NULL;
+            wifi_manager_stop_config_portal(wm);
+        }
+        return false;
+    }
+
+    portal_run(wm);
+    return wm->config_saved;
+}
+
+/**
+ * @brief Stop a running configuration portal
+ */
+esp_err_t wifi_manager_stop_config_portal(wifi_manager_t *wm)
+{
+    if (!wm)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!wm->portal_active)
+        return ESP_ERR_INVALID_STATE;
+
+    ESP_LOGI(TAG, "Stopping config portal");
+    wm->portal_aborted = true;
+    xSemaphoreGive(wm->portal_wakeup); // Let a blocked caller or the portal task return
+    portal_check(wm);                  // Last use: the done callback may destroy the instance
+    return ESP_OK;
+}
+#else
+bool wifi_manager_start_config_portal(wifi_manager_t *wm, const char *ap_name, const char *ap_password)
+{
+    ESP_LOGW(TAG, "Config portal not available (CONFIG_WIFI_MANAGER_PORTAL is disabled)");
+    return false;
+}
+
+esp_err_t wifi_manager_stop_config_portal(wifi_manager_t *wm)
+{
+    return wm ? ESP_ERR_NOT_SUPPORTED : ESP_ERR_INVALID_ARG;
+}
+#endif // CONFIG_WIFI_MANAGER_PORTAL
+
+/**
+ * @brief Drive the portal from the application loop
+ */
+bool wifi_manager_process(wifi_manager_t *wm)
+{
+    if (!wm)
+        return false;
+
+    bool connected = wm->current_status == WIFI_STATUS_CONNECTED;
+#ifdef CONFIG_WIFI_MANAGER_PORTAL
+    portal_check(wm); // Last use: the done callback may destroy the instance
+#endif
+    return connected;
+}
+
+/**
+ * @brief Choose whether wifi_manager_start_config_portal() blocks
+ */
+void wifi_manager_set_config_portal_blocking(wifi_manager_t *wm, bool blocking)
+{
+    if (wm)
+    {
+        wm->portal_blocking = blocking;
+    }
+}
+
+/**
+ * @brief Set the callback reporting the end of the config portal
+ */
+void wifi_manager_set_portal_done_callback(wifi_manager_t *wm, portal_done_callback_t callback)
+{
+    if (wm)
+    {
+        wm->portal_done_callback = callback;
+    }
+}
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include "sdkconfig.h"
 #include "wifi_manager.h"
 #include "esp_wifi.h"
 #include "esp_netif.h"
@@ -24,6 +25,9 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 /* ==========================================
  *             CONSTANTS
@@ -34,18 +38,69 @@
 #define WIFI_MANAGER_AP_PASS "12345678"        // Legacy compatibility
 
 // Scan task notification values
-#define SCAN_NOTIFICATION_START 1
-#define SCAN_NOTIFICATION_COMPLETE 2
+#define SCAN_NOTIFICATION_START 0x01    // Notification bits for the scan task
+#define SCAN_NOTIFICATION_COMPLETE 0x02
+#define SCAN_NOTIFICATION_ROAM 0x04
+#define SCAN_NOTIFICATION_EXIT 0x08
 
 #define WIFI_MANAGER_MAX_RETRY 3
+#define WIFI_MANAGER_DHCP_RENEW_TIMEOUT_MS 10000 // Lease renewal window before reassociating
+#define WIFI_MANAGER_ARP_PROBE_WAIT_MS 500       // Replies to the ARP probe of a cached address
+#define WIFI_MANAGER_CACHED_LEASE_RENEW_MS (30 * 60 * 1000) // DHCP takes over a confirmed cached lease
+#define RSSI_QUALITY_TABLE_SIZE 128              // RSSI 0 to -127 dBm
+#define WIFI_MANAGER_LINK_SAMPLE_INTERVAL_MS 2000 // RSSI sampling period while connected
+#define LINK_WINDOW_SIZE 32                       // RSSI samples kept for min/max/percentile
+#define WIFI_MANAGER_ROAM_RSSI_THRESHOLD -70     // Default roaming trigger (dBm)
+#define WIFI_MANAGER_ROAM_HYSTERESIS 8           // Default margin a new AP must win by (dB)
+#define WIFI_MANAGER_ROAM_SCAN_INTERVAL_MS 5000  // Default background scan tick (one channel)
+#define WIFI_MANAGER_ROAM_MIN_INTERVAL_MS 60000  // Default hold-down after a roam
+#define WIFI_MANAGER_PORTAL_AP_GRACE_MS 30000    // Soft-AP stays up this long after a portal connect
+#define WIFI_MANAGER_RESTART_DELAY_MS 1000       // Restart/reset requests reply before the device restarts
+#define DNS_ANSWER_SIZE 16                       // Prebuilt captive DNS A record
+#define DNS_MAX_PACKET_SIZE 512                  // Captive DNS packet buffer, the classic DNS over UDP limit
+#define EVENTS_MAX_CLIENTS 3                     // /events streams (each keeps an httpd socket open)
+#define WS_MAX_CLIENTS 2                         // /ws control channel clients
+#define WS_CLOSE_TRY_AGAIN 1013                  // Close code for refused /ws clients (RFC 6455 "Try Again Later")
+#define HTTP_RESERVED_SOCKETS 4                  // Sockets /events and /ws clients may never take
+#define HTTP_KEEP_ALIVE_IDLE_S 5                 // TCP keep-alive of portal sockets: idle time before probing,
+#define HTTP_KEEP_ALIVE_INTERVAL_S 5             // probe interval
+#define HTTP_KEEP_ALIVE_COUNT 3                  // and unanswered probes until the socket is closed
+#define HTTP_STATIC_MAX_AGE "max-age=300"        // Browser caching of style.css/script.js within a portal session
+#define EVENT_PENDING_STATUS 0x01                // Event bits for events_publish()
+#define EVENT_PENDING_SCAN 0x02
+#define STATUS_JSON_SIZE 320                     // /status response buffer, fits a fully escaped 32 byte SSID
+#define CONFIG_FORM_MAX_SIZE 2048                // Longest config form accepted by /config/save and /ws
 #define WIFI_MANAGER_NVS_NAMESPACE "wifi_config"
 #define WIFI_MANAGER_CONFIG_NAMESPACE "app_config"
 #define WIFI_MANAGER_DEFAULT_TIMEOUT 180 // 3 minutes like tzapu default
-#define MAX_SCANNED_NETWORKS 20
+
+// Limits and stack sizes (menuconfig -> Component config -> WiFi Manager)
+#define MAX_SCANNED_NETWORKS CONFIG_WIFI_MANAGER_MAX_SCANNED_NETWORKS
+#define WIFI_LIST_JSON_SIZE (MAX_SCANNED_NETWORKS * 200 + 96) // /wifi response buffer
+#ifdef CONFIG_WIFI_MANAGER_SCAN_TASK
+#define SCAN_TASK_STACK_SIZE CONFIG_WIFI_MANAGER_SCAN_TASK_STACK_SIZE
+#endif
+#ifdef CONFIG_WIFI_MANAGER_PORTAL
+#define PORTAL_TASK_STACK_SIZE CONFIG_WIFI_MANAGER_PORTAL_TASK_STACK_SIZE
+#define DNS_TASK_STACK_SIZE CONFIG_WIFI_MANAGER_DNS_TASK_STACK_SIZE
+#endif
 
 // Configuration parameter limits
-#define MAX_CONFIG_STRING_LEN 128
-#define MAX_CONFIG_PARAMS 16
+#ifdef CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
+#define MAX_CONFIG_STRING_LEN CONFIG_WIFI_MANAGER_CONFIG_STRING_LEN
+#define MAX_CONFIG_PARAMS CONFIG_WIFI_MANAGER_MAX_CONFIG_PARAMS
+// One /config entry: its strings at full length and the text around them, longest type and "false" included
+#define CONFIG_JSON_PARAM_SIZE                                                                      \
+    (sizeof(((config_param_t *)0)->key) + sizeof(((config_param_t *)0)->label) +                    \
+     sizeof(((config_param_t *)0)->value) + sizeof(((config_param_t *)0)->placeholder) +            \
+     sizeof(",{\"key\":\"\",\"label\":\"\",\"type\":\"checkbox\",\"value\":\"\","                   \
+            "\"placeholder\":\"\",\"required\":false}"))
+#define CONFIG_JSON_SIZE (sizeof("{\"parameters\":[]}") + MAX_CONFIG_PARAMS * CONFIG_JSON_PARAM_SIZE) // /config response
+#else
+#define MAX_CONFIG_STRING_LEN 128 // Only sizes config_param_t, no parameters are stored
+#define MAX_CONFIG_PARAMS 0
+#define CONFIG_JSON_SIZE 32 // Empty parameter list
+#endif
 
 extern const char *TAG;
 
@@ -82,10 +137,106 @@ typedef struct
 {
     char ssid[33];             // WiFi network name
     int8_t rssi;               // Signal strength
+    uint8_t quality;           // Signal quality percentage (rssi_to_quality)
     wifi_auth_mode_t authmode; // Security type
     bool is_hidden;            // Whether SSID is hidden
+    uint8_t bssid[6];          // AP MAC address
+    uint8_t channel;           // Primary channel
 } scanned_network_t;
 
+// Saved network (persisted as part of network_store_t)
+typedef struct
+{
+    char ssid[33];
+    char password[65];
+    uint8_t priority;       // Higher is tried first
+    uint32_t last_success;  // time() of the last successful connection
+    uint16_t success_count; // Successful connections
+    uint16_t failure_count; // Failed attempts since the last success
+    uint8_t bssid[6];       // Last AP used, for a direct connect
+    uint8_t channel;        // Channel of that AP
+} stored_network_t;
+
+// Saved networks, stored as a single NVS blob
+typedef struct
+{
+    uint8_t count;
+    stored_network_t entries[WIFI_MANAGER_MAX_NETWORKS];
+} network_store_t;
+
+// Saved network matched against a scan
+typedef struct
+{
+    int store_index;  // Entry in network_store_t
+    bool visible;     // Seen in the last scan
+    int8_t rssi;      // Strongest AP for this SSID
+    uint8_t bssid[6]; // That AP (or the cached one when not visible)
+    uint8_t channel;
+} network_candidate_t;
+
+// Credentials from a portal form (connect, saved networks), decoded in place
+typedef struct
+{
+    char ssid[97];      // Room for a fully percent-encoded 32 byte SSID before url_decode()
+    char password[193]; // And for a 64 byte key
+} connect_form_t;
+
+// Station addressing mode (config parameter "ip_mode")
+typedef enum
+{
+    IP_MODE_DHCP = 0, // Regular DHCP
+    IP_MODE_STATIC,   // Fixed address from the static_* parameters
+    IP_MODE_CACHED    // Last DHCP lease applied at once, checked by ARP, renewed by DHCP later
+} ip_mode_t;
+
+// DHCP lease cached in NVS (IPv4, network byte order)
+typedef struct
+{
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t netmask;
+    uint32_t dns;
+    char ssid[33]; // Network the lease was obtained on
+} cached_lease_t;
+
+// Heap accounting buckets (wifi_manager_mem.c)
+typedef enum
+{
+    MEM_SCAN = 0,
+    MEM_WEB,
+    MEM_CONFIG,
+    MEM_SUBSYSTEM_COUNT
+} mem_subsystem_t;
+
+// Connection state published to readers through the sequence lock
+typedef struct
+{
+    wifi_status_t status;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t netmask;
+    int8_t rssi;
+    uint8_t bssid[6];
+    uint8_t channel;
+    int64_t state_since_us; // esp_timer timestamp of the last status change
+} wifi_manager_state_t;
+
+// RSSI sampler state (wifi_manager_link.c)
+typedef struct
+{
+    portMUX_TYPE lock;          // Sampler (timer task) vs. readers and the event loop
+    int32_t ewma;               // Fixed point RSSI average
+    bool ewma_valid;
+    int8_t last_rssi;
+    int8_t window[LINK_WINDOW_SIZE];
+    uint8_t window_head;
+    uint16_t window_count;
+    int64_t connected_since_us; // Start of the current association, 0 when not associated
+    int64_t connected_us;       // Accumulated time of finished associations
+    uint32_t disconnect_count;
+    uint32_t beacon_loss_count;
+} link_monitor_t;
+
 // WiFi Manager structure (tzapu-style)
 struct wifi_manager_t
 {
@@ -99,43 +250,104 @@ struct wifi_manager_t
     // Callbacks (tzapu-style)
     config_mode_callback_t ap_callback;
     save_config_callback_t save_callback;
+    portal_done_callback_t portal_done_callback;
+    wifi_event_callback_t status_callback; // Legacy status callback (wifi_manager_init)
 
     // Internal state
     esp_netif_t *sta_netif;
     esp_netif_t *ap_netif;
     httpd_handle_t server;
+    TaskHandle_t httpd_task; // Web server task, recorded on its first connection
+    uint32_t http_sessions;  // Portal connections accepted since the server started (httpd task only)
+    uint32_t http_requests;  // Requests handled on them, see web_dispatch()
+    uint16_t http_open;      // Connections open now
+    uint16_t http_open_peak; // Most connections open at once
+    wifi_manager_http_config_t http_config;
+    TimerHandle_t restart_timer; // Deferred restart after /restart, /reset and /wifi-reset
+    bool restart_disconnect;     // Disconnect from WiFi before the deferred restart
+    esp_event_handler_instance_t wifi_event_instance;
+    esp_event_handler_instance_t ip_event_instance;
     wifi_status_t current_status;
     char ip_address[16];
     int retry_count;
+    bool suppress_reconnect; // Next disconnect was requested by the manager, don't retry
+    uint8_t last_disconnect_reason;
     TimerHandle_t timeout_timer;
+    TimerHandle_t dhcp_renew_timer; // Bounds the DHCP renewal after IP_EVENT_STA_LOST_IP
     bool portal_aborted;
     bool config_saved;
 
+    // Config portal lifecycle (wifi_manager_portal.c)
+    bool portal_blocking;                 // start_config_portal waits for the result
+    bool portal_active;                   // Portal is up and not yet finished
+    TaskHandle_t portal_task;             // Lifecycle task in non-blocking mode, cleared by the task as it exits
+    SemaphoreHandle_t portal_task_exited; // Given by the portal task as it exits
+    bool portal_task_started;             // A portal task was created and not joined yet
+    bool *portal_task_destroyed;          // Set when the done callback destroys the instance (portal task only)
+    SemaphoreHandle_t portal_wakeup;      // Given on status changes, timeout and stop
+    TimerHandle_t portal_scan_timer;      // Deferred initial scan
+    TimerHandle_t portal_ap_timer;        // Closes the soft-AP after a successful portal connect
+    bool portal_connect_attempted;        // Credentials were submitted in this portal session
+
+    // Server-sent events (wifi_manager_events.c), client table owned by the httpd task
+    int event_fds[EVENTS_MAX_CLIENTS]; // Socket per stream client, -1 when free
+    volatile int event_client_count;
+    uint32_t event_pending; // EVENT_PENDING_* bits not yet sent
+    bool event_work_queued;
+    uint32_t event_id;
+    int ws_fds[WS_MAX_CLIENTS]; // /ws clients (wifi_manager_ws.c) that get the same pushes
+    volatile int ws_client_count;
+
+    // Captive DNS responder (wifi_manager_dns.c)
+    TaskHandle_t dns_task;             // Cleared by the task as it exits
+    SemaphoreHandle_t dns_task_exited; // Given by the task as it exits
+    bool dns_task_started;             // A task was created and not joined yet
+    int dns_socket;
+    volatile bool dns_running;
+    uint8_t dns_answer[DNS_ANSWER_SIZE];
+
+    // Connection state snapshot (seqlock: odd sequence = write in progress)
+    uint32_t state_seq;
+    wifi_manager_state_t state;
+    portMUX_TYPE state_lock; // Serializes writers only, readers never take it
+
+    // IP configuration
+    bool using_cached_lease;    // Current address came from the NVS lease cache
+    bool lease_probe_pending;   // ARP probe for the cached address awaits its replies
+    TimerHandle_t lease_timer;  // Ends the ARP probe, then the renewal period of a cached lease
+    int64_t connect_started_us; // Start of the current connection attempt (time-to-IP)
+
+    // Link quality monitoring
+    link_monitor_t link;
+    TimerHandle_t link_timer;
+
+    // Roaming (background scan while connected)
+    wifi_manager_roam_config_t roam_config;
+    TimerHandle_t roam_timer;
+    bool roam_scan_active;   // Running scan belongs to the roaming engine
+    bool roam_in_progress;   // Reassociating to a better BSSID
+    bool roam_bssid_locked;  // STA config is pinned to the roam target BSSID
+    uint8_t roam_channel;    // Next channel for the background scan
+    int64_t roam_started_us; // Start of the current reassociation
+    int64_t last_roam_us;
+    uint32_t roam_count;
+
     // WiFi scanning
     scanned_network_t scanned_networks[MAX_SCANNED_NETWORKS];
     uint16_t scanned_count;
     bool scan_completed;
     TaskHandle_t scan_task_handle;
+    SemaphoreHandle_t scan_task_exited; // Given by the scan task as it exits
 
     // Custom configuration parameters
+#ifdef CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
     config_param_t config_params[MAX_CONFIG_PARAMS];
+#endif
     int config_param_count;
     bool config_portal_enabled;
 };
 
-/* ==========================================
- *          GLOBAL VARIABLES
- * ========================================== */
-
-// Global variables for legacy API compatibility
-extern esp_netif_t *sta_netif;
-extern esp_netif_t *ap_netif;
-extern wifi_event_callback_t user_callback;
-extern wifi_status_t current_status;
-extern char ip_address[16];
-extern int retry_count;
-extern wifi_manager_t *g_wm; // Global reference for event handler
-
+#ifdef CONFIG_WIFI_MANAGER_PORTAL
 /* ==========================================
  *          EMBEDDED WEB FILES
  * ========================================== */
@@ -151,6 +363,38 @@ extern const uint8_t success_html_start[] asm("_binary_success_html_start");
 extern const uint8_t success_html_end[] asm("_binary_success_html_end");
 extern const uint8_t config_html_start[] asm("_binary_config_html_start");
 extern const uint8_t config_html_end[] asm("_binary_config_html_end");
+#ifdef CONFIG_WIFI_MANAGER_WEB_BUNDLE
+extern const uint8_t portal_html_start[] asm("_binary_portal_html_start");
+extern const uint8_t portal_html_end[] asm("_binary_portal_html_end");
+#endif
+
+// Slots of the server-rendered pages, the {{placeholders}} known to tools/compile_templates.py
+typedef enum
+{
+    TPL_SLOT_NONE = 0, // End of the page
+    TPL_SLOT_WIFI,     // {{wifi}}: /wifi JSON for the page script
+    TPL_SLOT_NETWORKS, // {{networks}}: network list items
+    TPL_SLOT_PARAMS,   // {{params}}: configuration parameter fields
+    TPL_SLOT_STATUS,   // {{status}}: connection status text
+    TPL_SLOT_IP        // {{ip}}: station IP address
+} tpl_slot_id_t;
+
+// Offset table entry generated into wifi_manager_templates.h
+typedef struct
+{
+    uint16_t offset; // Byte offset of the slot in the embedded page
+    uint8_t id;      // tpl_slot_id_t
+} tpl_slot_t;
+#endif // CONFIG_WIFI_MANAGER_PORTAL
+
+/**
+ * @brief Start of a timed operation, see perf_begin()/perf_end()
+ */
+typedef struct
+{
+    int64_t start_us;
+    size_t free_heap; // Free heap at the start, for the allocation delta
+} perf_mark_t;
 
 /* ==========================================
  *       INTERNAL FUNCTION PROTOTYPES
@@ -158,13 +402,95 @@ extern const uint8_t config_html_end[] asm("_binary_config_html_end");
 
 // Core WiFi functions (wifi_manager_core.c)
 void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
-void update_status(wifi_status_t status);
+void update_status(wifi_manager_t *wm, wifi_status_t status);
 void timeout_timer_callback(TimerHandle_t xTimer);
+void dhcp_renew_timer_callback(TimerHandle_t xTimer);
+void start_dhcp_renew(wifi_manager_t *wm);
+void state_write_begin(wifi_manager_t *wm);
+void state_write_end(wifi_manager_t *wm);
+void state_read(wifi_manager_t *wm, wifi_manager_state_t *out);
+void perf_end(const perf_mark_t *mark, const char *what);
+
+/**
+ * @brief Start timing a hot path (scan processing, JSON generation, config load/save)
+ *
+ * perf_end() logs the duration and heap delta at debug level, enable with
+ * esp_log_level_set("wifi_manager", ESP_LOG_DEBUG).
+ */
+static inline void perf_begin(perf_mark_t *mark)
+{
+    mark->start_us = esp_timer_get_time();
+    mark->free_heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
 
 // WiFi scanning functions (wifi_manager_scan.c)
-void wifi_scan_done_handler(void);
+void wifi_scan_done_handler(wifi_manager_t *wm);
+#ifdef CONFIG_WIFI_MANAGER_SCAN_TASK
 void wifi_scan_task(void *pvParameters);
+void stop_scan_task(wifi_manager_t *wm);
+#else
+static inline void stop_scan_task(wifi_manager_t *wm) {}
+#endif
 void trigger_wifi_scan(wifi_manager_t *wm);
+const char *authmode_to_string(wifi_auth_mode_t authmode);
+
+extern const uint8_t rssi_quality_table[RSSI_QUALITY_TABLE_SIZE];
+
+/**
+ * @brief Map RSSI to a 0-100 signal quality percentage
+ */
+static inline uint8_t rssi_to_quality(int rssi)
+{
+    if (rssi >= 0)
+        return rssi_quality_table[0];
+    if (rssi <= -(RSSI_QUALITY_TABLE_SIZE - 1))
+        return rssi_quality_table[RSSI_QUALITY_TABLE_SIZE - 1];
+    return rssi_quality_table[-rssi];
+}
+
+// Memory accounting functions (wifi_manager_mem.c)
+void *mem_alloc(mem_subsystem_t subsystem, size_t size);
+void mem_free(mem_subsystem_t subsystem, void *ptr);
+void mem_account(mem_subsystem_t subsystem, ssize_t delta);
+void mem_task_exiting(TaskHandle_t *handle);
+
+// Link quality functions (wifi_manager_link.c)
+void link_init(wifi_manager_t *wm);
+void link_timer_callback(TimerHandle_t xTimer);
+void link_on_connected(wifi_manager_t *wm);
+void link_on_disconnected(wifi_manager_t *wm, uint8_t reason);
+
+// Roaming functions (wifi_manager_roam.c)
+void roam_init(wifi_manager_t *wm);
+void roam_timer_callback(TimerHandle_t xTimer);
+void roam_tick(wifi_manager_t *wm);
+void roam_process_scan_results(wifi_manager_t *wm);
+bool roam_should_switch(int current_rssi, int candidate_rssi, uint8_t hysteresis);
+void roam_on_disconnected(wifi_manager_t *wm);
+void roam_on_got_ip(wifi_manager_t *wm);
+
+#ifdef CONFIG_WIFI_MANAGER_PORTAL
+// Server-sent event functions (wifi_manager_events.c)
+esp_err_t events_handler(httpd_req_t *req);
+void events_on_close(httpd_handle_t hd, int sockfd);
+void events_publish(wifi_manager_t *wm, uint32_t events);
+bool events_stream_allowed(wifi_manager_t *wm);
+void events_keep_streams(wifi_manager_t *wm, httpd_handle_t hd);
+
+// WebSocket control channel (wifi_manager_ws.c, needs CONFIG_HTTPD_WS_SUPPORT)
+esp_err_t ws_handler(httpd_req_t *req);
+
+// Captive DNS functions (wifi_manager_dns.c)
+int build_dns_reply(uint8_t *packet, int len, const uint8_t *answer);
+esp_err_t start_dns_server(wifi_manager_t *wm);
+void stop_dns_server(wifi_manager_t *wm, bool wait);
+
+// Server-rendered pages (wifi_manager_template.c)
+esp_err_t tpl_render(httpd_req_t *req, wifi_manager_t *wm, const uint8_t *page, const tpl_slot_t *slots);
+
+// Config portal functions (wifi_manager_portal.c)
+void portal_notify(wifi_manager_t *wm);
+void stop_portal_task(wifi_manager_t *wm);
 
 // Web server functions (wifi_manager_web.c)
 esp_err_t setup_page_handler(httpd_req_t *req);
@@ -180,12 +506,54 @@ esp_err_t config_save_handler(httpd_req_t *req);
 esp_err_t restart_handler(httpd_req_t *req);
 esp_err_t reset_handler(httpd_req_t *req);
 esp_err_t wifi_reset_handler(httpd_req_t *req);
-esp_err_t start_webserver(void);
-void stop_webserver(void);
+esp_err_t networks_list_handler(httpd_req_t *req);
+esp_err_t networks_update_handler(httpd_req_t *req);
+esp_err_t stats_handler(httpd_req_t *req);
+esp_err_t status_handler(httpd_req_t *req);
+esp_err_t captive_redirect_handler(httpd_req_t *req, httpd_err_code_t err);
+void url_decode(char *value);
+bool parse_connect_form(const char *form, connect_form_t *out);
+int collect_networks(wifi_manager_t *wm, uint8_t *order);
+int format_wifi_list(wifi_manager_t *wm, char *buf, size_t size);
+int format_config_params(wifi_manager_t *wm, char *buf, size_t size);
+int format_portal_status(wifi_manager_t *wm, char *buf, size_t size);
+esp_err_t apply_config_form(wifi_manager_t *wm, char *form);
+void start_portal_connect(wifi_manager_t *wm, const char *ssid, const char *password);
+void defer_portal_connect(wifi_manager_t *wm, const char *ssid, const char *password);
+void restart_timer_callback(TimerHandle_t xTimer);
+esp_err_t schedule_restart(wifi_manager_t *wm, bool disconnect);
+esp_err_t start_webserver(wifi_manager_t *wm);
+void stop_webserver(wifi_manager_t *wm);
+
+#else
+// Portal compiled out (CONFIG_WIFI_MANAGER_PORTAL): hooks the rest of the code calls become no-ops
+static inline void events_publish(wifi_manager_t *wm, uint32_t events) {}
+static inline esp_err_t start_webserver(wifi_manager_t *wm) { return ESP_ERR_NOT_SUPPORTED; }
+static inline void stop_webserver(wifi_manager_t *wm) {}
+static inline void stop_dns_server(wifi_manager_t *wm, bool wait) {}
+static inline void portal_notify(wifi_manager_t *wm) {}
+static inline void stop_portal_task(wifi_manager_t *wm) {}
+#endif // CONFIG_WIFI_MANAGER_PORTAL
 
 // Storage functions (wifi_manager_storage.c)
 esp_err_t save_wifi_credentials(const char *ssid, const char *password);
-esp_err_t load_wifi_credentials(char *ssid, char *password);
+esp_err_t load_network_store(network_store_t *store);
+esp_err_t save_network_store(const network_store_t *store);
+esp_err_t save_cached_lease(const cached_lease_t *lease);
+esp_err_t load_cached_lease(cached_lease_t *lease);
+
+// Saved network functions (wifi_manager_networks.c)
+int network_store_find(const network_store_t *store, const char *ssid);
+esp_err_t network_store_upsert(network_store_t *store, const char *ssid, const char *password, int priority);
+esp_err_t network_store_remove(network_store_t *store, const char *ssid);
+int select_network_candidates(wifi_manager_t *wm, const network_store_t *store, network_candidate_t *candidates);
+void record_connection_result(const char *ssid, bool success, const uint8_t *bssid, uint8_t channel);
+
+// IP configuration functions (wifi_manager_ip.c)
+void init_ip_config_parameters(wifi_manager_t *wm);
+void apply_ip_config(wifi_manager_t *wm);
+void ip_config_on_got_ip(wifi_manager_t *wm, const ip_event_got_ip_t *event);
+void lease_timer_callback(TimerHandle_t xTimer);
 
 // Configuration functions (wifi_manager_config.c)
 esp_err_t save_config_parameters(wifi_manager_t *wm);
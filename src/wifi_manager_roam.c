@@ -0,0 +1,330 @@
+/**
+ * @file wifi_manager_roam.c
+ * @brief Background scanning and roaming between APs of the connected network
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ */
+
+#include "wifi_manager_private.h"
+
+#define ROAM_MAX_SCAN_RECORDS 8 // Single channel, single SSID - only a handful of APs
+
+/**
+ * @brief Put the roaming state of a new instance in place - roaming stays off until enabled
+ */
+void roam_init(wifi_manager_t *wm)
+{
+    memset(&wm->roam_config, 0, sizeof(wm->roam_config));
+    wm->roam_timer = NULL;
+    wm->roam_scan_active = false;
+    wm->roam_in_progress = false;
+    wm->roam_bssid_locked = false;
+    wm->roam_channel = 0;
+    wm->roam_started_us = 0;
+    wm->last_roam_us = 0;
+    wm->roam_count = 0;
+}
+
+/**
+ * @brief Decide whether a candidate AP is worth a reassociation
+ * @param current_rssi RSSI of the current AP (dBm)
+ * @param candidate_rssi RSSI of the candidate AP (dBm)
+ * @param hysteresis Margin the candidate must win by (dB)
+ * @return true if the station should roam
+ */
+bool roam_should_switch(int current_rssi, int candidate_rssi, uint8_t hysteresis)
+{
+    return candidate_rssi >= current_rssi + hysteresis;
+}
+
+/**
+ * @brief Roaming timer callback - runs in the timer task, hands the work to the scan task
+ */
+void roam_timer_callback(TimerHandle_t xTimer)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvTimerGetTimerID(xTimer);
+    if (wm && wm->scan_task_handle && wm->current_status == WIFI_STATUS_CONNECTED)
+    {
+        xTaskNotify(wm->scan_task_handle, SCAN_NOTIFICATION_ROAM, eSetBits);
+    }
+}
+
+/**
+ * @brief Remove the BSSID lock set for a roam so retries may use any AP of the SSID
+ */
+static void release_bssid_lock(wifi_manager_t *wm)
+{
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK)
+    {
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    }
+    wm->roam_bssid_locked = false;
+}
+
+/**
+ * @brief One background scan step - check the link and scan a single channel if it is weak
+ *
+ * Scanning one channel per tick keeps each off-channel period short, so traffic on
+ * the current AP continues between ticks.
+ * @param wm WiFiManager instance
+ */
+void roam_tick(wifi_manager_t *wm)
+{
+    if (wm->current_status != WIFI_STATUS_CONNECTED || wm->roam_in_progress || wm->roam_scan_active)
+    {
+        return;
+    }
+
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+    {
+        return;
+    }
+
+    state_write_begin(wm);
+    wm->state.rssi = ap_info.rssi;
+    state_write_end(wm);
+
+    if (ap_info.rssi >= wm->roam_config.rssi_threshold)
+    {
+        // Link is good - restart the channel sweep next time it drops
+        wm->roam_channel = 0;
+        return;
+    }
+
+    if (wm->last_roam_us &&
+        esp_timer_get_time() - wm->last_roam_us < (int64_t)wm->roam_config.min_roam_interval_ms * 1000)
+    {
+        return;
+    }
+
+    // Walk the channels allowed in the configured country
+    uint8_t first_channel = 1;
+    uint8_t channel_count = 11;
+    wifi_country_t country;
+    if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0)
+    {
+        first_channel = country.schan;
+        channel_count = country.nchan;
+    }
+    if (wm->roam_channel < first_channel || wm->roam_channel >= first_channel + channel_count)
+    {
+        wm->roam_channel = first_channel;
+    }
+    uint8_t channel = wm->roam_channel++;
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+    {
+        return;
+    }
+
+    // sta.ssid is not terminated when the name takes all 32 bytes
+    uint8_t ssid[sizeof(wifi_config.sta.ssid) + 1];
+    memcpy(ssid, wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid));
+    ssid[sizeof(wifi_config.sta.ssid)] = '\0';
+
+    wifi_scan_config_t scan_config = {0};
+    scan_config.ssid = ssid;
+    scan_config.channel = channel;
+    scan_config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+    scan_config.scan_time.active.min = 20; // Short dwell, we only look for beacons/probe responses of one SSID
+    scan_config.scan_time.active.max = 60;
+
+    ESP_LOGD(TAG, "Roaming scan on channel %d (RSSI %d dBm)", channel, ap_info.rssi);
+
+    wm->roam_scan_active = true;
+    esp_err_t err = esp_wifi_scan_start(&scan_config, false);
+    if (err != ESP_OK)
+    {
+        ESP_LOGD(TAG, "Roaming scan not started: %s", esp_err_to_name(err));
+        wm->roam_scan_active = false;
+    }
+}
+
+/**
+ * @brief Pick the best AP from a roaming scan and reassociate if it wins by the hysteresis
+ * @param wm WiFiManager instance
+ */
+void roam_process_scan_results(wifi_manager_t *wm)
+{
+    uint16_t ap_num = ROAM_MAX_SCAN_RECORDS;
+    wifi_ap_record_t ap_records[ROAM_MAX_SCAN_RECORDS];
+
+    if (esp_wifi_scan_get_ap_records(&ap_num, ap_records) != ESP_OK)
+    {
+        return;
+    }
+
+    wifi_ap_record_t current;
+    if (wm->current_status != WIFI_STATUS_CONNECTED || esp_wifi_sta_get_ap_info(&current) != ESP_OK)
+    {
+        return;
+    }
+
+    const wifi_ap_record_t *best = NULL;
+    for (int i = 0; i < ap_num; i++)
+    {
+        if (strcmp((char *)ap_records[i].ssid, (char *)current.ssid) != 0 ||
+            memcmp(ap_records[i].bssid, current.bssid, sizeof(current.bssid)) == 0)
+        {
+            continue;
+        }
+        if (!best || ap_records[i].rssi > best->rssi)
+        {
+            best = &ap_records[i];
+        }
+    }
+
+    if (!best || !roam_should_switch(current.rssi, best->rssi, wm->roam_config.rssi_hysteresis))
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Roaming from " MACSTR " (%d dBm) to " MACSTR " (%d dBm, channel %d)",
+             MAC2STR(current.bssid), current.rssi, MAC2STR(best->bssid), best->rssi, best->primary);
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+    {
+        return;
+    }
+    wifi_config.sta.bssid_set = true;
+    memcpy(wifi_config.sta.bssid, best->bssid, sizeof(wifi_config.sta.bssid));
+    wifi_config.sta.channel = best->primary;
+    if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+    {
+        return;
+    }
+
+    wm->roam_bssid_locked = true;
+    wm->roam_in_progress = true;
+    wm->roam_started_us = esp_timer_get_time();
+    wm->retry_count = 0;
+
+    // STA_DISCONNECTED runs the normal retry path, which joins the locked BSSID
+    esp_wifi_disconnect();
+}
+
+/**
+ * @brief Called on STA_DISCONNECTED before the retry logic runs
+ *
+ * The first disconnect of a roam is the one we requested. Any later one means the
+ * new AP did not take us, so the BSSID lock is dropped and retries may use any AP.
+ */
+void roam_on_disconnected(wifi_manager_t *wm)
+{
+    if (wm->roam_in_progress && wm->retry_count == 0)
+    {
+        return;
+    }
+
+    if (wm->roam_in_progress)
+    {
+        ESP_LOGW(TAG, "Roaming failed, reconnecting to any AP");
+        wm->roam_in_progress = false;
+        wm->last_roam_us = esp_timer_get_time();
+    }
+
+    if (wm->roam_bssid_locked)
+    {
+        release_bssid_lock(wm);
+    }
+}
+
+/**
+ * @brief Called on IP_EVENT_STA_GOT_IP - completes a roam
+ */
+void roam_on_got_ip(wifi_manager_t *wm)
+{
+    if (!wm->roam_in_progress)
+    {
+        return;
+    }
+
+    wm->roam_in_progress = false;
+    wm->last_roam_us = esp_timer_get_time();
+    wm->roam_count++;
+
+    ESP_LOGI(TAG, "Roam %lu completed, %lld ms without connectivity", (unsigned long)wm->roam_count,
+             (long long)((wm->last_roam_us - wm->roam_started_us) / 1000));
+}
+
+/* ==========================================
+ *          PUBLIC API
+ * ========================================== */
+
+/**
+ * @brief Enable background scanning and roaming
+ */
+esp_err_t wifi_manager_enable_roaming(wifi_manager_t *wm, const wifi_manager_roam_config_t *config)
+{
+    if (!wm || (config && config->scan_interval_ms == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#ifdef CONFIG_WIFI_MANAGER_SCAN_TASK
+    if (config)
+    {
+        wm->roam_config = *config;
+    }
+    else
+    {
+        wm->roam_config.rssi_threshold = WIFI_MANAGER_ROAM_RSSI_THRESHOLD;
+        wm->roam_config.rssi_hysteresis = WIFI_MANAGER_ROAM_HYSTERESIS;
+        wm->roam_config.scan_interval_ms = WIFI_MANAGER_ROAM_SCAN_INTERVAL_MS;
+        wm->roam_config.min_roam_interval_ms = WIFI_MANAGER_ROAM_MIN_INTERVAL_MS;
+    }
+
+    TickType_t period = pdMS_TO_TICKS(wm->roam_config.scan_interval_ms);
+    if (!wm->roam_timer)
+    {
+        wm->roam_timer = xTimerCreate("wm_roam", period, pdTRUE, wm, roam_timer_callback);
+        if (!wm->roam_timer)
+        {
+            ESP_LOGE(TAG, "Failed to create roaming timer");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    else
+    {
+        xTimerChangePeriod(wm->roam_timer, period, 0);
+    }
+    xTimerStart(wm->roam_timer, 0);
+
+    ESP_LOGI(TAG, "Roaming enabled (threshold %d dBm, hysteresis %d dB, scan every %lu ms)",
+             wm->roam_config.rssi_threshold, wm->roam_config.rssi_hysteresis,
+             (unsigned long)wm->roam_config.scan_interval_ms);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED; // Background scans run in the scan task
+#endif
+}
+
+/**
+ * @brief Disable background scanning and roaming
+ */
+esp_err_t wifi_manager_disable_roaming(wifi_manager_t *wm)
+{
+    if (!wm)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (wm->roam_timer)
+    {
+        xTimerStop(wm->roam_timer, 0);
+    }
+
+    // Reconnects may use any AP of the SSID again
+    if (wm->roam_bssid_locked)
+    {
+        release_bssid_lock(wm);
+    }
+    return ESP_OK;
+}
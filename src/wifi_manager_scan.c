@@ -8,19 +8,65 @@
 
 #include "wifi_manager_private.h"
 
+/**
+ * @brief Signal quality in percent, indexed by -RSSI (0 to -127 dBm)
+ *
+ * Linear between -100 dBm (0%) and -50 dBm (100%), the same scale as tzapu's
+ * getRSSIasQuality(), so minimum_signal_quality values carry over.
+ */
+const uint8_t rssi_quality_table[RSSI_QUALITY_TABLE_SIZE] = {
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, // 0..-15 dBm
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, // -16..-31 dBm
+    100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, // -32..-47 dBm
+    100, 100, 100,  98,  96,  94,  92,  90,  88,  86,  84,  82,  80,  78,  76,  74, // -48..-63 dBm
+     72,  70,  68,  66,  64,  62,  60,  58,  56,  54,  52,  50,  48,  46,  44,  42, // -64..-79 dBm
+     40,  38,  36,  34,  32,  30,  28,  26,  24,  22,  20,  18,  16,  14,  12,  10, // -80..-95 dBm
+      8,   6,   4,   2,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, // -96..-111 dBm
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, // -112..-127 dBm
+};
+
+/**
+ * @brief Display names of the authentication modes
+ */
+static const char *const authmode_names[WIFI_AUTH_MAX] = {
+    [WIFI_AUTH_OPEN] = "Open",
+    [WIFI_AUTH_WEP] = "WEP",
+    [WIFI_AUTH_WPA_PSK] = "WPA",
+    [WIFI_AUTH_WPA2_PSK] = "WPA2",
+    [WIFI_AUTH_WPA_WPA2_PSK] = "WPA/WPA2",
+    [WIFI_AUTH_WPA2_ENTERPRISE] = "WPA2-Enterprise",
+    [WIFI_AUTH_WPA3_PSK] = "WPA3",
+    [WIFI_AUTH_WPA2_WPA3_PSK] = "WPA2/WPA3",
+    [WIFI_AUTH_WAPI_PSK] = "WAPI",
+    [WIFI_AUTH_OWE] = "OWE",
+};
+
+/**
+ * @brief Get the display name of an authentication mode
+ */
+const char *authmode_to_string(wifi_auth_mode_t authmode)
+{
+    if (authmode < WIFI_AUTH_MAX && authmode_names[authmode])
+    {
+        return authmode_names[authmode];
+    }
+    return "Unknown";
+}
+
 /**
  * @brief Handle WiFi scan completion event - minimal processing in event context
+ * @param wm WiFiManager instance that received the event
  */
-void wifi_scan_done_handler(void)
+void wifi_scan_done_handler(wifi_manager_t *wm)
 {
-    if (!g_wm || !g_wm->scan_task_handle)
+    if (!wm || !wm->scan_task_handle)
     {
         return;
     }
 
     // Just notify the scan task to process results - no data processing in event context
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    xTaskNotifyFromISR(g_wm->scan_task_handle, SCAN_NOTIFICATION_COMPLETE, eSetValueWithOverwrite, &xHigherPriorityTaskWoken);
+    xTaskNotifyFromISR(wm->scan_task_handle, SCAN_NOTIFICATION_COMPLETE, eSetBits, &xHigherPriorityTaskWoken);
 
     // Request context switch if needed
     if (xHigherPriorityTaskWoken == pdTRUE)
@@ -29,8 +75,121 @@ void wifi_scan_done_handler(void)
     }
 }
 
+/**
+ * @brief Start a portal/auto-connect scan across all channels
+ * @param wm WiFiManager instance
+ * @param block true to wait for the scan in the calling task
+ * @return true if the scan was started (and with block, finished)
+ */
+static bool start_scan(wifi_manager_t *wm, bool block)
+{
+    ESP_LOGI(TAG, "Starting WiFi scan...");
+
+    // Check if we're already connected - if so, skip scanning to avoid conflicts
+    if (wm->current_status == WIFI_STATUS_CONNECTED)
+    {
+        ESP_LOGI(TAG, "Already connected to WiFi, skipping scan");
+        return false;
+    }
+
+    // Check if we're in the right mode for scanning
+    wifi_mode_t mode;
+    esp_err_t err = esp_wifi_get_mode(&mode);
+    if (err == ESP_OK && (mode == WIFI_MODE_APSTA || mode == WIFI_MODE_STA))
+    {
+        // Reset scan state
+        wm->scan_completed = false;
+        wm->scanned_count = 0;
+
+        // Configure scan parameters
+        wifi_scan_config_t scan_config = {0};
+        scan_config.show_hidden = true;
+        scan_config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+        scan_config.scan_time.active.min = 100;
+        scan_config.scan_time.active.max = 300;
+
+        err = esp_wifi_scan_start(&scan_config, block);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Failed to start WiFi scan: %s", esp_err_to_name(err));
+            wm->scan_completed = true; // Mark as completed even if failed
+            return false;
+        }
+
+        ESP_LOGI(TAG, "WiFi scan started successfully");
+        // Without block, wait for WIFI_EVENT_SCAN_DONE which will send SCAN_NOTIFICATION_COMPLETE
+        return true;
+    }
+
+    ESP_LOGW(TAG, "WiFi not in correct mode for scanning (mode: %d)", mode);
+    wm->scan_completed = true; // Mark as completed since we can't scan
+    return false;
+}
+
+/**
+ * @brief Copy the results of a full scan into the instance
+ * @param wm WiFiManager instance
+ */
+static void process_scan_results(wifi_manager_t *wm)
+{
+    ESP_LOGI(TAG, "WiFi scan finished, processing results...");
+
+    perf_mark_t perf;
+    perf_begin(&perf);
+
+    // Records live on the heap only while they are copied, not on the scan task stack
+    uint16_t ap_num = MAX_SCANNED_NETWORKS;
+    wifi_ap_record_t *ap_records = mem_alloc(MEM_SCAN, MAX_SCANNED_NETWORKS * sizeof(wifi_ap_record_t));
+
+    esp_err_t err = ap_records ? esp_wifi_scan_get_ap_records(&ap_num, ap_records) : ESP_ERR_NO_MEM;
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to get scan results: %s", esp_err_to_name(err));
+        mem_free(MEM_SCAN, ap_records);
+        esp_wifi_clear_ap_list();
+        wm->scanned_count = 0;
+        wm->scan_completed = true;
+        return;
+    }
+
+    // Copy scan results to our structure, dropping networks below the minimum quality
+    uint16_t kept = 0;
+    for (int i = 0; i < ap_num && i < MAX_SCANNED_NETWORKS; i++)
+    {
+        uint8_t quality = rssi_to_quality(ap_records[i].rssi);
+        if (quality < wm->minimum_signal_quality)
+        {
+            continue;
+        }
+
+        scanned_network_t *network = &wm->scanned_networks[kept++];
+        strncpy(network->ssid, (char *)ap_records[i].ssid, sizeof(network->ssid) - 1);
+        network->ssid[sizeof(network->ssid) - 1] = '\0';
+        network->rssi = ap_records[i].rssi;
+        network->quality = quality;
+        network->authmode = ap_records[i].authmode;
+        network->is_hidden = (strlen((char *)ap_records[i].ssid) == 0);
+        memcpy(network->bssid, ap_records[i].bssid, sizeof(network->bssid));
+        network->channel = ap_records[i].primary;
+    }
+
+    mem_free(MEM_SCAN, ap_records);
+    wm->scanned_count = kept;
+    wm->scan_completed = true;
+
+    ESP_LOGI(TAG, "WiFi scan completed. Found %d networks (%d below %d%% quality skipped)", ap_num,
+             ap_num - kept, wm->minimum_signal_quality);
+    perf_end(&perf, "scan processing");
+    events_publish(wm, EVENT_PENDING_SCAN);
+}
+
+#ifdef CONFIG_WIFI_MANAGER_SCAN_TASK
 /**
  * @brief Dedicated WiFi scan task - handles scan requests via task notifications
+ *
+ * Requests are notification bits, so a roaming tick can never overwrite a
+ * pending scan completion. An exit request ends the task between requests,
+ * never in the middle of one (see stop_scan_task).
  * @param pvParameters Pointer to WiFiManager instance
  */
 void wifi_scan_task(void *pvParameters)
@@ -42,86 +201,64 @@ void wifi_scan_task(void *pvParameters)
     while (true)
     {
         // Wait for notification
-        uint32_t notification_value = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t notification_value = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notification_value, portMAX_DELAY);
 
-        if (notification_value == SCAN_NOTIFICATION_START && wm)
+        if (notification_value & SCAN_NOTIFICATION_EXIT)
         {
-            ESP_LOGI(TAG, "Scan task received start notification, starting WiFi scan...");
-
-            // Check if we're already connected - if so, skip scanning to avoid conflicts
-            if (wm->current_status == WIFI_STATUS_CONNECTED)
-            {
-                ESP_LOGI(TAG, "Already connected to WiFi, skipping scan");
-                continue;
-            }
+            break;
+        }
 
-            // Check if we're in the right mode for scanning
-            wifi_mode_t mode;
-            esp_err_t err = esp_wifi_get_mode(&mode);
-            if (err == ESP_OK && (mode == WIFI_MODE_APSTA || mode == WIFI_MODE_STA))
+        if (notification_value & SCAN_NOTIFICATION_COMPLETE)
+        {
+            if (wm->roam_scan_active)
             {
-                // Reset scan state
-                wm->scan_completed = false;
-                wm->scanned_count = 0;
-
-                // Configure scan parameters
-                wifi_scan_config_t scan_config = {0};
-                scan_config.show_hidden = true;
-                scan_config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
-                scan_config.scan_time.active.min = 100;
-                scan_config.scan_time.active.max = 300;
-
-                // Start the scan (non-blocking)
-                err = esp_wifi_scan_start(&scan_config, false);
-                if (err != ESP_OK)
-                {
-                    ESP_LOGW(TAG, "Failed to start WiFi scan: %s", esp_err_to_name(err));
-                    wm->scan_completed = true; // Mark as completed even if failed
-                }
-                else
-                {
-                    ESP_LOGI(TAG, "WiFi scan started successfully");
-                    // Wait for WIFI_EVENT_SCAN_DONE which will send SCAN_NOTIFICATION_COMPLETE
-                }
+                // Background scan for roaming - results are not published to the portal
+                wm->roam_scan_active = false;
+                roam_process_scan_results(wm);
             }
             else
             {
-                ESP_LOGW(TAG, "WiFi not in correct mode for scanning (mode: %d)", mode);
-                wm->scan_completed = true; // Mark as completed since we can't scan
+                process_scan_results(wm);
             }
         }
-        else if (notification_value == SCAN_NOTIFICATION_COMPLETE && wm)
-        {
-            ESP_LOGI(TAG, "Scan task received completion notification, processing results...");
 
-            uint16_t ap_num = MAX_SCANNED_NETWORKS;
-            wifi_ap_record_t ap_records[MAX_SCANNED_NETWORKS];
-
-            esp_err_t err = esp_wifi_scan_get_ap_records(&ap_num, ap_records);
-            if (err != ESP_OK)
-            {
-                ESP_LOGW(TAG, "Failed to get scan results: %s", esp_err_to_name(err));
-                wm->scanned_count = 0;
-                wm->scan_completed = true;
-                continue;
-            }
+        if (notification_value & SCAN_NOTIFICATION_START)
+        {
+            start_scan(wm, false);
+        }
 
-            wm->scanned_count = ap_num;
+        if (notification_value & SCAN_NOTIFICATION_ROAM)
+        {
+            roam_tick(wm);
+        }
+    }
 
-            // Copy scan results to our structure
-            for (int i = 0; i < ap_num && i < MAX_SCANNED_NETWORKS; i++)
-            {
-                strncpy(wm->scanned_networks[i].ssid, (char *)ap_records[i].ssid, sizeof(wm->scanned_networks[i].ssid) - 1);
-                wm->scanned_networks[i].ssid[sizeof(wm->scanned_networks[i].ssid) - 1] = '\0';
-                wm->scanned_networks[i].rssi = ap_records[i].rssi;
-                wm->scanned_networks[i].authmode = ap_records[i].authmode;
-                wm->scanned_networks[i].is_hidden = (strlen((char *)ap_records[i].ssid) == 0);
-            }
+    ESP_LOGI(TAG, "WiFi scan task stopped");
+    xSemaphoreGive(wm->scan_task_exited);
+    vTaskDelete(NULL);
+}
 
-            wm->scan_completed = true;
+/**
+ * @brief Ask the scan task to exit and wait until it has
+ *
+ * The task finishes the request in hand first, so a scan result buffer it
+ * holds is freed by the task itself and the scan memory count stays exact.
+ * @param wm WiFiManager instance
+ */
+void stop_scan_task(wifi_manager_t *wm)
+{
+    if (wm->scan_task_handle)
+    {
+        xTaskNotify(wm->scan_task_handle, SCAN_NOTIFICATION_EXIT, eSetBits);
+        xSemaphoreTake(wm->scan_task_exited, portMAX_DELAY);
+        wm->scan_task_handle = NULL;
+    }
 
-            ESP_LOGI(TAG, "WiFi scan completed. Found %d networks", ap_num);
-        }
+    if (wm->scan_task_exited)
+    {
+        vSemaphoreDelete(wm->scan_task_exited);
+        wm->scan_task_exited = NULL;
     }
 }
 
@@ -134,10 +271,26 @@ void trigger_wifi_scan(wifi_manager_t *wm)
     if (wm && wm->scan_task_handle)
     {
         ESP_LOGI(TAG, "Triggering WiFi scan...");
-        xTaskNotify(wm->scan_task_handle, SCAN_NOTIFICATION_START, eSetValueWithOverwrite);
+        xTaskNotify(wm->scan_task_handle, SCAN_NOTIFICATION_START, eSetBits);
     }
     else
     {
         ESP_LOGW(TAG, "Cannot trigger scan - WiFiManager or scan task not available");
     }
-}
\ No newline at end of file
+}
+#else
+/**
+ * @brief Run a WiFi scan in the calling task
+ *
+ * Without CONFIG_WIFI_MANAGER_SCAN_TASK there is no task to hand the scan to,
+ * so the caller blocks for the duration of the scan (a few seconds).
+ * @param wm WiFiManager instance
+ */
+void trigger_wifi_scan(wifi_manager_t *wm)
+{
+    if (wm && start_scan(wm, true))
+    {
+        process_scan_results(wm);
+    }
+}
+#endif // CONFIG_WIFI_MANAGER_SCAN_TASK
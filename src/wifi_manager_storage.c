@@ -9,12 +9,73 @@
 #include "wifi_manager_private.h"
 
 /**
- * @brief Save WiFi credentials to NVS storage
- * @param ssid WiFi network name
- * @param password WiFi password
+ * @brief Load the saved networks from NVS storage
+ *
+ * Credentials written by earlier versions (single "ssid"/"password" pair) are
+ * imported as the only entry; they are removed on the next save.
+ * @param store Buffer to store the networks (count is 0 when nothing is saved)
+ * @return ESP_OK on success (including an empty store), error code on failure
+ */
+esp_err_t load_network_store(network_store_t *store)
+{
+    memset(store, 0, sizeof(*store));
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        return ESP_OK; // Nothing saved yet
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to open NVS handle for reading: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    size_t len = sizeof(*store);
+    err = nvs_get_blob(nvs_handle, "networks", store, &len);
+    if (err == ESP_OK && (len != sizeof(*store) || store->count > WIFI_MANAGER_MAX_NETWORKS))
+    {
+        ESP_LOGW(TAG, "Ignoring saved networks with unexpected layout");
+        memset(store, 0, sizeof(*store));
+    }
+    else if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        // Import single credentials saved by earlier versions
+        stored_network_t *entry = &store->entries[0];
+        size_t ssid_len = sizeof(entry->ssid);
+        size_t password_len = sizeof(entry->password);
+
+        if (nvs_get_str(nvs_handle, "ssid", entry->ssid, &ssid_len) == ESP_OK &&
+            nvs_get_str(nvs_handle, "password", entry->password, &password_len) == ESP_OK &&
+            strlen(entry->ssid) > 0)
+        {
+            ESP_LOGI(TAG, "Imported legacy WiFi credentials for: %s", entry->ssid);
+            store->count = 1;
+        }
+        else
+        {
+            memset(entry, 0, sizeof(*entry));
+        }
+        err = ESP_OK;
+    }
+
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to load saved networks: %s", esp_err_to_name(err));
+    }
+
+    return err;
+}
+
+/**
+ * @brief Save the networks to NVS storage
+ * @param store Networks to save
  * @return ESP_OK on success, error code on failure
  */
-esp_err_t save_wifi_credentials(const char *ssid, const char *password)
+esp_err_t save_network_store(const network_store_t *store)
 {
     nvs_handle_t nvs_handle;
     esp_err_t err = nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
@@ -24,18 +85,47 @@ esp_err_t save_wifi_credentials(const char *ssid, const char *password)
         return err;
     }
 
-    err = nvs_set_str(nvs_handle, "ssid", ssid);
-    if (err == ESP_OK)
-    {
-        err = nvs_set_str(nvs_handle, "password", password);
-    }
+    err = nvs_set_blob(nvs_handle, "networks", store, sizeof(*store));
     if (err == ESP_OK)
     {
+        // Legacy single credentials now live in the store
+        nvs_erase_key(nvs_handle, "ssid");
+        nvs_erase_key(nvs_handle, "password");
         err = nvs_commit(nvs_handle);
     }
 
     nvs_close(nvs_handle);
 
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save networks: %s", esp_err_to_name(err));
+    }
+
+    return err;
+}
+
+/**
+ * @brief Save WiFi credentials to NVS storage
+ *
+ * Adds the network to the saved networks, keeping its priority and statistics if
+ * it is already known.
+ * @param ssid WiFi network name
+ * @param password WiFi password
+ * @return ESP_OK on success, error code on failure
+ */
+esp_err_t save_wifi_credentials(const char *ssid, const char *password)
+{
+    network_store_t store;
+    esp_err_t err = load_network_store(&store);
+    if (err == ESP_OK)
+    {
+        err = network_store_upsert(&store, ssid, password, -1);
+    }
+    if (err == ESP_OK)
+    {
+        err = save_network_store(&store);
+    }
+
     if (err == ESP_OK)
     {
         ESP_LOGI(TAG, "WiFi credentials saved to NVS");
@@ -49,39 +139,71 @@ esp_err_t save_wifi_credentials(const char *ssid, const char *password)
 }
 
 /**
- * @brief Load WiFi credentials from NVS storage
- * @param ssid Buffer to store WiFi network name (must be at least 33 bytes)
- * @param password Buffer to store WiFi password (must be at least 65 bytes)
+ * @brief Save the last DHCP lease to NVS storage
+ *
+ * The write is skipped when the stored lease is identical, so renewing the same
+ * address on every boot does not wear the flash.
+ * @param lease Lease to cache
  * @return ESP_OK on success, error code on failure
  */
-esp_err_t load_wifi_credentials(char *ssid, char *password)
+esp_err_t save_cached_lease(const cached_lease_t *lease)
 {
+    cached_lease_t stored;
+    if (load_cached_lease(&stored) == ESP_OK && memcmp(&stored, lease, sizeof(stored)) == 0)
+    {
+        return ESP_OK;
+    }
+
     nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    esp_err_t err = nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK)
     {
-        ESP_LOGW(TAG, "Failed to open NVS handle for reading: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to open NVS handle: %s", esp_err_to_name(err));
         return err;
     }
 
-    size_t ssid_len = 32;
-    size_t password_len = 64;
-
-    err = nvs_get_str(nvs_handle, "ssid", ssid, &ssid_len);
+    err = nvs_set_blob(nvs_handle, "last_lease", lease, sizeof(*lease));
     if (err == ESP_OK)
     {
-        err = nvs_get_str(nvs_handle, "password", password, &password_len);
+        err = nvs_commit(nvs_handle);
     }
 
     nvs_close(nvs_handle);
 
     if (err == ESP_OK)
     {
-        ESP_LOGI(TAG, "WiFi credentials loaded from NVS - SSID: %s", ssid);
+        ESP_LOGI(TAG, "DHCP lease cached to NVS");
     }
     else
     {
-        ESP_LOGW(TAG, "Failed to load WiFi credentials: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to cache DHCP lease: %s", esp_err_to_name(err));
+    }
+
+    return err;
+}
+
+/**
+ * @brief Load the cached DHCP lease from NVS storage
+ * @param lease Buffer to store the lease
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if no lease is cached
+ */
+esp_err_t load_cached_lease(cached_lease_t *lease)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(WIFI_MANAGER_NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    size_t len = sizeof(*lease);
+    memset(lease, 0, sizeof(*lease));
+    err = nvs_get_blob(nvs_handle, "last_lease", lease, &len);
+    nvs_close(nvs_handle);
+
+    if (err == ESP_OK && (len != sizeof(*lease) || lease->ip == 0))
+    {
+        err = ESP_ERR_NVS_NOT_FOUND;
     }
 
     return err;
@@ -0,0 +1,381 @@
+/**
+ * @file wifi_manager_template.c
+ * @brief Streaming renderer for the server-rendered portal pages
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ *
+ * Pages with {{placeholders}} are compiled at build time by
+ * tools/compile_templates.py into the embedded page (placeholders removed)
+ * and an offset table per page in wifi_manager_templates.h. tpl_render()
+ * sends the static parts straight from flash and renders each slot into one
+ * TPL_CHUNK_SIZE buffer that is flushed with httpd_resp_send_chunk() whenever
+ * it fills, so a page costs the same RAM however many networks or parameters
+ * it lists.
+ */
+
+#include "wifi_manager_private.h"
+#include <stdarg.h>
+
+#define TPL_CHUNK_SIZE 512 // Rendered bytes collected before a chunk is sent
+
+typedef struct
+{
+    httpd_req_t *req;
+    esp_err_t err; // First send error, later output is dropped
+    size_t len;
+    char buf[TPL_CHUNK_SIZE];
+} tpl_writer_t;
+
+static void tpl_flush(tpl_writer_t *w)
+{
+    if (w->len > 0 && w->err == ESP_OK)
+    {
+        w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+    }
+    w->len = 0;
+}
+
+static void tpl_write(tpl_writer_t *w, const char *data, size_t len)
+{
+    // Static page parts are sent from flash as they are, not copied
+    if (len >= TPL_CHUNK_SIZE)
+    {
+        tpl_flush(w);
+        if (w->err == ESP_OK)
+        {
+            w->err = httpd_resp_send_chunk(w->req, data, len);
+        }
+        return;
+    }
+    if (w->len + len > TPL_CHUNK_SIZE)
+    {
+        tpl_flush(w);
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void tpl_putc(tpl_writer_t *w, char c)
+{
+    if (w->len == TPL_CHUNK_SIZE)
+    {
+        tpl_flush(w);
+    }
+    w->buf[w->len++] = c;
+}
+
+/**
+ * @brief Format into the chunk buffer; pieces are short, longer output is truncated
+ */
+static void tpl_printf(tpl_writer_t *w, const char *fmt, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(w->buf + w->len, TPL_CHUNK_SIZE - w->len, fmt, args);
+        va_end(args);
+
+        if (len < 0)
+        {
+            return;
+        }
+        if (w->len + len < TPL_CHUNK_SIZE)
+        {
+            w->len += len;
+            return;
+        }
+        if (w->len == 0)
+        {
+            w->len = TPL_CHUNK_SIZE - 1;
+            return;
+        }
+        tpl_flush(w);
+    }
+}
+
+/**
+ * @brief Write text for an HTML element or attribute value
+ */
+static void tpl_write_html(tpl_writer_t *w, const char *text)
+{
+    for (; *text; text++)
+    {
+        switch (*text)
+        {
+        case '&':
+            tpl_write(w, "&amp;", 5);
+            break;
+        case '<':
+            tpl_write(w, "&lt;", 4);
+            break;
+        case '>':
+            tpl_write(w, "&gt;", 4);
+            break;
+        case '"':
+            tpl_write(w, "&quot;", 6);
+            break;
+        case '\'':
+            tpl_write(w, "&#39;", 5);
+            break;
+        default:
+            tpl_putc(w, *text);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Write text for a JSON string inside a <script> element ('<' escaped too)
+ */
+static void tpl_write_json(tpl_writer_t *w, const char *text)
+{
+    for (; *text; text++)
+    {
+        unsigned char c = (unsigned char)*text;
+        if (c == '"' || c == '\\')
+        {
+            tpl_putc(w, '\\');
+            tpl_putc(w, c);
+        }
+        else if (c < 0x20 || c == '<')
+        {
+            tpl_printf(w, "\\u%04x", c);
+        }
+        else
+        {
+            tpl_putc(w, c);
+        }
+    }
+}
+
+/**
+ * @brief Networks listed on the page: none while connected, same as /wifi
+ */
+static int tpl_networks(wifi_manager_t *wm, uint8_t *order)
+{
+    return wm->current_status == WIFI_STATUS_CONNECTED ? 0 : collect_networks(wm, order);
+}
+
+/**
+ * @brief {{wifi}} - the /wifi JSON, read by the page script instead of fetching it
+ */
+static void render_wifi(tpl_writer_t *w, wifi_manager_t *wm, const uint8_t *order, int count)
+{
+    if (wm->current_status == WIFI_STATUS_CONNECTED)
+    {
+        tpl_printf(w, "{\"connected\":true,\"networks\":[]}");
+        return;
+    }
+
+    tpl_printf(w, "{\"connected\":false,\"networks\":[");
+    for (int i = 0; i < count; i++)
+    {
+        const scanned_network_t *network = &wm->scanned_networks[order[i]];
+        tpl_printf(w, "%s{\"ssid\":\"", i > 0 ? "," : "");
+        tpl_write_json(w, network->ssid);
+        tpl_printf(w, "\",\"rssi\":%d,\"quality\":%d,\"auth\":\"%s\",\"secure\":%s}",
+                   network->rssi, network->quality, authmode_to_string(network->authmode),
+                   network->authmode == WIFI_AUTH_OPEN ? "false" : "true");
+    }
+    tpl_printf(w, "],\"scan_completed\":%s,\"count\":%d}", wm->scan_completed ? "true" : "false",
+               wm->scanned_count);
+}
+
+/**
+ * @brief {{networks}} - the network list, same markup as displayNetworks() in script.js
+ */
+static void render_networks(tpl_writer_t *w, wifi_manager_t *wm, const uint8_t *order, int count)
+{
+    if (count == 0)
+    {
+        tpl_printf(w, "<div class=\"loading\">%s</div>",
+                   wm->scan_completed ? "No networks found. Use manual entry below." : "Scanning for networks...");
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        const scanned_network_t *network = &wm->scanned_networks[order[i]];
+        tpl_printf(w, "<div class=\"wifi-item\" onclick=\"selectNetwork(%d)\" id=\"network-%d\"><span class=\"wifi-name\">",
+                   i, i);
+        tpl_write_html(w, network->ssid);
+        tpl_printf(w, "</span><span class=\"wifi-signal\">\xF0\x9F\x93\xB6 %d%%</span>"
+                      "<span class=\"wifi-security\">%s %s</span></div>",
+                   network->quality, network->authmode == WIFI_AUTH_OPEN ? "\xF0\x9F\x94\x93" : "\xF0\x9F\x94\x92",
+                   authmode_to_string(network->authmode));
+    }
+}
+
+/**
+ * @brief {{params}} - the configuration fields, same markup as displayConfiguration() in script.js
+ */
+static void render_params(tpl_writer_t *w, wifi_manager_t *wm)
+{
+    // data-rendered tells the page script the fields need not be fetched
+    if (wm->config_param_count == 0)
+    {
+        tpl_printf(w, "<div class=\"info\" data-rendered=\"1\">No configuration parameters defined.</div>");
+        return;
+    }
+
+    tpl_printf(w, "<div class=\"config-params\" data-rendered=\"1\">");
+#ifdef CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
+    for (int i = 0; i < wm->config_param_count; i++)
+    {
+        const config_param_t *param = &wm->config_params[i];
+        const char *type = "text";
+        if (param->type == CONFIG_TYPE_BOOL)
+        {
+            type = "checkbox";
+        }
+        else if (param->type == CONFIG_TYPE_INT || param->type == CONFIG_TYPE_FLOAT)
+        {
+            type = "number";
+        }
+        else if (strstr(param->key, "password"))
+        {
+            type = "password";
+        }
+
+        tpl_printf(w, "<div class=\"config-param\"><label for=\"config_%s\">", param->key);
+        tpl_write_html(w, param->label);
+        tpl_printf(w, ":</label><input type=\"%s\" id=\"config_%s\" name=\"%s\"", type, param->key, param->key);
+        if (param->type == CONFIG_TYPE_BOOL)
+        {
+            bool checked = strcmp(param->value, "true") == 0 || strcmp(param->value, "1") == 0;
+            tpl_printf(w, "%s", checked ? " checked" : "");
+        }
+        else
+        {
+            tpl_printf(w, " value=\"");
+            tpl_write_html(w, param->value);
+            tpl_printf(w, "\" placeholder=\"");
+            tpl_write_html(w, param->placeholder);
+            tpl_printf(w, "\"");
+        }
+        tpl_printf(w, "%s></div>", param->required ? " required" : "");
+    }
+#endif
+    tpl_printf(w, "</div>");
+}
+
+/**
+ * @brief {{status}} - connection status text
+ */
+static void render_status(tpl_writer_t *w, const wifi_manager_state_t *state)
+{
+    const char *text;
+    switch (state->status)
+    {
+    case WIFI_STATUS_CONNECTED:
+        text = "Connected";
+        break;
+    case WIFI_STATUS_CONNECTING:
+        text = "Connecting";
+        break;
+    case WIFI_STATUS_NO_IP:
+        text = "Waiting for IP address";
+        break;
+    case WIFI_STATUS_FAILED:
+        text = "Connection failed";
+        break;
+    case WIFI_STATUS_AP_MODE:
+    case WIFI_STATUS_CONFIG_PORTAL:
+        text = "Setup mode";
+        break;
+    default:
+        text = "Disconnected";
+        break;
+    }
+    tpl_printf(w, "%s", text);
+}
+
+/**
+ * @brief {{ip}} - station IP address
+ */
+static void render_ip(tpl_writer_t *w, const wifi_manager_state_t *state)
+{
+    if (state->status != WIFI_STATUS_CONNECTED || state->ip == 0)
+    {
+        tpl_printf(w, "Unknown");
+        return;
+    }
+    esp_ip4_addr_t ip = {.addr = state->ip};
+    tpl_printf(w, IPSTR, IP2STR(&ip));
+}
+
+/**
+ * @brief Stream a compiled template page with its slots rendered
+ *
+ * Sets the HTML content type. The response is chunked; a send error stops
+ * the output and is returned.
+ * @param req Request to answer
+ * @param wm WiFiManager instance
+ * @param page Embedded page (from tools/compile_templates.py)
+ * @param slots Its offset table from wifi_manager_templates.h, ends with TPL_SLOT_NONE
+ */
+esp_err_t tpl_render(httpd_req_t *req, wifi_manager_t *wm, const uint8_t *page, const tpl_slot_t *slots)
+{
+    perf_mark_t perf;
+    perf_begin(&perf);
+
+    tpl_writer_t w = {.req = req, .err = ESP_OK, .len = 0};
+    uint8_t order[MAX_SCANNED_NETWORKS];
+    int network_count = -1; // Collected on first use, shared by {{wifi}} and {{networks}}
+    wifi_manager_state_t state;
+    bool have_state = false;
+
+    httpd_resp_set_type(req, "text/html; charset=utf-8");
+
+    size_t pos = 0;
+    for (const tpl_slot_t *slot = slots; w.err == ESP_OK; slot++)
+    {
+        tpl_write(&w, (const char *)page + pos, slot->offset - pos);
+        pos = slot->offset;
+
+        if ((slot->id == TPL_SLOT_WIFI || slot->id == TPL_SLOT_NETWORKS) && network_count < 0)
+        {
+            network_count = tpl_networks(wm, order);
+        }
+        if ((slot->id == TPL_SLOT_STATUS || slot->id == TPL_SLOT_IP) && !have_state)
+        {
+            state_read(wm, &state);
+            have_state = true;
+        }
+
+        switch (slot->id)
+        {
+        case TPL_SLOT_WIFI:
+            render_wifi(&w, wm, order, network_count);
+            break;
+        case TPL_SLOT_NETWORKS:
+            render_networks(&w, wm, order, network_count);
+            break;
+        case TPL_SLOT_PARAMS:
+            render_params(&w, wm);
+            break;
+        case TPL_SLOT_STATUS:
+            render_status(&w, &state);
+            break;
+        case TPL_SLOT_IP:
+            render_ip(&w, &state);
+            break;
+        default:
+            break;
+        }
+        if (slot->id == TPL_SLOT_NONE)
+        {
+            break;
+        }
+    }
+
+    tpl_flush(&w);
+    if (w.err == ESP_OK)
+    {
+        w.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    perf_end(&perf, "template page");
+    return w.err;
+}
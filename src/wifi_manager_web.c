@@ -7,23 +7,26 @@
  */
 
 #include "wifi_manager_private.h"
+#include "wifi_manager_templates.h" // Generated offset tables of the template pages
 
 /**
  * @brief Handler for main setup page - smart routing based on WiFi status
  */
 esp_err_t setup_page_handler(httpd_req_t *req)
 {
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
     ESP_LOGI(TAG, "Main page requested - checking WiFi status");
 
-    if (!g_wm)
+    if (!wm)
     {
         ESP_LOGE(TAG, "WiFi Manager not initialized");
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "WiFi Manager not initialized");
-        return ESP_FAIL;
+        return ESP_OK;
     }
 
     // Check current WiFi status
-    wifi_status_t status = current_status;
+    wifi_status_t status = wm->current_status;
 
     // If connected, show configuration page instead of setup page
     if (status == WIFI_STATUS_CONNECTED)
@@ -34,23 +37,26 @@ esp_err_t setup_page_handler(httpd_req_t *req)
     else
     {
         ESP_LOGI(TAG, "WiFi not connected - serving setup page with scan");
-        // Trigger a fresh scan when someone accesses the portal and not connected
-        trigger_wifi_scan(g_wm);
-        return setup_html_handler(req);
+        // Render the last results first - the scan clears them - then trigger a fresh scan
+        esp_err_t err = setup_html_handler(req);
+        trigger_wifi_scan(wm);
+        return err;
     }
 }
 
 /**
- * @brief Handler for serving embedded HTML
+ * @brief Handler for the setup page, rendered with the current scan
  */
 esp_err_t setup_html_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Setup HTML requested");
 
-    httpd_resp_set_type(req, "text/html; charset=utf-8");
-
-    size_t html_size = setup_html_end - setup_html_start;
-    return httpd_resp_send(req, (const char *)setup_html_start, html_size);
+#ifdef CONFIG_WIFI_MANAGER_WEB_BUNDLE
+    // Single document: stylesheet and script inlined
+    return tpl_render(req, (wifi_manager_t *)req->user_ctx, portal_html_start, portal_html_slots);
+#else
+    return tpl_render(req, (wifi_manager_t *)req->user_ctx, setup_html_start, setup_html_slots);
+#endif
 }
 
 /**
@@ -61,6 +67,7 @@ esp_err_t style_css_handler(httpd_req_t *req)
     ESP_LOGI(TAG, "Style CSS requested");
 
     httpd_resp_set_type(req, "text/css");
+    httpd_resp_set_hdr(req, "Cache-Control", HTTP_STATIC_MAX_AGE);
 
     size_t css_size = style_css_end - style_css_start;
     return httpd_resp_send(req, (const char *)style_css_start, css_size);
@@ -74,6 +81,7 @@ esp_err_t script_js_handler(httpd_req_t *req)
     ESP_LOGI(TAG, "Script JS requested");
 
     httpd_resp_set_type(req, "application/javascript");
+    httpd_resp_set_hdr(req, "Cache-Control", HTTP_STATIC_MAX_AGE);
 
     size_t js_size = script_js_end - script_js_start;
     return httpd_resp_send(req, (const char *)script_js_start, js_size);
@@ -93,16 +101,88 @@ esp_err_t success_html_handler(httpd_req_t *req)
 }
 
 /**
- * @brief Handler for serving embedded configuration page
+ * @brief Handler for the configuration page, rendered with the parameters and status
  */
 esp_err_t config_html_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Configuration HTML requested");
 
-    httpd_resp_set_type(req, "text/html; charset=utf-8");
+    return tpl_render(req, (wifi_manager_t *)req->user_ctx, config_html_start, config_html_slots);
+}
+
+/**
+ * @brief Save submitted credentials and test them on the STA interface
+ *
+ * The soft-AP stays up (APSTA) so the user sees the result on the success
+ * page; the AP is closed after GOT_IP.
+ * @param wm WiFiManager instance
+ * @param ssid Network name
+ * @param password Network password (may be empty)
+ */
+void start_portal_connect(wifi_manager_t *wm, const char *ssid, const char *password)
+{
+    save_wifi_credentials(ssid, password);
+
+    wifi_config_t wifi_config = {0};
+    strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+
+    esp_wifi_disconnect();
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    apply_ip_config(wm);
+    wm->retry_count = 0;
+    wm->last_disconnect_reason = 0;
+    wm->portal_connect_attempted = true;
+    update_status(wm, WIFI_STATUS_CONNECTING);
+    esp_wifi_connect();
+}
+
+// Credentials waiting for portal_connect_work()
+typedef struct
+{
+    wifi_manager_t *wm;
+    char ssid[33];
+    char password[65];
+} portal_connect_job_t;
 
-    size_t html_size = config_html_end - config_html_start;
-    return httpd_resp_send(req, (const char *)config_html_start, html_size);
+/**
+ * @brief Run a deferred start_portal_connect() - httpd work item
+ */
+static void portal_connect_work(void *arg)
+{
+    portal_connect_job_t *job = (portal_connect_job_t *)arg;
+    start_portal_connect(job->wm, job->ssid, job->password);
+    mem_free(MEM_WEB, job);
+}
+
+/**
+ * @brief Start the portal connection after the current response
+ *
+ * The NVS write and WiFi driver calls of start_portal_connect() take long
+ * enough to hold up the other requests of the page. Queued with
+ * httpd_queue_work(), they run once the handler has returned and its response
+ * is on the wire. Falls back to connecting right away if the work cannot be
+ * queued.
+ * @param wm WiFiManager instance
+ * @param ssid Network name
+ * @param password Network password (may be empty)
+ */
+void defer_portal_connect(wifi_manager_t *wm, const char *ssid, const char *password)
+{
+    portal_connect_job_t *job = mem_alloc(MEM_WEB, sizeof(portal_connect_job_t));
+    if (job)
+    {
+        memset(job, 0, sizeof(*job));
+        job->wm = wm;
+        strncpy(job->ssid, ssid, sizeof(job->ssid) - 1);
+        strncpy(job->password, password, sizeof(job->password) - 1);
+        if (httpd_queue_work(wm->server, portal_connect_work, job) == ESP_OK)
+        {
+            return;
+        }
+        mem_free(MEM_WEB, job);
+    }
+    start_portal_connect(wm, ssid, password);
 }
 
 /**
@@ -110,14 +190,21 @@ esp_err_t config_html_handler(httpd_req_t *req)
  */
 esp_err_t connect_handler(httpd_req_t *req)
 {
-    char buf[1000];
-    char ssid[33] = {0};
-    char password[65] = {0};
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
+    char buf[512];
     int ret, remaining = req->content_len;
 
+    if (remaining >= sizeof(buf))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request too large");
+        return ESP_FAIL;
+    }
+
+    int total_read = 0;
     while (remaining > 0)
     {
-        if ((ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)))) <= 0)
+        if ((ret = httpd_req_recv(req, buf + total_read, remaining)) <= 0)
         {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT)
             {
@@ -126,59 +213,202 @@ esp_err_t connect_handler(httpd_req_t *req)
             return ESP_FAIL;
         }
         remaining -= ret;
+        total_read += ret;
+    }
+    buf[total_read] = '\0';
+
+    connect_form_t form;
+    if (!parse_connect_form(buf, &form))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "SSID required");
+        return ESP_OK;
     }
-    buf[req->content_len] = '\0';
 
-    // Parse form data (simple parsing for ssid=...&password=...)
-    char *ssid_start = strstr(buf, "ssid=");
-    char *password_start = strstr(buf, "password=");
+    ESP_LOGI(TAG, "Received WiFi credentials - SSID: %s", form.ssid);
+
+    // Success page first, the connection attempt follows once it is sent
+    success_html_handler(req);
+    defer_portal_connect(wm, form.ssid, form.password);
+    return ESP_OK;
+}
 
-    if (ssid_start)
+/**
+ * @brief Read the ssid and password fields of a portal form
+ *
+ * Shared by the REST and WebSocket connect requests and the saved network
+ * updates, so all of them take the same lengths.
+ * @param form URL-encoded form
+ * @param out Decoded fields, empty when missing
+ * @return true if the form names an SSID
+ */
+bool parse_connect_form(const char *form, connect_form_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    httpd_query_key_value(form, "ssid", out->ssid, sizeof(out->ssid));
+    httpd_query_key_value(form, "password", out->password, sizeof(out->password));
+    url_decode(out->ssid);
+    url_decode(out->password);
+    return out->ssid[0] != '\0';
+}
+
+/**
+ * @brief Copy a string into a JSON string body
+ *
+ * Escapes quotes, backslashes and control characters, and '<' as \u003c so the
+ * JSON can also be placed inside a <script> element of a page.
+ * @param in Input string
+ * @param out Output buffer, always terminated
+ * @param size Size of out (6 * strlen(in) + 1 always fits)
+ */
+static void json_escape(const char *in, char *out, size_t size)
+{
+    size_t len = 0;
+    for (; *in && len + 7 <= size; in++)
     {
-        ssid_start += 5; // Skip "ssid="
-        char *ssid_end = strchr(ssid_start, '&');
-        if (ssid_end)
+        unsigned char c = (unsigned char)*in;
+        if (c == '"' || c == '\\')
         {
-            strncpy(ssid, ssid_start, MIN(ssid_end - ssid_start, sizeof(ssid) - 1));
+            out[len++] = '\\';
+            out[len++] = c;
+        }
+        else if (c < 0x20 || c == '<')
+        {
+            len += snprintf(out + len, size - len, "\\u%04x", c);
         }
         else
         {
-            strncpy(ssid, ssid_start, sizeof(ssid) - 1);
+            out[len++] = c;
         }
     }
+    out[len] = '\0';
+}
+
+/**
+ * @brief Pick the networks to list: the strongest entry per visible SSID, strongest first
+ * @param wm WiFiManager instance
+ * @param order Receives indices into wm->scanned_networks (MAX_SCANNED_NETWORKS entries)
+ * @return Number of indices written, 0 until a scan has completed
+ */
+int collect_networks(wifi_manager_t *wm, uint8_t *order)
+{
+    int count = 0;
+    if (!wm->scan_completed)
+    {
+        return 0;
+    }
 
-    if (password_start)
+    for (int i = 0; i < wm->scanned_count && i < MAX_SCANNED_NETWORKS; i++)
     {
-        password_start += 9; // Skip "password="
-        char *password_end = strchr(password_start, '&');
-        if (password_end)
+        const scanned_network_t *network = &wm->scanned_networks[i];
+
+        // Skip hidden networks and empty SSIDs
+        if (network->ssid[0] == '\0' || network->is_hidden)
         {
-            strncpy(password, password_start, MIN(password_end - password_start, sizeof(password) - 1));
+            continue;
         }
-        else
+
+        // Keep the strongest entry of an SSID seen before
+        int j = 0;
+        while (j < count && strcmp(wm->scanned_networks[order[j]].ssid, network->ssid) != 0)
+        {
+            j++;
+        }
+        if (j == count)
+        {
+            order[count++] = i;
+        }
+        else if (network->rssi > wm->scanned_networks[order[j]].rssi)
         {
-            strncpy(password, password_start, sizeof(password) - 1);
+            order[j] = i;
         }
     }
 
-    ESP_LOGI(TAG, "Received WiFi credentials - SSID: %s", ssid);
+    // Sort by signal strength
+    for (int i = 1; i < count; i++)
+    {
+        uint8_t index = order[i];
+        int j = i;
+        while (j > 0 && wm->scanned_networks[order[j - 1]].rssi < wm->scanned_networks[index].rssi)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = index;
+    }
+    return count;
+}
 
-    // Save credentials and try to connect
-    save_wifi_credentials(ssid, password);
+/**
+ * @brief Build the /wifi JSON: the current connection, or the deduplicated scan results
+ * @param wm WiFiManager instance
+ * @param buf Output buffer (WIFI_LIST_JSON_SIZE is enough for a full scan)
+ * @param size Size of buf
+ * @return Length written
+ */
+int format_wifi_list(wifi_manager_t *wm, char *buf, size_t size)
+{
+    // Check if already connected - return current connection info instead of scan
+    if (wm->current_status == WIFI_STATUS_CONNECTED)
+    {
+        ESP_LOGI(TAG, "Already connected - returning current connection info");
 
-    // Send success page
-    success_html_handler(req);
+        // Get current WiFi info
+        wifi_ap_record_t ap_info;
+        esp_err_t ret = esp_wifi_sta_get_ap_info(&ap_info);
 
-    // Configure and start STA mode
-    wifi_config_t wifi_config = {0};
-    strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid) - 1);
-    strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password) - 1);
+        // Get IP address
+        char ip_str[16] = "Unknown";
+        esp_netif_ip_info_t ip_info;
+        if (wm->sta_netif && esp_netif_get_ip_info(wm->sta_netif, &ip_info) == ESP_OK)
+        {
+            snprintf(ip_str, sizeof(ip_str), IPSTR, IP2STR(&ip_info.ip));
+        }
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    esp_wifi_connect();
+        if (ret == ESP_OK)
+        {
+            char ssid[6 * sizeof(ap_info.ssid) + 1];
+            json_escape((const char *)ap_info.ssid, ssid, sizeof(ssid));
+            return snprintf(buf, size,
+                            "{\"connected\":true,\"current_network\":\"%s\",\"signal\":%d,\"ip\":\"%s\",\"networks\":[]}",
+                            ssid, ap_info.rssi, ip_str);
+        }
 
-    return ESP_OK;
+        // Fallback if we can't get current AP info
+        return snprintf(buf, size,
+                        "{\"connected\":true,\"current_network\":\"Connected\",\"ip\":\"%s\",\"networks\":[]}", ip_str);
+    }
+
+    ESP_LOGI(TAG, "Not connected - returning scan results: scan_completed: %s, count: %d",
+             wm->scan_completed ? "true" : "false", wm->scanned_count);
+
+    int offset = snprintf(buf, size, "{\"connected\":false,\"networks\":[");
+
+    uint8_t order[MAX_SCANNED_NETWORKS];
+    int count = collect_networks(wm, order);
+
+    // Keep room for the closing fields
+    char ssid[6 * sizeof(wm->scanned_networks[0].ssid) + 1];
+    for (int i = 0; i < count && offset + (int)sizeof(ssid) + 128 < (int)size; i++)
+    {
+        const scanned_network_t *network = &wm->scanned_networks[order[i]];
+
+        json_escape(network->ssid, ssid, sizeof(ssid));
+        offset += snprintf(buf + offset, size - offset,
+                           "%s{\"ssid\":\"%s\",\"rssi\":%d,\"quality\":%d,\"auth\":\"%s\",\"secure\":%s}",
+                           (i > 0) ? "," : "",
+                           ssid,
+                           network->rssi,
+                           network->quality,
+                           authmode_to_string(network->authmode),
+                           (network->authmode == WIFI_AUTH_OPEN) ? "false" : "true");
+    }
+
+    offset += snprintf(buf + offset, size - offset,
+                       "],\"scan_completed\":%s,\"count\":%d}",
+                       wm->scan_completed ? "true" : "false",
+                       wm->scanned_count);
+
+    return offset;
 }
 
 /**
@@ -186,362 +416,564 @@ esp_err_t connect_handler(httpd_req_t *req)
  */
 esp_err_t wifi_list_handler(httpd_req_t *req)
 {
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
     ESP_LOGI(TAG, "WiFi list requested");
 
-    if (!g_wm)
+    if (!wm)
     {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "WiFiManager not initialized");
-        return ESP_FAIL;
+        return ESP_OK;
     }
 
     // Set content type to JSON
     httpd_resp_set_type(req, "application/json");
 
-    // Check if already connected - return current connection info instead of scan
-    if (current_status == WIFI_STATUS_CONNECTED)
+    // Allocate buffer for JSON response
+    char *json_response = mem_alloc(MEM_WEB, WIFI_LIST_JSON_SIZE);
+    if (!json_response)
     {
-        ESP_LOGI(TAG, "Already connected - returning current connection info");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
+    }
 
-        // Get current WiFi info
-        wifi_ap_record_t ap_info;
-        esp_err_t ret = esp_wifi_sta_get_ap_info(&ap_info);
+    perf_mark_t perf;
+    perf_begin(&perf);
+    int len = format_wifi_list(wm, json_response, WIFI_LIST_JSON_SIZE);
+    perf_end(&perf, "/wifi JSON");
 
-        // Get IP address
-        char ip_str[16] = "Unknown";
-        esp_netif_ip_info_t ip_info;
-        if (sta_netif && esp_netif_get_ip_info(sta_netif, &ip_info) == ESP_OK)
+    ESP_LOGI(TAG, "Sending WiFi JSON response (%d bytes)", len);
+    httpd_resp_send(req, json_response, len);
+
+    mem_free(MEM_WEB, json_response);
+    return ESP_OK;
+}
+
+/**
+ * @brief Decode a URL-encoded form value in place
+ */
+void url_decode(char *value)
+{
+    char *out = value;
+    for (char *in = value; *in; in++)
+    {
+        if (*in == '+')
         {
-            snprintf(ip_str, sizeof(ip_str), IPSTR, IP2STR(&ip_info.ip));
+            *out++ = ' ';
         }
-
-        if (ret == ESP_OK)
+        else if (*in == '%' && in[1] && in[2])
         {
-            char response[512];
-            snprintf(response, sizeof(response),
-                     "{\"connected\":true,\"current_network\":\"%s\",\"signal\":%d,\"ip\":\"%s\",\"networks\":[]}",
-                     (char *)ap_info.ssid, ap_info.rssi, ip_str);
-            return httpd_resp_send(req, response, -1);
+            char hex[3] = {in[1], in[2], '\0'};
+            *out++ = (char)strtol(hex, NULL, 16);
+            in += 2;
         }
         else
         {
-            // Fallback if we can't get current AP info
-            char response[512];
-            snprintf(response, sizeof(response),
-                     "{\"connected\":true,\"current_network\":\"Connected\",\"ip\":\"%s\",\"networks\":[]}", ip_str);
-            return httpd_resp_send(req, response, -1);
+            *out++ = *in;
         }
     }
+    *out = '\0';
+}
 
-    ESP_LOGI(TAG, "Not connected - returning scan results: scan_completed: %s, count: %d",
-             g_wm->scan_completed ? "true" : "false", g_wm->scanned_count);
+/**
+ * @brief Handler for listing saved networks as JSON (passwords are never sent)
+ */
+esp_err_t networks_list_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
 
-    // Allocate buffer for JSON response
-    char *json_response = malloc(4096);
-    if (!json_response)
+    wifi_manager_network_info_t networks[WIFI_MANAGER_MAX_NETWORKS];
+    size_t count = 0;
+    if (wifi_manager_list_networks(wm, networks, WIFI_MANAGER_MAX_NETWORKS, &count) != ESP_OK)
     {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to load saved networks");
+        return ESP_OK;
     }
 
-    int offset = snprintf(json_response, 4096, "{\"connected\":false,\"networks\":[");
+    // Set content type to JSON
+    httpd_resp_set_type(req, "application/json");
+
+    // Fits WIFI_MANAGER_MAX_NETWORKS entries with fully escaped SSIDs (about 310 bytes each)
+    char json_response[2048];
+    char ssid[6 * sizeof(networks[0].ssid) + 1];
+    int offset = snprintf(json_response, sizeof(json_response), "{\"networks\":[");
 
-    // Only process networks if scan is completed
-    if (g_wm->scan_completed && g_wm->scanned_count > 0)
+    for (size_t i = 0; i < count && offset < sizeof(json_response); i++)
     {
-        // Create a unique network list (strongest signal per SSID)
-        scanned_network_t unique_networks[MAX_SCANNED_NETWORKS];
-        int unique_count = 0;
-        int output_count = 0;
+        json_escape(networks[i].ssid, ssid, sizeof(ssid));
+        offset += snprintf(json_response + offset, sizeof(json_response) - offset,
+                           "%s{\"ssid\":\"%s\",\"priority\":%d,\"last_success\":%lu,\"success_count\":%u,"
+                           "\"failure_count\":%u,\"channel\":%d}",
+                           (i > 0) ? "," : "",
+                           ssid,
+                           networks[i].priority,
+                           (unsigned long)networks[i].last_success,
+                           (unsigned)networks[i].success_count,
+                           (unsigned)networks[i].failure_count,
+                           networks[i].channel);
+    }
 
-        // First pass: collect unique SSIDs with strongest signal
-        for (int i = 0; i < g_wm->scanned_count; i++)
-        {
-            const char *current_ssid = g_wm->scanned_networks[i].ssid;
+    if (offset < sizeof(json_response))
+    {
+        offset += snprintf(json_response + offset, sizeof(json_response) - offset, "]}");
+    }
+    if (offset >= sizeof(json_response))
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+        return ESP_OK;
+    }
 
-            // Skip hidden networks and empty SSIDs
-            if (strlen(current_ssid) == 0 || g_wm->scanned_networks[i].is_hidden)
-            {
-                continue;
-            }
+    return httpd_resp_send(req, json_response, offset);
+}
 
-            // Check if this SSID already exists in unique list
-            int existing_index = -1;
-            for (int j = 0; j < unique_count; j++)
-            {
-                if (strcmp(unique_networks[j].ssid, current_ssid) == 0)
-                {
-                    existing_index = j;
-                    break;
-                }
-            }
+/**
+ * @brief Handler for adding or removing a saved network
+ *
+ * Form fields: action=add|remove, ssid, password, priority (0-255).
+ */
+esp_err_t networks_update_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
 
-            if (existing_index >= 0)
-            {
-                // SSID exists, keep the one with stronger signal
-                if (g_wm->scanned_networks[i].rssi > unique_networks[existing_index].rssi)
-                {
-                    unique_networks[existing_index] = g_wm->scanned_networks[i];
-                }
-            }
-            else if (unique_count < MAX_SCANNED_NETWORKS)
-            {
-                // New SSID, add to unique list
-                unique_networks[unique_count] = g_wm->scanned_networks[i];
-                unique_count++;
-            }
-        }
+    char buf[512];
+    int ret, remaining = req->content_len;
 
-        // Second pass: sort by signal strength (strongest first)
-        for (int i = 0; i < unique_count - 1; i++)
+    if (remaining >= sizeof(buf))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request too large");
+        return ESP_FAIL;
+    }
+
+    int total_read = 0;
+    while (remaining > 0)
+    {
+        if ((ret = httpd_req_recv(req, buf + total_read, remaining)) <= 0)
         {
-            for (int j = i + 1; j < unique_count; j++)
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
             {
-                if (unique_networks[j].rssi > unique_networks[i].rssi)
-                {
-                    scanned_network_t temp = unique_networks[i];
-                    unique_networks[i] = unique_networks[j];
-                    unique_networks[j] = temp;
-                }
+                continue;
             }
+            return ESP_FAIL;
         }
+        remaining -= ret;
+        total_read += ret;
+    }
+    buf[total_read] = '\0';
 
-        // Third pass: generate JSON for unique networks
-        for (int i = 0; i < unique_count; i++)
-        {
-            int strongest_index = i;
+    char action[8] = {0};
+    char priority[8] = {0};
+    connect_form_t form;
 
-            // Determine authentication type string
-            const char *auth_str;
-            switch (unique_networks[strongest_index].authmode)
+    httpd_query_key_value(buf, "action", action, sizeof(action));
+    httpd_query_key_value(buf, "priority", priority, sizeof(priority));
+    parse_connect_form(buf, &form);
+
+    esp_err_t err;
+    if (strcmp(action, "remove") == 0)
+    {
+        err = wifi_manager_remove_network(wm, form.ssid);
+    }
+    else if (strcmp(action, "add") == 0)
+    {
+        int prio = atoi(priority);
+        err = wifi_manager_add_network(wm, form.ssid, form.password,
+                                       (uint8_t)(prio < 0 ? 0 : (prio > 255 ? 255 : prio)));
+    }
+    else
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown action");
+        return ESP_OK;
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Saved network update failed: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, err == ESP_ERR_NOT_FOUND ? HTTPD_404_NOT_FOUND : HTTPD_400_BAD_REQUEST,
+                            esp_err_to_name(err));
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\"}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Build the /status JSON for the connection attempt started from the portal
+ *
+ * state is one of idle, connecting, connected, failed.
+ * @param wm WiFiManager instance
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @return Length written
+ */
+int format_portal_status(wifi_manager_t *wm, char *buf, size_t size)
+{
+    wifi_config_t wifi_config = {0};
+    esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+
+    // sta.ssid is not terminated when the name takes all 32 bytes
+    char ssid_raw[sizeof(wifi_config.sta.ssid) + 1];
+    memcpy(ssid_raw, wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid));
+    ssid_raw[sizeof(wifi_config.sta.ssid)] = '\0';
+    char ssid[6 * sizeof(wifi_config.sta.ssid) + 1];
+    json_escape(ssid_raw, ssid, sizeof(ssid));
+
+    // Status and address from one snapshot, never from two different updates
+    wifi_manager_state_t snapshot;
+    state_read(wm, &snapshot);
+    char ip[16] = "";
+    if (snapshot.status == WIFI_STATUS_CONNECTED)
+    {
+        esp_ip4_addr_t addr = {.addr = snapshot.ip};
+        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&addr));
+    }
+
+    const char *state = "idle";
+    const char *reason = "";
+    switch (snapshot.status)
+    {
+    case WIFI_STATUS_CONNECTING:
+    case WIFI_STATUS_NO_IP:
+        state = "connecting";
+        break;
+    case WIFI_STATUS_CONNECTED:
+        state = "connected";
+        break;
+    case WIFI_STATUS_DISCONNECTED:
+    case WIFI_STATUS_FAILED:
+        if (wm->portal_connect_attempted)
+        {
+            state = "failed";
+            switch (wm->last_disconnect_reason)
             {
-            case WIFI_AUTH_OPEN:
-                auth_str = "Open";
+            case WIFI_REASON_AUTH_FAIL:
+            case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+            case WIFI_REASON_HANDSHAKE_TIMEOUT:
+                reason = "wrong_password";
                 break;
-            case WIFI_AUTH_WEP:
-                auth_str = "WEP";
-                break;
-            case WIFI_AUTH_WPA_PSK:
-                auth_str = "WPA";
-                break;
-            case WIFI_AUTH_WPA2_PSK:
-                auth_str = "WPA2";
-                break;
-            case WIFI_AUTH_WPA_WPA2_PSK:
-                auth_str = "WPA/WPA2";
-                break;
-            case WIFI_AUTH_WPA3_PSK:
-                auth_str = "WPA3";
-                break;
-            case WIFI_AUTH_WPA2_WPA3_PSK:
-                auth_str = "WPA2/WPA3";
+            case WIFI_REASON_NO_AP_FOUND:
+                reason = "not_found";
                 break;
             default:
-                auth_str = "Open";
+                reason = "connection_failed";
                 break;
             }
-
-            // Calculate signal quality percentage (RSSI to percentage)
-            int quality = 0;
-            if (unique_networks[strongest_index].rssi >= -50)
-            {
-                quality = 100;
-            }
-            else if (unique_networks[strongest_index].rssi >= -60)
-            {
-                quality = 90;
-            }
-            else if (unique_networks[strongest_index].rssi >= -70)
-            {
-                quality = 70;
-            }
-            else if (unique_networks[strongest_index].rssi >= -80)
-            {
-                quality = 50;
-            }
-            else if (unique_networks[strongest_index].rssi >= -90)
-            {
-                quality = 25;
-            }
-            else
-            {
-                quality = 10;
-            }
-
-            offset += snprintf(json_response + offset, 4096 - offset,
-                               "%s{\"ssid\":\"%s\",\"rssi\":%d,\"quality\":%d,\"auth\":\"%s\",\"secure\":%s}",
-                               (output_count > 0) ? "," : "",
-                               unique_networks[strongest_index].ssid,
-                               unique_networks[strongest_index].rssi,
-                               quality,
-                               auth_str,
-                               (unique_networks[strongest_index].authmode == WIFI_AUTH_OPEN) ? "false" : "true");
-            output_count++;
         }
+        break;
+    default:
+        break;
     }
 
-    offset += snprintf(json_response + offset, 4096 - offset,
-                       "],\"scan_completed\":%s,\"count\":%d}",
-                       g_wm->scan_completed ? "true" : "false",
-                       g_wm->scanned_count);
+    return snprintf(buf, size, "{\"state\":\"%s\",\"ssid\":\"%s\",\"ip\":\"%s\",\"reason\":\"%s\"}", state, ssid,
+                    ip, reason);
+}
 
-    ESP_LOGI(TAG, "Sending WiFi JSON response (%d bytes)", offset);
-    httpd_resp_send(req, json_response, offset);
+/**
+ * @brief Handler for the state of the connection attempt started from the portal
+ *
+ * Polled by success.html.
+ */
+esp_err_t status_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
 
-    free(json_response);
-    return ESP_OK;
+    // Set content type to JSON
+    httpd_resp_set_type(req, "application/json");
+
+    char response[STATUS_JSON_SIZE];
+    int len = format_portal_status(wm, response, sizeof(response));
+
+    return httpd_resp_send(req, response, len);
 }
 
 /**
- * @brief Start the HTTP web server
+ * @brief Length written so far, held at the last byte when snprintf truncated
  */
-esp_err_t start_webserver(void)
+static int clamp_len(int len, size_t size)
 {
-    if (!g_wm)
+    return len < (int)size ? len : (int)size - 1;
+}
+
+/**
+ * @brief Handler for link quality statistics as JSON
+ */
+esp_err_t stats_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
+    wifi_manager_link_stats_t stats;
+    wifi_manager_mem_stats_t mem;
+    if (wifi_manager_get_link_stats(wm, &stats) != ESP_OK || wifi_manager_get_mem_stats(wm, &mem) != ESP_OK)
     {
-        ESP_LOGE(TAG, "WiFiManager not initialized");
-        return ESP_FAIL;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "WiFiManager not initialized");
+        return ESP_OK;
     }
 
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.lru_purge_enable = true;
-    config.max_uri_handlers = 16; // Increase from default 8 to accommodate all our handlers
+    wifi_manager_state_t state;
+    state_read(wm, &state);
 
-    if (httpd_start(&g_wm->server, &config) == ESP_OK)
-    {
-        httpd_uri_t setup_uri = {
-            .uri = "/",
-            .method = HTTP_GET,
-            .handler = setup_page_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &setup_uri);
+    // Set content type to JSON
+    httpd_resp_set_type(req, "application/json");
 
-        httpd_uri_t connect_uri = {
-            .uri = "/connect",
-            .method = HTTP_POST,
-            .handler = connect_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &connect_uri);
+    char response[1024];
+    int len = snprintf(response, sizeof(response),
+                       "{\"status\":%d,\"rssi\":%d,\"rssi_avg\":%d,\"rssi_min\":%d,\"rssi_max\":%d,"
+                       "\"rssi_p10\":%d,\"samples\":%u,\"link_quality\":%u,\"connected_ms\":%lu,"
+                       "\"disconnects\":%lu,\"beacon_losses\":%lu,\"beacon_losses_per_hour\":%.2f,",
+                       state.status, stats.rssi_last, stats.rssi_avg, stats.rssi_min, stats.rssi_max,
+                       stats.rssi_p10, stats.sample_count, stats.link_quality, (unsigned long)stats.connected_ms,
+                       (unsigned long)stats.disconnect_count, (unsigned long)stats.beacon_loss_count,
+                       stats.beacon_loss_per_hour);
+    len = clamp_len(len, sizeof(response));
+
+    const wifi_manager_mem_usage_t *usage[] = {&mem.scan, &mem.web, &mem.config};
+    static const char *const usage_names[] = {"scan", "web", "config"};
+    len += snprintf(response + len, sizeof(response) - len, "\"mem\":{\"instance\":%lu,",
+                    (unsigned long)mem.instance_bytes);
+    len = clamp_len(len, sizeof(response));
+    for (size_t i = 0; i < sizeof(usage) / sizeof(usage[0]); i++)
+    {
+        len += snprintf(response + len, sizeof(response) - len, "\"%s\":{\"current\":%lu,\"peak\":%lu,\"allocs\":%lu},",
+                        usage_names[i], (unsigned long)usage[i]->current_bytes,
+                        (unsigned long)usage[i]->peak_bytes, (unsigned long)usage[i]->alloc_count);
+        len = clamp_len(len, sizeof(response));
+    }
+    len += snprintf(response + len, sizeof(response) - len,
+                    "\"stack_free\":{\"scan\":%lu,\"portal\":%lu,\"dns\":%lu,\"httpd\":%lu},"
+                    "\"heap_free\":%lu,\"heap_min_free\":%lu},",
+                    (unsigned long)mem.scan_task_stack_free, (unsigned long)mem.portal_task_stack_free,
+                    (unsigned long)mem.dns_task_stack_free, (unsigned long)mem.httpd_task_stack_free,
+                    (unsigned long)mem.heap_free, (unsigned long)mem.heap_min_free);
+    len = clamp_len(len, sizeof(response));
+
+    // Connection reuse: requests per connection close to the page's request count is good
+    len += snprintf(response + len, sizeof(response) - len,
+                    "\"http\":{\"connections\":%lu,\"requests\":%lu,\"open\":%u,\"open_peak\":%u}}",
+                    (unsigned long)wm->http_sessions, (unsigned long)wm->http_requests, wm->http_open,
+                    wm->http_open_peak);
+    len = clamp_len(len, sizeof(response));
+
+    return httpd_resp_send(req, response, len);
+}
 
-        httpd_uri_t wifi_list_uri = {
-            .uri = "/wifi",
-            .method = HTTP_GET,
-            .handler = wifi_list_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &wifi_list_uri);
+/**
+ * @brief Catch-all for unknown URIs - redirects to the portal while the soft-AP is up
+ *
+ * Covers the OS connectivity checks (Android /generate_204, Apple
+ * /hotspot-detect.html, Windows /connecttest.txt and /ncsi.txt, Firefox
+ * /success.txt, ...): answering them with a redirect makes the OS open its
+ * captive portal sign-in window immediately.
+ */
+esp_err_t captive_redirect_handler(httpd_req_t *req, httpd_err_code_t err)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)httpd_get_global_user_ctx(req->handle);
 
-        // Register static file handlers
-        httpd_uri_t style_css_uri = {
-            .uri = "/style.css",
-            .method = HTTP_GET,
-            .handler = style_css_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &style_css_uri);
+    esp_netif_ip_info_t ip_info;
+    wifi_mode_t mode;
+    if (!wm || !wm->ap_netif || esp_wifi_get_mode(&mode) != ESP_OK || mode == WIFI_MODE_STA ||
+        esp_netif_get_ip_info(wm->ap_netif, &ip_info) != ESP_OK)
+    {
+        // Not running as a portal - plain 404
+        httpd_resp_send_err(req, err, NULL);
+        return ESP_OK;
+    }
 
-        httpd_uri_t script_js_uri = {
-            .uri = "/script.js",
-            .method = HTTP_GET,
-            .handler = script_js_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &script_js_uri);
+    char location[32];
+    snprintf(location, sizeof(location), "http://" IPSTR "/", IP2STR(&ip_info.ip));
 
-        // Register configuration page handler
-        httpd_uri_t config_html_uri = {
-            .uri = "/config.html",
-            .method = HTTP_GET,
-            .handler = config_html_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &config_html_uri);
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", location);
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+}
 
-        // Register configuration handlers
-        httpd_uri_t config_uri = {
-            .uri = "/config",
-            .method = HTTP_GET,
-            .handler = config_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &config_uri);
+/**
+ * @brief The server does not own the instance passed as global_user_ctx
+ */
+static void no_free(void *ctx)
+{
+}
 
-        httpd_uri_t config_save_uri = {
-            .uri = "/config/save",
-            .method = HTTP_POST,
-            .handler = config_save_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &config_save_uri);
+/**
+ * @brief Session open hook - runs in the httpd task, records it for stack accounting
+ * and keeps the streams ahead of the new connection for LRU purge
+ */
+static esp_err_t web_on_open(httpd_handle_t hd, int sockfd)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)httpd_get_global_user_ctx(hd);
+    if (wm)
+    {
+        wm->httpd_task = xTaskGetCurrentTaskHandle();
+        wm->http_sessions++;
+        if (++wm->http_open > wm->http_open_peak)
+        {
+            wm->http_open_peak = wm->http_open;
+        }
+        events_keep_streams(wm, hd);
+    }
+    return ESP_OK;
+}
 
-        // Register device management handlers
-        httpd_uri_t restart_uri = {
-            .uri = "/restart",
-            .method = HTTP_POST,
-            .handler = restart_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &restart_uri);
+// Portal route, registered with itself as user_ctx so web_dispatch() finds the handler
+typedef struct
+{
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *req);
+} web_route_t;
+
+static const web_route_t web_routes[] = {
+    // Pages and their assets
+    {"/", HTTP_GET, setup_page_handler},
+    {"/style.css", HTTP_GET, style_css_handler},
+    {"/script.js", HTTP_GET, script_js_handler},
+    {"/config.html", HTTP_GET, config_html_handler},
+
+    // Portal API
+    {"/connect", HTTP_POST, connect_handler},
+    {"/wifi", HTTP_GET, wifi_list_handler},
+    {"/config", HTTP_GET, config_handler},
+    {"/config/save", HTTP_POST, config_save_handler},
+    {"/status", HTTP_GET, status_handler},
+    {"/events", HTTP_GET, events_handler},
+
+    // Device management
+    {"/restart", HTTP_POST, restart_handler},
+    {"/reset", HTTP_POST, reset_handler},
+    {"/wifi-reset", HTTP_POST, wifi_reset_handler},
+    {"/networks", HTTP_GET, networks_list_handler},
+    {"/networks", HTTP_POST, networks_update_handler},
+    {"/stats", HTTP_GET, stats_handler},
+};
 
-        httpd_uri_t reset_uri = {
-            .uri = "/reset",
-            .method = HTTP_POST,
-            .handler = reset_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &reset_uri);
+/**
+ * @brief Common entry of the portal routes - counts the request and passes the instance on
+ *
+ * Handlers take the instance from req->user_ctx as before. With the session
+ * count from web_on_open(), the request count shows how well browsers reuse
+ * their connections (/stats "http"). Returning ESP_FAIL closes the connection,
+ * so handlers do that only when the request could not be read; error
+ * responses to complete requests return ESP_OK and keep it open.
+ */
+static esp_err_t web_dispatch(httpd_req_t *req)
+{
+    const web_route_t *route = (const web_route_t *)req->user_ctx;
+    wifi_manager_t *wm = (wifi_manager_t *)httpd_get_global_user_ctx(req->handle);
 
-        httpd_uri_t wifi_reset_uri = {
-            .uri = "/wifi-reset",
-            .method = HTTP_POST,
-            .handler = wifi_reset_handler,
-        };
-        httpd_register_uri_handler(g_wm->server, &wifi_reset_uri);
+    wm->http_requests++;
+    req->user_ctx = wm;
+    return route->handler(req);
+}
 
-        ESP_LOGI(TAG, "Web server started on port %d", config.server_port);
-        return ESP_OK;
+/**
+ * @brief Start the HTTP web server
+ * @param wm WiFiManager instance, handed to every handler through req->user_ctx
+ */
+esp_err_t start_webserver(wifi_manager_t *wm)
+{
+    if (!wm)
+    {
+        ESP_LOGE(TAG, "WiFiManager not initialized");
+        return ESP_FAIL;
     }
-    else
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.stack_size = wm->http_config.stack_size;
+    config.task_priority = wm->http_config.task_priority;
+    config.core_id = wm->http_config.core_id;
+    config.server_port = wm->http_config.server_port;
+    config.max_open_sockets = wm->http_config.max_open_sockets;
+    config.backlog_conn = wm->http_config.backlog_conn;
+    config.recv_wait_timeout = wm->http_config.recv_wait_timeout;
+    config.send_wait_timeout = wm->http_config.send_wait_timeout;
+    // Browsers keep their connections open and reuse them; when every socket
+    // is taken, the least recently used one is closed for a new client rather
+    // than making it wait. TCP keep-alive reclaims the sockets of phones that
+    // left the soft-AP without closing them, so they do not hold slots.
+    config.lru_purge_enable = true;
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = HTTP_KEEP_ALIVE_IDLE_S;
+    config.keep_alive_interval = HTTP_KEEP_ALIVE_INTERVAL_S;
+    config.keep_alive_count = HTTP_KEEP_ALIVE_COUNT;
+    config.max_uri_handlers = sizeof(web_routes) / sizeof(web_routes[0]) + 1; // + /ws
+    config.global_user_ctx = wm; // For the error handler, which has no per-URI user_ctx
+    config.global_user_ctx_free_fn = no_free;
+    config.open_fn = web_on_open;
+    config.close_fn = events_on_close; // Forget /events and /ws clients when their socket closes
+
+    wm->http_sessions = 0;
+    wm->http_requests = 0;
+    wm->http_open = 0;
+    wm->http_open_peak = 0;
+
+    if (httpd_start(&wm->server, &config) != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to start web server");
         return ESP_FAIL;
     }
+
+    for (size_t i = 0; i < sizeof(web_routes) / sizeof(web_routes[0]); i++)
+    {
+        httpd_uri_t uri = {
+            .uri = web_routes[i].uri,
+            .method = web_routes[i].method,
+            .handler = web_dispatch,
+            .user_ctx = (void *)&web_routes[i],
+        };
+        httpd_register_uri_handler(wm->server, &uri);
+    }
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    // Called per frame, so not counted as requests
+    httpd_uri_t ws_uri = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = wm,
+        .is_websocket = true,
+    };
+    httpd_register_uri_handler(wm->server, &ws_uri);
+#endif
+
+    // Everything else (connectivity checks, typed-in URLs) goes to the portal
+    httpd_register_err_handler(wm->server, HTTPD_404_NOT_FOUND, captive_redirect_handler);
+
+    ESP_LOGI(TAG, "Web server started on port %d", config.server_port);
+    return ESP_OK;
 }
 
 /**
  * @brief Stop the HTTP web server
+ * @param wm WiFiManager instance owning the server
  */
-void stop_webserver(void)
+void stop_webserver(wifi_manager_t *wm)
 {
-    if (g_wm && g_wm->server)
+    if (wm && wm->server)
     {
         ESP_LOGI(TAG, "Stopping web server");
-        httpd_stop(g_wm->server);
-        g_wm->server = NULL;
+        httpd_stop(wm->server);
+        wm->server = NULL;
+        wm->httpd_task = NULL;
     }
 }
 
 /**
- * @brief Handler for configuration parameters JSON API
+ * @brief Build the /config JSON describing the custom configuration parameters
+ * @param wm WiFiManager instance
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @return Length written
  */
-esp_err_t config_handler(httpd_req_t *req)
+int format_config_params(wifi_manager_t *wm, char *buf, size_t size)
 {
-    ESP_LOGI(TAG, "Configuration parameters requested");
-
-    if (!g_wm)
-    {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "WiFiManager not initialized");
-        return ESP_FAIL;
-    }
-
-    // Set content type to JSON
-    httpd_resp_set_type(req, "application/json");
-
-    // Allocate buffer for JSON response
-    char *json_response = malloc(4096);
-    if (!json_response)
-    {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
-    }
-
-    int offset = snprintf(json_response, 4096, "{\"parameters\":[");
+    int offset = clamp_len(snprintf(buf, size, "{\"parameters\":["), size);
 
+#ifdef CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
     // Add all configuration parameters
-    for (int i = 0; i < g_wm->config_param_count; i++)
+    for (int i = 0; i < wm->config_param_count; i++)
     {
-        config_param_t *param = &g_wm->config_params[i];
+        config_param_t *param = &wm->config_params[i];
 
         const char *type_str;
         switch (param->type)
@@ -563,7 +995,7 @@ esp_err_t config_handler(httpd_req_t *req)
             break;
         }
 
-        offset += snprintf(json_response + offset, 4096 - offset,
+        offset += snprintf(buf + offset, size - offset,
                            "%s{\"key\":\"%s\",\"label\":\"%s\",\"type\":\"%s\",\"value\":\"%s\",\"placeholder\":\"%s\",\"required\":%s}",
                            (i > 0) ? "," : "",
                            param->key,
@@ -572,52 +1004,62 @@ esp_err_t config_handler(httpd_req_t *req)
                            param->value,
                            param->placeholder,
                            param->required ? "true" : "false");
+        offset = clamp_len(offset, size);
     }
+#endif
 
-    offset += snprintf(json_response + offset, 4096 - offset, "]}");
-
-    ESP_LOGI(TAG, "Sending config JSON response (%d bytes)", offset);
-    httpd_resp_send(req, json_response, offset);
-
-    free(json_response);
-    return ESP_OK;
+    offset += snprintf(buf + offset, size - offset, "]}");
+    offset = clamp_len(offset, size);
+    return offset;
 }
 
 /**
- * @brief Handler for saving configuration parameters
+ * @brief Handler for configuration parameters JSON API
  */
-esp_err_t config_save_handler(httpd_req_t *req)
+esp_err_t config_handler(httpd_req_t *req)
 {
-    char buf[2048];
-    int ret, remaining = req->content_len;
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
 
-    if (remaining >= sizeof(buf))
+    ESP_LOGI(TAG, "Configuration parameters requested");
+
+    if (!wm)
     {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request too large");
-        return ESP_FAIL;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "WiFiManager not initialized");
+        return ESP_OK;
     }
 
-    // Read the request body
-    int total_read = 0;
-    while (remaining > 0 && total_read < sizeof(buf) - 1)
+    // Set content type to JSON
+    httpd_resp_set_type(req, "application/json");
+
+    // Allocate buffer for JSON response
+    char *json_response = mem_alloc(MEM_WEB, CONFIG_JSON_SIZE);
+    if (!json_response)
     {
-        if ((ret = httpd_req_recv(req, buf + total_read, remaining)) <= 0)
-        {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
-            {
-                continue;
-            }
-            return ESP_FAIL;
-        }
-        remaining -= ret;
-        total_read += ret;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
+        return ESP_OK;
     }
-    buf[total_read] = '\0';
 
-    ESP_LOGI(TAG, "Received config data: %s", buf);
+    perf_mark_t perf;
+    perf_begin(&perf);
+    int offset = format_config_params(wm, json_response, CONFIG_JSON_SIZE);
+    perf_end(&perf, "/config JSON");
 
-    // Parse form data and update configuration parameters
-    char *token = strtok(buf, "&");
+    ESP_LOGI(TAG, "Sending config JSON response (%d bytes)", offset);
+    httpd_resp_send(req, json_response, offset);
+
+    mem_free(MEM_WEB, json_response);
+    return ESP_OK;
+}
+
+/**
+ * @brief Apply a URL-encoded form of configuration parameters and save them
+ * @param wm WiFiManager instance
+ * @param form key=value&... string, modified in place
+ * @return ESP_OK when saved, ESP_ERR_NOT_FOUND if no known parameter was in the form
+ */
+esp_err_t apply_config_form(wifi_manager_t *wm, char *form)
+{
+    char *token = strtok(form, "&");
     bool config_updated = false;
 
     while (token != NULL)
@@ -653,7 +1095,7 @@ esp_err_t config_save_handler(httpd_req_t *req)
             decoded_value[decoded_len] = '\0';
 
             // Update the configuration parameter
-            if (set_config_parameter(g_wm, key, decoded_value) == ESP_OK)
+            if (set_config_parameter(wm, key, decoded_value) == ESP_OK)
             {
                 config_updated = true;
             }
@@ -661,48 +1103,127 @@ esp_err_t config_save_handler(httpd_req_t *req)
         token = strtok(NULL, "&");
     }
 
-    if (config_updated)
+    if (!config_updated)
     {
-        // Save configuration to NVS
-        esp_err_t err = save_config_parameters(g_wm);
-        if (err == ESP_OK)
-        {
-            ESP_LOGI(TAG, "Configuration saved successfully");
+        return ESP_ERR_NOT_FOUND;
+    }
 
-            // Send success response
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"Configuration saved\"}", -1);
-        }
-        else
+    // Save configuration to NVS
+    return save_config_parameters(wm);
+}
+
+/**
+ * @brief Handler for saving configuration parameters
+ */
+esp_err_t config_save_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
+    char buf[CONFIG_FORM_MAX_SIZE];
+    int ret, remaining = req->content_len;
+
+    if (remaining >= sizeof(buf))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request too large");
+        return ESP_FAIL;
+    }
+
+    // Read the request body
+    int total_read = 0;
+    while (remaining > 0 && total_read < sizeof(buf) - 1)
+    {
+        if ((ret = httpd_req_recv(req, buf + total_read, remaining)) <= 0)
         {
-            ESP_LOGE(TAG, "Failed to save configuration: %s", esp_err_to_name(err));
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save configuration");
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
+                continue;
+            }
             return ESP_FAIL;
         }
+        remaining -= ret;
+        total_read += ret;
     }
-    else
+    buf[total_read] = '\0';
+
+    ESP_LOGI(TAG, "Received config data: %s", buf);
+
+    // Parse form data and update configuration parameters
+    esp_err_t err = apply_config_form(wm, buf);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Configuration saved successfully");
+
+        // Send success response
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"Configuration saved\"}", -1);
+    }
+    else if (err == ESP_ERR_NOT_FOUND)
     {
         ESP_LOGW(TAG, "No configuration parameters were updated");
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(req, "{\"status\":\"warning\",\"message\":\"No changes detected\"}", -1);
     }
+    else
+    {
+        ESP_LOGE(TAG, "Failed to save configuration: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save configuration");
+        return ESP_OK;
+    }
 
     return ESP_OK;
 }
 
+/**
+ * @brief Deferred restart - runs in the timer task
+ */
+void restart_timer_callback(TimerHandle_t xTimer)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)pvTimerGetTimerID(xTimer);
+
+    if (wm->restart_disconnect)
+    {
+        // Stop STA mode; the device will start the config portal due to no saved credentials
+        wm->suppress_reconnect = true;
+        esp_wifi_disconnect();
+        update_status(wm, WIFI_STATUS_DISCONNECTED);
+    }
+
+    esp_restart();
+}
+
+/**
+ * @brief Restart the device after WIFI_MANAGER_RESTART_DELAY_MS
+ *
+ * The handler returns at once so the httpd task keeps serving (and flushes
+ * the reply) while the restart is pending.
+ * @param wm WiFiManager instance
+ * @param disconnect true to disconnect from WiFi before restarting
+ * @return ESP_OK if the restart is scheduled
+ */
+esp_err_t schedule_restart(wifi_manager_t *wm, bool disconnect)
+{
+    wm->restart_disconnect = disconnect;
+    if (xTimerStart(wm->restart_timer, 0) != pdPASS)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 /**
  * @brief Handler for device restart requests
  */
 esp_err_t restart_handler(httpd_req_t *req)
 {
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
     ESP_LOGI(TAG, "Device restart requested");
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"Device restarting...\"}", -1);
 
     // Restart after a brief delay to allow response to be sent
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    esp_restart();
+    schedule_restart(wm, false);
 
     return ESP_OK;
 }
@@ -712,23 +1233,24 @@ esp_err_t restart_handler(httpd_req_t *req)
  */
 esp_err_t reset_handler(httpd_req_t *req)
 {
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
     ESP_LOGI(TAG, "Factory reset requested");
 
     httpd_resp_set_type(req, "application/json");
 
     // Erase WiFi configuration
-    esp_err_t wifi_err = wifi_manager_erase_config(g_wm);
+    esp_err_t wifi_err = wifi_manager_erase_config(wm);
 
     // Reset configuration parameters to defaults
-    esp_err_t config_err = reset_config_parameters(g_wm);
+    esp_err_t config_err = reset_config_parameters(wm);
 
     if (wifi_err == ESP_OK && config_err == ESP_OK)
     {
         httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"Settings reset. Device will restart.\"}", -1);
 
         // Restart after a brief delay
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        esp_restart();
+        schedule_restart(wm, false);
     }
     else
     {
@@ -745,26 +1267,21 @@ esp_err_t reset_handler(httpd_req_t *req)
  */
 esp_err_t wifi_reset_handler(httpd_req_t *req)
 {
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
     ESP_LOGI(TAG, "WiFi reset requested");
 
     httpd_resp_set_type(req, "application/json");
 
     // Only erase WiFi configuration, keep device configuration
-    esp_err_t wifi_err = wifi_manager_erase_config(g_wm);
+    esp_err_t wifi_err = wifi_manager_erase_config(wm);
 
     if (wifi_err == ESP_OK)
     {
         httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"WiFi settings reset. Returning to setup mode.\"}", -1);
 
         // Disconnect from current WiFi and restart in AP mode after a brief delay
-        vTaskDelay(pdMS_TO_TICKS(1000));
-
-        // Stop STA mode and start AP mode
-        esp_wifi_disconnect();
-        update_status(WIFI_STATUS_DISCONNECTED);
-
-        // The device will automatically start the config portal due to no saved credentials
-        esp_restart();
+        schedule_restart(wm, true);
     }
     else
     {
@@ -773,4 +1290,4 @@ esp_err_t wifi_reset_handler(httpd_req_t *req)
     }
 
     return ESP_OK;
-}
\ No newline at end of file
+}
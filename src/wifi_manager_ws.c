@@ -0,0 +1,271 @@
+/**
+ * @file wifi_manager_ws.c
+ * @brief WebSocket control channel (/ws) for the portal
+ * @version 2.0.0
+ * @date 2025-09-21
+ * @author Peter Stangsdal
+ *
+ * One socket carries everything the portal pages otherwise do with separate
+ * requests. Messages are text frames of the form "<type>[ <payload>]":
+ *
+ *   client -> device                 device -> client
+ *   wifi                             wifi {.../wifi JSON...}
+ *   scan                             scan {"started":true|false}
+ *   status                           status {.../status JSON...}
+ *   config                           config {.../config JSON...}
+ *   save key=value&...               save {"status":"success|warning|error"}
+ *   connect ssid=...&password=...    connect {"status":"success"}
+ *   restart | reset | wifi-reset     <same type> {"status":"success|error"}
+ *                                    error {"message":"..."}
+ *
+ * Request payloads are URL-encoded forms like the REST routes take. "status"
+ * and "wifi" are also pushed unsolicited on status changes and finished scans
+ * (see wifi_manager_events.c). The REST routes stay for compatibility.
+ */
+
+#include "wifi_manager_private.h"
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+#define WS_MAX_REQUEST_SIZE (sizeof("save ") - 1 + CONFIG_FORM_MAX_SIZE) // Longest client message, a config form
+
+/**
+ * @brief Send one text message on the request's socket
+ */
+static esp_err_t ws_send(httpd_req_t *req, const char *text, int len)
+{
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)text,
+        .len = len,
+    };
+    return httpd_ws_send_frame(req, &frame);
+}
+
+/**
+ * @brief Send "<type> {"status":"..."}"
+ */
+static esp_err_t ws_send_result(httpd_req_t *req, const char *type, const char *status)
+{
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%s {\"status\":\"%s\"}", type, status);
+    return ws_send(req, buf, len);
+}
+
+/**
+ * @brief Send a message built by one of the shared JSON formatters
+ * @param type Message type prefix
+ * @param size Buffer size the formatter needs
+ */
+static esp_err_t ws_send_formatted(httpd_req_t *req, wifi_manager_t *wm, const char *type,
+                                   int (*format)(wifi_manager_t *, char *, size_t), size_t size)
+{
+    size_t prefix = strlen(type) + 1;
+    char *buf = mem_alloc(MEM_WEB, prefix + size);
+    if (!buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(buf, type, prefix - 1);
+    buf[prefix - 1] = ' ';
+    int len = prefix + format(wm, buf + prefix, size);
+
+    esp_err_t err = ws_send(req, buf, len);
+    mem_free(MEM_WEB, buf);
+    return err;
+}
+
+/**
+ * @brief Handle "connect ssid=...&password=..."
+ */
+static esp_err_t ws_connect(httpd_req_t *req, wifi_manager_t *wm, const char *form)
+{
+    connect_form_t fields;
+    if (!parse_connect_form(form, &fields))
+    {
+        return ws_send_result(req, "connect", "error");
+    }
+
+    ESP_LOGI(TAG, "Received WiFi credentials over WebSocket - SSID: %s", fields.ssid);
+
+    // Result follows as "status" pushes, same as the success page polling /status
+    ws_send_result(req, "connect", "success");
+    defer_portal_connect(wm, fields.ssid, fields.password);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handle "restart", "reset" and "wifi-reset"
+ */
+static esp_err_t ws_device_action(httpd_req_t *req, wifi_manager_t *wm, const char *type)
+{
+    esp_err_t err = ESP_OK;
+
+    if (strcmp(type, "restart") != 0)
+    {
+        err = wifi_manager_erase_config(wm);
+        if (err == ESP_OK && strcmp(type, "reset") == 0)
+        {
+            err = reset_config_parameters(wm);
+        }
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s failed: %s", type, esp_err_to_name(err));
+        return ws_send_result(req, type, "error");
+    }
+
+    ESP_LOGI(TAG, "Device %s requested over WebSocket", type);
+    ws_send_result(req, type, "success");
+
+    // Restart after a brief delay to allow the reply to be sent
+    return schedule_restart(wm, strcmp(type, "wifi-reset") == 0);
+}
+
+/**
+ * @brief Remember a new WebSocket client for status and scan pushes
+ * @return false if all slots are taken or the sockets are needed for plain requests
+ */
+static bool ws_add_client(wifi_manager_t *wm, int fd)
+{
+    if (!events_stream_allowed(wm))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (wm->ws_fds[i] < 0)
+        {
+            wm->ws_fds[i] = fd;
+            wm->ws_client_count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Run one "<type> <payload>" command from a client
+ * @param buf NUL terminated message, split in place
+ */
+static esp_err_t ws_dispatch(httpd_req_t *req, wifi_manager_t *wm, char *buf)
+{
+    // Split "<type> <payload>"
+    char *payload = strchr(buf, ' ');
+    if (payload)
+    {
+        *payload++ = '\0';
+    }
+    else
+    {
+        payload = "";
+    }
+    const char *type = buf;
+
+    if (strcmp(type, "wifi") == 0)
+    {
+        return ws_send_formatted(req, wm, type, format_wifi_list, WIFI_LIST_JSON_SIZE);
+    }
+    if (strcmp(type, "status") == 0)
+    {
+        return ws_send_formatted(req, wm, type, format_portal_status, STATUS_JSON_SIZE);
+    }
+    if (strcmp(type, "config") == 0)
+    {
+        return ws_send_formatted(req, wm, type, format_config_params, CONFIG_JSON_SIZE);
+    }
+    if (strcmp(type, "scan") == 0)
+    {
+        // Results follow as a "wifi" push when the scan completes
+        bool started = (wm->scan_task_handle != NULL);
+        if (started)
+        {
+            trigger_wifi_scan(wm);
+        }
+        char reply[32];
+        int len = snprintf(reply, sizeof(reply), "scan {\"started\":%s}", started ? "true" : "false");
+        return ws_send(req, reply, len);
+    }
+    if (strcmp(type, "save") == 0)
+    {
+        esp_err_t err = apply_config_form(wm, payload);
+        return ws_send_result(req, type, err == ESP_OK ? "success" : (err == ESP_ERR_NOT_FOUND ? "warning" : "error"));
+    }
+    if (strcmp(type, "connect") == 0)
+    {
+        return ws_connect(req, wm, payload);
+    }
+    if (strcmp(type, "restart") == 0 || strcmp(type, "reset") == 0 || strcmp(type, "wifi-reset") == 0)
+    {
+        return ws_device_action(req, wm, type);
+    }
+
+    static const char unknown[] = "error {\"message\":\"unknown command\"}";
+    return ws_send(req, unknown, sizeof(unknown) - 1);
+}
+
+/**
+ * @brief Handler for the /ws control channel
+ *
+ * Called once for the handshake (HTTP_GET) and then once per received frame.
+ */
+esp_err_t ws_handler(httpd_req_t *req)
+{
+    wifi_manager_t *wm = (wifi_manager_t *)req->user_ctx;
+
+    if (req->method == HTTP_GET)
+    {
+        if (!ws_add_client(wm, httpd_req_to_sockfd(req)))
+        {
+            // The handshake is already answered: say why before closing, the page then
+            // falls back to /events and REST
+            uint8_t code[2] = {WS_CLOSE_TRY_AGAIN >> 8, WS_CLOSE_TRY_AGAIN & 0xff};
+            httpd_ws_frame_t close_frame = {.type = HTTPD_WS_TYPE_CLOSE, .payload = code, .len = sizeof(code)};
+            httpd_ws_send_frame(req, &close_frame);
+            ESP_LOGW(TAG, "Too many WebSocket clients");
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "WebSocket client connected (%d/%d)", wm->ws_client_count, WS_MAX_CLIENTS);
+        return ESP_OK;
+    }
+
+    httpd_ws_frame_t frame = {0};
+
+    // Read the header first to learn the length
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (frame.type != HTTPD_WS_TYPE_TEXT || frame.len == 0)
+    {
+        return ESP_OK; // Control frames are handled by the server
+    }
+    if (frame.len >= WS_MAX_REQUEST_SIZE)
+    {
+        ESP_LOGW(TAG, "WebSocket message too large (%d bytes)", (int)frame.len);
+        return ESP_FAIL;
+    }
+
+    char *buf = mem_alloc(MEM_WEB, frame.len + 1);
+    if (!buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    frame.payload = (uint8_t *)buf;
+    err = httpd_ws_recv_frame(req, &frame, frame.len);
+    if (err == ESP_OK)
+    {
+        buf[frame.len] = '\0';
+        err = ws_dispatch(req, wm, buf);
+    }
+    mem_free(MEM_WEB, buf);
+    return err;
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
@@ -0,0 +1,25 @@
+/**
+ * @file sdkconfig.h
+ * @brief Host test configuration: every component option on, Kconfig defaults
+ */
+
+#pragma once
+
+#define CONFIG_WIFI_MANAGER_SCAN_TASK 1
+#define CONFIG_WIFI_MANAGER_SCAN_TASK_STACK_SIZE 4096
+#define CONFIG_WIFI_MANAGER_PORTAL 1
+#define CONFIG_WIFI_MANAGER_PORTAL_TASK_STACK_SIZE 3072
+#define CONFIG_WIFI_MANAGER_DNS_TASK_STACK_SIZE 3072
+#define CONFIG_WIFI_MANAGER_WEB_MINIFY 1
+#define CONFIG_WIFI_MANAGER_WEB_INLINE_CSS_MAX 1024
+#define CONFIG_WIFI_MANAGER_CUSTOM_PARAMS 1
+#define CONFIG_WIFI_MANAGER_MQTT_DEFAULT_PARAMS 1
+#define CONFIG_WIFI_MANAGER_MAX_CONFIG_PARAMS 16
+#define CONFIG_WIFI_MANAGER_CONFIG_STRING_LEN 128
+#define CONFIG_WIFI_MANAGER_MAX_SCANNED_NETWORKS 20
+#define CONFIG_WIFI_MANAGER_LEGACY_API 1
+#define CONFIG_WIFI_MANAGER_SIZE_BUDGET_FLASH 0
+#define CONFIG_WIFI_MANAGER_SIZE_BUDGET_RAM 0
+
+// esp_http_server
+#define CONFIG_HTTPD_WS_SUPPORT 1
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_netif.h"
+
+/**
+ * @brief The lwIP netif behind an esp_netif, for the calls in lwip/etharp.h
+ */
+void *esp_netif_get_netif_impl(esp_netif_t *esp_netif);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Counted instead of restarting, see fake_system.h
+void esp_restart(void);
@@ -0,0 +1,29 @@
+/**
+ * @file fake_httpd.h
+ * @brief Control interface of the esp_http_server fake
+ *
+ * The server listens on 127.0.0.1. A privileged port such as 80 is replaced
+ * by an ephemeral one, so tests ask for the port they can connect to.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Port of the running server, 0 if none
+ */
+uint16_t fake_httpd_port(void);
+
+typedef struct
+{
+    unsigned sessions;   // Connections accepted
+    unsigned requests;   // Requests and WebSocket frames handed to handlers
+    unsigned purged;     // Sessions closed by lru_purge_enable for a new client
+    unsigned open_peak;  // Most sessions open at once
+} fake_httpd_stats_t;
+
+/**
+ * @brief Counters of the running server (zero if none)
+ */
+void fake_httpd_get_stats(fake_httpd_stats_t *stats);
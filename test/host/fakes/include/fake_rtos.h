@@ -0,0 +1,81 @@
+/**
+ * @file fake_rtos.h
+ * @brief Control interface of the host FreeRTOS fake
+ *
+ * FAKE_CLOCK_VIRTUAL adopts the calling thread as task "main" (priority 1) and
+ * advances time straight to the next deadline whenever no task is ready, so a
+ * run of minutes of device time takes milliseconds and repeats exactly.
+ * FAKE_CLOCK_REALTIME follows CLOCK_MONOTONIC; the calling thread stays outside
+ * the scheduler like a second core, which is what tests with real sockets need.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    FAKE_CLOCK_REALTIME,
+    FAKE_CLOCK_VIRTUAL,
+} fake_clock_t;
+
+/**
+ * @brief Start the scheduler; call once before any other FreeRTOS function
+ */
+void fake_rtos_init(fake_clock_t clock);
+
+fake_clock_t fake_rtos_clock(void);
+
+/**
+ * @brief Microseconds since fake_rtos_init() on the scheduler clock
+ */
+int64_t fake_rtos_now_us(void);
+
+/**
+ * @brief Let the system run for a while (vTaskDelay from a task, a sleep outside)
+ */
+void fake_rtos_run_for_ms(uint32_t ms);
+
+/**
+ * @brief Whether the calling thread is a scheduled task
+ */
+bool fake_rtos_in_task(void);
+
+/**
+ * @brief Name the calling thread outside the scheduler (httpd, test clients)
+ */
+void fake_rtos_register_thread(const char *name, uint32_t stack_depth);
+
+/**
+ * @brief Release the CPU around a blocking system call made from a task
+ */
+void fake_rtos_syscall_begin(void);
+void fake_rtos_syscall_end(void);
+
+/**
+ * @brief Run fn(arg) after delay_us in the "wifi" driver task (priority 23)
+ *
+ * Used by the driver fakes for work the radio would do asynchronously.
+ * @return Id for fake_rtos_cancel(), never 0
+ */
+uint32_t fake_rtos_call_later(int64_t delay_us, void (*fn)(void *arg), void *arg);
+bool fake_rtos_cancel(uint32_t id);
+
+/**
+ * @brief Make the next creation of a task, timer or semaphore fail
+ * @param countdown Creations that still succeed first; -1 disables
+ */
+void fake_rtos_fail_create_after(int countdown);
+
+/**
+ * @brief Live objects, for leak checks after wifi_manager_destroy()
+ */
+typedef struct
+{
+    unsigned tasks;      // Tasks created with xTaskCreate and not yet deleted
+    unsigned timers;     // Timers not yet deleted
+    unsigned semaphores; // Semaphores not yet deleted
+} fake_rtos_counts_t;
+
+void fake_rtos_get_counts(fake_rtos_counts_t *counts);
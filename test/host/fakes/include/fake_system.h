@@ -0,0 +1,67 @@
+/**
+ * @file fake_system.h
+ * @brief Control interface of the esp_system, heap and log fakes
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FAKE_HEAP_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief esp_restart() calls so far
+ */
+unsigned fake_system_restart_count(void);
+
+/**
+ * @brief Bytes allocated with malloc by all threads of the process
+ */
+size_t fake_heap_used(void);
+
+/**
+ * @brief Leave the calling thread's allocations out of the heap, e.g. a benchmark client
+ *
+ * Its blocks must not be freed by other threads. No effect under AddressSanitizer.
+ */
+void fake_heap_ignore_thread(void);
+
+/**
+ * @brief Leave the calling thread's allocations out of the heap until unpaused
+ *
+ * For libc calls that allocate on one thread and free on another, such as the
+ * TLS block pthread_create() keeps with its cached stacks.
+ */
+void fake_heap_pause(bool paused);
+
+/**
+ * @brief Make an allocation of the calling thread fail, once
+ * @param countdown Allocations that still succeed first; -1 disables
+ * @return false under AddressSanitizer, whose allocator is not wrapped
+ */
+bool fake_heap_fail_after(int countdown);
+
+/**
+ * @brief Update the minimum free heap; also sampled on every heap_caps query
+ */
+void fake_heap_sample(void);
+
+/**
+ * @brief Restart the minimum free heap from the current value
+ */
+void fake_heap_reset_minimum(void);
+
+/**
+ * @brief Called with every log line whatever the level, e.g. for debug probes (NULL to remove)
+ *
+ * Runs under the log lock: the hook must not log.
+ */
+typedef void (*fake_log_hook_t)(const char *line, void *ctx);
+void fake_log_set_hook(fake_log_hook_t hook, void *ctx);
+
+/**
+ * @brief Erase the in-memory NVS and mark it uninitialized
+ */
+void fake_nvs_reset(void);
@@ -0,0 +1,111 @@
+/**
+ * @file fake_wifi.h
+ * @brief The radio world simulated behind the esp_wifi and esp_netif fakes
+ *
+ * Access points are added with fake_wifi_add_ap(). The driver answers scans,
+ * associations and DHCP with WIFI_EVENT / IP_EVENT posts on the scheduler
+ * clock, using the timings below, so the component sees the same event order
+ * as on the device.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_wifi.h"
+
+#define FAKE_WIFI_MAX_APS 16
+
+typedef struct
+{
+    const char *ssid;         // Networks with the same SSID share the IP subnet (roaming keeps the lease)
+    uint8_t bssid[6];         // All zero: derived from the AP index
+    uint8_t channel;          // 0: channel 1
+    wifi_auth_mode_t authmode;
+    const char *password;     // NULL or "" for an open network
+    int8_t rssi;              // As seen by the station
+    bool hidden;              // SSID not broadcast
+    uint32_t dhcp_ms;         // DHCP exchange after association, 0: fake_wifi_timing_t.dhcp_ms
+} fake_ap_config_t;
+
+typedef struct
+{
+    uint32_t scan_channel_ms; // Active dwell per channel when the scan config leaves it 0
+    uint32_t scan_dwell_cap_ms; // Upper bound on the dwell the scan config asks for, 0: none
+    uint32_t assoc_ms;        // Authentication and association of a reachable AP
+    uint32_t auth_fail_ms;    // Until a wrong password is reported (4-way handshake timeout)
+    uint32_t dhcp_ms;         // DHCP exchange after association
+    uint32_t beacon_timeout_ms; // Until a vanished AP is reported as BEACON_TIMEOUT
+} fake_wifi_timing_t;
+
+typedef struct
+{
+    unsigned scans;          // Scans started
+    unsigned connects;       // esp_wifi_connect() calls accepted
+    unsigned connected;      // Associations
+    unsigned disconnects;    // STA_DISCONNECTED events
+    unsigned dhcp_starts;    // DHCP client starts on the station netif
+    unsigned dhcp_leases;    // Leases handed out
+} fake_wifi_stats_t;
+
+/**
+ * @brief Remove all APs, reset timings, counters and driver state
+ *
+ * Only between tests, with the component destroyed.
+ */
+void fake_wifi_reset(void);
+
+/**
+ * @return AP index for the other calls
+ */
+int fake_wifi_add_ap(const fake_ap_config_t *config);
+
+/**
+ * @brief Change the signal the station sees; below -95 dBm the AP is out of range
+ */
+void fake_wifi_set_rssi(int ap, int8_t rssi);
+
+/**
+ * @brief Switch an AP off (beacon timeout when associated) or back on
+ */
+void fake_wifi_set_ap_up(int ap, bool up);
+
+/**
+ * @brief Fail the next association attempts with the given reason
+ */
+void fake_wifi_fail_connects(unsigned count, wifi_err_reason_t reason);
+
+/**
+ * @brief Drop the association as if the AP deauthenticated the station
+ */
+void fake_wifi_drop_link(wifi_err_reason_t reason);
+
+/**
+ * @brief Let the DHCP server of an AP's network stop answering (or answer again)
+ */
+void fake_wifi_set_dhcp_up(int ap, bool up);
+
+/**
+ * @brief Address the DHCP server of an AP's network hands out (network byte order)
+ */
+uint32_t fake_wifi_lease_ip(int ap);
+
+void fake_wifi_get_timing(fake_wifi_timing_t *timing);
+void fake_wifi_set_timing(const fake_wifi_timing_t *timing);
+void fake_wifi_get_stats(fake_wifi_stats_t *stats);
+
+/**
+ * @brief AP the station is associated with, -1 if none
+ */
+int fake_wifi_connected_ap(void);
+
+/**
+ * @brief Address currently configured on the station netif (network byte order, 0 if none)
+ */
+uint32_t fake_netif_sta_ip(void);
+
+/**
+ * @brief Another host on the station's network holds this address and answers ARP for it
+ * @param ip Network byte order, 0 for none
+ */
+void fake_netif_set_ip_in_use(uint32_t ip);
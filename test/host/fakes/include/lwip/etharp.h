@@ -0,0 +1,36 @@
+/**
+ * @file etharp.h
+ * @brief The lwIP ARP calls used to probe an address, answered by the netif fake
+ *
+ * Built as lwIP with address conflict detection (LWIP_ACD), which exports the
+ * RFC 5227 probe. A probe for the address set with fake_netif_set_ip_in_use()
+ * is answered a few milliseconds later; the answer stays in the table until the link goes
+ * down, as etharp_cleanup_netif() does.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LWIP_ACD 1
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_IF -12
+
+typedef struct ip4_addr
+{
+    uint32_t addr;
+} ip4_addr_t;
+
+struct eth_addr
+{
+    uint8_t addr[6];
+};
+
+struct netif;
+
+err_t etharp_acd_probe(struct netif *netif, const ip4_addr_t *ipaddr);
+ssize_t etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr **eth_ret,
+                         const ip4_addr_t **ip_ret);
@@ -0,0 +1,27 @@
+/**
+ * @file sockets.h
+ * @brief lwIP sockets on the host socket API
+ *
+ * recvfrom() and bind() are wrapped (fakes/src/lwip.c): a blocking receive
+ * releases the fake CPU, on the virtual clock it polls in 10 ms task delays
+ * up to SO_RCVTIMEO, and privileged ports are bound to an ephemeral port.
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+ssize_t fake_lwip_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *from, socklen_t *fromlen);
+int fake_lwip_bind(int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+/**
+ * @brief Host port a socket bound to the requested (privileged) port got, 0 if none
+ */
+unsigned short fake_lwip_bound_port(unsigned short requested);
+
+#define recvfrom fake_lwip_recvfrom
+#define bind fake_lwip_bind
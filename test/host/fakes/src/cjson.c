@@ -0,0 +1,554 @@
+/**
+ * @file cjson.c
+ * @brief Small cJSON replacement for the host build (the IDF component is not available)
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+
+static cJSON *item_new(int type)
+{
+    cJSON *item = calloc(1, sizeof(*item));
+    if (item)
+    {
+        item->type = type;
+    }
+    return item;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while (item)
+    {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_CreateObject(void)
+{
+    return item_new(cJSON_Object);
+}
+
+cJSON *cJSON_CreateArray(void)
+{
+    return item_new(cJSON_Array);
+}
+
+static void append_child(cJSON *parent, cJSON *item)
+{
+    if (!parent->child)
+    {
+        parent->child = item;
+        item->prev = item; // cJSON keeps the last child in child->prev
+        return;
+    }
+    cJSON *last = parent->child->prev;
+    last->next = item;
+    item->prev = last;
+    parent->child->prev = item;
+}
+
+static cJSON *add_to_object(cJSON *object, const char *name, cJSON *item)
+{
+    if (!object || !name || !item)
+    {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    item->string = strdup(name);
+    append_child(object, item);
+    return item;
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string)
+{
+    cJSON *item = item_new(cJSON_String);
+    if (item)
+    {
+        item->valuestring = strdup(string ? string : "");
+    }
+    return add_to_object(object, name, item);
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number)
+{
+    cJSON *item = item_new(cJSON_Number);
+    if (item)
+    {
+        item->valuedouble = number;
+        item->valueint = (int)number;
+    }
+    return add_to_object(object, name, item);
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name, cJSON_bool boolean)
+{
+    return add_to_object(object, name, item_new(boolean ? cJSON_True : cJSON_False));
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item)
+{
+    if (!array || !item)
+    {
+        return 0;
+    }
+    append_child(array, item);
+    return 1;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string)
+{
+    if (!object || !string)
+    {
+        return NULL;
+    }
+    for (cJSON *item = object->child; item; item = item->next)
+    {
+        if (item->string && strcasecmp(item->string, string) == 0)
+        {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+int cJSON_GetArraySize(const cJSON *array)
+{
+    int count = 0;
+    for (cJSON *item = array ? array->child : NULL; item; item = item->next)
+    {
+        count++;
+    }
+    return count;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index)
+{
+    cJSON *item = array ? array->child : NULL;
+    while (item && index-- > 0)
+    {
+        item = item->next;
+    }
+    return item;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item)
+{
+    return item && (item->type & 0xFF) == cJSON_String;
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item)
+{
+    return item && (item->type & 0xFF) == cJSON_Number;
+}
+
+cJSON_bool cJSON_IsBool(const cJSON *item)
+{
+    return item && (item->type & (cJSON_True | cJSON_False)) != 0;
+}
+
+cJSON_bool cJSON_IsTrue(const cJSON *item)
+{
+    return item && (item->type & 0xFF) == cJSON_True;
+}
+
+cJSON_bool cJSON_IsArray(const cJSON *item)
+{
+    return item && (item->type & 0xFF) == cJSON_Array;
+}
+
+cJSON_bool cJSON_IsObject(const cJSON *item)
+{
+    return item && (item->type & 0xFF) == cJSON_Object;
+}
+
+/* ==========================================
+ *          PRINT
+ * ========================================== */
+
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t size;
+    int failed;
+} printer_t;
+
+static void put(printer_t *p, const char *data, size_t len)
+{
+    if (p->failed)
+    {
+        return;
+    }
+    if (p->len + len + 1 > p->size)
+    {
+        size_t size = (p->size ? p->size * 2 : 64) + len;
+        char *buf = realloc(p->buf, size);
+        if (!buf)
+        {
+            p->failed = 1;
+            return;
+        }
+        p->buf = buf;
+        p->size = size;
+    }
+    memcpy(p->buf + p->len, data, len);
+    p->len += len;
+    p->buf[p->len] = '\0';
+}
+
+static void put_str(printer_t *p, const char *s)
+{
+    put(p, s, strlen(s));
+}
+
+static void put_string(printer_t *p, const char *s)
+{
+    put(p, "\"", 1);
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        char esc[8];
+        switch (c)
+        {
+        case '"':
+            put_str(p, "\\\"");
+            break;
+        case '\\':
+            put_str(p, "\\\\");
+            break;
+        case '\n':
+            put_str(p, "\\n");
+            break;
+        case '\r':
+            put_str(p, "\\r");
+            break;
+        case '\t':
+            put_str(p, "\\t");
+            break;
+        default:
+            if (c < 0x20)
+            {
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                put_str(p, esc);
+            }
+            else
+            {
+                put(p, (const char *)&c, 1);
+            }
+            break;
+        }
+    }
+    put(p, "\"", 1);
+}
+
+static void put_indent(printer_t *p, int depth)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        put(p, "\t", 1);
+    }
+}
+
+static void print_item(printer_t *p, const cJSON *item, int depth, int format)
+{
+    char num[64];
+    switch (item->type & 0xFF)
+    {
+    case cJSON_False:
+        put_str(p, "false");
+        break;
+    case cJSON_True:
+        put_str(p, "true");
+        break;
+    case cJSON_NULL:
+        put_str(p, "null");
+        break;
+    case cJSON_Number:
+        if (item->valuedouble == (double)item->valueint)
+        {
+            snprintf(num, sizeof(num), "%d", item->valueint);
+        }
+        else
+        {
+            snprintf(num, sizeof(num), "%1.15g", item->valuedouble);
+        }
+        put_str(p, num);
+        break;
+    case cJSON_String:
+        put_string(p, item->valuestring ? item->valuestring : "");
+        break;
+    case cJSON_Array:
+    case cJSON_Object:
+    {
+        int object = (item->type & 0xFF) == cJSON_Object;
+        put(p, object ? "{" : "[", 1);
+        for (const cJSON *child = item->child; child; child = child->next)
+        {
+            if (format && object)
+            {
+                put(p, "\n", 1);
+                put_indent(p, depth + 1);
+            }
+            if (object)
+            {
+                put_string(p, child->string ? child->string : "");
+                put_str(p, format ? ":\t" : ":");
+            }
+            print_item(p, child, depth + 1, format);
+            if (child->next)
+            {
+                put_str(p, format && !object ? ", " : ",");
+            }
+        }
+        if (format && object)
+        {
+            put(p, "\n", 1);
+            put_indent(p, depth);
+        }
+        put(p, object ? "}" : "]", 1);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static char *print(const cJSON *item, int format)
+{
+    if (!item)
+    {
+        return NULL;
+    }
+    printer_t p = {0};
+    print_item(&p, item, 0, format);
+    if (p.failed)
+    {
+        free(p.buf);
+        return NULL;
+    }
+    return p.buf;
+}
+
+char *cJSON_Print(const cJSON *item)
+{
+    return print(item, 1);
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item)
+{
+    return print(item, 0);
+}
+
+/* ==========================================
+ *          PARSE
+ * ========================================== */
+
+static const char *skip_ws(const char *s)
+{
+    while (*s && isspace((unsigned char)*s))
+    {
+        s++;
+    }
+    return s;
+}
+
+static const char *parse_value(cJSON *item, const char *s, int depth);
+
+static const char *parse_string(char **out, const char *s)
+{
+    if (*s != '"')
+    {
+        return NULL;
+    }
+    s++;
+    size_t cap = strlen(s) + 1;
+    char *buf = malloc(cap);
+    size_t len = 0;
+    while (*s && *s != '"')
+    {
+        if (*s != '\\')
+        {
+            buf[len++] = *s++;
+            continue;
+        }
+        s++;
+        switch (*s)
+        {
+        case 'b':
+            buf[len++] = '\b';
+            break;
+        case 'f':
+            buf[len++] = '\f';
+            break;
+        case 'n':
+            buf[len++] = '\n';
+            break;
+        case 'r':
+            buf[len++] = '\r';
+            break;
+        case 't':
+            buf[len++] = '\t';
+            break;
+        case 'u':
+        {
+            unsigned code = 0;
+            for (int i = 1; i <= 4; i++)
+            {
+                if (!isxdigit((unsigned char)s[i]))
+                {
+                    free(buf);
+                    return NULL;
+                }
+                code = code * 16 + (isdigit((unsigned char)s[i]) ? s[i] - '0' : (tolower(s[i]) - 'a' + 10));
+            }
+            s += 4;
+            if (code < 0x80)
+            {
+                buf[len++] = (char)code;
+            }
+            else if (code < 0x800)
+            {
+                buf[len++] = (char)(0xC0 | (code >> 6));
+                buf[len++] = (char)(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                buf[len++] = (char)(0xE0 | (code >> 12));
+                buf[len++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                buf[len++] = (char)(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        case '\0':
+            free(buf);
+            return NULL;
+        default:
+            buf[len++] = *s;
+            break;
+        }
+        s++;
+    }
+    if (*s != '"')
+    {
+        free(buf);
+        return NULL;
+    }
+    buf[len] = '\0';
+    *out = buf;
+    return s + 1;
+}
+
+static const char *parse_container(cJSON *item, const char *s, int depth)
+{
+    int object = *s == '{';
+    item->type = object ? cJSON_Object : cJSON_Array;
+    s = skip_ws(s + 1);
+    if (*s == (object ? '}' : ']'))
+    {
+        return s + 1;
+    }
+    for (;;)
+    {
+        cJSON *child = item_new(cJSON_Invalid);
+        append_child(item, child);
+        if (object)
+        {
+            s = parse_string(&child->string, skip_ws(s));
+            if (!s)
+            {
+                return NULL;
+            }
+            s = skip_ws(s);
+            if (*s != ':')
+            {
+                return NULL;
+            }
+            s++;
+        }
+        s = parse_value(child, skip_ws(s), depth + 1);
+        if (!s)
+        {
+            return NULL;
+        }
+        s = skip_ws(s);
+        if (*s == ',')
+        {
+            s++;
+            continue;
+        }
+        if (*s == (object ? '}' : ']'))
+        {
+            return s + 1;
+        }
+        return NULL;
+    }
+}
+
+static const char *parse_value(cJSON *item, const char *s, int depth)
+{
+    if (depth > 64)
+    {
+        return NULL;
+    }
+    if (strncmp(s, "null", 4) == 0)
+    {
+        item->type = cJSON_NULL;
+        return s + 4;
+    }
+    if (strncmp(s, "false", 5) == 0)
+    {
+        item->type = cJSON_False;
+        return s + 5;
+    }
+    if (strncmp(s, "true", 4) == 0)
+    {
+        item->type = cJSON_True;
+        item->valueint = 1;
+        return s + 4;
+    }
+    if (*s == '"')
+    {
+        item->type = cJSON_String;
+        return parse_string(&item->valuestring, s);
+    }
+    if (*s == '{' || *s == '[')
+    {
+        return parse_container(item, s, depth);
+    }
+    if (*s == '-' || isdigit((unsigned char)*s))
+    {
+        char *end;
+        double number = strtod(s, &end);
+        item->type = cJSON_Number;
+        item->valuedouble = number;
+        item->valueint = number >= 2147483647.0 ? 2147483647 : number <= -2147483648.0 ? -2147483647 - 1 : (int)number;
+        return end;
+    }
+    return NULL;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    if (!value)
+    {
+        return NULL;
+    }
+    cJSON *item = item_new(cJSON_Invalid);
+    const char *end = parse_value(item, skip_ws(value), 0);
+    if (!end)
+    {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
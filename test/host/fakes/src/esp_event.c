@@ -0,0 +1,256 @@
+/**
+ * @file esp_event.c
+ * @brief Default event loop: a "sys_evt" task dispatching posted events in order
+ *
+ * As in ESP-IDF the loop holds a recursive mutex while it runs handlers, so
+ * unregistering a handler waits for a call in progress to return.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_event.h"
+#include "fake_internal.h"
+#include "freertos/semphr.h"
+
+typedef struct handler_node
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler; // NULL once unregistered during a dispatch
+    void *arg;
+    struct handler_node *next;
+} handler_node_t;
+
+typedef struct event_node
+{
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+    struct event_node *next;
+} event_node_t;
+
+static SemaphoreHandle_t loop_mutex;
+static SemaphoreHandle_t pending;
+static portMUX_TYPE queue_lock = portMUX_INITIALIZER_UNLOCKED;
+static event_node_t *queue_head;
+static event_node_t *queue_tail;
+static handler_node_t *handlers;
+static int dispatching;
+static TaskHandle_t loop_task;
+
+static void sweep_handlers(void)
+{
+    for (handler_node_t **p = &handlers; *p;)
+    {
+        handler_node_t *node = *p;
+        if (!node->handler)
+        {
+            *p = node->next;
+            free(node);
+        }
+        else
+        {
+            p = &node->next;
+        }
+    }
+}
+
+static void event_loop_task(void *arg)
+{
+    for (;;)
+    {
+        xSemaphoreTake(pending, portMAX_DELAY);
+
+        portENTER_CRITICAL(&queue_lock);
+        event_node_t *event = queue_head;
+        if (event)
+        {
+            queue_head = event->next;
+            if (!queue_head)
+            {
+                queue_tail = NULL;
+            }
+        }
+        portEXIT_CRITICAL(&queue_lock);
+        if (!event)
+        {
+            continue;
+        }
+
+        xSemaphoreTakeRecursive(loop_mutex, portMAX_DELAY);
+        dispatching++;
+        for (handler_node_t *node = handlers; node; node = node->next)
+        {
+            if (node->handler && (node->base == ESP_EVENT_ANY_BASE || node->base == event->base) &&
+                (node->id == ESP_EVENT_ANY_ID || node->id == event->id))
+            {
+                node->handler(node->arg, event->base, event->id, event->data);
+            }
+        }
+        if (--dispatching == 0)
+        {
+            sweep_handlers();
+        }
+        xSemaphoreGiveRecursive(loop_mutex);
+
+        free(event->data);
+        free(event);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (loop_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    loop_mutex = xSemaphoreCreateRecursiveMutex();
+    pending = xSemaphoreCreateCounting(UINT32_MAX, 0);
+    if (!loop_mutex || !pending)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    fake_rtos_mark_system_semaphore(loop_mutex);
+    fake_rtos_mark_system_semaphore(pending);
+    loop_task = fake_rtos_create_system_task(event_loop_task, "sys_evt", NULL, 20);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete_default(void)
+{
+    // The loop lives as long as the process; tests only unregister their handlers
+    return loop_task ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+static esp_err_t register_handler(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t handler,
+                                  void *handler_arg, handler_node_t **out)
+{
+    if (!loop_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!handler)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    handler_node_t *node = calloc(1, sizeof(*node));
+    if (!node)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    node->base = event_base;
+    node->id = event_id;
+    node->handler = handler;
+    node->arg = handler_arg;
+
+    xSemaphoreTakeRecursive(loop_mutex, portMAX_DELAY);
+    handler_node_t **p = &handlers;
+    while (*p)
+    {
+        p = &(*p)->next;
+    }
+    *p = node;
+    xSemaphoreGiveRecursive(loop_mutex);
+
+    if (out)
+    {
+        *out = node;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t unregister_matching(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t handler,
+                                     handler_node_t *instance)
+{
+    if (!loop_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTakeRecursive(loop_mutex, portMAX_DELAY);
+    for (handler_node_t *node = handlers; node; node = node->next)
+    {
+        if (node->handler && node->base == event_base && node->id == event_id &&
+            (instance ? node == instance : node->handler == handler))
+        {
+            node->handler = NULL;
+            err = ESP_OK;
+            break;
+        }
+    }
+    if (dispatching == 0)
+    {
+        sweep_handlers();
+    }
+    xSemaphoreGiveRecursive(loop_mutex);
+    return err;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t handler,
+                                     void *handler_arg)
+{
+    return register_handler(event_base, event_id, handler, handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t handler)
+{
+    return unregister_matching(event_base, event_id, handler, NULL);
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t handler, void *handler_arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    handler_node_t *node = NULL;
+    esp_err_t err = register_handler(event_base, event_id, handler, handler_arg, &node);
+    if (instance)
+    {
+        *instance = node;
+    }
+    return err;
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+                                                esp_event_handler_instance_t instance)
+{
+    if (!instance)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return unregister_matching(event_base, event_id, NULL, instance);
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (!loop_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    event_node_t *event = calloc(1, sizeof(*event));
+    event->base = event_base;
+    event->id = event_id;
+    if (event_data && event_data_size > 0)
+    {
+        event->data = malloc(event_data_size);
+        memcpy(event->data, event_data, event_data_size);
+    }
+
+    portENTER_CRITICAL(&queue_lock);
+    if (queue_tail)
+    {
+        queue_tail->next = event;
+    }
+    else
+    {
+        queue_head = event;
+    }
+    queue_tail = event;
+    portEXIT_CRITICAL(&queue_lock);
+
+    xSemaphoreGive(pending);
+    return ESP_OK;
+}
@@ -0,0 +1,1672 @@
+/**
+ * @file esp_http_server.c
+ * @brief esp_http_server over loopback TCP
+ *
+ * One "httpd" thread serves all sessions, as the IDF server task does: it
+ * accepts (closing the least recently used session when full and
+ * lru_purge_enable is set), parses one request at a time, runs the handler
+ * and then the queued work items. Handlers see the same API behaviour as on
+ * the device: keep-alive sessions, chunked responses, default error
+ * responses that close the session, close_fn owning the socket, WebSocket
+ * handshake and frames with PING/CLOSE answered by the server.
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "fake_httpd.h"
+#include "fake_rtos.h"
+#include "fake_system.h"
+
+static const char *TAG = "fake_httpd";
+
+#define RECV_BUF_SIZE 1024     // Request line and headers must fit
+#define MAX_WS_FRAME (64 * 1024)
+#define MAX_RESP_HDRS 16
+
+typedef struct
+{
+    httpd_uri_t uri;
+    bool used;
+} uri_entry_t;
+
+typedef struct
+{
+    int fd; // -1: free slot
+    uint64_t lru;
+    bool close_pending;
+    bool ws;
+    const uri_entry_t *ws_uri;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    char buf[RECV_BUF_SIZE];
+    size_t buf_len; // Bytes in buf
+    size_t buf_pos; // Bytes of buf already consumed
+} session_t;
+
+typedef struct work_item
+{
+    httpd_work_fn_t fn;
+    void *arg;
+    struct work_item *next;
+} work_item_t;
+
+typedef struct
+{
+    session_t *sess;
+    char headers[RECV_BUF_SIZE]; // Header lines of the request, NUL separated
+    size_t headers_len;
+    const char *query;           // Within req->uri, NULL if none
+    size_t remaining;            // Body bytes not read yet
+    bool keep_alive;
+    const char *status;
+    const char *type;
+    const char *hdr_fields[MAX_RESP_HDRS];
+    const char *hdr_values[MAX_RESP_HDRS];
+    int hdr_count;
+    bool chunked;   // Chunked response started
+    bool responded; // Response complete
+    bool send_failed;
+    // WebSocket frame being handled
+    httpd_ws_type_t ws_type;
+    bool ws_final;
+    uint8_t *ws_payload;
+    size_t ws_len;
+} req_aux_t;
+
+struct httpd_data
+{
+    httpd_config_t config;
+    int listen_fd;
+    uint16_t port;
+    int wake_pipe[2];
+    pthread_t thread;
+    pthread_mutex_t lock; // Sessions, work queue, counters
+    session_t *sessions;
+    uri_entry_t *uris;
+    httpd_err_handler_func_t err_handlers[HTTPD_ERR_CODE_MAX];
+    work_item_t *work_head;
+    work_item_t *work_tail;
+    bool stopping;
+    uint64_t lru_counter;
+    fake_httpd_stats_t stats;
+};
+
+static pthread_mutex_t running_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct httpd_data *running_server;
+
+/* ==========================================
+ *          SOCKET HELPERS
+ * ========================================== */
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = send(fd, buf + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+        }
+        sent += n;
+    }
+    return (int)sent;
+}
+
+/**
+ * @brief Receive for a session, buffered bytes first
+ * @return Bytes, 0 when the peer closed, HTTPD_SOCK_ERR_* on error
+ */
+static int sess_recv(session_t *s, void *dst, size_t len)
+{
+    if (s->buf_pos < s->buf_len)
+    {
+        size_t n = s->buf_len - s->buf_pos;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(dst, s->buf + s->buf_pos, n);
+        s->buf_pos += n;
+        return (int)n;
+    }
+    for (;;)
+    {
+        ssize_t n = recv(s->fd, dst, len, 0);
+        if (n >= 0)
+        {
+            return (int)n;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+}
+
+static int sess_recv_exact(session_t *s, void *dst, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        int n = sess_recv(s, (char *)dst + got, len - got);
+        if (n <= 0)
+        {
+            return n == 0 ? HTTPD_SOCK_ERR_FAIL : n;
+        }
+        got += n;
+    }
+    return (int)got;
+}
+
+/* ==========================================
+ *          SESSIONS
+ * ========================================== */
+
+static int session_count_locked(struct httpd_data *hd)
+{
+    int count = 0;
+    for (int i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        count += hd->sessions[i].fd >= 0;
+    }
+    return count;
+}
+
+static session_t *session_find_locked(struct httpd_data *hd, int fd)
+{
+    for (int i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i].fd == fd && fd >= 0)
+        {
+            return &hd->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void session_close(struct httpd_data *hd, session_t *s)
+{
+    pthread_mutex_lock(&hd->lock);
+    int fd = s->fd;
+    s->fd = -1;
+    pthread_mutex_unlock(&hd->lock);
+    if (fd < 0)
+    {
+        return;
+    }
+    if (s->ctx)
+    {
+        if (s->free_ctx)
+        {
+            s->free_ctx(s->ctx);
+        }
+        else
+        {
+            free(s->ctx);
+        }
+    }
+    s->ctx = NULL;
+    s->free_ctx = NULL;
+
+    if (hd->config.close_fn)
+    {
+        hd->config.close_fn(hd, fd);
+    }
+    else
+    {
+        close(fd);
+    }
+}
+
+static void accept_session(struct httpd_data *hd)
+{
+    pthread_mutex_lock(&hd->lock);
+    bool full = session_count_locked(hd) >= hd->config.max_open_sockets;
+    session_t *lru = NULL;
+    if (full)
+    {
+        for (int i = 0; i < hd->config.max_open_sockets; i++)
+        {
+            session_t *s = &hd->sessions[i];
+            if (s->fd >= 0 && (!lru || s->lru < lru->lru))
+            {
+                lru = s;
+            }
+        }
+        hd->stats.purged++;
+    }
+    pthread_mutex_unlock(&hd->lock);
+    if (full)
+    {
+        ESP_LOGD(TAG, "Purging least recently used session %d", lru->fd);
+        session_close(hd, lru);
+    }
+
+    int fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct timeval rcv = {.tv_sec = hd->config.recv_wait_timeout};
+    struct timeval snd = {.tv_sec = hd->config.send_wait_timeout};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rcv, sizeof(rcv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd, sizeof(snd));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (hd->config.keep_alive_enable)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    }
+
+    pthread_mutex_lock(&hd->lock);
+    session_t *slot = NULL;
+    for (int i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i].fd < 0)
+        {
+            slot = &hd->sessions[i];
+            break;
+        }
+    }
+    if (slot)
+    {
+        memset(slot, 0, sizeof(*slot));
+        slot->fd = fd;
+        slot->lru = ++hd->lru_counter;
+        hd->stats.sessions++;
+        unsigned open = session_count_locked(hd);
+        if (open > hd->stats.open_peak)
+        {
+            hd->stats.open_peak = open;
+        }
+    }
+    pthread_mutex_unlock(&hd->lock);
+
+    if (!slot)
+    {
+        close(fd);
+        return;
+    }
+    if (hd->config.open_fn && hd->config.open_fn(hd, fd) != ESP_OK)
+    {
+        session_close(hd, slot);
+    }
+}
+
+/* ==========================================
+ *          RESPONSES
+ * ========================================== */
+
+static req_aux_t *aux_of(httpd_req_t *r)
+{
+    return (req_aux_t *)r->aux;
+}
+
+static int fd_of(httpd_req_t *r)
+{
+    return aux_of(r)->sess->fd;
+}
+
+static esp_err_t send_headers(httpd_req_t *r, const char *framing)
+{
+    req_aux_t *aux = aux_of(r);
+    char head[1024];
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s\r\n", aux->status, aux->type,
+                       framing);
+    for (int i = 0; i < aux->hdr_count && len < (int)sizeof(head); i++)
+    {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n", aux->hdr_fields[i], aux->hdr_values[i]);
+    }
+    if (len < (int)sizeof(head))
+    {
+        len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    }
+    if (len >= (int)sizeof(head))
+    {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    if (send_all(fd_of(r), head, len) < 0)
+    {
+        aux->send_failed = true;
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!r || !r->aux)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = aux_of(r);
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+    {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+    char framing[48];
+    snprintf(framing, sizeof(framing), "Content-Length: %d", (int)buf_len);
+    esp_err_t err = send_headers(r, framing);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (buf_len > 0 && send_all(fd_of(r), buf, buf_len) < 0)
+    {
+        aux->send_failed = true;
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    aux->responded = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!r || !r->aux)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = aux_of(r);
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+    {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+    if (!aux->chunked)
+    {
+        esp_err_t err = send_headers(r, "Transfer-Encoding: chunked");
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        aux->chunked = true;
+    }
+
+    char size[16];
+    int size_len = snprintf(size, sizeof(size), "%x\r\n", (unsigned)buf_len);
+    if (send_all(fd_of(r), size, size_len) < 0 || (buf_len > 0 && send_all(fd_of(r), buf, buf_len) < 0) ||
+        send_all(fd_of(r), "\r\n", 2) < 0)
+    {
+        aux->send_failed = true;
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if (buf_len == 0)
+    {
+        aux->responded = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    if (!r || !r->aux || !status)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    aux_of(r)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    if (!r || !r->aux || !type)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    aux_of(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    if (!r || !r->aux || !field || !value)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = aux_of(r);
+    struct httpd_data *hd = r->handle;
+    if (aux->hdr_count >= hd->config.max_resp_headers || aux->hdr_count >= MAX_RESP_HDRS)
+    {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    // Only the pointers are kept, as in ESP-IDF
+    aux->hdr_fields[aux->hdr_count] = field;
+    aux->hdr_values[aux->hdr_count] = value;
+    aux->hdr_count++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *usr_msg)
+{
+    const char *status;
+    const char *msg;
+    switch (error)
+    {
+    case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+        status = "501 Method Not Implemented";
+        msg = "Server does not support this method";
+        break;
+    case HTTPD_505_VERSION_NOT_SUPPORTED:
+        status = "505 Version Not Supported";
+        msg = "HTTP version not supported by server";
+        break;
+    case HTTPD_400_BAD_REQUEST:
+        status = "400 Bad Request";
+        msg = "Bad request syntax";
+        break;
+    case HTTPD_401_UNAUTHORIZED:
+        status = "401 Unauthorized";
+        msg = "No permission -- see authorization schemes";
+        break;
+    case HTTPD_403_FORBIDDEN:
+        status = "403 Forbidden";
+        msg = "Request forbidden -- authorization will not help";
+        break;
+    case HTTPD_404_NOT_FOUND:
+        status = "404 Not Found";
+        msg = "Nothing matches the given URI";
+        break;
+    case HTTPD_405_METHOD_NOT_ALLOWED:
+        status = "405 Method Not Allowed";
+        msg = "Specified method is invalid for this resource";
+        break;
+    case HTTPD_408_REQ_TIMEOUT:
+        status = "408 Request Timeout";
+        msg = "Server closed this connection";
+        break;
+    case HTTPD_411_LENGTH_REQUIRED:
+        status = "411 Length Required";
+        msg = "Client must specify Content-Length";
+        break;
+    case HTTPD_414_URI_TOO_LONG:
+        status = "414 URI Too Long";
+        msg = "URI is too long";
+        break;
+    case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE:
+        status = "431 Request Header Fields Too Large";
+        msg = "Header fields are too long";
+        break;
+    default:
+        status = "500 Internal Server Error";
+        msg = "Server has encountered an unexpected error";
+        break;
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, usr_msg ? usr_msg : msg, HTTPD_RESP_USE_STRLEN);
+}
+
+/* ==========================================
+ *          REQUESTS
+ * ========================================== */
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (!r || !r->aux || !buf)
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    req_aux_t *aux = aux_of(r);
+    if (aux->remaining == 0)
+    {
+        return 0;
+    }
+    if (buf_len > aux->remaining)
+    {
+        buf_len = aux->remaining;
+    }
+    int n = sess_recv(aux->sess, buf, buf_len);
+    if (n > 0)
+    {
+        aux->remaining -= n;
+    }
+    else if (n == 0)
+    {
+        return HTTPD_SOCK_ERR_FAIL; // Peer closed before sending the body
+    }
+    return n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    return r && r->aux ? fd_of(r) : -1;
+}
+
+static const char *find_header(httpd_req_t *r, const char *field)
+{
+    req_aux_t *aux = aux_of(r);
+    size_t field_len = strlen(field);
+    for (size_t pos = 0; pos < aux->headers_len;)
+    {
+        const char *line = aux->headers + pos;
+        size_t line_len = strlen(line);
+        if (line_len > field_len && strncasecmp(line, field, field_len) == 0 && line[field_len] == ':')
+        {
+            const char *value = line + field_len + 1;
+            while (*value == ' ' || *value == '\t')
+            {
+                value++;
+            }
+            return value;
+        }
+        pos += line_len + 1;
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    const char *value = r && r->aux && field ? find_header(r, field) : NULL;
+    return value ? strlen(value) : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (!r || !r->aux || !field || !val || val_size == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *value = find_header(r, field);
+    if (!value)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(val, val_size, "%s", value);
+    return strlen(value) >= val_size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    return r && r->aux && aux_of(r)->query ? strlen(aux_of(r)->query) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (!r || !r->aux || !buf || buf_len == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *query = aux_of(r)->query;
+    if (!query)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(buf, buf_len, "%s", query);
+    return strlen(query) >= buf_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    if (!qry || !key || !val || val_size == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t key_len = strlen(key);
+    for (const char *p = qry; p && *p;)
+    {
+        const char *end = strchr(p, '&');
+        size_t pair_len = end ? (size_t)(end - p) : strlen(p);
+        if (pair_len > key_len && strncmp(p, key, key_len) == 0 && p[key_len] == '=')
+        {
+            const char *value = p + key_len + 1;
+            size_t value_len = pair_len - key_len - 1;
+            size_t copy = value_len < val_size - 1 ? value_len : val_size - 1;
+            memcpy(val, value, copy);
+            val[copy] = '\0';
+            return copy < value_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* ==========================================
+ *          WEBSOCKET
+ * ========================================== */
+
+typedef struct
+{
+    uint32_t h[5];
+    uint8_t block[64];
+    size_t block_len;
+    uint64_t total;
+} sha1_t;
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(sha1_t *s, const uint8_t *p)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 80; i++)
+    {
+        w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3], e = s->h[4];
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL(b, 30);
+        b = a;
+        a = t;
+    }
+    s->h[0] += a;
+    s->h[1] += b;
+    s->h[2] += c;
+    s->h[3] += d;
+    s->h[4] += e;
+}
+
+static void sha1_update(sha1_t *s, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    s->total += len;
+    while (len > 0)
+    {
+        size_t n = 64 - s->block_len < len ? 64 - s->block_len : len;
+        memcpy(s->block + s->block_len, p, n);
+        s->block_len += n;
+        p += n;
+        len -= n;
+        if (s->block_len == 64)
+        {
+            sha1_block(s, s->block);
+            s->block_len = 0;
+        }
+    }
+}
+
+static void sha1(const void *data1, size_t len1, const void *data2, size_t len2, uint8_t digest[20])
+{
+    sha1_t s = {.h = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0}};
+    sha1_update(&s, data1, len1);
+    sha1_update(&s, data2, len2);
+    uint64_t bits = s.total * 8;
+    uint8_t pad = 0x80;
+    sha1_update(&s, &pad, 1);
+    pad = 0;
+    while (s.block_len != 56)
+    {
+        sha1_update(&s, &pad, 1);
+    }
+    uint8_t length[8];
+    for (int i = 0; i < 8; i++)
+    {
+        length[i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha1_update(&s, length, 8);
+    for (int i = 0; i < 20; i++)
+    {
+        digest[i] = (uint8_t)(s.h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static void base64(const uint8_t *in, size_t len, char *out)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0) |
+                     (i + 2 < len ? in[i + 2] : 0);
+        out[o++] = table[(v >> 18) & 63];
+        out[o++] = table[(v >> 12) & 63];
+        out[o++] = i + 1 < len ? table[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < len ? table[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+static int ws_send(int fd, httpd_ws_type_t type, bool final, const uint8_t *payload, size_t len)
+{
+    uint8_t head[10];
+    size_t head_len = 2;
+    head[0] = (final ? 0x80 : 0) | type;
+    if (len < 126)
+    {
+        head[1] = len;
+    }
+    else if (len < 65536)
+    {
+        head[1] = 126;
+        head[2] = len >> 8;
+        head[3] = len;
+        head_len = 4;
+    }
+    else
+    {
+        head[1] = 127;
+        for (int i = 0; i < 8; i++)
+        {
+            head[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+        }
+        head_len = 10;
+    }
+    if (send_all(fd, (const char *)head, head_len) < 0 || (len > 0 && send_all(fd, (const char *)payload, len) < 0))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    if (!req || !req->aux || !pkt)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    req_aux_t *aux = aux_of(req);
+    if (!aux->sess->ws)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pkt->type = aux->ws_type;
+    pkt->final = aux->ws_final;
+    pkt->fragmented = !aux->ws_final;
+    pkt->len = aux->ws_len;
+    if (max_len == 0)
+    {
+        return ESP_OK;
+    }
+    if (!pkt->payload)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (aux->ws_len > max_len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(pkt->payload, aux->ws_payload, aux->ws_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    if (!req || !req->aux || !pkt)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return httpd_ws_send_frame_async(req->handle, fd_of(req), pkt);
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t handle, int fd, httpd_ws_frame_t *frame)
+{
+    if (!handle || !frame || (frame->len > 0 && !frame->payload))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Frames may be sent from any task, as the IDF function is
+    bool final = frame->final || !frame->fragmented;
+    return ws_send(fd, frame->type, final, frame->payload, frame->len) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t handle, int fd)
+{
+    struct httpd_data *hd = handle;
+    pthread_mutex_lock(&hd->lock);
+    session_t *s = session_find_locked(hd, fd);
+    httpd_ws_client_info_t info =
+        !s ? HTTPD_WS_CLIENT_INVALID : (s->ws ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP);
+    pthread_mutex_unlock(&hd->lock);
+    return info;
+}
+
+/**
+ * @brief Read one frame of a WebSocket session and hand it to the handler
+ * @return false to close the session
+ */
+static bool serve_ws_frame(struct httpd_data *hd, session_t *s)
+{
+    uint8_t head[2];
+    if (sess_recv_exact(s, head, 2) < 0)
+    {
+        return false;
+    }
+    bool final = head[0] & 0x80;
+    httpd_ws_type_t type = head[0] & 0x0f;
+    bool masked = head[1] & 0x80;
+    uint64_t len = head[1] & 0x7f;
+    if (len == 126 || len == 127)
+    {
+        uint8_t ext[8];
+        size_t ext_len = len == 126 ? 2 : 8;
+        if (sess_recv_exact(s, ext, ext_len) < 0)
+        {
+            return false;
+        }
+        len = 0;
+        for (size_t i = 0; i < ext_len; i++)
+        {
+            len = len << 8 | ext[i];
+        }
+    }
+    uint8_t mask[4] = {0};
+    if (!masked || len > MAX_WS_FRAME || sess_recv_exact(s, mask, 4) < 0)
+    {
+        return false; // Client frames must be masked
+    }
+    uint8_t *payload = malloc(len + 1);
+    if (!payload || (len > 0 && sess_recv_exact(s, payload, len) < 0))
+    {
+        free(payload);
+        return false;
+    }
+    for (uint64_t i = 0; i < len; i++)
+    {
+        payload[i] ^= mask[i % 4];
+    }
+
+    const uri_entry_t *entry = s->ws_uri;
+    if (!entry->uri.handle_ws_control_frames &&
+        (type == HTTPD_WS_TYPE_PING || type == HTTPD_WS_TYPE_PONG || type == HTTPD_WS_TYPE_CLOSE))
+    {
+        bool keep = true;
+        if (type == HTTPD_WS_TYPE_PING)
+        {
+            keep = ws_send(s->fd, HTTPD_WS_TYPE_PONG, true, payload, len) == 0;
+        }
+        else if (type == HTTPD_WS_TYPE_CLOSE)
+        {
+            ws_send(s->fd, HTTPD_WS_TYPE_CLOSE, true, payload, len >= 2 ? 2 : 0);
+            keep = false;
+        }
+        free(payload);
+        return keep;
+    }
+
+    httpd_req_t req = {0};
+    req_aux_t *aux = calloc(1, sizeof(*aux));
+    aux->sess = s;
+    aux->status = HTTPD_200;
+    aux->type = HTTPD_TYPE_TEXT;
+    aux->ws_type = type;
+    aux->ws_final = final;
+    aux->ws_payload = payload;
+    aux->ws_len = len;
+    req.handle = hd;
+    req.method = 0; // Frames are not HTTP_GET, which marks the handshake
+    req.aux = aux;
+    req.user_ctx = entry->uri.user_ctx;
+    req.sess_ctx = s->ctx;
+    snprintf((char *)req.uri, sizeof(req.uri), "%s", entry->uri.uri);
+
+    pthread_mutex_lock(&hd->lock);
+    hd->stats.requests++;
+    pthread_mutex_unlock(&hd->lock);
+
+    esp_err_t err = entry->uri.handler(&req);
+    s->ctx = req.sess_ctx;
+    free(aux);
+    free(payload);
+    return err == ESP_OK;
+}
+
+/* ==========================================
+ *          HTTP
+ * ========================================== */
+
+static int parse_method(const char *method)
+{
+    static const struct
+    {
+        const char *name;
+        int method;
+    } methods[] = {
+        {"DELETE", HTTP_DELETE}, {"GET", HTTP_GET}, {"HEAD", HTTP_HEAD}, {"POST", HTTP_POST}, {"PUT", HTTP_PUT},
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+    {
+        if (strcmp(method, methods[i].name) == 0)
+        {
+            return methods[i].method;
+        }
+    }
+    return -1;
+}
+
+static bool uri_matches(struct httpd_data *hd, const char *reference, const char *uri)
+{
+    size_t len = strcspn(uri, "?");
+    if (hd->config.uri_match_fn)
+    {
+        return hd->config.uri_match_fn(reference, uri, len);
+    }
+    return strlen(reference) == len && strncmp(reference, uri, len) == 0;
+}
+
+/**
+ * @brief Read the request line and headers into the session buffer
+ * @return Length of the header block including the blank line, 0 if the
+ *         peer closed, HTTPD_SOCK_ERR_* on error, -100 if it does not fit
+ */
+static int read_head(session_t *s)
+{
+    // Bytes of a previous request left in the buffer come first
+    if (s->buf_pos > 0)
+    {
+        memmove(s->buf, s->buf + s->buf_pos, s->buf_len - s->buf_pos);
+        s->buf_len -= s->buf_pos;
+        s->buf_pos = 0;
+    }
+    for (;;)
+    {
+        s->buf[s->buf_len < sizeof(s->buf) ? s->buf_len : sizeof(s->buf) - 1] = '\0';
+        char *end = s->buf_len >= 4 ? memmem(s->buf, s->buf_len, "\r\n\r\n", 4) : NULL;
+        if (end)
+        {
+            return (int)(end - s->buf) + 4;
+        }
+        if (s->buf_len >= sizeof(s->buf) - 1)
+        {
+            return -100;
+        }
+        ssize_t n = recv(s->fd, s->buf + s->buf_len, sizeof(s->buf) - 1 - s->buf_len, 0);
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+        }
+        s->buf_len += n;
+    }
+}
+
+/**
+ * @brief Run the error handler registered for err, or send the default response
+ * @return ESP_OK to keep the session open
+ */
+static esp_err_t handle_error(struct httpd_data *hd, httpd_req_t *req, httpd_err_code_t err)
+{
+    if (err < HTTPD_ERR_CODE_MAX && hd->err_handlers[err])
+    {
+        return hd->err_handlers[err](req, err);
+    }
+    httpd_resp_send_err(req, err, NULL);
+    return ESP_FAIL;
+}
+
+static bool websocket_handshake(httpd_req_t *req, const uri_entry_t *entry)
+{
+    const char *key = find_header(req, "Sec-WebSocket-Key");
+    if (!key)
+    {
+        return false;
+    }
+    static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t digest[20];
+    char accept[32];
+    sha1(key, strlen(key), guid, sizeof(guid) - 1, digest);
+    base64(digest, sizeof(digest), accept);
+
+    char response[256];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: %s\r\n\r\n",
+                       accept);
+    return send_all(fd_of(req), response, len) == len;
+}
+
+/**
+ * @brief Serve one request of an HTTP session
+ * @return false to close the session
+ */
+static bool serve_request(struct httpd_data *hd, session_t *s)
+{
+    int head_len = read_head(s);
+    if (head_len <= 0 && head_len != -100)
+    {
+        return false; // Closed, timed out or failed before a request arrived
+    }
+
+    httpd_req_t req = {0};
+    req_aux_t *aux = calloc(1, sizeof(*aux));
+    aux->sess = s;
+    aux->status = HTTPD_200;
+    aux->type = HTTPD_TYPE_TEXT;
+    req.handle = hd;
+    req.aux = aux;
+    req.sess_ctx = s->ctx;
+
+    bool keep = false;
+    if (head_len == -100)
+    {
+        handle_error(hd, &req, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+        goto done;
+    }
+
+    // Request line: METHOD SP URI SP VERSION
+    s->buf[head_len - 2] = '\0';
+    char *line_end = strstr(s->buf, "\r\n");
+    *line_end = '\0';
+    char method[8];
+    char uri[HTTPD_MAX_URI_LEN + 2];
+    char version[16];
+    if (sscanf(s->buf, "%7s %513s %15s", method, uri, version) != 3 || strncmp(version, "HTTP/1.", 7) != 0)
+    {
+        handle_error(hd, &req, HTTPD_400_BAD_REQUEST);
+        goto done;
+    }
+    if (strlen(uri) > HTTPD_MAX_URI_LEN)
+    {
+        handle_error(hd, &req, HTTPD_414_URI_TOO_LONG);
+        goto done;
+    }
+    strcpy((char *)req.uri, uri);
+    char *query = strchr(req.uri, '?');
+    aux->query = query ? query + 1 : NULL;
+
+    // Header lines, NUL separated for find_header()
+    for (char *line = line_end + 2; *line;)
+    {
+        char *next = strstr(line, "\r\n");
+        size_t len = next ? (size_t)(next - line) : strlen(line);
+        memcpy(aux->headers + aux->headers_len, line, len);
+        aux->headers[aux->headers_len + len] = '\0';
+        aux->headers_len += len + 1;
+        line = next ? next + 2 : line + len;
+    }
+    s->buf_pos = head_len;
+
+    const char *length = find_header(&req, "Content-Length");
+    req.content_len = length ? strtoul(length, NULL, 10) : 0;
+    aux->remaining = req.content_len;
+    const char *connection = find_header(&req, "Connection");
+    aux->keep_alive = strcmp(version, "HTTP/1.1") == 0 ? !(connection && strcasecmp(connection, "close") == 0)
+                                                       : (connection && strcasecmp(connection, "keep-alive") == 0);
+
+    req.method = parse_method(method);
+    if (req.method < 0)
+    {
+        handle_error(hd, &req, HTTPD_501_METHOD_NOT_IMPLEMENTED);
+        goto done;
+    }
+
+    const uri_entry_t *entry = NULL;
+    bool path_known = false;
+    for (int i = 0; i < hd->config.max_uri_handlers; i++)
+    {
+        const uri_entry_t *candidate = &hd->uris[i];
+        if (!candidate->used || !uri_matches(hd, candidate->uri.uri, req.uri))
+        {
+            continue;
+        }
+        path_known = true;
+        if (candidate->uri.method == (httpd_method_t)req.method || candidate->uri.method == HTTP_ANY)
+        {
+            entry = candidate;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&hd->lock);
+    hd->stats.requests++;
+    pthread_mutex_unlock(&hd->lock);
+
+    esp_err_t err;
+    if (!entry)
+    {
+        err = handle_error(hd, &req, path_known ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND);
+    }
+    else
+    {
+        req.user_ctx = entry->uri.user_ctx;
+        const char *upgrade = find_header(&req, "Upgrade");
+        if (entry->uri.is_websocket && upgrade && strcasecmp(upgrade, "websocket") == 0)
+        {
+            if (!websocket_handshake(&req, entry))
+            {
+                goto done;
+            }
+            s->ws = true;
+            s->ws_uri = entry;
+        }
+        err = entry->uri.handler(&req);
+    }
+    keep = err == ESP_OK && !aux->send_failed && (aux->keep_alive || s->ws);
+
+    // A body the handler did not read is dropped so the next request parses
+    char discard[256];
+    while (keep && aux->remaining > 0)
+    {
+        int n = httpd_req_recv(&req, discard, sizeof(discard));
+        if (n <= 0)
+        {
+            keep = false;
+        }
+    }
+
+done:
+    s->ctx = req.sess_ctx;
+    s->free_ctx = req.free_ctx;
+    free(aux);
+    return keep;
+}
+
+/* ==========================================
+ *          SERVER TASK
+ * ========================================== */
+
+static void run_work(struct httpd_data *hd)
+{
+    char drain[64];
+    while (read(hd->wake_pipe[0], drain, sizeof(drain)) > 0)
+    {
+    }
+    for (;;)
+    {
+        pthread_mutex_lock(&hd->lock);
+        work_item_t *item = hd->work_head;
+        if (item)
+        {
+            hd->work_head = item->next;
+            if (!hd->work_head)
+            {
+                hd->work_tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&hd->lock);
+        if (!item)
+        {
+            break;
+        }
+        item->fn(item->arg);
+        free(item);
+    }
+}
+
+static void *server_main(void *arg)
+{
+    struct httpd_data *hd = arg;
+    fake_rtos_register_thread("httpd", hd->config.stack_size);
+    int max = hd->config.max_open_sockets;
+    struct pollfd *fds = calloc(max + 2, sizeof(*fds));
+    session_t **owners = calloc(max + 2, sizeof(*owners));
+
+    for (;;)
+    {
+        pthread_mutex_lock(&hd->lock);
+        bool stopping = hd->stopping;
+        pthread_mutex_unlock(&hd->lock);
+        if (stopping)
+        {
+            break;
+        }
+
+        // Sessions marked by httpd_sess_trigger_close()
+        for (int i = 0; i < max; i++)
+        {
+            session_t *s = &hd->sessions[i];
+            pthread_mutex_lock(&hd->lock);
+            bool pending = s->fd >= 0 && s->close_pending;
+            pthread_mutex_unlock(&hd->lock);
+            if (pending)
+            {
+                session_close(hd, s);
+            }
+        }
+
+        int n = 0;
+        fds[n++] = (struct pollfd){.fd = hd->wake_pipe[0], .events = POLLIN};
+        fds[n++] = (struct pollfd){.fd = hd->listen_fd, .events = POLLIN};
+        pthread_mutex_lock(&hd->lock);
+        for (int i = 0; i < max; i++)
+        {
+            if (hd->sessions[i].fd >= 0)
+            {
+                owners[n] = &hd->sessions[i];
+                fds[n++] = (struct pollfd){.fd = hd->sessions[i].fd, .events = POLLIN};
+            }
+        }
+        pthread_mutex_unlock(&hd->lock);
+        if (!hd->config.lru_purge_enable && n - 2 >= max)
+        {
+            fds[1].fd = -1; // Full: new clients wait in the backlog
+        }
+
+        if (poll(fds, n, -1) < 0)
+        {
+            continue;
+        }
+        if (fds[0].revents)
+        {
+            run_work(hd);
+        }
+        for (int i = 2; i < n; i++)
+        {
+            session_t *s = owners[i];
+            // A session with bytes left over from pipelining is served without waiting for more
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) || s->fd != fds[i].fd)
+            {
+                continue;
+            }
+            pthread_mutex_lock(&hd->lock);
+            s->lru = ++hd->lru_counter;
+            pthread_mutex_unlock(&hd->lock);
+            bool keep = s->ws ? serve_ws_frame(hd, s) : serve_request(hd, s);
+            while (keep && !s->ws && s->buf_pos < s->buf_len)
+            {
+                keep = serve_request(hd, s);
+            }
+            if (!keep)
+            {
+                session_close(hd, s);
+            }
+        }
+        if (fds[1].fd >= 0 && (fds[1].revents & POLLIN))
+        {
+            accept_session(hd);
+        }
+    }
+
+    for (int i = 0; i < max; i++)
+    {
+        session_close(hd, &hd->sessions[i]);
+    }
+    run_work(hd); // Work queued before the stop still runs, its callers rely on it
+    free(fds);
+    free(owners);
+    return NULL;
+}
+
+/* ==========================================
+ *          SERVER API
+ * ========================================== */
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (!handle || !config)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct httpd_data *hd = calloc(1, sizeof(*hd));
+    if (!hd)
+    {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    hd->config = *config;
+    hd->sessions = calloc(config->max_open_sockets, sizeof(session_t));
+    hd->uris = calloc(config->max_uri_handlers, sizeof(uri_entry_t));
+    for (int i = 0; i < config->max_open_sockets; i++)
+    {
+        hd->sessions[i].fd = -1;
+    }
+    pthread_mutex_init(&hd->lock, NULL);
+
+    hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(config->server_port < 1024 ? 0 : config->server_port),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(hd->listen_fd, config->backlog_conn) != 0 ||
+        getsockname(hd->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0 || pipe(hd->wake_pipe) != 0)
+    {
+        ESP_LOGE(TAG, "Cannot listen: %s", strerror(errno));
+        close(hd->listen_fd);
+        free(hd->sessions);
+        free(hd->uris);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    hd->port = ntohs(addr.sin_port);
+    fcntl(hd->wake_pipe[0], F_SETFL, O_NONBLOCK);
+
+    fake_heap_pause(true);
+    int created = pthread_create(&hd->thread, NULL, server_main, hd);
+    fake_heap_pause(false);
+    if (created != 0)
+    {
+        close(hd->listen_fd);
+        close(hd->wake_pipe[0]);
+        close(hd->wake_pipe[1]);
+        free(hd->sessions);
+        free(hd->uris);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    pthread_mutex_lock(&running_lock);
+    running_server = hd;
+    pthread_mutex_unlock(&running_lock);
+    ESP_LOGD(TAG, "Serving port %d on 127.0.0.1:%d", config->server_port, hd->port);
+    *handle = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    struct httpd_data *hd = handle;
+    if (!hd)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&running_lock);
+    if (running_server == hd)
+    {
+        running_server = NULL;
+    }
+    pthread_mutex_unlock(&running_lock);
+
+    pthread_mutex_lock(&hd->lock);
+    hd->stopping = true;
+    pthread_mutex_unlock(&hd->lock);
+    if (write(hd->wake_pipe[1], "s", 1) < 0)
+    {
+        ESP_LOGW(TAG, "Cannot wake the server: %s", strerror(errno));
+    }
+    if (pthread_equal(pthread_self(), hd->thread))
+    {
+        ESP_LOGE(TAG, "httpd_stop() called from the server task");
+        abort();
+    }
+    // The server thread calls into the component; a task waiting here must not hold the CPU
+    bool in_task = fake_rtos_in_task();
+    if (in_task)
+    {
+        fake_rtos_syscall_begin();
+    }
+    fake_heap_pause(true);
+    pthread_join(hd->thread, NULL);
+    fake_heap_pause(false);
+    if (in_task)
+    {
+        fake_rtos_syscall_end();
+    }
+
+    close(hd->listen_fd);
+    close(hd->wake_pipe[0]);
+    close(hd->wake_pipe[1]);
+    for (work_item_t *item = hd->work_head; item;)
+    {
+        work_item_t *next = item->next;
+        free(item);
+        item = next;
+    }
+    if (hd->config.global_user_ctx)
+    {
+        if (hd->config.global_user_ctx_free_fn)
+        {
+            hd->config.global_user_ctx_free_fn(hd->config.global_user_ctx);
+        }
+        else
+        {
+            free(hd->config.global_user_ctx);
+        }
+    }
+    pthread_mutex_destroy(&hd->lock);
+    free(hd->sessions);
+    free(hd->uris);
+    free(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    struct httpd_data *hd = handle;
+    if (!hd || !uri_handler || !uri_handler->uri || !uri_handler->handler)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uri_entry_t *free_entry = NULL;
+    for (int i = 0; i < hd->config.max_uri_handlers; i++)
+    {
+        uri_entry_t *entry = &hd->uris[i];
+        if (!entry->used)
+        {
+            free_entry = free_entry ? free_entry : entry;
+            continue;
+        }
+        if (entry->uri.method == uri_handler->method && strcmp(entry->uri.uri, uri_handler->uri) == 0)
+        {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (!free_entry)
+    {
+        ESP_LOGW(TAG, "No slot left for URI handler %s", uri_handler->uri);
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    free_entry->uri = *uri_handler;
+    free_entry->used = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char *uri, httpd_method_t method)
+{
+    struct httpd_data *hd = handle;
+    if (!hd || !uri)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < hd->config.max_uri_handlers; i++)
+    {
+        uri_entry_t *entry = &hd->uris[i];
+        if (entry->used && entry->uri.method == method && strcmp(entry->uri.uri, uri) == 0)
+        {
+            entry->used = false;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_register_err_handler(httpd_handle_t handle, httpd_err_code_t error,
+                                     httpd_err_handler_func_t handler_fn)
+{
+    struct httpd_data *hd = handle;
+    if (!hd || error >= HTTPD_ERR_CODE_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hd->err_handlers[error] = handler_fn;
+    return ESP_OK;
+}
+
+void *httpd_get_global_user_ctx(httpd_handle_t handle)
+{
+    return handle ? ((struct httpd_data *)handle)->config.global_user_ctx : NULL;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    struct httpd_data *hd = handle;
+    if (!hd || !work)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    work_item_t *item = malloc(sizeof(*item));
+    if (!item)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    item->fn = work;
+    item->arg = arg;
+    item->next = NULL;
+
+    pthread_mutex_lock(&hd->lock);
+    if (hd->stopping)
+    {
+        pthread_mutex_unlock(&hd->lock);
+        free(item);
+        return ESP_FAIL;
+    }
+    if (hd->work_tail)
+    {
+        hd->work_tail->next = item;
+    }
+    else
+    {
+        hd->work_head = item;
+    }
+    hd->work_tail = item;
+    pthread_mutex_unlock(&hd->lock);
+
+    if (write(hd->wake_pipe[1], "w", 1) < 0)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    struct httpd_data *hd = handle;
+    if (!hd)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hd->lock);
+    session_t *s = session_find_locked(hd, sockfd);
+    if (s)
+    {
+        s->close_pending = true;
+    }
+    pthread_mutex_unlock(&hd->lock);
+    if (!s)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (write(hd->wake_pipe[1], "c", 1) < 0)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd)
+{
+    struct httpd_data *hd = handle;
+    if (!hd)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hd->lock);
+    session_t *s = session_find_locked(hd, sockfd);
+    if (s)
+    {
+        s->lru = ++hd->lru_counter;
+    }
+    pthread_mutex_unlock(&hd->lock);
+    return s ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds)
+{
+    struct httpd_data *hd = handle;
+    if (!hd || !fds || !client_fds)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t count = 0;
+    pthread_mutex_lock(&hd->lock);
+    for (int i = 0; i < hd->config.max_open_sockets && count < *fds; i++)
+    {
+        if (hd->sessions[i].fd >= 0)
+        {
+            client_fds[count++] = hd->sessions[i].fd;
+        }
+    }
+    pthread_mutex_unlock(&hd->lock);
+    *fds = count;
+    return ESP_OK;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    (void)hd;
+    (void)flags;
+    if (sockfd < 0 || (!buf && buf_len > 0))
+    {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return send_all(sockfd, buf, buf_len);
+}
+
+int httpd_socket_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags)
+{
+    (void)hd;
+    ssize_t n = recv(sockfd, buf, buf_len, flags);
+    if (n < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)n;
+}
+
+/* ==========================================
+ *          CONTROL
+ * ========================================== */
+
+uint16_t fake_httpd_port(void)
+{
+    pthread_mutex_lock(&running_lock);
+    uint16_t port = running_server ? running_server->port : 0;
+    pthread_mutex_unlock(&running_lock);
+    return port;
+}
+
+void fake_httpd_get_stats(fake_httpd_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&running_lock);
+    if (running_server)
+    {
+        pthread_mutex_lock(&running_server->lock);
+        *stats = running_server->stats;
+        pthread_mutex_unlock(&running_server->lock);
+    }
+    pthread_mutex_unlock(&running_lock);
+}
@@ -0,0 +1,523 @@
+/**
+ * @file esp_netif.c
+ * @brief Station and soft-AP netifs with a simulated DHCP client
+ *
+ * Follows the esp_netif DHCP client states: a netif starts in INIT, the
+ * client runs (STARTED) once the link comes up and posts IP_EVENT_STA_GOT_IP
+ * with the lease, and a STOPPED client keeps whatever address was set with
+ * esp_netif_set_ip_info(). Losing the link resets a running client and, as
+ * esp_netif does, posts IP_EVENT_STA_LOST_IP if no address came back within
+ * the IP lost timer. Unanswered discovers are retried with lwIP's backoff.
+ * ARP probes are answered for the one address another host is said to hold.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "fake_internal.h"
+#include "fake_rtos.h"
+#include "fake_wifi.h"
+#include "lwip/etharp.h"
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+static const char *TAG = "fake_netif";
+
+#define IP_LOST_TIMER_MS 120000 // CONFIG_ESP_NETIF_IP_LOST_TIMER_INTERVAL default
+#define DHCP_RETRY_FIRST_MS 2000
+#define DHCP_RETRY_MAX_MS 60000
+#define ARP_REPLY_MS 5
+
+struct esp_netif_obj
+{
+    bool sta;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns[ESP_NETIF_DNS_MAX];
+    esp_netif_dhcp_status_t dhcpc;
+};
+
+static portMUX_TYPE netif_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_netif_t *sta_netif;
+static bool link_up;
+static fake_network_t network;
+static uint32_t dhcp_call;     // Pending lease, 0 if none
+static uint32_t dhcp_attempt;  // Bumped whenever a pending lease is superseded
+static uint32_t last_ip;       // Address of the last GOT_IP, for ip_changed
+static uint32_t dhcp_retry_ms; // Wait before the next discover when unanswered
+static uint32_t lost_call;     // Pending IP lost timer, 0 if none
+static uint32_t ip_in_use;     // Held by another host on the network, 0 if none
+static uint32_t arp_entry;     // Address an ARP reply was received for, 0 if none
+static uint32_t arp_call;      // Pending ARP reply, 0 if none
+
+static bool ip_valid(const esp_netif_ip_info_t *info)
+{
+    return info->ip.addr != 0;
+}
+
+static void post_got_ip(esp_netif_t *netif, const esp_netif_ip_info_t *info, bool changed)
+{
+    ip_event_got_ip_t event = {
+        .esp_netif = netif,
+        .ip_info = *info,
+        .ip_changed = changed,
+    };
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &event, sizeof(event), portMAX_DELAY);
+}
+
+/* ==========================================
+ *          DHCP CLIENT
+ * ========================================== */
+
+static void dhcp_lease(void *arg)
+{
+    uint32_t expected = (uint32_t)(uintptr_t)arg;
+    portENTER_CRITICAL(&netif_lock);
+    if (!sta_netif || !link_up || sta_netif->dhcpc != ESP_NETIF_DHCP_STARTED || dhcp_attempt != expected)
+    {
+        portEXIT_CRITICAL(&netif_lock);
+        return;
+    }
+    dhcp_call = 0;
+    if (!network.dhcp_up)
+    {
+        // No offer: the client discovers again later and no event is posted
+        uint32_t retry_ms = dhcp_retry_ms;
+        dhcp_retry_ms = retry_ms * 2 < DHCP_RETRY_MAX_MS ? retry_ms * 2 : DHCP_RETRY_MAX_MS;
+        dhcp_call = fake_rtos_call_later((int64_t)retry_ms * 1000, dhcp_lease, (void *)(uintptr_t)++dhcp_attempt);
+        portEXIT_CRITICAL(&netif_lock);
+        ESP_LOGD(TAG, "DHCP server of AP %d does not answer, retry in %lu ms", network.ap, (unsigned long)retry_ms);
+        return;
+    }
+    fake_rtos_cancel(lost_call);
+    lost_call = 0;
+    esp_netif_t *netif = sta_netif;
+    // The server skips an address another host holds
+    netif->ip_info.ip.addr = network.ip == ip_in_use ? network.ip + esp_netif_htonl(1) : network.ip;
+    netif->ip_info.gw.addr = network.gateway;
+    netif->ip_info.netmask.addr = network.netmask;
+    netif->dns[ESP_NETIF_DNS_MAIN].ip.u_addr.ip4.addr = network.gateway;
+    netif->dns[ESP_NETIF_DNS_MAIN].ip.type = ESP_IPADDR_TYPE_V4;
+    esp_netif_ip_info_t info = netif->ip_info;
+    bool changed = info.ip.addr != last_ip;
+    last_ip = info.ip.addr;
+    portEXIT_CRITICAL(&netif_lock);
+
+    fake_wifi_count_dhcp_lease();
+    post_got_ip(netif, &info, changed);
+}
+
+/**
+ * @brief Run DISCOVER..ACK for the current link (netif_lock held)
+ */
+static void dhcp_begin_locked(void)
+{
+    fake_rtos_cancel(dhcp_call);
+    dhcp_retry_ms = DHCP_RETRY_FIRST_MS;
+    dhcp_call = fake_rtos_call_later((int64_t)network.dhcp_ms * 1000, dhcp_lease, (void *)(uintptr_t)++dhcp_attempt);
+}
+
+static void dhcp_cancel_locked(void)
+{
+    fake_rtos_cancel(dhcp_call);
+    dhcp_call = 0;
+    dhcp_attempt++;
+}
+
+static void ip_lost(void *arg)
+{
+    portENTER_CRITICAL(&netif_lock);
+    lost_call = 0;
+    esp_netif_t *netif = sta_netif && !ip_valid(&sta_netif->ip_info) ? sta_netif : NULL;
+    portEXIT_CRITICAL(&netif_lock);
+
+    if (netif)
+    {
+        ip_event_got_ip_t event = {.esp_netif = netif};
+        esp_event_post(IP_EVENT, IP_EVENT_STA_LOST_IP, &event, sizeof(event), portMAX_DELAY);
+    }
+}
+
+/* ==========================================
+ *          ARP
+ * ========================================== */
+
+static void arp_reply(void *arg)
+{
+    portENTER_CRITICAL(&netif_lock);
+    arp_call = 0;
+    if (link_up)
+    {
+        arp_entry = (uint32_t)(uintptr_t)arg;
+    }
+    portEXIT_CRITICAL(&netif_lock);
+}
+
+void fake_netif_set_ip_in_use(uint32_t ip)
+{
+    portENTER_CRITICAL(&netif_lock);
+    ip_in_use = ip;
+    portEXIT_CRITICAL(&netif_lock);
+}
+
+void *esp_netif_get_netif_impl(esp_netif_t *netif)
+{
+    return netif;
+}
+
+esp_err_t esp_netif_tcpip_exec(esp_netif_callback_fn fn, void *ctx)
+{
+    return fn(ctx);
+}
+
+err_t etharp_acd_probe(struct netif *netif, const ip4_addr_t *ipaddr)
+{
+    portENTER_CRITICAL(&netif_lock);
+    if ((esp_netif_t *)netif != sta_netif || !link_up)
+    {
+        portEXIT_CRITICAL(&netif_lock);
+        return ERR_IF;
+    }
+    if (ipaddr->addr == ip_in_use && !arp_call)
+    {
+        arp_call = fake_rtos_call_later((int64_t)ARP_REPLY_MS * 1000, arp_reply, (void *)(uintptr_t)ipaddr->addr);
+    }
+    portEXIT_CRITICAL(&netif_lock);
+    return ERR_OK;
+}
+
+ssize_t etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr **eth_ret,
+                         const ip4_addr_t **ip_ret)
+{
+    static struct eth_addr owner_mac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0xee}};
+    static ip4_addr_t owner_ip;
+
+    portENTER_CRITICAL(&netif_lock);
+    bool found = (esp_netif_t *)netif == sta_netif && ipaddr->addr != 0 && ipaddr->addr == arp_entry;
+    portEXIT_CRITICAL(&netif_lock);
+    if (!found)
+    {
+        return -1;
+    }
+    owner_ip = *ipaddr;
+    *eth_ret = &owner_mac;
+    *ip_ret = &owner_ip;
+    return 0;
+}
+
+/* ==========================================
+ *          LINK (from the driver)
+ * ========================================== */
+
+void fake_netif_sta_link_up(const fake_network_t *net)
+{
+    esp_netif_t *netif = NULL;
+    esp_netif_ip_info_t info;
+    bool changed = false;
+    bool started = false;
+
+    portENTER_CRITICAL(&netif_lock);
+    link_up = true;
+    network = *net;
+    if (sta_netif)
+    {
+        switch (sta_netif->dhcpc)
+        {
+        case ESP_NETIF_DHCP_INIT:
+            sta_netif->dhcpc = ESP_NETIF_DHCP_STARTED;
+            started = true;
+            dhcp_begin_locked();
+            break;
+        case ESP_NETIF_DHCP_STARTED:
+            dhcp_begin_locked();
+            break;
+        case ESP_NETIF_DHCP_STOPPED:
+            if (ip_valid(&sta_netif->ip_info))
+            {
+                // A static address is usable as soon as the link is up
+                netif = sta_netif;
+                info = sta_netif->ip_info;
+                changed = info.ip.addr != last_ip;
+                last_ip = info.ip.addr;
+            }
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&netif_lock);
+
+    if (started)
+    {
+        fake_wifi_count_dhcp_start();
+    }
+    if (netif)
+    {
+        post_got_ip(netif, &info, changed);
+    }
+}
+
+void fake_netif_sta_link_down(void)
+{
+    portENTER_CRITICAL(&netif_lock);
+    link_up = false;
+    dhcp_cancel_locked();
+    fake_rtos_cancel(arp_call);
+    arp_call = 0;
+    arp_entry = 0;
+    if (sta_netif && sta_netif->dhcpc == ESP_NETIF_DHCP_STARTED)
+    {
+        // As esp_netif_down(): a running client starts over on the next link
+        sta_netif->dhcpc = ESP_NETIF_DHCP_INIT;
+        if (ip_valid(&sta_netif->ip_info) && !lost_call)
+        {
+            lost_call = fake_rtos_call_later((int64_t)IP_LOST_TIMER_MS * 1000, ip_lost, NULL);
+        }
+        memset(&sta_netif->ip_info, 0, sizeof(sta_netif->ip_info));
+    }
+    portEXIT_CRITICAL(&netif_lock);
+}
+
+void fake_netif_sta_dhcp_server(bool up)
+{
+    portENTER_CRITICAL(&netif_lock);
+    network.dhcp_up = up;
+    portEXIT_CRITICAL(&netif_lock);
+}
+
+void fake_netif_reset(void)
+{
+    portENTER_CRITICAL(&netif_lock);
+    dhcp_cancel_locked();
+    fake_rtos_cancel(lost_call);
+    lost_call = 0;
+    fake_rtos_cancel(arp_call);
+    arp_call = 0;
+    arp_entry = 0;
+    ip_in_use = 0;
+    link_up = false;
+    last_ip = 0;
+    memset(&network, 0, sizeof(network));
+    portEXIT_CRITICAL(&netif_lock);
+}
+
+uint32_t fake_netif_sta_ip(void)
+{
+    portENTER_CRITICAL(&netif_lock);
+    uint32_t ip = sta_netif ? sta_netif->ip_info.ip.addr : 0;
+    portEXIT_CRITICAL(&netif_lock);
+    return ip;
+}
+
+/* ==========================================
+ *          ESP_NETIF API
+ * ========================================== */
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    esp_netif_t *netif = calloc(1, sizeof(*netif));
+    if (!netif)
+    {
+        return NULL;
+    }
+    netif->sta = true;
+    netif->dhcpc = ESP_NETIF_DHCP_INIT;
+
+    portENTER_CRITICAL(&netif_lock);
+    if (sta_netif)
+    {
+        portEXIT_CRITICAL(&netif_lock);
+        free(netif);
+        ESP_LOGE(TAG, "Station netif already created");
+        return NULL;
+    }
+    sta_netif = netif;
+    portEXIT_CRITICAL(&netif_lock);
+    return netif;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void)
+{
+    esp_netif_t *netif = calloc(1, sizeof(*netif));
+    if (!netif)
+    {
+        return NULL;
+    }
+    netif->ip_info.ip.addr = ESP_IP4TOADDR(192, 168, 4, 1);
+    netif->ip_info.gw.addr = ESP_IP4TOADDR(192, 168, 4, 1);
+    netif->ip_info.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+    netif->dhcpc = ESP_NETIF_DHCP_STOPPED;
+    return netif;
+}
+
+void esp_netif_destroy(esp_netif_t *netif)
+{
+    if (!netif)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    if (netif == sta_netif)
+    {
+        dhcp_cancel_locked();
+        fake_rtos_cancel(lost_call);
+        lost_call = 0;
+        fake_rtos_cancel(arp_call);
+        arp_call = 0;
+        arp_entry = 0;
+        sta_netif = NULL;
+    }
+    portEXIT_CRITICAL(&netif_lock);
+    free(netif);
+}
+
+void esp_netif_destroy_default_wifi(void *esp_netif)
+{
+    esp_netif_destroy(esp_netif);
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *ip_info)
+{
+    if (!netif || !ip_info)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    *ip_info = netif->ip_info;
+    portEXIT_CRITICAL(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info)
+{
+    if (!netif || !ip_info)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    bool post = false;
+    bool changed = false;
+    portENTER_CRITICAL(&netif_lock);
+    if (netif->sta && netif->dhcpc == ESP_NETIF_DHCP_STARTED)
+    {
+        portEXIT_CRITICAL(&netif_lock);
+        return ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED;
+    }
+    netif->ip_info = *ip_info;
+    if (netif == sta_netif && link_up && ip_valid(ip_info))
+    {
+        post = true;
+        changed = ip_info->ip.addr != last_ip;
+        last_ip = ip_info->ip.addr;
+    }
+    portEXIT_CRITICAL(&netif_lock);
+
+    if (post)
+    {
+        post_got_ip(netif, ip_info, changed);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *netif)
+{
+    if (!netif || !netif->sta)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    if (netif->dhcpc == ESP_NETIF_DHCP_STARTED)
+    {
+        portEXIT_CRITICAL(&netif_lock);
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED;
+    }
+    netif->dhcpc = ESP_NETIF_DHCP_STARTED;
+    memset(&netif->ip_info, 0, sizeof(netif->ip_info));
+    if (netif == sta_netif && link_up)
+    {
+        dhcp_begin_locked();
+    }
+    portEXIT_CRITICAL(&netif_lock);
+
+    fake_wifi_count_dhcp_start();
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif)
+{
+    if (!netif || !netif->sta)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    if (netif->dhcpc == ESP_NETIF_DHCP_STOPPED)
+    {
+        portEXIT_CRITICAL(&netif_lock);
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+    }
+    netif->dhcpc = ESP_NETIF_DHCP_STOPPED;
+    if (netif == sta_netif)
+    {
+        dhcp_cancel_locked();
+    }
+    portEXIT_CRITICAL(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_get_status(esp_netif_t *netif, esp_netif_dhcp_status_t *status)
+{
+    if (!netif || !status)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    *status = netif->dhcpc;
+    portEXIT_CRITICAL(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+    if (!netif || !dns || type >= ESP_NETIF_DNS_MAX)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    netif->dns[type] = *dns;
+    portEXIT_CRITICAL(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t *netif, esp_netif_dns_type_t type, esp_netif_dns_info_t *dns)
+{
+    if (!netif || !dns || type >= ESP_NETIF_DNS_MAX)
+    {
+        return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    }
+    portENTER_CRITICAL(&netif_lock);
+    *dns = netif->dns[type];
+    portEXIT_CRITICAL(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_str_to_ip4(const char *src, esp_ip4_addr_t *dst)
+{
+    struct in_addr addr;
+    if (!src || !dst || inet_pton(AF_INET, src, &addr) != 1)
+    {
+        return ESP_FAIL;
+    }
+    dst->addr = addr.s_addr;
+    return ESP_OK;
+}
+
+char *esp_ip4addr_ntoa(const esp_ip4_addr_t *addr, char *buf, int buflen)
+{
+    struct in_addr in = {.s_addr = addr->addr};
+    return inet_ntop(AF_INET, &in, buf, buflen) ? buf : NULL;
+}
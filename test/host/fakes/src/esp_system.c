@@ -0,0 +1,449 @@
+/**
+ * @file esp_system.c
+ * @brief esp_err, esp_log, esp_timer, heap_caps and esp_restart on the host
+ *
+ * The heap is a FAKE_HEAP_SIZE region from which whatever the process has
+ * allocated with malloc is taken, so free and minimum free sizes move with the
+ * component's allocations as they do on the device. malloc and friends are
+ * wrapped to count the live bytes; mallinfo2() would also count the chunks
+ * glibc caches per thread after free(), which hides small releases. Under
+ * AddressSanitizer, which owns malloc, mallinfo2() is used instead.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "fake_rtos.h"
+#include "fake_system.h"
+#include "nvs.h"
+
+/* ==========================================
+ *          ERRORS
+ * ========================================== */
+
+#define ERR_NAME(code) {code, #code}
+
+static const struct
+{
+    esp_err_t code;
+    const char *name;
+} err_names[] = {
+    ERR_NAME(ESP_OK),
+    ERR_NAME(ESP_FAIL),
+    ERR_NAME(ESP_ERR_NO_MEM),
+    ERR_NAME(ESP_ERR_INVALID_ARG),
+    ERR_NAME(ESP_ERR_INVALID_STATE),
+    ERR_NAME(ESP_ERR_INVALID_SIZE),
+    ERR_NAME(ESP_ERR_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NOT_SUPPORTED),
+    ERR_NAME(ESP_ERR_TIMEOUT),
+    ERR_NAME(ESP_ERR_INVALID_RESPONSE),
+    ERR_NAME(ESP_ERR_NOT_FINISHED),
+    ERR_NAME(ESP_ERR_NVS_NOT_INITIALIZED),
+    ERR_NAME(ESP_ERR_NVS_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NVS_TYPE_MISMATCH),
+    ERR_NAME(ESP_ERR_NVS_READ_ONLY),
+    ERR_NAME(ESP_ERR_NVS_NOT_ENOUGH_SPACE),
+    ERR_NAME(ESP_ERR_NVS_INVALID_NAME),
+    ERR_NAME(ESP_ERR_NVS_INVALID_HANDLE),
+    ERR_NAME(ESP_ERR_NVS_KEY_TOO_LONG),
+    ERR_NAME(ESP_ERR_NVS_INVALID_LENGTH),
+    ERR_NAME(ESP_ERR_NVS_NO_FREE_PAGES),
+    ERR_NAME(ESP_ERR_NVS_NEW_VERSION_FOUND),
+    ERR_NAME(ESP_ERR_WIFI_NOT_INIT),
+    ERR_NAME(ESP_ERR_WIFI_NOT_STARTED),
+    ERR_NAME(ESP_ERR_WIFI_NOT_STOPPED),
+    ERR_NAME(ESP_ERR_WIFI_IF),
+    ERR_NAME(ESP_ERR_WIFI_MODE),
+    ERR_NAME(ESP_ERR_WIFI_STATE),
+    ERR_NAME(ESP_ERR_WIFI_CONN),
+    ERR_NAME(ESP_ERR_WIFI_SSID),
+    ERR_NAME(ESP_ERR_WIFI_PASSWORD),
+    ERR_NAME(ESP_ERR_WIFI_TIMEOUT),
+    ERR_NAME(ESP_ERR_WIFI_NOT_CONNECT),
+    ERR_NAME(ESP_ERR_ESP_NETIF_INVALID_PARAMS),
+    ERR_NAME(ESP_ERR_ESP_NETIF_IF_NOT_READY),
+    ERR_NAME(ESP_ERR_ESP_NETIF_DHCPC_START_FAILED),
+    ERR_NAME(ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED),
+    ERR_NAME(ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED),
+    ERR_NAME(ESP_ERR_ESP_NETIF_NO_MEM),
+    ERR_NAME(ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLERS_FULL),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLER_EXISTS),
+    ERR_NAME(ESP_ERR_HTTPD_INVALID_REQ),
+    ERR_NAME(ESP_ERR_HTTPD_RESULT_TRUNC),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_HDR),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_SEND),
+    ERR_NAME(ESP_ERR_HTTPD_ALLOC_MEM),
+    ERR_NAME(ESP_ERR_HTTPD_TASK),
+};
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); i++)
+    {
+        if (err_names[i].code == code)
+        {
+            return err_names[i].name;
+        }
+    }
+    return "UNKNOWN ERROR";
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function, const char *expression)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nfunc: %s\nexpression: %s\n", rc,
+            esp_err_to_name(rc), file, line, function, expression);
+    abort();
+}
+
+/* ==========================================
+ *          LOG
+ * ========================================== */
+
+#define LOG_MAX_TAGS 16
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static esp_log_level_t default_level = ESP_LOG_WARN;
+static struct
+{
+    char tag[32];
+    esp_log_level_t level;
+} tag_levels[LOG_MAX_TAGS];
+static int tag_level_count;
+static vprintf_like_t log_vprintf = vprintf;
+static fake_log_hook_t log_hook;
+static void *log_hook_ctx;
+
+__attribute__((constructor)) static void fake_system_init(void)
+{
+#ifdef __SANITIZE_ADDRESS__
+    // One arena, so mallinfo2() sees the allocations of every thread
+    mallopt(M_ARENA_MAX, 1);
+#endif
+
+    const char *env = getenv("WM_HOST_LOG");
+    if (env && *env)
+    {
+        const char *letters = "NEWIDV";
+        const char *found = strchr(letters, env[0]);
+        if (found)
+        {
+            default_level = (esp_log_level_t)(found - letters);
+        }
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    pthread_mutex_lock(&log_lock);
+    if (strcmp(tag, "*") == 0)
+    {
+        default_level = level;
+        tag_level_count = 0;
+    }
+    else
+    {
+        int i = 0;
+        while (i < tag_level_count && strcmp(tag_levels[i].tag, tag) != 0)
+        {
+            i++;
+        }
+        if (i < LOG_MAX_TAGS)
+        {
+            snprintf(tag_levels[i].tag, sizeof(tag_levels[i].tag), "%s", tag);
+            tag_levels[i].level = level;
+            tag_level_count = i == tag_level_count ? i + 1 : tag_level_count;
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+static esp_log_level_t level_for_locked(const char *tag)
+{
+    for (int i = 0; i < tag_level_count; i++)
+    {
+        if (strcmp(tag_levels[i].tag, tag) == 0)
+        {
+            return tag_levels[i].level;
+        }
+    }
+    return default_level;
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    pthread_mutex_lock(&log_lock);
+    esp_log_level_t level = level_for_locked(tag);
+    pthread_mutex_unlock(&log_lock);
+    return level;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    pthread_mutex_lock(&log_lock);
+    vprintf_like_t previous = log_vprintf;
+    log_vprintf = func;
+    pthread_mutex_unlock(&log_lock);
+    return previous;
+}
+
+void fake_log_set_hook(fake_log_hook_t hook, void *ctx)
+{
+    pthread_mutex_lock(&log_lock);
+    log_hook = hook;
+    log_hook_ctx = ctx;
+    pthread_mutex_unlock(&log_lock);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(fake_rtos_now_us() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    pthread_mutex_lock(&log_lock);
+    bool printed = level <= level_for_locked(tag);
+    bool hooked = log_hook != NULL;
+    if (!printed && !hooked)
+    {
+        pthread_mutex_unlock(&log_lock);
+        return;
+    }
+
+    va_list args;
+    if (printed)
+    {
+        va_start(args, format);
+        log_vprintf(format, args);
+        va_end(args);
+    }
+    if (hooked)
+    {
+        // The hook sees every line, so benchmarks can collect debug probes without printing them
+        char line[512];
+        va_start(args, format);
+        vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        log_hook(line, log_hook_ctx);
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+/* ==========================================
+ *          TIMER, HEAP, RESTART
+ * ========================================== */
+
+int64_t esp_timer_get_time(void)
+{
+    return fake_rtos_now_us();
+}
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t heap_minimum_free = FAKE_HEAP_SIZE;
+static unsigned restart_count;
+
+#ifndef __SANITIZE_ADDRESS__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static size_t heap_live_bytes;
+static __thread bool heap_ignored;
+static __thread bool heap_paused;
+static __thread int heap_fail_countdown = -1;
+
+void fake_heap_ignore_thread(void)
+{
+    heap_ignored = true;
+}
+
+void fake_heap_pause(bool paused)
+{
+    heap_paused = paused;
+}
+
+bool fake_heap_fail_after(int countdown)
+{
+    heap_fail_countdown = countdown;
+    return true;
+}
+
+static bool alloc_fails(void)
+{
+    if (heap_fail_countdown < 0)
+    {
+        return false;
+    }
+    return heap_fail_countdown-- == 0;
+}
+
+static void *count_alloc(void *ptr)
+{
+    if (ptr && !heap_ignored && !heap_paused)
+    {
+        __atomic_add_fetch(&heap_live_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+void *malloc(size_t size)
+{
+    return alloc_fails() ? NULL : count_alloc(__libc_malloc(size));
+}
+
+void *calloc(size_t count, size_t size)
+{
+    return alloc_fails() ? NULL : count_alloc(__libc_calloc(count, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (size > 0 && alloc_fails())
+    {
+        return NULL;
+    }
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void *moved = __libc_realloc(ptr, size);
+    if ((moved || size == 0) && !heap_ignored && !heap_paused)
+    {
+        __atomic_sub_fetch(&heap_live_bytes, old_size, __ATOMIC_RELAXED);
+        count_alloc(moved);
+    }
+    return moved;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return alloc_fails() ? NULL : count_alloc(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size)
+{
+    void *ptr = memalign(alignment, size);
+    if (!ptr)
+    {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    if (ptr && !heap_ignored && !heap_paused)
+    {
+        __atomic_sub_fetch(&heap_live_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    }
+    __libc_free(ptr);
+}
+
+size_t fake_heap_used(void)
+{
+    return __atomic_load_n(&heap_live_bytes, __ATOMIC_RELAXED);
+}
+#else
+void fake_heap_ignore_thread(void)
+{
+}
+
+void fake_heap_pause(bool paused)
+{
+}
+
+bool fake_heap_fail_after(int countdown)
+{
+    return false;
+}
+
+size_t fake_heap_used(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+#endif
+
+static size_t heap_free_now(void)
+{
+    size_t used = fake_heap_used();
+    return used < FAKE_HEAP_SIZE ? FAKE_HEAP_SIZE - used : 0;
+}
+
+void fake_heap_sample(void)
+{
+    size_t free_now = heap_free_now();
+    pthread_mutex_lock(&heap_lock);
+    if (free_now < heap_minimum_free)
+    {
+        heap_minimum_free = free_now;
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void fake_heap_reset_minimum(void)
+{
+    size_t free_now = heap_free_now();
+    pthread_mutex_lock(&heap_lock);
+    heap_minimum_free = free_now;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    fake_heap_sample();
+    return heap_free_now();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    fake_heap_sample();
+    pthread_mutex_lock(&heap_lock);
+    size_t minimum = heap_minimum_free;
+    pthread_mutex_unlock(&heap_lock);
+    return minimum;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+    return FAKE_HEAP_SIZE;
+}
+
+void esp_restart(void)
+{
+    __atomic_add_fetch(&restart_count, 1, __ATOMIC_RELAXED);
+    ESP_LOGW("fake_system", "esp_restart() called");
+}
+
+unsigned fake_system_restart_count(void)
+{
+    return __atomic_load_n(&restart_count, __ATOMIC_RELAXED);
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t base[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+    memcpy(mac, base, sizeof(base));
+    mac[5] += (uint8_t)type;
+    return ESP_OK;
+}
@@ -0,0 +1,1137 @@
+/**
+ * @file esp_wifi.c
+ * @brief Simulated WiFi driver answering from the world of fake_wifi.h
+ *
+ * Scans, associations and link losses complete in the "wifi" driver task after
+ * the delays of fake_wifi_timing_t and are reported with the same events, in
+ * the same order, as the ESP-IDF driver posts them. Association hands the link
+ * to the netif fake, which runs DHCP.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "fake_internal.h"
+#include "fake_rtos.h"
+#include "fake_wifi.h"
+#include "freertos/semphr.h"
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+static const char *TAG = "fake_wifi";
+
+#define MIN_RSSI -95          // Weaker APs are out of range
+#define PASSIVE_DWELL_MS 360  // Per channel when a passive scan config leaves it 0
+#define COUNTRY_CHANNELS 11
+
+typedef struct
+{
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+    int8_t rssi;
+    bool hidden;
+    bool up;
+    bool dhcp_up;
+    uint32_t dhcp_ms;
+    int network; // Index of the first AP with the same SSID
+} fake_ap_t;
+
+typedef enum
+{
+    STA_IDLE,
+    STA_CONNECTING,
+    STA_CONNECTED,
+} sta_state_t;
+
+#define DEFAULT_TIMING                                                                                                \
+    {                                                                                                                 \
+        .scan_channel_ms = 120, .assoc_ms = 400, .auth_fail_ms = 4000, .dhcp_ms = 1500, .beacon_timeout_ms = 6000,    \
+    }
+
+static portMUX_TYPE driver_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// World
+static fake_ap_t aps[FAKE_WIFI_MAX_APS];
+static int ap_count;
+static fake_wifi_timing_t timing = DEFAULT_TIMING;
+static fake_wifi_stats_t stats;
+static unsigned fail_count;
+static wifi_err_reason_t fail_reason;
+
+// Driver
+static bool initialized;
+static bool started;
+static wifi_mode_t mode;
+static wifi_config_t sta_config;
+static wifi_config_t ap_config;
+
+static bool scanning;
+static uint32_t scan_call; // Id of the scan in progress, 0 if none
+static uint32_t scan_counter;
+static wifi_scan_config_t scan_config;
+static uint8_t scan_ssid[33];
+static uint8_t scan_bssid[6];
+static bool scan_has_ssid;
+static bool scan_has_bssid;
+static wifi_ap_record_t *scan_results;
+static uint16_t scan_result_count;
+static SemaphoreHandle_t scan_done_sem; // Given when a blocking scan finishes
+static bool scan_blocking;
+
+static sta_state_t sta_state;
+static int sta_ap = -1;
+static uint32_t sta_call;    // Pending association result
+static uint32_t beacon_call; // Pending beacon timeout
+static uint32_t generation;  // Bumped whenever a pending call is superseded
+
+/* ==========================================
+ *          HELPERS
+ * ========================================== */
+
+static bool ap_in_range(const fake_ap_t *ap)
+{
+    return ap->up && ap->rssi >= MIN_RSSI;
+}
+
+static void post(int32_t id, const void *data, size_t size)
+{
+    esp_event_post(WIFI_EVENT, id, data, size, portMAX_DELAY);
+}
+
+static void fill_disconnected(wifi_event_sta_disconnected_t *event, int ap, wifi_err_reason_t reason)
+{
+    memset(event, 0, sizeof(*event));
+    size_t len = strnlen((const char *)sta_config.sta.ssid, sizeof(sta_config.sta.ssid));
+    memcpy(event->ssid, sta_config.sta.ssid, len);
+    event->ssid_len = len;
+    if (ap >= 0)
+    {
+        memcpy(event->bssid, aps[ap].bssid, sizeof(event->bssid));
+        event->rssi = aps[ap].rssi;
+    }
+    event->reason = reason;
+}
+
+/**
+ * @brief End the association or attempt in progress (driver_lock held)
+ * @return Whether a STA_DISCONNECTED is due
+ */
+static bool sta_drop_locked(int *ap)
+{
+    bool was_active = sta_state != STA_IDLE;
+    bool was_connected = sta_state == STA_CONNECTED;
+    *ap = sta_ap;
+    fake_rtos_cancel(sta_call);
+    fake_rtos_cancel(beacon_call);
+    sta_call = 0;
+    beacon_call = 0;
+    generation++;
+    sta_state = STA_IDLE;
+    sta_ap = -1;
+    if (was_connected)
+    {
+        fake_netif_sta_link_down();
+    }
+    if (was_active)
+    {
+        stats.disconnects++;
+    }
+    return was_active;
+}
+
+static void post_disconnected(int ap, wifi_err_reason_t reason)
+{
+    wifi_event_sta_disconnected_t event;
+    portENTER_CRITICAL(&driver_lock);
+    fill_disconnected(&event, ap, reason);
+    portEXIT_CRITICAL(&driver_lock);
+    post(WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event));
+}
+
+static uint32_t network_base(int network)
+{
+    return ESP_IP4TOADDR(192, 168, 10 + network, 0);
+}
+
+/* ==========================================
+ *          SCAN
+ * ========================================== */
+
+static int compare_rssi(const void *a, const void *b)
+{
+    const wifi_ap_record_t *ra = a;
+    const wifi_ap_record_t *rb = b;
+    return rb->rssi - ra->rssi;
+}
+
+static void scan_complete(void *arg)
+{
+    uint32_t expected = (uint32_t)(uintptr_t)arg;
+    wifi_event_sta_scan_done_t event = {0};
+    bool give = false;
+
+    portENTER_CRITICAL(&driver_lock);
+    if (!scanning || scan_call != expected)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return;
+    }
+    free(scan_results);
+    scan_results = calloc(FAKE_WIFI_MAX_APS, sizeof(wifi_ap_record_t));
+    scan_result_count = 0;
+    for (int i = 0; i < ap_count; i++)
+    {
+        const fake_ap_t *ap = &aps[i];
+        if (!ap_in_range(ap) || (scan_config.channel && scan_config.channel != ap->channel))
+        {
+            continue;
+        }
+        if (scan_has_bssid && memcmp(scan_bssid, ap->bssid, sizeof(scan_bssid)) != 0)
+        {
+            continue;
+        }
+        // A probe request for the SSID is answered by a hidden AP as well
+        bool probed = scan_has_ssid && strcmp((const char *)scan_ssid, ap->ssid) == 0;
+        if (scan_has_ssid && !probed)
+        {
+            continue;
+        }
+        if (ap->hidden && !probed && !scan_config.show_hidden)
+        {
+            continue;
+        }
+
+        wifi_ap_record_t *record = &scan_results[scan_result_count++];
+        memcpy(record->bssid, ap->bssid, sizeof(record->bssid));
+        if (!ap->hidden || probed)
+        {
+            strcpy((char *)record->ssid, ap->ssid);
+        }
+        record->primary = ap->channel;
+        record->rssi = ap->rssi;
+        record->authmode = ap->authmode;
+    }
+    qsort(scan_results, scan_result_count, sizeof(wifi_ap_record_t), compare_rssi);
+    scanning = false;
+    scan_call = 0;
+    event.number = scan_result_count;
+    give = scan_blocking;
+    scan_blocking = false;
+    portEXIT_CRITICAL(&driver_lock);
+
+    post(WIFI_EVENT_SCAN_DONE, &event, sizeof(event));
+    if (give)
+    {
+        xSemaphoreGive(scan_done_sem);
+    }
+}
+
+/**
+ * @brief Abort a scan in progress (driver_lock held)
+ * @return Whether SCAN_DONE with status 1 is due
+ */
+static bool scan_abort_locked(bool *give)
+{
+    if (!scanning)
+    {
+        *give = false;
+        return false;
+    }
+    scanning = false;
+    scan_call = 0;
+    *give = scan_blocking;
+    scan_blocking = false;
+    return true;
+}
+
+static void post_scan_aborted(bool give)
+{
+    wifi_event_sta_scan_done_t event = {.status = 1};
+    post(WIFI_EVENT_SCAN_DONE, &event, sizeof(event));
+    if (give)
+    {
+        xSemaphoreGive(scan_done_sem);
+    }
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!started)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    if (mode != WIFI_MODE_STA && mode != WIFI_MODE_APSTA)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_MODE;
+    }
+    if (scanning || sta_state == STA_CONNECTING)
+    {
+        // The radio is busy with a scan or with joining an AP
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_STATE;
+    }
+
+    static const wifi_scan_config_t defaults = {.scan_type = WIFI_SCAN_TYPE_ACTIVE};
+    scan_config = config ? *config : defaults;
+    scan_has_ssid = scan_config.ssid != NULL;
+    if (scan_has_ssid)
+    {
+        strncpy((char *)scan_ssid, (const char *)scan_config.ssid, 32);
+        scan_ssid[32] = '\0';
+    }
+    scan_has_bssid = scan_config.bssid != NULL;
+    if (scan_has_bssid)
+    {
+        memcpy(scan_bssid, scan_config.bssid, sizeof(scan_bssid));
+    }
+
+    uint32_t dwell;
+    if (scan_config.scan_type == WIFI_SCAN_TYPE_PASSIVE)
+    {
+        dwell = scan_config.scan_time.passive ? scan_config.scan_time.passive : PASSIVE_DWELL_MS;
+    }
+    else
+    {
+        dwell = scan_config.scan_time.active.max ? scan_config.scan_time.active.max : timing.scan_channel_ms;
+    }
+    if (timing.scan_dwell_cap_ms && dwell > timing.scan_dwell_cap_ms)
+    {
+        dwell = timing.scan_dwell_cap_ms;
+    }
+    uint32_t channels = scan_config.channel ? 1 : COUNTRY_CHANNELS;
+
+    scanning = true;
+    scan_blocking = block;
+    stats.scans++;
+    uint32_t id = ++scan_counter ? scan_counter : ++scan_counter;
+    scan_call = id;
+    portEXIT_CRITICAL(&driver_lock);
+
+    // A completion left over from an aborted scan finds scan_call changed
+    fake_rtos_call_later((int64_t)dwell * channels * 1000, scan_complete, (void *)(uintptr_t)id);
+
+    if (block)
+    {
+        xSemaphoreTake(scan_done_sem, portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_stop(void)
+{
+    bool give;
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    bool aborted = scan_abort_locked(&give);
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (aborted)
+    {
+        post_scan_aborted(give);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number)
+{
+    if (!number)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    *number = scan_results ? scan_result_count : 0;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records)
+{
+    if (!number || !ap_records)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    uint16_t count = scan_results ? scan_result_count : 0;
+    if (count > *number)
+    {
+        count = *number;
+    }
+    if (count > 0)
+    {
+        memcpy(ap_records, scan_results, count * sizeof(wifi_ap_record_t));
+    }
+    *number = count;
+    // As in ESP-IDF the driver frees its list once the records are read
+    free(scan_results);
+    scan_results = NULL;
+    scan_result_count = 0;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_clear_ap_list(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    free(scan_results);
+    scan_results = NULL;
+    scan_result_count = 0;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+/* ==========================================
+ *          STATION
+ * ========================================== */
+
+static void beacon_timeout(void *arg)
+{
+    uint32_t expected = (uint32_t)(uintptr_t)arg;
+    int ap;
+    portENTER_CRITICAL(&driver_lock);
+    if (beacon_call == 0 || generation != expected)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return;
+    }
+    beacon_call = 0;
+    sta_drop_locked(&ap);
+    portEXIT_CRITICAL(&driver_lock);
+
+    ESP_LOGD(TAG, "Beacon timeout");
+    post_disconnected(ap, WIFI_REASON_BEACON_TIMEOUT);
+}
+
+/**
+ * @brief Start the beacon timeout if the associated AP went away (driver_lock held)
+ */
+static void check_link_locked(void)
+{
+    if (sta_state != STA_CONNECTED || beacon_call)
+    {
+        return;
+    }
+    if (!ap_in_range(&aps[sta_ap]))
+    {
+        beacon_call = fake_rtos_call_later((int64_t)timing.beacon_timeout_ms * 1000, beacon_timeout,
+                                           (void *)(uintptr_t)generation);
+    }
+}
+
+static void association_done(void *arg)
+{
+    uint32_t expected = (uint32_t)(uintptr_t)arg;
+    wifi_event_sta_connected_t event = {0};
+    fake_network_t network;
+
+    portENTER_CRITICAL(&driver_lock);
+    if (sta_state != STA_CONNECTING || generation != expected)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return;
+    }
+    const fake_ap_t *ap = &aps[sta_ap];
+    sta_state = STA_CONNECTED;
+    sta_call = 0;
+    stats.connected++;
+
+    size_t len = strlen(ap->ssid);
+    memcpy(event.ssid, ap->ssid, len);
+    event.ssid_len = len;
+    memcpy(event.bssid, ap->bssid, sizeof(event.bssid));
+    event.channel = ap->channel;
+    event.authmode = ap->authmode;
+    event.aid = 1;
+
+    network.ap = sta_ap;
+    network.ip = network_base(ap->network) | esp_netif_htonl(100);
+    network.gateway = network_base(ap->network) | esp_netif_htonl(1);
+    network.netmask = ESP_IP4TOADDR(255, 255, 255, 0);
+    network.dhcp_ms = ap->dhcp_ms ? ap->dhcp_ms : timing.dhcp_ms;
+    network.dhcp_up = aps[ap->network].dhcp_up;
+    portEXIT_CRITICAL(&driver_lock);
+
+    post(WIFI_EVENT_STA_CONNECTED, &event, sizeof(event));
+    // The netif only sees the link once the event is queued, as with esp_netif_action_connected()
+    fake_netif_sta_link_up(&network);
+
+    portENTER_CRITICAL(&driver_lock);
+    check_link_locked();
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+typedef struct
+{
+    uint32_t generation;
+    int ap;
+    wifi_err_reason_t reason;
+} failure_t;
+
+static void connect_failed(void *arg)
+{
+    failure_t *failure = arg;
+    portENTER_CRITICAL(&driver_lock);
+    bool current = sta_state == STA_CONNECTING && generation == failure->generation;
+    if (current)
+    {
+        sta_state = STA_IDLE;
+        sta_ap = -1;
+        sta_call = 0;
+        stats.disconnects++;
+    }
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (current)
+    {
+        post_disconnected(failure->ap, failure->reason);
+    }
+    free(failure);
+}
+
+/**
+ * @brief AP an association attempt goes to, -1 if none is in range (driver_lock held)
+ */
+static int pick_ap_locked(void)
+{
+    const wifi_sta_config_t *sta = &sta_config.sta;
+    int best = -1;
+    for (int i = 0; i < ap_count; i++)
+    {
+        const fake_ap_t *ap = &aps[i];
+        if (!ap_in_range(ap) || strncmp(ap->ssid, (const char *)sta->ssid, sizeof(sta->ssid)) != 0)
+        {
+            continue;
+        }
+        if (sta->bssid_set && memcmp(ap->bssid, sta->bssid, sizeof(sta->bssid)) != 0)
+        {
+            continue;
+        }
+        if (best < 0 || ap->rssi > aps[best].rssi)
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    int old_ap;
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!started)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    if (mode != WIFI_MODE_STA && mode != WIFI_MODE_APSTA)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_MODE;
+    }
+    if (sta_config.sta.ssid[0] == '\0')
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_SSID;
+    }
+
+    // Connecting while associated leaves the current AP first
+    bool dropped = sta_drop_locked(&old_ap);
+
+    stats.connects++;
+    int ap = pick_ap_locked();
+    uint32_t id = generation;
+    failure_t *failure = NULL;
+    int64_t delay_ms;
+
+    if (ap < 0)
+    {
+        failure = malloc(sizeof(*failure));
+        failure->reason = WIFI_REASON_NO_AP_FOUND;
+        delay_ms = (int64_t)timing.scan_channel_ms * COUNTRY_CHANNELS;
+    }
+    else if (fail_count > 0)
+    {
+        fail_count--;
+        failure = malloc(sizeof(*failure));
+        failure->reason = fail_reason;
+        delay_ms = timing.assoc_ms;
+    }
+    else if (aps[ap].authmode != WIFI_AUTH_OPEN &&
+             strncmp(aps[ap].password, (const char *)sta_config.sta.password, sizeof(sta_config.sta.password)) != 0)
+    {
+        failure = malloc(sizeof(*failure));
+        failure->reason = WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT;
+        delay_ms = timing.auth_fail_ms;
+    }
+    else
+    {
+        delay_ms = timing.assoc_ms;
+    }
+
+    sta_state = STA_CONNECTING;
+    sta_ap = ap;
+    if (failure)
+    {
+        failure->generation = id;
+        failure->ap = ap;
+        sta_call = fake_rtos_call_later(delay_ms * 1000, connect_failed, failure);
+    }
+    else
+    {
+        sta_call = fake_rtos_call_later(delay_ms * 1000, association_done, (void *)(uintptr_t)id);
+    }
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (dropped)
+    {
+        post_disconnected(old_ap, WIFI_REASON_ASSOC_LEAVE);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    int ap;
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!started)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    bool dropped = sta_drop_locked(&ap);
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (dropped)
+    {
+        post_disconnected(ap, WIFI_REASON_ASSOC_LEAVE);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (!ap_info)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&driver_lock);
+    if (sta_state != STA_CONNECTED)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+    const fake_ap_t *ap = &aps[sta_ap];
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, ap->bssid, sizeof(ap_info->bssid));
+    strcpy((char *)ap_info->ssid, ap->ssid);
+    ap_info->primary = ap->channel;
+    ap_info->rssi = ap->rssi;
+    ap_info->authmode = ap->authmode;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi)
+{
+    wifi_ap_record_t info;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&info);
+    if (err == ESP_OK)
+    {
+        *rssi = info.rssi;
+    }
+    return err;
+}
+
+/* ==========================================
+ *          LIFECYCLE
+ * ========================================== */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    (void)config;
+    if (!scan_done_sem)
+    {
+        // Created once and kept, it belongs to the driver not to the component
+        SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+        fake_rtos_mark_system_semaphore(sem);
+        portENTER_CRITICAL(&driver_lock);
+        if (!scan_done_sem)
+        {
+            scan_done_sem = sem;
+            sem = NULL;
+        }
+        portEXIT_CRITICAL(&driver_lock);
+        if (sem)
+        {
+            vSemaphoreDelete(sem);
+        }
+    }
+
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        initialized = true;
+        started = false;
+        mode = WIFI_MODE_STA;
+        memset(&sta_config, 0, sizeof(sta_config));
+        memset(&ap_config, 0, sizeof(ap_config));
+    }
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (started)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_STOPPED;
+    }
+    initialized = false;
+    free(scan_results);
+    scan_results = NULL;
+    scan_result_count = 0;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t new_mode)
+{
+    if (new_mode >= WIFI_MODE_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int ap = -1;
+    bool dropped = false;
+    bool aborted = false;
+    bool give = false;
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    bool had_sta = mode == WIFI_MODE_STA || mode == WIFI_MODE_APSTA;
+    bool had_ap = mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA;
+    bool has_sta = new_mode == WIFI_MODE_STA || new_mode == WIFI_MODE_APSTA;
+    bool has_ap = new_mode == WIFI_MODE_AP || new_mode == WIFI_MODE_APSTA;
+    bool was_started = started;
+    mode = new_mode;
+    if (was_started && had_sta && !has_sta)
+    {
+        dropped = sta_drop_locked(&ap);
+        aborted = scan_abort_locked(&give);
+    }
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (!was_started)
+    {
+        return ESP_OK;
+    }
+    // A started driver brings interfaces up and down with the mode
+    if (dropped)
+    {
+        post_disconnected(ap, WIFI_REASON_ASSOC_LEAVE);
+    }
+    if (aborted)
+    {
+        post_scan_aborted(give);
+    }
+    if (had_sta && !has_sta)
+    {
+        post(WIFI_EVENT_STA_STOP, NULL, 0);
+    }
+    if (!had_sta && has_sta)
+    {
+        post(WIFI_EVENT_STA_START, NULL, 0);
+    }
+    if (had_ap && !has_ap)
+    {
+        post(WIFI_EVENT_AP_STOP, NULL, 0);
+    }
+    if (!had_ap && has_ap)
+    {
+        post(WIFI_EVENT_AP_START, NULL, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *out)
+{
+    if (!out)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    *out = mode;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (started)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_OK;
+    }
+    started = true;
+    wifi_mode_t current = mode;
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (current == WIFI_MODE_STA || current == WIFI_MODE_APSTA)
+    {
+        post(WIFI_EVENT_STA_START, NULL, 0);
+    }
+    if (current == WIFI_MODE_AP || current == WIFI_MODE_APSTA)
+    {
+        post(WIFI_EVENT_AP_START, NULL, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    int ap;
+    bool give;
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!started)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_OK;
+    }
+    bool dropped = sta_drop_locked(&ap);
+    bool aborted = scan_abort_locked(&give);
+    started = false;
+    wifi_mode_t current = mode;
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (dropped)
+    {
+        post_disconnected(ap, WIFI_REASON_ASSOC_LEAVE);
+    }
+    if (aborted)
+    {
+        post_scan_aborted(give);
+    }
+    if (current == WIFI_MODE_STA || current == WIFI_MODE_APSTA)
+    {
+        post(WIFI_EVENT_STA_STOP, NULL, 0);
+    }
+    if (current == WIFI_MODE_AP || current == WIFI_MODE_APSTA)
+    {
+        post(WIFI_EVENT_AP_STOP, NULL, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!conf)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface == WIFI_IF_STA)
+    {
+        sta_config = *conf;
+    }
+    else
+    {
+        ap_config = *conf;
+    }
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (!conf)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&driver_lock);
+    if (!initialized)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    *conf = interface == WIFI_IF_STA ? sta_config : ap_config;
+    portEXIT_CRITICAL(&driver_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_country(wifi_country_t *country)
+{
+    if (!country)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(country, 0, sizeof(*country));
+    strcpy(country->cc, "01");
+    country->schan = 1;
+    country->nchan = COUNTRY_CHANNELS;
+    country->max_tx_power = 20;
+    country->policy = WIFI_COUNTRY_POLICY_AUTO;
+    return ESP_OK;
+}
+
+/* ==========================================
+ *          WORLD CONTROL
+ * ========================================== */
+
+void fake_wifi_reset(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    fake_rtos_cancel(sta_call);
+    fake_rtos_cancel(beacon_call);
+    generation++;
+    memset(aps, 0, sizeof(aps));
+    ap_count = 0;
+    timing = (fake_wifi_timing_t)DEFAULT_TIMING;
+    memset(&stats, 0, sizeof(stats));
+    fail_count = 0;
+    initialized = false;
+    started = false;
+    mode = WIFI_MODE_NULL;
+    scanning = false;
+    scan_blocking = false;
+    scan_call = 0;
+    free(scan_results);
+    scan_results = NULL;
+    scan_result_count = 0;
+    sta_state = STA_IDLE;
+    sta_ap = -1;
+    sta_call = 0;
+    beacon_call = 0;
+    portEXIT_CRITICAL(&driver_lock);
+    fake_netif_reset();
+}
+
+int fake_wifi_add_ap(const fake_ap_config_t *config)
+{
+    portENTER_CRITICAL(&driver_lock);
+    if (ap_count == FAKE_WIFI_MAX_APS)
+    {
+        portEXIT_CRITICAL(&driver_lock);
+        return -1;
+    }
+    int index = ap_count++;
+    fake_ap_t *ap = &aps[index];
+    memset(ap, 0, sizeof(*ap));
+    strncpy(ap->ssid, config->ssid ? config->ssid : "", sizeof(ap->ssid) - 1);
+    strncpy(ap->password, config->password ? config->password : "", sizeof(ap->password) - 1);
+    static const uint8_t zero[6] = {0};
+    if (memcmp(config->bssid, zero, sizeof(zero)) != 0)
+    {
+        memcpy(ap->bssid, config->bssid, sizeof(ap->bssid));
+    }
+    else
+    {
+        const uint8_t derived[6] = {0x02, 0x00, 0x5e, 0x10, 0x00, (uint8_t)(index + 1)};
+        memcpy(ap->bssid, derived, sizeof(ap->bssid));
+    }
+    ap->channel = config->channel ? config->channel : 1;
+    ap->authmode = config->authmode;
+    ap->rssi = config->rssi;
+    ap->hidden = config->hidden;
+    ap->up = true;
+    ap->dhcp_up = true;
+    ap->dhcp_ms = config->dhcp_ms;
+    ap->network = index;
+    for (int i = 0; i < index; i++)
+    {
+        if (strcmp(aps[i].ssid, ap->ssid) == 0)
+        {
+            ap->network = aps[i].network;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&driver_lock);
+    return index;
+}
+
+void fake_wifi_set_rssi(int ap, int8_t rssi)
+{
+    portENTER_CRITICAL(&driver_lock);
+    if (ap >= 0 && ap < ap_count)
+    {
+        aps[ap].rssi = rssi;
+        if (sta_state == STA_CONNECTED && sta_ap == ap && ap_in_range(&aps[ap]) && beacon_call)
+        {
+            // Back in range before the timeout
+            fake_rtos_cancel(beacon_call);
+            beacon_call = 0;
+        }
+        check_link_locked();
+    }
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+void fake_wifi_set_ap_up(int ap, bool up)
+{
+    portENTER_CRITICAL(&driver_lock);
+    if (ap >= 0 && ap < ap_count)
+    {
+        aps[ap].up = up;
+        if (up && sta_state == STA_CONNECTED && sta_ap == ap && ap_in_range(&aps[ap]) && beacon_call)
+        {
+            fake_rtos_cancel(beacon_call);
+            beacon_call = 0;
+        }
+        check_link_locked();
+    }
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+void fake_wifi_fail_connects(unsigned count, wifi_err_reason_t reason)
+{
+    portENTER_CRITICAL(&driver_lock);
+    fail_count = count;
+    fail_reason = reason;
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+void fake_wifi_drop_link(wifi_err_reason_t reason)
+{
+    int ap;
+    portENTER_CRITICAL(&driver_lock);
+    bool dropped = sta_state == STA_CONNECTED && sta_drop_locked(&ap);
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (dropped)
+    {
+        post_disconnected(ap, reason);
+    }
+}
+
+void fake_wifi_set_dhcp_up(int ap, bool up)
+{
+    bool current = false;
+    portENTER_CRITICAL(&driver_lock);
+    if (ap >= 0 && ap < ap_count)
+    {
+        aps[aps[ap].network].dhcp_up = up;
+        current = sta_state == STA_CONNECTED && aps[sta_ap].network == aps[ap].network;
+    }
+    portEXIT_CRITICAL(&driver_lock);
+
+    if (current)
+    {
+        fake_netif_sta_dhcp_server(up);
+    }
+}
+
+uint32_t fake_wifi_lease_ip(int ap)
+{
+    portENTER_CRITICAL(&driver_lock);
+    uint32_t ip = ap >= 0 && ap < ap_count ? network_base(aps[ap].network) | esp_netif_htonl(100) : 0;
+    portEXIT_CRITICAL(&driver_lock);
+    return ip;
+}
+
+void fake_wifi_get_timing(fake_wifi_timing_t *out)
+{
+    portENTER_CRITICAL(&driver_lock);
+    *out = timing;
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+void fake_wifi_set_timing(const fake_wifi_timing_t *in)
+{
+    portENTER_CRITICAL(&driver_lock);
+    timing = *in;
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+void fake_wifi_get_stats(fake_wifi_stats_t *out)
+{
+    portENTER_CRITICAL(&driver_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+int fake_wifi_connected_ap(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    int ap = sta_state == STA_CONNECTED ? sta_ap : -1;
+    portEXIT_CRITICAL(&driver_lock);
+    return ap;
+}
+
+void fake_wifi_count_dhcp_start(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    stats.dhcp_starts++;
+    portEXIT_CRITICAL(&driver_lock);
+}
+
+void fake_wifi_count_dhcp_lease(void)
+{
+    portENTER_CRITICAL(&driver_lock);
+    stats.dhcp_leases++;
+    portEXIT_CRITICAL(&driver_lock);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file fake_internal.h
+ * @brief Interfaces between the fakes, not used by tests
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Task belonging to the fakes (event loop, timers, driver), never fails and is not counted
+ */
+TaskHandle_t fake_rtos_create_system_task(TaskFunction_t code, const char *name, void *params,
+                                          UBaseType_t priority);
+
+/**
+ * @brief Leave a semaphore of the fakes out of fake_rtos_get_counts()
+ */
+void fake_rtos_mark_system_semaphore(SemaphoreHandle_t sem);
+
+/**
+ * @brief Network the station is associated with, as seen by the netif fake
+ */
+typedef struct
+{
+    int ap;             // AP index
+    uint32_t ip;        // Address the DHCP server hands out
+    uint32_t gateway;
+    uint32_t netmask;
+    uint32_t dhcp_ms;   // Exchange duration
+    bool dhcp_up;       // Whether the DHCP server answers
+} fake_network_t;
+
+/**
+ * @brief Station link state changes, called by the driver with the event already posted
+ */
+void fake_netif_sta_link_up(const fake_network_t *network);
+void fake_netif_sta_link_down(void);
+
+/**
+ * @brief The DHCP server of the associated network stopped or resumed answering
+ */
+void fake_netif_sta_dhcp_server(bool up);
+
+/**
+ * @brief Driver and netif counters live in the driver
+ */
+void fake_wifi_count_dhcp_start(void);
+void fake_wifi_count_dhcp_lease(void);
+
+/**
+ * @brief Forget the station netif state (fake_wifi_reset)
+ */
+void fake_netif_reset(void);
@@ -0,0 +1,1430 @@
+/**
+ * @file freertos.c
+ * @brief FreeRTOS on POSIX threads for the host tests
+ *
+ * Every task is a thread, but only the one holding the fake CPU (`running`)
+ * executes; the others wait on their condition variable. The CPU goes to the
+ * highest-priority ready task, FIFO within a priority, whenever the running
+ * task blocks, yields, or readies a task of higher priority, so the component
+ * sees the same interleavings as on a single core. Threads outside the
+ * scheduler (httpd, test clients, main on the real clock) run concurrently
+ * like a second core and wait on `external_cond`.
+ *
+ * A scheduler thread wakes blocked tasks at their deadlines. On the virtual
+ * clock it moves time straight to the next deadline once nothing is ready.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fake_internal.h"
+#include "fake_rtos.h"
+#include "fake_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+typedef enum
+{
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_BLOCKED,
+} task_state_t;
+
+struct fake_task
+{
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    uint32_t stack_depth;
+    TaskFunction_t code;
+    void *params;
+    bool external; // Thread outside the scheduler, handle only
+    bool system;   // Part of the fakes, not counted by fake_rtos_get_counts()
+    bool deleted;
+    task_state_t state;
+    uint64_t ready_seq;
+    const void *wait_obj; // Object whose change readies the task
+    int64_t wake_us;      // Deadline of the current wait, -1 for none
+    uint32_t notify_value;
+    bool notify_pending;
+    pthread_cond_t cond;
+    struct fake_task *next;
+};
+
+typedef enum
+{
+    SEM_BINARY,
+    SEM_COUNTING,
+    SEM_MUTEX,
+    SEM_RECURSIVE_MUTEX,
+} sem_type_t;
+
+struct fake_semaphore
+{
+    sem_type_t type;
+    UBaseType_t count;
+    UBaseType_t max_count;
+    TaskHandle_t holder;
+    UBaseType_t depth;
+    bool system;
+};
+
+struct fake_timer
+{
+    char name[configMAX_TASK_NAME_LEN];
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    bool deleted;
+    int64_t expiry_us;
+    struct fake_timer *next;
+};
+
+typedef struct fake_call
+{
+    uint32_t id;
+    int64_t when_us;
+    uint64_t seq;
+    void (*fn)(void *arg);
+    void *arg;
+    struct fake_call *next;
+} fake_call_entry_t;
+
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond;     // Scheduler thread
+static pthread_cond_t external_cond; // Threads outside the scheduler
+static pthread_cond_t gone_cond;     // A task exited
+static bool started;
+static fake_clock_t clock_mode;
+static struct timespec epoch;
+static int64_t virtual_now_us;
+
+static struct fake_task *tasks;            // Scheduled tasks
+static struct fake_task *external_waiters; // External threads in a timed or object wait
+static struct fake_task *running;
+static uint64_t ready_counter;
+static unsigned syscalls; // Tasks inside a blocking system call (they hold the CPU in reality)
+static int fail_countdown = -1;
+static unsigned live_timers;
+static unsigned live_semaphores;
+
+static struct fake_timer *timers;
+static struct fake_timer *timer_executing;
+static const char timer_list_marker = 0;
+
+static fake_call_entry_t *calls;
+static uint32_t call_counter;
+static uint64_t call_seq;
+static const char call_list_marker = 0;
+static const char syscall_marker = 0;
+
+static __thread struct fake_task *self_task;
+static __thread int critical_depth;
+static pthread_key_t external_key;
+
+/* ==========================================
+ *          CLOCK
+ * ========================================== */
+
+static int64_t monotonic_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - epoch.tv_sec) * 1000000 + (now.tv_nsec - epoch.tv_nsec) / 1000;
+}
+
+static int64_t now_us_locked(void)
+{
+    return clock_mode == FAKE_CLOCK_VIRTUAL ? virtual_now_us : monotonic_us();
+}
+
+static struct timespec abs_time(int64_t us)
+{
+    struct timespec ts = epoch;
+    ts.tv_sec += us / 1000000;
+    ts.tv_nsec += (us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+static int64_t deadline_for(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return -1;
+    }
+    return now_us_locked() + (int64_t)pdTICKS_TO_MS(ticks) * 1000;
+}
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* ==========================================
+ *          SCHEDULER
+ * ========================================== */
+
+static void *scheduler_main(void *arg);
+static void timer_task(void *arg);
+static void driver_task(void *arg);
+
+static void ensure_started(void)
+{
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE))
+    {
+        fake_rtos_init(FAKE_CLOCK_REALTIME);
+    }
+}
+
+static struct fake_task *pick_ready_locked(void)
+{
+    struct fake_task *best = NULL;
+    for (struct fake_task *t = tasks; t; t = t->next)
+    {
+        if (t->state != TASK_READY || t->deleted)
+        {
+            continue;
+        }
+        if (!best || t->priority > best->priority ||
+            (t->priority == best->priority && t->ready_seq < best->ready_seq))
+        {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void make_ready_locked(struct fake_task *t)
+{
+    t->state = TASK_READY;
+    t->ready_seq = ++ready_counter;
+    t->wait_obj = NULL;
+    t->wake_us = -1;
+}
+
+/**
+ * @brief Give a free CPU to the best ready task
+ */
+static void dispatch_locked(void)
+{
+    if (running)
+    {
+        return;
+    }
+    struct fake_task *next = pick_ready_locked();
+    if (next)
+    {
+        running = next;
+        next->state = TASK_RUNNING;
+        pthread_cond_signal(&next->cond);
+    }
+    else
+    {
+        pthread_cond_signal(&idle_cond);
+    }
+}
+
+static void unlink_task_locked(struct fake_task *t)
+{
+    for (struct fake_task **p = &tasks; *p; p = &(*p)->next)
+    {
+        if (*p == t)
+        {
+            *p = t->next;
+            return;
+        }
+    }
+}
+
+static bool task_listed_locked(const struct fake_task *t)
+{
+    for (struct fake_task *p = tasks; p; p = p->next)
+    {
+        if (p == t)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void task_exit_locked(struct fake_task *self) __attribute__((noreturn));
+static void task_exit_locked(struct fake_task *self)
+{
+    unlink_task_locked(self);
+    if (running == self)
+    {
+        running = NULL;
+        dispatch_locked();
+    }
+    pthread_cond_broadcast(&gone_cond);
+    pthread_cond_destroy(&self->cond);
+    free(self);
+    self_task = NULL;
+    pthread_mutex_unlock(&sched_lock);
+    fake_heap_pause(true); // What is left are libc's thread blocks
+    pthread_exit(NULL);
+}
+
+static void wait_until_running_locked(struct fake_task *self)
+{
+    while (self->state != TASK_RUNNING || running != self)
+    {
+        if (self->deleted)
+        {
+            task_exit_locked(self);
+        }
+        pthread_cond_wait(&self->cond, &sched_lock);
+    }
+    if (self->deleted)
+    {
+        task_exit_locked(self);
+    }
+}
+
+static void block_locked(struct fake_task *self, const void *obj, int64_t wake_us)
+{
+    if (self->deleted)
+    {
+        task_exit_locked(self);
+    }
+    self->state = TASK_BLOCKED;
+    self->wait_obj = obj;
+    self->wake_us = wake_us;
+    running = NULL;
+    dispatch_locked();
+    if (wake_us >= 0)
+    {
+        pthread_cond_signal(&idle_cond);
+    }
+    wait_until_running_locked(self);
+}
+
+/**
+ * @brief Yield to a ready task of higher priority (not inside a critical section)
+ */
+static void maybe_preempt_locked(void)
+{
+    struct fake_task *self = self_task;
+    if (!self || running != self || critical_depth > 0)
+    {
+        return;
+    }
+    struct fake_task *best = pick_ready_locked();
+    if (best && best->priority > self->priority)
+    {
+        make_ready_locked(self);
+        running = NULL;
+        dispatch_locked();
+        wait_until_running_locked(self);
+    }
+}
+
+static struct fake_task *external_self(void)
+{
+    struct fake_task *t = pthread_getspecific(external_key);
+    if (!t)
+    {
+        t = calloc(1, sizeof(*t));
+        snprintf(t->name, sizeof(t->name), "ext");
+        t->external = true;
+        t->wake_us = -1;
+        pthread_setspecific(external_key, t);
+    }
+    return t;
+}
+
+static void external_free(void *ptr)
+{
+    free(ptr);
+}
+
+static void external_wait_locked(int64_t wake_us)
+{
+    struct fake_task *me = external_self();
+    me->wake_us = wake_us;
+    me->next = external_waiters;
+    external_waiters = me;
+    if (wake_us >= 0)
+    {
+        pthread_cond_signal(&idle_cond);
+    }
+
+    if (clock_mode == FAKE_CLOCK_VIRTUAL || wake_us < 0)
+    {
+        pthread_cond_wait(&external_cond, &sched_lock);
+    }
+    else
+    {
+        struct timespec ts = abs_time(wake_us);
+        pthread_cond_timedwait(&external_cond, &sched_lock, &ts);
+    }
+
+    for (struct fake_task **p = &external_waiters; *p; p = &(*p)->next)
+    {
+        if (*p == me)
+        {
+            *p = me->next;
+            break;
+        }
+    }
+    me->wake_us = -1;
+    pthread_cond_signal(&idle_cond); // Its deadline no longer holds the virtual clock
+}
+
+/**
+ * @brief Wait once for obj to change or the deadline to pass; callers re-check their condition
+ * @return false if the deadline had already passed
+ */
+static bool wait_locked(const void *obj, int64_t wake_us)
+{
+    if (wake_us >= 0 && now_us_locked() >= wake_us)
+    {
+        return false;
+    }
+    if (self_task)
+    {
+        block_locked(self_task, obj, wake_us);
+    }
+    else
+    {
+        external_wait_locked(wake_us);
+    }
+    return true;
+}
+
+/**
+ * @brief Ready everything waiting for obj
+ */
+static void wake_object_locked(const void *obj)
+{
+    for (struct fake_task *t = tasks; t; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wait_obj == obj)
+        {
+            make_ready_locked(t);
+        }
+    }
+    if (external_waiters)
+    {
+        pthread_cond_broadcast(&external_cond);
+    }
+    dispatch_locked();
+}
+
+static void expire_locked(int64_t now)
+{
+    for (struct fake_task *t = tasks; t; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wake_us >= 0 && t->wake_us <= now)
+        {
+            make_ready_locked(t);
+        }
+    }
+    for (struct fake_task *t = external_waiters; t; t = t->next)
+    {
+        if (t->wake_us >= 0 && t->wake_us <= now)
+        {
+            pthread_cond_broadcast(&external_cond);
+            break;
+        }
+    }
+}
+
+static int64_t earliest_deadline_locked(void)
+{
+    int64_t earliest = -1;
+    for (struct fake_task *t = tasks; t; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wake_us >= 0 && (earliest < 0 || t->wake_us < earliest))
+        {
+            earliest = t->wake_us;
+        }
+    }
+    for (struct fake_task *t = external_waiters; t; t = t->next)
+    {
+        if (t->wake_us >= 0 && (earliest < 0 || t->wake_us < earliest))
+        {
+            earliest = t->wake_us;
+        }
+    }
+    return earliest;
+}
+
+static void *scheduler_main(void *arg)
+{
+    pthread_mutex_lock(&sched_lock);
+    for (;;)
+    {
+        expire_locked(now_us_locked());
+        dispatch_locked();
+
+        int64_t next = earliest_deadline_locked();
+        if (clock_mode == FAKE_CLOCK_VIRTUAL)
+        {
+            if (!running && !pick_ready_locked() && syscalls == 0 && next > virtual_now_us)
+            {
+                virtual_now_us = next; // Nothing can run before the next deadline
+                continue;
+            }
+            pthread_cond_wait(&idle_cond, &sched_lock);
+        }
+        else if (next >= 0)
+        {
+            struct timespec ts = abs_time(next);
+            pthread_cond_timedwait(&idle_cond, &sched_lock, &ts);
+        }
+        else
+        {
+            pthread_cond_wait(&idle_cond, &sched_lock);
+        }
+    }
+    return NULL;
+}
+
+/* ==========================================
+ *          CONTROL INTERFACE
+ * ========================================== */
+
+void fake_rtos_init(fake_clock_t clock)
+{
+    pthread_mutex_lock(&sched_lock);
+    if (started)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return;
+    }
+
+    clock_mode = clock;
+    clock_gettime(CLOCK_MONOTONIC, &epoch);
+    cond_init(&idle_cond);
+    cond_init(&external_cond);
+    cond_init(&gone_cond);
+    pthread_key_create(&external_key, external_free);
+
+    if (clock == FAKE_CLOCK_VIRTUAL)
+    {
+        // The caller becomes a task so its delays are part of the schedule
+        struct fake_task *t = calloc(1, sizeof(*t));
+        snprintf(t->name, sizeof(t->name), "main");
+        t->priority = 1;
+        t->stack_depth = 8192;
+        t->system = true;
+        t->wake_us = -1;
+        cond_init(&t->cond);
+        t->state = TASK_RUNNING;
+        t->next = tasks;
+        tasks = t;
+        running = t;
+        self_task = t;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    fake_heap_pause(true);
+    pthread_create(&thread, &attr, scheduler_main, NULL);
+    fake_heap_pause(false);
+    pthread_attr_destroy(&attr);
+
+    __atomic_store_n(&started, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+fake_clock_t fake_rtos_clock(void)
+{
+    ensure_started();
+    return clock_mode;
+}
+
+int64_t fake_rtos_now_us(void)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    int64_t now = now_us_locked();
+    pthread_mutex_unlock(&sched_lock);
+    return now;
+}
+
+void fake_rtos_run_for_ms(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+bool fake_rtos_in_task(void)
+{
+    return self_task != NULL;
+}
+
+void fake_rtos_register_thread(const char *name, uint32_t stack_depth)
+{
+    ensure_started();
+    struct fake_task *t = external_self();
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    t->stack_depth = stack_depth;
+}
+
+void fake_rtos_syscall_begin(void)
+{
+    struct fake_task *self = self_task;
+    if (!self)
+    {
+        return;
+    }
+    pthread_mutex_lock(&sched_lock);
+    self->state = TASK_BLOCKED;
+    self->wait_obj = &syscall_marker;
+    self->wake_us = -1;
+    syscalls++;
+    running = NULL;
+    dispatch_locked();
+    pthread_mutex_unlock(&sched_lock);
+}
+
+void fake_rtos_syscall_end(void)
+{
+    struct fake_task *self = self_task;
+    if (!self)
+    {
+        return;
+    }
+    pthread_mutex_lock(&sched_lock);
+    if (!self->deleted) // vTaskDelete() already took it off the count
+    {
+        syscalls--;
+        make_ready_locked(self);
+        dispatch_locked();
+    }
+    wait_until_running_locked(self);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+void fake_rtos_fail_create_after(int countdown)
+{
+    pthread_mutex_lock(&sched_lock);
+    fail_countdown = countdown;
+    pthread_mutex_unlock(&sched_lock);
+}
+
+static bool create_fails_locked(void)
+{
+    if (fail_countdown < 0)
+    {
+        return false;
+    }
+    if (fail_countdown == 0)
+    {
+        fail_countdown = -1;
+        return true;
+    }
+    fail_countdown--;
+    return false;
+}
+
+void fake_rtos_get_counts(fake_rtos_counts_t *counts)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    counts->tasks = 0;
+    for (struct fake_task *t = tasks; t; t = t->next)
+    {
+        if (!t->system && !t->deleted)
+        {
+            counts->tasks++;
+        }
+    }
+    counts->timers = live_timers;
+    counts->semaphores = live_semaphores;
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/* ==========================================
+ *          TASKS
+ * ========================================== */
+
+static void *task_main(void *arg)
+{
+    struct fake_task *t = arg;
+    self_task = t;
+
+    pthread_mutex_lock(&sched_lock);
+    wait_until_running_locked(t);
+    pthread_mutex_unlock(&sched_lock);
+
+    t->code(t->params);
+
+    fprintf(stderr, "fake_rtos: task %s returned from its function\n", t->name);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static BaseType_t task_create(TaskFunction_t code, const char *name, uint32_t stack_depth, void *params,
+                              UBaseType_t priority, TaskHandle_t *created, bool system)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    if (!system && create_fails_locked())
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return -1; // errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY
+    }
+
+    struct fake_task *t = calloc(1, sizeof(*t));
+    if (!t)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return -1;
+    }
+    snprintf(t->name, sizeof(t->name), "%s", name ? name : "");
+    t->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    t->stack_depth = stack_depth;
+    t->code = code;
+    t->params = params;
+    t->system = system;
+    cond_init(&t->cond);
+    t->next = tasks;
+    tasks = t;
+    if (created)
+    {
+        *created = t; // Written before the task can run, as FreeRTOS does
+    }
+    make_ready_locked(t);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    fake_heap_pause(true);
+    pthread_create(&thread, &attr, task_main, t);
+    fake_heap_pause(false);
+    pthread_attr_destroy(&attr);
+
+    dispatch_locked();
+    maybe_preempt_locked();
+    pthread_mutex_unlock(&sched_lock);
+    return pdPASS;
+}
+
+TaskHandle_t fake_rtos_create_system_task(TaskFunction_t code, const char *name, void *params,
+                                          UBaseType_t priority)
+{
+    TaskHandle_t handle = NULL;
+    task_create(code, name, 4096, params, priority, &handle, true);
+    return handle;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *params,
+                       UBaseType_t priority, TaskHandle_t *created_task)
+{
+    return task_create(task_code, name, stack_depth, params, priority, created_task, false);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth, void *params,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    return task_create(task_code, name, stack_depth, params, priority, created_task, false);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    struct fake_task *self = self_task;
+    if (!task || task == self)
+    {
+        if (!self)
+        {
+            pthread_mutex_unlock(&sched_lock);
+            return;
+        }
+        task_exit_locked(self);
+    }
+
+    if (task->external || !task_listed_locked(task))
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return;
+    }
+
+    task->deleted = true;
+    if (task->state == TASK_RUNNING)
+    {
+        // Only a thread outside the scheduler gets here (the other core);
+        // the task stops at its next scheduling point
+        while (task_listed_locked(task))
+        {
+            pthread_cond_wait(&gone_cond, &sched_lock);
+        }
+    }
+    else
+    {
+        if (task->state == TASK_BLOCKED && task->wait_obj == &syscall_marker)
+        {
+            syscalls--;
+        }
+        unlink_task_locked(task);
+        pthread_cond_signal(&task->cond);
+    }
+    pthread_mutex_unlock(&sched_lock);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    if (ticks == 0)
+    {
+        if (self_task)
+        {
+            make_ready_locked(self_task);
+            running = NULL;
+            dispatch_locked();
+            wait_until_running_locked(self_task);
+        }
+        pthread_mutex_unlock(&sched_lock);
+        return;
+    }
+
+    int64_t wake_us = deadline_for(ticks);
+    while (wait_locked(NULL, wake_us))
+    {
+    }
+    pthread_mutex_unlock(&sched_lock);
+}
+
+void taskYIELD(void)
+{
+    vTaskDelay(0);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(fake_rtos_now_us() / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    ensure_started();
+    return self_task ? self_task : external_self();
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    return (task ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return (task ? task : xTaskGetCurrentTaskHandle())->priority;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    UBaseType_t count = 0;
+    for (struct fake_task *t = tasks; t; t = t->next)
+    {
+        count++;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return count;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return (task ? task : xTaskGetCurrentTaskHandle())->stack_depth;
+}
+
+/* ==========================================
+ *          NOTIFICATIONS
+ * ========================================== */
+
+static bool notify_locked(struct fake_task *task, uint32_t value, eNotifyAction action)
+{
+    switch (action)
+    {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->notify_pending)
+        {
+            return false;
+        }
+        task->notify_value = value;
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notify_pending = true;
+    wake_object_locked(&task->notify_value);
+    return true;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    bool ok = notify_locked(task, value, action);
+    maybe_preempt_locked();
+    pthread_mutex_unlock(&sched_lock);
+    return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t *higher_priority_task_woken)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    bool ok = notify_locked(task, value, action);
+    if (higher_priority_task_woken && task->state == TASK_READY &&
+        (!self_task || task->priority > self_task->priority))
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    ensure_started();
+    struct fake_task *self = self_task;
+    if (!self)
+    {
+        return pdFALSE;
+    }
+
+    pthread_mutex_lock(&sched_lock);
+    if (!self->notify_pending)
+    {
+        self->notify_value &= ~clear_on_entry;
+        int64_t wake_us = deadline_for(ticks);
+        while (!self->notify_pending && wait_locked(&self->notify_value, wake_us))
+        {
+        }
+    }
+    if (value)
+    {
+        *value = self->notify_value;
+    }
+    BaseType_t result = pdFALSE;
+    if (self->notify_pending)
+    {
+        self->notify_value &= ~clear_on_exit;
+        self->notify_pending = false;
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return result;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    ensure_started();
+    struct fake_task *self = self_task;
+    if (!self)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&sched_lock);
+    int64_t wake_us = deadline_for(ticks);
+    while (self->notify_value == 0 && wait_locked(&self->notify_value, wake_us))
+    {
+    }
+    uint32_t value = self->notify_value;
+    if (value != 0)
+    {
+        self->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    self->notify_pending = false;
+    pthread_mutex_unlock(&sched_lock);
+    return value;
+}
+
+/* ==========================================
+ *          CRITICAL SECTIONS
+ * ========================================== */
+
+void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mux->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&mux->mutex);
+    critical_depth++;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    critical_depth--;
+    pthread_mutex_unlock(&mux->mutex);
+    if (critical_depth == 0 && self_task)
+    {
+        // A task readied inside the section runs now, as after a pended yield
+        pthread_mutex_lock(&sched_lock);
+        maybe_preempt_locked();
+        pthread_mutex_unlock(&sched_lock);
+    }
+}
+
+void vPortYieldFromISR(void)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    maybe_preempt_locked();
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/* ==========================================
+ *          SEMAPHORES
+ * ========================================== */
+
+static SemaphoreHandle_t semaphore_create(sem_type_t type, UBaseType_t max_count, UBaseType_t initial_count)
+{
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    if (create_fails_locked())
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return NULL;
+    }
+    struct fake_semaphore *sem = calloc(1, sizeof(*sem));
+    if (!sem)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return NULL;
+    }
+    sem->type = type;
+    sem->max_count = max_count;
+    sem->count = initial_count;
+    live_semaphores++;
+    pthread_mutex_unlock(&sched_lock);
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_create(SEM_BINARY, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return semaphore_create(SEM_COUNTING, max_count, initial_count);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_create(SEM_MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return semaphore_create(SEM_RECURSIVE_MUTEX, 1, 1);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (!sem)
+    {
+        return;
+    }
+    pthread_mutex_lock(&sched_lock);
+    if (!sem->system)
+    {
+        live_semaphores--;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    free(sem);
+}
+
+void fake_rtos_mark_system_semaphore(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sched_lock);
+    if (sem && !sem->system)
+    {
+        sem->system = true;
+        live_semaphores--;
+    }
+    pthread_mutex_unlock(&sched_lock);
+}
+
+static BaseType_t semaphore_take(SemaphoreHandle_t sem, TickType_t ticks, bool recursive)
+{
+    ensure_started();
+    TaskHandle_t me = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&sched_lock);
+    if (recursive && sem->holder == me && sem->depth > 0)
+    {
+        sem->depth++;
+        pthread_mutex_unlock(&sched_lock);
+        return pdTRUE;
+    }
+
+    int64_t wake_us = deadline_for(ticks);
+    while (sem->count == 0)
+    {
+        if (!wait_locked(sem, wake_us))
+        {
+            pthread_mutex_unlock(&sched_lock);
+            return pdFALSE;
+        }
+    }
+    sem->count--;
+    if (sem->type == SEM_MUTEX || sem->type == SEM_RECURSIVE_MUTEX)
+    {
+        sem->holder = me;
+        sem->depth = 1;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return pdTRUE;
+}
+
+static BaseType_t semaphore_give(SemaphoreHandle_t sem, bool recursive)
+{
+    ensure_started();
+    TaskHandle_t me = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&sched_lock);
+    if (sem->type == SEM_MUTEX || sem->type == SEM_RECURSIVE_MUTEX)
+    {
+        if (sem->holder != me)
+        {
+            pthread_mutex_unlock(&sched_lock);
+            return pdFALSE;
+        }
+        if (recursive && --sem->depth > 0)
+        {
+            pthread_mutex_unlock(&sched_lock);
+            return pdTRUE;
+        }
+        sem->holder = NULL;
+        sem->depth = 0;
+    }
+    if (sem->count >= sem->max_count)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return pdFALSE;
+    }
+    sem->count++;
+    wake_object_locked(sem);
+    maybe_preempt_locked();
+    pthread_mutex_unlock(&sched_lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return semaphore_take(sem, ticks, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return semaphore_give(sem, false);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return semaphore_take(sem, ticks, true);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+    return semaphore_give(sem, true);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sched_lock);
+    UBaseType_t count = sem->count;
+    pthread_mutex_unlock(&sched_lock);
+    return count;
+}
+
+/* ==========================================
+ *          SOFTWARE TIMERS
+ * ========================================== */
+
+static void timer_task(void *arg)
+{
+    pthread_mutex_lock(&sched_lock);
+    for (;;)
+    {
+        // Deleted timers are freed here, never while their callback runs
+        for (struct fake_timer **p = &timers; *p;)
+        {
+            struct fake_timer *t = *p;
+            if (t->deleted)
+            {
+                *p = t->next;
+                free(t);
+            }
+            else
+            {
+                p = &t->next;
+            }
+        }
+
+        struct fake_timer *due = NULL;
+        for (struct fake_timer *t = timers; t; t = t->next)
+        {
+            if (t->active && (!due || t->expiry_us < due->expiry_us))
+            {
+                due = t;
+            }
+        }
+
+        int64_t now = now_us_locked();
+        if (due && due->expiry_us <= now)
+        {
+            if (due->auto_reload)
+            {
+                due->expiry_us += (int64_t)pdTICKS_TO_MS(due->period) * 1000;
+                if (due->expiry_us <= now)
+                {
+                    due->expiry_us = now + (int64_t)pdTICKS_TO_MS(due->period) * 1000;
+                }
+            }
+            else
+            {
+                due->active = false;
+            }
+            timer_executing = due;
+            pthread_mutex_unlock(&sched_lock);
+            due->callback(due);
+            pthread_mutex_lock(&sched_lock);
+            timer_executing = NULL;
+            continue;
+        }
+
+        block_locked(self_task, &timer_list_marker, due ? due->expiry_us : -1);
+    }
+}
+
+static pthread_once_t timer_task_once = PTHREAD_ONCE_INIT;
+
+static void start_timer_task(void)
+{
+    fake_rtos_create_system_task(timer_task, "Tmr Svc", NULL, configTIMER_TASK_PRIORITY);
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id,
+                           TimerCallbackFunction_t callback)
+{
+    ensure_started();
+    if (period == 0)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&sched_lock);
+    if (create_fails_locked())
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return NULL;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    pthread_once(&timer_task_once, start_timer_task);
+
+    struct fake_timer *t = calloc(1, sizeof(*t));
+    if (!t)
+    {
+        return NULL;
+    }
+    snprintf(t->name, sizeof(t->name), "%s", name ? name : "");
+    t->period = period;
+    t->auto_reload = auto_reload;
+    t->id = timer_id;
+    t->callback = callback;
+
+    pthread_mutex_lock(&sched_lock);
+    t->next = timers;
+    timers = t;
+    live_timers++;
+    pthread_mutex_unlock(&sched_lock);
+    return t;
+}
+
+static BaseType_t timer_command(TimerHandle_t timer, bool active, TickType_t period, bool delete)
+{
+    if (!timer)
+    {
+        return pdFAIL;
+    }
+    ensure_started();
+    pthread_mutex_lock(&sched_lock);
+    if (period)
+    {
+        timer->period = period;
+    }
+    timer->active = active && !delete;
+    if (delete && !timer->deleted)
+    {
+        // Counted out at once: the handle is dead for the caller even before the timer task frees it
+        timer->deleted = true;
+        live_timers--;
+    }
+    if (timer->active)
+    {
+        timer->expiry_us = now_us_locked() + (int64_t)pdTICKS_TO_MS(timer->period) * 1000;
+    }
+    wake_object_locked(&timer_list_marker);
+    maybe_preempt_locked();
+    pthread_mutex_unlock(&sched_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return timer_command(timer, true, 0, false);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return timer_command(timer, false, 0, false);
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return timer_command(timer, true, 0, false);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait)
+{
+    if (period == 0)
+    {
+        return pdFAIL;
+    }
+    return timer_command(timer, true, period, false);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return timer_command(timer, false, 0, true);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    pthread_mutex_lock(&sched_lock);
+    BaseType_t active = timer->active ? pdTRUE : pdFALSE;
+    pthread_mutex_unlock(&sched_lock);
+    return active;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+/* ==========================================
+ *          DRIVER WORK
+ * ========================================== */
+
+static void driver_task(void *arg)
+{
+    pthread_mutex_lock(&sched_lock);
+    for (;;)
+    {
+        fake_call_entry_t *due = calls; // Sorted by time, then by order of scheduling
+        if (due && due->when_us <= now_us_locked())
+        {
+            calls = due->next;
+            pthread_mutex_unlock(&sched_lock);
+            due->fn(due->arg);
+            free(due);
+            pthread_mutex_lock(&sched_lock);
+            continue;
+        }
+        block_locked(self_task, &call_list_marker, due ? due->when_us : -1);
+    }
+}
+
+static pthread_once_t driver_task_once = PTHREAD_ONCE_INIT;
+
+static void start_driver_task(void)
+{
+    fake_rtos_create_system_task(driver_task, "wifi", NULL, 23);
+}
+
+uint32_t fake_rtos_call_later(int64_t delay_us, void (*fn)(void *arg), void *arg)
+{
+    ensure_started();
+    pthread_once(&driver_task_once, start_driver_task);
+
+    fake_call_entry_t *call = calloc(1, sizeof(*call));
+    call->fn = fn;
+    call->arg = arg;
+
+    pthread_mutex_lock(&sched_lock);
+    call->id = ++call_counter ? call_counter : ++call_counter;
+    call->seq = ++call_seq;
+    call->when_us = now_us_locked() + (delay_us > 0 ? delay_us : 0);
+    fake_call_entry_t **p = &calls;
+    while (*p && (*p)->when_us <= call->when_us)
+    {
+        p = &(*p)->next;
+    }
+    call->next = *p;
+    *p = call;
+    uint32_t id = call->id;
+    wake_object_locked(&call_list_marker);
+    maybe_preempt_locked();
+    pthread_mutex_unlock(&sched_lock);
+    return id;
+}
+
+bool fake_rtos_cancel(uint32_t id)
+{
+    if (id == 0)
+    {
+        return false;
+    }
+    pthread_mutex_lock(&sched_lock);
+    for (fake_call_entry_t **p = &calls; *p; p = &(*p)->next)
+    {
+        if ((*p)->id == id)
+        {
+            fake_call_entry_t *call = *p;
+            *p = call->next;
+            pthread_mutex_unlock(&sched_lock);
+            free(call);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return false;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file lwip.c
+ * @brief Socket calls of the component that need the scheduler's help on the host
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "fake_rtos.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#undef recvfrom
+#undef bind
+
+#define POLL_STEP_MS 10 // Receive polling interval on the virtual clock
+
+static pthread_mutex_t ports_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned short bound_ports[1024]; // Privileged port -> host port
+
+static int receive_timeout_ms(int fd)
+{
+    struct timeval tv = {0};
+    socklen_t len = sizeof(tv);
+    if (getsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, &len) != 0 || (tv.tv_sec == 0 && tv.tv_usec == 0))
+    {
+        return -1;
+    }
+    return (int)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+ssize_t fake_lwip_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *from, socklen_t *fromlen)
+{
+    if (!fake_rtos_in_task())
+    {
+        return recvfrom(fd, buf, len, flags, from, fromlen);
+    }
+
+    int timeout_ms = receive_timeout_ms(fd);
+    if (fake_rtos_clock() == FAKE_CLOCK_REALTIME)
+    {
+        // Other tasks run while this one waits in the kernel
+        fake_rtos_syscall_begin();
+        ssize_t result = recvfrom(fd, buf, len, flags, from, fromlen);
+        int saved = errno;
+        fake_rtos_syscall_end();
+        errno = saved;
+        return result;
+    }
+
+    // Virtual time must not pass a task stuck in the kernel: poll and sleep in task delays
+    int64_t deadline_us = timeout_ms >= 0 ? fake_rtos_now_us() + (int64_t)timeout_ms * 1000 : -1;
+    for (;;)
+    {
+        ssize_t result = recvfrom(fd, buf, len, flags | MSG_DONTWAIT, from, fromlen);
+        if (result >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            return result;
+        }
+        if (deadline_us >= 0 && fake_rtos_now_us() >= deadline_us)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        vTaskDelay(pdMS_TO_TICKS(POLL_STEP_MS));
+    }
+}
+
+int fake_lwip_bind(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    if (addr->sa_family != AF_INET)
+    {
+        return bind(fd, addr, addrlen);
+    }
+
+    struct sockaddr_in in = *(const struct sockaddr_in *)addr;
+    unsigned short requested = ntohs(in.sin_port);
+    if (requested == 0 || requested >= 1024)
+    {
+        return bind(fd, addr, addrlen);
+    }
+
+    // Tests do not run as root: take any free port and remember it
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    in.sin_port = 0;
+    int result = bind(fd, (struct sockaddr *)&in, sizeof(in));
+    if (result == 0)
+    {
+        socklen_t len = sizeof(in);
+        getsockname(fd, (struct sockaddr *)&in, &len);
+        pthread_mutex_lock(&ports_lock);
+        bound_ports[requested] = ntohs(in.sin_port);
+        pthread_mutex_unlock(&ports_lock);
+    }
+    return result;
+}
+
+unsigned short fake_lwip_bound_port(unsigned short requested)
+{
+    if (requested >= 1024)
+    {
+        return requested;
+    }
+    pthread_mutex_lock(&ports_lock);
+    unsigned short port = bound_ports[requested];
+    pthread_mutex_unlock(&ports_lock);
+    return port;
+}
@@ -0,0 +1,366 @@
+/**
+ * @file nvs.c
+ * @brief In-memory NVS with namespaces, typed entries and the ESP-IDF error codes
+ */
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fake_system.h"
+#include "nvs_flash.h"
+
+#define NVS_MAX_HANDLES 16
+
+typedef enum
+{
+    ENTRY_U8,
+    ENTRY_U32,
+    ENTRY_STR,
+    ENTRY_BLOB,
+} entry_type_t;
+
+typedef struct entry
+{
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    entry_type_t type;
+    void *data;
+    size_t length; // Strings include the terminator
+    struct entry *next;
+} entry_t;
+
+typedef struct
+{
+    bool used;
+    bool writable;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+} handle_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool initialized;
+static entry_t *entries;
+static handle_t handles[NVS_MAX_HANDLES];
+static char namespaces[NVS_MAX_HANDLES][NVS_KEY_NAME_MAX_SIZE]; // Created by the first read-write open
+static int namespace_count;
+
+static void erase_all_locked(const char *ns)
+{
+    for (entry_t **p = &entries; *p;)
+    {
+        entry_t *entry = *p;
+        if (!ns || strcmp(entry->ns, ns) == 0)
+        {
+            *p = entry->next;
+            free(entry->data);
+            free(entry);
+        }
+        else
+        {
+            p = &entry->next;
+        }
+    }
+}
+
+void fake_nvs_reset(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    erase_all_locked(NULL);
+    memset(handles, 0, sizeof(handles));
+    namespace_count = 0;
+    initialized = false;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    initialized = true;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    erase_all_locked(NULL);
+    namespace_count = 0;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    initialized = false;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+static bool namespace_exists_locked(const char *ns)
+{
+    for (int i = 0; i < namespace_count; i++)
+    {
+        if (strcmp(namespaces[i], ns) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (!namespace_name || strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    if (!initialized)
+    {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    // A namespace is only created by a writer
+    if (open_mode == NVS_READONLY && !namespace_exists_locked(namespace_name))
+    {
+        pthread_mutex_unlock(&nvs_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (!namespace_exists_locked(namespace_name))
+    {
+        if (namespace_count == NVS_MAX_HANDLES)
+        {
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        strcpy(namespaces[namespace_count++], namespace_name);
+    }
+    for (int i = 0; i < NVS_MAX_HANDLES; i++)
+    {
+        if (!handles[i].used)
+        {
+            handles[i].used = true;
+            handles[i].writable = open_mode == NVS_READWRITE;
+            strcpy(handles[i].ns, namespace_name);
+            *out_handle = (nvs_handle_t)(i + 1);
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES)
+    {
+        handles[handle - 1].used = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+static handle_t *handle_get_locked(nvs_handle_t handle)
+{
+    if (handle < 1 || handle > NVS_MAX_HANDLES || !handles[handle - 1].used)
+    {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+static entry_t *entry_find_locked(const char *ns, const char *key)
+{
+    for (entry_t *entry = entries; entry; entry = entry->next)
+    {
+        if (strcmp(entry->ns, ns) == 0 && strcmp(entry->key, key) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t entry_set(nvs_handle_t handle, const char *key, entry_type_t type, const void *data, size_t length)
+{
+    if (!key || strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = handle_get_locked(handle);
+    esp_err_t err = ESP_OK;
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else
+    {
+        entry_t *entry = entry_find_locked(h->ns, key);
+        if (!entry)
+        {
+            entry = calloc(1, sizeof(*entry));
+            strcpy(entry->ns, h->ns);
+            strcpy(entry->key, key);
+            entry->next = entries;
+            entries = entry;
+        }
+        free(entry->data);
+        entry->type = type;
+        entry->length = length;
+        entry->data = malloc(length ? length : 1);
+        memcpy(entry->data, data, length);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+/**
+ * @brief Copy an entry out; a NULL buffer reports the length, a short one is an error
+ */
+static esp_err_t entry_get(nvs_handle_t handle, const char *key, entry_type_t type, void *out, size_t *length)
+{
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = handle_get_locked(handle);
+    esp_err_t err = ESP_OK;
+    entry_t *entry = h ? entry_find_locked(h->ns, key) : NULL;
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!entry)
+    {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (entry->type != type)
+    {
+        err = ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    else if (!out)
+    {
+        *length = entry->length;
+    }
+    else if (*length < entry->length)
+    {
+        *length = entry->length;
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(out, entry->data, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return entry_set(handle, key, ENTRY_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return entry_get(handle, key, ENTRY_STR, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return entry_set(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return entry_get(handle, key, ENTRY_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return entry_set(handle, key, ENTRY_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    return entry_get(handle, key, ENTRY_U8, out_value, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return entry_set(handle, key, ENTRY_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    return entry_get(handle, key, ENTRY_U32, out_value, &length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = handle_get_locked(handle);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else
+    {
+        for (entry_t **p = &entries; *p; p = &(*p)->next)
+        {
+            entry_t *entry = *p;
+            if (strcmp(entry->ns, h->ns) == 0 && strcmp(entry->key, key) == 0)
+            {
+                *p = entry->next;
+                free(entry->data);
+                free(entry);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    handle_t *h = handle_get_locked(handle);
+    esp_err_t err = ESP_OK;
+    if (!h)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else
+    {
+        erase_all_locked(h->ns);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = handle_get_locked(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file harness.c
+ * @brief Checks and setup shared by the host tests and tools
+ */
+
+#include <string.h>
+#include "harness.h"
+#include "nvs_flash.h"
+
+#define WAIT_STEP_MS 10
+#define TASK_EXIT_MS 1000
+
+void harness_init(fake_clock_t clock)
+{
+    fake_rtos_init(clock);
+    harness_reset();
+}
+
+void harness_reset(void)
+{
+    fake_wifi_reset();
+    fake_nvs_reset();
+    CHECK(nvs_flash_init() == ESP_OK);
+    if (fake_rtos_clock() == FAKE_CLOCK_REALTIME)
+    {
+        harness_fast_timing();
+    }
+}
+
+void harness_fast_timing(void)
+{
+    fake_wifi_timing_t timing = {
+        .scan_channel_ms = 5,
+        .scan_dwell_cap_ms = 5,
+        .assoc_ms = 20,
+        .auth_fail_ms = 100,
+        .dhcp_ms = 30,
+        .beacon_timeout_ms = 200,
+    };
+    fake_wifi_set_timing(&timing);
+}
+
+int harness_add_ap(const char *ssid, const char *password, int8_t rssi, uint8_t channel)
+{
+    fake_ap_config_t config = {
+        .ssid = ssid,
+        .channel = channel,
+        .authmode = password ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN,
+        .password = password,
+        .rssi = rssi,
+    };
+    int ap = fake_wifi_add_ap(&config);
+    CHECK(ap >= 0);
+    return ap;
+}
+
+bool harness_wait(bool (*cond)(void *arg), void *arg, uint32_t timeout_ms)
+{
+    int64_t deadline_us = fake_rtos_now_us() + (int64_t)timeout_ms * 1000;
+    while (!cond(arg))
+    {
+        if (fake_rtos_now_us() >= deadline_us)
+        {
+            return false;
+        }
+        fake_rtos_run_for_ms(WAIT_STEP_MS);
+    }
+    return true;
+}
+
+typedef struct
+{
+    wifi_manager_t *wm;
+    wifi_status_t status;
+} status_wait_t;
+
+static bool status_reached(void *arg)
+{
+    status_wait_t *wait = arg;
+    return wifi_manager_get_status(wait->wm) == wait->status;
+}
+
+bool harness_wait_status(wifi_manager_t *wm, wifi_status_t status, uint32_t timeout_ms)
+{
+    status_wait_t wait = {.wm = wm, .status = status};
+    return harness_wait(status_reached, &wait, timeout_ms);
+}
+
+static bool tasks_exited(void *arg)
+{
+    fake_rtos_counts_t counts;
+    fake_rtos_get_counts(&counts);
+    return counts.tasks == 0;
+}
+
+bool harness_wait_tasks_exited(void)
+{
+    return harness_wait(tasks_exited, NULL, TASK_EXIT_MS);
+}
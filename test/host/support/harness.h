@@ -0,0 +1,91 @@
+/**
+ * @file harness.h
+ * @brief Checks and setup shared by the host tests and tools
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "fake_httpd.h"
+#include "fake_rtos.h"
+#include "fake_system.h"
+#include "fake_wifi.h"
+#include "wifi_manager.h"
+
+#define CHECK(cond)                                                                                                   \
+    do                                                                                                                \
+    {                                                                                                                 \
+        if (!(cond))                                                                                                  \
+        {                                                                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);                                  \
+            exit(1);                                                                                                  \
+        }                                                                                                             \
+    } while (0)
+
+// Compares as long long and prints both values on failure
+#define CHECK_INT(a, op, b)                                                                                           \
+    do                                                                                                                \
+    {                                                                                                                 \
+        long long check_a_ = (long long)(a);                                                                          \
+        long long check_b_ = (long long)(b);                                                                          \
+        if (!(check_a_ op check_b_))                                                                                  \
+        {                                                                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s %s %s (%lld vs %lld)\n", __FILE__, __LINE__, #a, #op, #b,        \
+                    check_a_, check_b_);                                                                              \
+            exit(1);                                                                                                  \
+        }                                                                                                             \
+    } while (0)
+
+#define RUN_TEST(test)                                                                                                \
+    do                                                                                                                \
+    {                                                                                                                 \
+        printf("%s\n", #test);                                                                                        \
+        fflush(stdout);                                                                                               \
+        harness_reset();                                                                                              \
+        test();                                                                                                       \
+    } while (0)
+
+/**
+ * @brief Start the scheduler on the given clock and initialize NVS
+ */
+void harness_init(fake_clock_t clock);
+
+/**
+ * @brief Empty radio world and NVS between test cases (component destroyed)
+ *
+ * On the realtime clock the fast timings are applied as well.
+ */
+void harness_reset(void);
+
+/**
+ * @brief Shorten the radio timings for tests on the realtime clock
+ */
+void harness_fast_timing(void);
+
+/**
+ * @brief Add a WPA2 access point (open if password is NULL)
+ * @return AP index for the fake_wifi_* calls
+ */
+int harness_add_ap(const char *ssid, const char *password, int8_t rssi, uint8_t channel);
+
+/**
+ * @brief Wait on the scheduler clock until cond(arg) holds
+ * @return false on timeout
+ */
+bool harness_wait(bool (*cond)(void *arg), void *arg, uint32_t timeout_ms);
+
+/**
+ * @brief Wait until the instance reports the status
+ */
+bool harness_wait_status(wifi_manager_t *wm, wifi_status_t status, uint32_t timeout_ms);
+
+/**
+ * @brief Wait until no task is left
+ *
+ * A joined task has signalled its exit but can still be on its way to
+ * vTaskDelete() when the join returns.
+ * @return false if tasks are still there after a second
+ */
+bool harness_wait_tasks_exited(void);
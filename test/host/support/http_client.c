@@ -0,0 +1,506 @@
+/**
+ * @file http_client.c
+ * @brief Minimal HTTP/1.1, SSE and WebSocket client for the host portal
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "http_client.h"
+
+#define LINE_MAX_LEN 1024
+#define WS_KEY "dGhlIHNhbXBsZSBub25jZQ=="
+
+// ------------------------------------------
+//   Buffered socket reads
+// ------------------------------------------
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool fill(http_conn_t *conn)
+{
+    if (conn->start == conn->end)
+    {
+        conn->start = conn->end = 0;
+    }
+    else if (conn->end == sizeof(conn->buf))
+    {
+        memmove(conn->buf, conn->buf + conn->start, conn->end - conn->start);
+        conn->end -= conn->start;
+        conn->start = 0;
+    }
+    if (conn->end == sizeof(conn->buf))
+    {
+        return false; // Line longer than the buffer
+    }
+    ssize_t n = recv(conn->fd, conn->buf + conn->end, sizeof(conn->buf) - conn->end, 0);
+    if (n <= 0)
+    {
+        return false;
+    }
+    conn->end += (size_t)n;
+    return true;
+}
+
+// Reads one line without its CR LF, truncated to size - 1
+static bool read_line(http_conn_t *conn, char *line, size_t size)
+{
+    for (;;)
+    {
+        char *nl = memchr(conn->buf + conn->start, '\n', conn->end - conn->start);
+        if (nl)
+        {
+            size_t len = (size_t)(nl - (conn->buf + conn->start));
+            size_t copy = len;
+            if (copy > 0 && conn->buf[conn->start + copy - 1] == '\r')
+            {
+                copy--;
+            }
+            if (copy >= size)
+            {
+                copy = size - 1;
+            }
+            memcpy(line, conn->buf + conn->start, copy);
+            line[copy] = '\0';
+            conn->start += len + 1;
+            return true;
+        }
+        if (!fill(conn))
+        {
+            return false;
+        }
+    }
+}
+
+static bool read_exact(http_conn_t *conn, void *dst, size_t len)
+{
+    char *out = dst;
+    while (len > 0)
+    {
+        if (conn->start == conn->end && !fill(conn))
+        {
+            return false;
+        }
+        size_t chunk = conn->end - conn->start;
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(out, conn->buf + conn->start, chunk);
+        conn->start += chunk;
+        out += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+// ------------------------------------------
+//   HTTP
+// ------------------------------------------
+
+bool http_connect(http_conn_t *conn, uint16_t port, int timeout_ms)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd < 0)
+    {
+        return false;
+    }
+    struct timeval tv = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    int one = 1;
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(conn->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(conn->fd);
+        conn->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void http_close(http_conn_t *conn)
+{
+    if (conn->fd >= 0)
+    {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+static bool send_head(http_conn_t *conn, const char *method, const char *path, const char *extra,
+                      const char *content_type, size_t body_len)
+{
+    char head[1024];
+    int len = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: 192.168.4.1\r\n%s", method, path,
+                       extra ? extra : "");
+    if (content_type)
+    {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Type: %s\r\nContent-Length: %zu\r\n",
+                        content_type, body_len);
+    }
+    len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    return len < (int)sizeof(head) && send_all(conn->fd, head, (size_t)len);
+}
+
+// Status line and headers; returns the body framing
+static bool read_head(http_conn_t *conn, http_response_t *response, long *content_length, bool *chunked)
+{
+    char line[LINE_MAX_LEN];
+    if (!read_line(conn, line, sizeof(line)) || sscanf(line, "HTTP/1.%*d %d", &response->status) != 1)
+    {
+        return false;
+    }
+    *content_length = -1;
+    *chunked = false;
+    for (;;)
+    {
+        if (!read_line(conn, line, sizeof(line)))
+        {
+            return false;
+        }
+        if (line[0] == '\0')
+        {
+            return true;
+        }
+        char *value = strchr(line, ':');
+        if (!value)
+        {
+            continue;
+        }
+        *value++ = '\0';
+        while (*value == ' ')
+        {
+            value++;
+        }
+        if (strcasecmp(line, "Content-Length") == 0)
+        {
+            *content_length = strtol(value, NULL, 10);
+        }
+        else if (strcasecmp(line, "Transfer-Encoding") == 0)
+        {
+            *chunked = strcasecmp(value, "chunked") == 0;
+        }
+        else if (strcasecmp(line, "Content-Type") == 0)
+        {
+            snprintf(response->content_type, sizeof(response->content_type), "%s", value);
+        }
+        else if (strcasecmp(line, "Location") == 0)
+        {
+            snprintf(response->location, sizeof(response->location), "%s", value);
+        }
+        else if (strcasecmp(line, "Connection") == 0)
+        {
+            response->closed = strcasecmp(value, "close") == 0;
+        }
+    }
+}
+
+static bool append_body(http_response_t *response, size_t len, http_conn_t *conn)
+{
+    char *body = realloc(response->body, response->body_len + len + 1);
+    if (!body)
+    {
+        return false;
+    }
+    response->body = body;
+    if (!read_exact(conn, body + response->body_len, len))
+    {
+        return false;
+    }
+    response->body_len += len;
+    body[response->body_len] = '\0';
+    return true;
+}
+
+bool http_request(http_conn_t *conn, const char *method, const char *path, const char *content_type,
+                  const char *body, size_t body_len, http_response_t *response)
+{
+    memset(response, 0, sizeof(*response));
+    if (!send_head(conn, method, path, NULL, content_type, body_len) ||
+        (body_len > 0 && !send_all(conn->fd, body, body_len)))
+    {
+        return false;
+    }
+
+    long content_length;
+    bool chunked;
+    if (!read_head(conn, response, &content_length, &chunked))
+    {
+        return false;
+    }
+    response->body = calloc(1, 1);
+    if (chunked)
+    {
+        char line[64];
+        for (;;)
+        {
+            if (!read_line(conn, line, sizeof(line)))
+            {
+                return false;
+            }
+            size_t size = strtoul(line, NULL, 16);
+            if (size == 0)
+            {
+                return read_line(conn, line, sizeof(line)); // Blank line after the last chunk
+            }
+            if (!append_body(response, size, conn) || !read_line(conn, line, sizeof(line)))
+            {
+                return false;
+            }
+        }
+    }
+    if (content_length > 0)
+    {
+        return append_body(response, (size_t)content_length, conn);
+    }
+    if (content_length < 0 && response->closed)
+    {
+        // Body up to the end of the connection
+        while (conn->start < conn->end || fill(conn))
+        {
+            size_t len = conn->end - conn->start;
+            if (!append_body(response, len, conn))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool http_fetch(uint16_t port, const char *method, const char *path, const char *form, http_response_t *response)
+{
+    http_conn_t conn;
+    if (!http_connect(&conn, port, 5000))
+    {
+        memset(response, 0, sizeof(*response));
+        return false;
+    }
+    bool ok = http_request(&conn, method, path, form ? "application/x-www-form-urlencoded" : NULL, form,
+                           form ? strlen(form) : 0, response);
+    http_close(&conn);
+    return ok;
+}
+
+void http_response_free(http_response_t *response)
+{
+    free(response->body);
+    response->body = NULL;
+    response->body_len = 0;
+}
+
+// ------------------------------------------
+//   Server-Sent Events
+// ------------------------------------------
+
+bool sse_open(http_conn_t *conn, uint16_t port, const char *path, int timeout_ms)
+{
+    if (!http_connect(conn, port, timeout_ms))
+    {
+        return false;
+    }
+    http_response_t response = {0};
+    long content_length;
+    bool chunked;
+    if (!send_head(conn, "GET", path, "Accept: text/event-stream\r\n", NULL, 0) ||
+        !read_head(conn, &response, &content_length, &chunked) || response.status != 200 ||
+        strncmp(response.content_type, "text/event-stream", 17) != 0)
+    {
+        http_close(conn);
+        return false;
+    }
+    return true;
+}
+
+bool sse_next_event(http_conn_t *conn, char *event, size_t event_size, char *data, size_t data_size)
+{
+    char line[LINE_MAX_LEN];
+    bool any = false;
+    event[0] = '\0';
+    data[0] = '\0';
+    for (;;)
+    {
+        if (!read_line(conn, line, sizeof(line)))
+        {
+            return false;
+        }
+        if (line[0] == '\0')
+        {
+            if (any)
+            {
+                return true;
+            }
+        }
+        else if (strncmp(line, "event: ", 7) == 0)
+        {
+            snprintf(event, event_size, "%s", line + 7);
+            any = true;
+        }
+        else if (strncmp(line, "data: ", 6) == 0)
+        {
+            snprintf(data, data_size, "%s", line + 6);
+            any = true;
+        }
+    }
+}
+
+// ------------------------------------------
+//   WebSocket
+// ------------------------------------------
+
+bool ws_open(http_conn_t *conn, uint16_t port, const char *path, int timeout_ms)
+{
+    if (!http_connect(conn, port, timeout_ms))
+    {
+        return false;
+    }
+    http_response_t response = {0};
+    long content_length;
+    bool chunked;
+    if (!send_head(conn, "GET", path,
+                   "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: " WS_KEY
+                   "\r\nSec-WebSocket-Version: 13\r\n",
+                   NULL, 0) ||
+        !read_head(conn, &response, &content_length, &chunked) || response.status != 101)
+    {
+        http_close(conn);
+        return false;
+    }
+    return true;
+}
+
+static bool ws_send_frame(http_conn_t *conn, uint8_t opcode, const void *payload, size_t len)
+{
+    uint8_t head[14];
+    size_t head_len = 0;
+    const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+
+    head[head_len++] = 0x80 | opcode;
+    if (len < 126)
+    {
+        head[head_len++] = 0x80 | (uint8_t)len;
+    }
+    else
+    {
+        head[head_len++] = 0x80 | 126;
+        head[head_len++] = (uint8_t)(len >> 8);
+        head[head_len++] = (uint8_t)len;
+    }
+    memcpy(head + head_len, mask, 4);
+    head_len += 4;
+
+    uint8_t *frame = malloc(head_len + len);
+    if (!frame)
+    {
+        return false;
+    }
+    memcpy(frame, head, head_len);
+    for (size_t i = 0; i < len; i++)
+    {
+        frame[head_len + i] = ((const uint8_t *)payload)[i] ^ mask[i % 4];
+    }
+    bool ok = send_all(conn->fd, frame, head_len + len);
+    free(frame);
+    return ok;
+}
+
+bool ws_send_text(http_conn_t *conn, const char *text)
+{
+    return ws_send_frame(conn, 0x1, text, strlen(text));
+}
+
+int ws_recv_text(http_conn_t *conn, char *text, size_t size)
+{
+    for (;;)
+    {
+        uint8_t head[2];
+        if (!read_exact(conn, head, 2))
+        {
+            return -1;
+        }
+        uint8_t opcode = head[0] & 0x0F;
+        uint64_t len = head[1] & 0x7F;
+        if (len == 126)
+        {
+            uint8_t ext[2];
+            if (!read_exact(conn, ext, 2))
+            {
+                return -1;
+            }
+            len = ((uint64_t)ext[0] << 8) | ext[1];
+        }
+        else if (len == 127)
+        {
+            uint8_t ext[8];
+            if (!read_exact(conn, ext, 8))
+            {
+                return -1;
+            }
+            len = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                len = (len << 8) | ext[i];
+            }
+        }
+        uint8_t *payload = malloc(len + 1);
+        if (!payload || !read_exact(conn, payload, len))
+        {
+            free(payload);
+            return -1;
+        }
+
+        if (opcode == 0x9)
+        {
+            bool ok = ws_send_frame(conn, 0xA, payload, len);
+            free(payload);
+            if (!ok)
+            {
+                return -1;
+            }
+            continue;
+        }
+        if (opcode == 0x8)
+        {
+            free(payload);
+            return -1;
+        }
+        if (opcode != 0x1 && opcode != 0x2)
+        {
+            free(payload);
+            continue;
+        }
+        size_t copy = len < size ? len : size - 1;
+        memcpy(text, payload, copy);
+        text[copy] = '\0';
+        free(payload);
+        return (int)copy;
+    }
+}
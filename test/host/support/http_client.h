@@ -0,0 +1,84 @@
+/**
+ * @file http_client.h
+ * @brief Minimal HTTP/1.1, SSE and WebSocket client for the host portal
+ *
+ * Blocking sockets on 127.0.0.1 with a receive timeout. Connections are kept
+ * alive between requests so latency figures do not include a handshake per
+ * request unless a tool asks for it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP_CLIENT_BUF_SIZE 4096
+
+typedef struct
+{
+    int fd;
+    char buf[HTTP_CLIENT_BUF_SIZE];
+    size_t start;
+    size_t end;
+} http_conn_t;
+
+typedef struct
+{
+    int status;
+    char content_type[64];
+    char location[128];
+    bool closed;   // Server sent "Connection: close"
+    char *body;    // NUL terminated, malloc'd
+    size_t body_len;
+} http_response_t;
+
+/**
+ * @brief Connect to the portal
+ * @return false if the connection or the timeout setup failed
+ */
+bool http_connect(http_conn_t *conn, uint16_t port, int timeout_ms);
+
+void http_close(http_conn_t *conn);
+
+/**
+ * @brief Send one request and read the whole response
+ * @param content_type NULL for requests without a body
+ * @return false on socket errors, timeouts or a malformed response
+ */
+bool http_request(http_conn_t *conn, const char *method, const char *path, const char *content_type,
+                  const char *body, size_t body_len, http_response_t *response);
+
+/**
+ * @brief Connect, send one request and close
+ */
+bool http_fetch(uint16_t port, const char *method, const char *path, const char *form, http_response_t *response);
+
+void http_response_free(http_response_t *response);
+
+/**
+ * @brief Open an event stream and read its headers
+ */
+bool sse_open(http_conn_t *conn, uint16_t port, const char *path, int timeout_ms);
+
+/**
+ * @brief Next event with its name and data (the comment and retry lines are skipped)
+ * @return false on timeout or when the stream closed
+ */
+bool sse_next_event(http_conn_t *conn, char *event, size_t event_size, char *data, size_t data_size);
+
+/**
+ * @brief Upgrade a new connection to a WebSocket
+ */
+bool ws_open(http_conn_t *conn, uint16_t port, const char *path, int timeout_ms);
+
+/**
+ * @brief Send a masked text frame
+ */
+bool ws_send_text(http_conn_t *conn, const char *text);
+
+/**
+ * @brief Receive the next text frame, answering pings on the way
+ * @return Payload length (truncated to size - 1, NUL terminated), -1 on error or close
+ */
+int ws_recv_text(http_conn_t *conn, char *text, size_t size);
@@ -0,0 +1,68 @@
+/**
+ * @file samples.c
+ * @brief Latency samples and their percentiles for the benchmarks
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "samples.h"
+
+void samples_add(samples_t *samples, double value)
+{
+    if (samples->count == samples->capacity)
+    {
+        samples->capacity = samples->capacity ? samples->capacity * 2 : 64;
+        samples->values = realloc(samples->values, samples->capacity * sizeof(double));
+    }
+    samples->values[samples->count++] = value;
+    samples->sorted = 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+double samples_percentile(samples_t *samples, double p)
+{
+    if (samples->count == 0)
+    {
+        return 0;
+    }
+    if (!samples->sorted)
+    {
+        qsort(samples->values, samples->count, sizeof(double), compare_double);
+        samples->sorted = 1;
+    }
+    size_t rank = (size_t)ceil(p / 100.0 * samples->count);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    return samples->values[rank - 1];
+}
+
+double samples_mean(const samples_t *samples)
+{
+    double sum = 0;
+    for (size_t i = 0; i < samples->count; i++)
+    {
+        sum += samples->values[i];
+    }
+    return samples->count ? sum / samples->count : 0;
+}
+
+double samples_max(samples_t *samples)
+{
+    return samples_percentile(samples, 100);
+}
+
+void samples_free(samples_t *samples)
+{
+    free(samples->values);
+    samples->values = NULL;
+    samples->count = 0;
+    samples->capacity = 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file samples.h
+ * @brief Latency samples and their percentiles for the benchmarks
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+typedef struct
+{
+    double *values;
+    size_t count;
+    size_t capacity;
+    int sorted;
+} samples_t;
+
+void samples_add(samples_t *samples, double value);
+
+/**
+ * @brief Nearest-rank percentile, p in 0..100 (0 if empty)
+ */
+double samples_percentile(samples_t *samples, double p);
+
+double samples_mean(const samples_t *samples);
+double samples_max(samples_t *samples);
+void samples_free(samples_t *samples);
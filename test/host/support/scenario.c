@@ -0,0 +1,926 @@
+/**
+ * @file scenario.c
+ * @brief Scripted radio scenarios replayed on the virtual clock
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "harness.h"
+#include "scenario.h"
+
+#define SCENARIO_MAX_STEPS 128
+#define SCENARIO_NAME_LEN 16
+#define SCENARIO_LINE_LEN 256
+
+typedef enum
+{
+    // World steps, run in the driver task at their time
+    STEP_RSSI,
+    STEP_DOWN,
+    STEP_UP,
+    STEP_DROP,
+    STEP_FAIL_CONNECTS,
+    STEP_DHCP,
+    // Component steps and expectations, run in order in the main task
+    STEP_AUTO_CONNECT,
+    STEP_PORTAL,
+    STEP_STOP_PORTAL,
+    STEP_ROAMING,
+    STEP_EXPECT_STATUS,
+    STEP_EXPECT_AP,
+    STEP_EXPECT_IP,
+    STEP_EXPECT_RESULT,
+    STEP_EXPECT_STAT,
+} step_type_t;
+
+typedef enum
+{
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+} compare_op_t;
+
+typedef struct
+{
+    step_type_t type;
+    uint32_t at_ms;
+    int line;
+    int ap;             // AP index, -1 for none
+    int value;          // RSSI, count, status, result, stat index
+    int value2;         // Reason, comparison operand
+    compare_op_t op;
+    wifi_manager_roam_config_t roam;
+    bool roam_defaults;
+} step_t;
+
+typedef struct
+{
+    char name[SCENARIO_NAME_LEN];
+    char ssid[33];
+    char password[65];
+    fake_ap_config_t config;
+} scenario_ap_t;
+
+typedef struct
+{
+    char ssid[33];
+    char password[65];
+    uint8_t priority;
+} scenario_network_t;
+
+struct scenario
+{
+    char path[256];
+    scenario_ap_t aps[FAKE_WIFI_MAX_APS];
+    int ap_count;
+    scenario_network_t networks[WIFI_MANAGER_MAX_NETWORKS];
+    int network_count;
+    fake_wifi_timing_t timing;
+    uint32_t portal_timeout_s;
+    bool nonblocking;
+    step_t steps[SCENARIO_MAX_STEPS];
+    int step_count;
+    uint32_t end_ms;
+};
+
+static const char *const status_names[] = {
+    "disconnected", "connecting", "connected", "ap_mode", "config_portal", "failed", "no_ip",
+};
+
+static const char *const stat_names[] = {
+    "scans", "connects", "connected", "disconnects", "dhcp_starts", "dhcp_leases",
+};
+
+static const char *const op_names[] = {"==", "!=", "<", "<=", ">", ">="};
+
+#define COUNT_OF(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+// ------------------------------------------
+//   Parsing
+// ------------------------------------------
+
+typedef struct
+{
+    scenario_t *scenario;
+    int line;
+    char *err;
+    size_t err_size;
+} parser_t;
+
+static bool parse_error(parser_t *p, const char *format, ...)
+{
+    int len = snprintf(p->err, p->err_size, "%s:%d: ", p->scenario->path, p->line);
+    va_list args;
+    va_start(args, format);
+    if (len >= 0 && (size_t)len < p->err_size)
+    {
+        vsnprintf(p->err + len, p->err_size - len, format, args);
+    }
+    va_end(args);
+    return false;
+}
+
+static int find_name(const char *const *names, int count, const char *name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool parse_int(const char *text, long min, long max, long *out)
+{
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (!*text || *end || value < min || value > max)
+    {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static int find_ap(const scenario_t *scenario, const char *name)
+{
+    for (int i = 0; i < scenario->ap_count; i++)
+    {
+        if (strcmp(scenario->aps[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool parse_ap_arg(parser_t *p, char *word, int *ap)
+{
+    *ap = find_ap(p->scenario, word ? word : "");
+    return *ap >= 0 || parse_error(p, "unknown AP \"%s\"", word ? word : "");
+}
+
+static bool parse_uint_arg(parser_t *p, const char *word, long max, long *out)
+{
+    return (word && parse_int(word, 0, max, out)) || parse_error(p, "expected a number up to %ld", max);
+}
+
+// ap <name> ssid=<ssid> [pass=<password>] [rssi=<dBm>] [ch=<channel>] [hidden] [dhcp_ms=<ms>]
+static bool parse_ap(parser_t *p, char **save)
+{
+    scenario_t *scenario = p->scenario;
+    char *name = strtok_r(NULL, " \t", save);
+    if (!name || strlen(name) >= SCENARIO_NAME_LEN || find_ap(scenario, name) >= 0)
+    {
+        return parse_error(p, "ap needs a new name of up to %d characters", SCENARIO_NAME_LEN - 1);
+    }
+    if (scenario->ap_count == FAKE_WIFI_MAX_APS)
+    {
+        return parse_error(p, "more than %d APs", FAKE_WIFI_MAX_APS);
+    }
+    scenario_ap_t *ap = &scenario->aps[scenario->ap_count];
+    snprintf(ap->name, sizeof(ap->name), "%s", name);
+    ap->config.rssi = -60;
+
+    for (char *word; (word = strtok_r(NULL, " \t", save));)
+    {
+        char *value = strchr(word, '=');
+        long number;
+        if (value)
+        {
+            *value++ = '\0';
+        }
+        if (strcmp(word, "hidden") == 0 && !value)
+        {
+            ap->config.hidden = true;
+        }
+        else if (strcmp(word, "ssid") == 0 && value && strlen(value) < sizeof(ap->ssid))
+        {
+            snprintf(ap->ssid, sizeof(ap->ssid), "%s", value);
+        }
+        else if (strcmp(word, "pass") == 0 && value && strlen(value) < sizeof(ap->password))
+        {
+            snprintf(ap->password, sizeof(ap->password), "%s", value);
+        }
+        else if (strcmp(word, "rssi") == 0 && value && parse_int(value, -127, 0, &number))
+        {
+            ap->config.rssi = (int8_t)number;
+        }
+        else if (strcmp(word, "ch") == 0 && value && parse_int(value, 1, 13, &number))
+        {
+            ap->config.channel = (uint8_t)number;
+        }
+        else if (strcmp(word, "dhcp_ms") == 0 && value && parse_int(value, 1, 600000, &number))
+        {
+            ap->config.dhcp_ms = (uint32_t)number;
+        }
+        else
+        {
+            return parse_error(p, "bad ap attribute \"%s\"", word);
+        }
+    }
+    if (!ap->ssid[0])
+    {
+        return parse_error(p, "ap needs ssid=");
+    }
+    ap->config.authmode = ap->password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    scenario->ap_count++;
+    return true;
+}
+
+// network <ssid> <password|-> [priority]
+static bool parse_network(parser_t *p, char **save)
+{
+    scenario_t *scenario = p->scenario;
+    char *ssid = strtok_r(NULL, " \t", save);
+    char *password = strtok_r(NULL, " \t", save);
+    char *priority = strtok_r(NULL, " \t", save);
+    long number = 0;
+    if (scenario->network_count == WIFI_MANAGER_MAX_NETWORKS)
+    {
+        return parse_error(p, "more than %d networks", WIFI_MANAGER_MAX_NETWORKS);
+    }
+    if (!ssid || !password || strlen(ssid) > 32 || strlen(password) > 64 ||
+        (priority && !parse_int(priority, 0, 255, &number)))
+    {
+        return parse_error(p, "network needs <ssid> <password|-> [priority]");
+    }
+    scenario_network_t *network = &scenario->networks[scenario->network_count++];
+    snprintf(network->ssid, sizeof(network->ssid), "%s", ssid);
+    snprintf(network->password, sizeof(network->password), "%s", strcmp(password, "-") == 0 ? "" : password);
+    network->priority = (uint8_t)number;
+    return true;
+}
+
+// timing key=ms ...
+static bool parse_timing(parser_t *p, char **save)
+{
+    fake_wifi_timing_t *timing = &p->scenario->timing;
+    struct
+    {
+        const char *name;
+        uint32_t *field;
+    } fields[] = {
+        {"scan_channel_ms", &timing->scan_channel_ms}, {"scan_dwell_cap_ms", &timing->scan_dwell_cap_ms},
+        {"assoc_ms", &timing->assoc_ms},               {"auth_fail_ms", &timing->auth_fail_ms},
+        {"dhcp_ms", &timing->dhcp_ms},                 {"beacon_timeout_ms", &timing->beacon_timeout_ms},
+    };
+    for (char *word; (word = strtok_r(NULL, " \t", save));)
+    {
+        char *value = strchr(word, '=');
+        long number;
+        int i = 0;
+        if (value)
+        {
+            *value++ = '\0';
+            while (i < COUNT_OF(fields) && strcmp(fields[i].name, word) != 0)
+            {
+                i++;
+            }
+        }
+        if (!value || i == COUNT_OF(fields) || !parse_int(value, 0, 600000, &number))
+        {
+            return parse_error(p, "bad timing \"%s\"", word);
+        }
+        *fields[i].field = (uint32_t)number;
+    }
+    return true;
+}
+
+// roaming [threshold=<dBm>] [hysteresis=<dB>] [interval=<ms>] [hold=<ms>]
+static bool parse_roaming(parser_t *p, char **save, step_t *step)
+{
+    step->roam_defaults = true;
+    step->roam = (wifi_manager_roam_config_t){
+        .rssi_threshold = -70, .rssi_hysteresis = 8, .scan_interval_ms = 10000, .min_roam_interval_ms = 30000};
+    for (char *word; (word = strtok_r(NULL, " \t", save));)
+    {
+        char *value = strchr(word, '=');
+        long number;
+        if (value)
+        {
+            *value++ = '\0';
+        }
+        step->roam_defaults = false;
+        if (!value)
+        {
+            return parse_error(p, "bad roaming setting \"%s\"", word);
+        }
+        else if (strcmp(word, "threshold") == 0 && parse_int(value, -127, 0, &number))
+        {
+            step->roam.rssi_threshold = (int8_t)number;
+        }
+        else if (strcmp(word, "hysteresis") == 0 && parse_int(value, 0, 100, &number))
+        {
+            step->roam.rssi_hysteresis = (uint8_t)number;
+        }
+        else if (strcmp(word, "interval") == 0 && parse_int(value, 1, 3600000, &number))
+        {
+            step->roam.scan_interval_ms = (uint32_t)number;
+        }
+        else if (strcmp(word, "hold") == 0 && parse_int(value, 0, 3600000, &number))
+        {
+            step->roam.min_roam_interval_ms = (uint32_t)number;
+        }
+        else
+        {
+            return parse_error(p, "bad roaming setting \"%s\"", word);
+        }
+    }
+    return true;
+}
+
+static bool parse_expect(parser_t *p, char **save, step_t *step)
+{
+    char *what = strtok_r(NULL, " \t", save);
+    char *arg = strtok_r(NULL, " \t", save);
+    if (!what || !arg)
+    {
+        return parse_error(p, "expect needs a subject and a value");
+    }
+    if (strcmp(what, "status") == 0)
+    {
+        step->type = STEP_EXPECT_STATUS;
+        step->value = find_name(status_names, COUNT_OF(status_names), arg);
+        return step->value >= 0 || parse_error(p, "unknown status \"%s\"", arg);
+    }
+    if (strcmp(what, "ap") == 0)
+    {
+        step->type = STEP_EXPECT_AP;
+        return strcmp(arg, "none") == 0 ? (step->ap = -1, true) : parse_ap_arg(p, arg, &step->ap);
+    }
+    if (strcmp(what, "ip") == 0)
+    {
+        step->type = STEP_EXPECT_IP;
+        return strcmp(arg, "none") == 0 ? (step->ap = -1, true) : parse_ap_arg(p, arg, &step->ap);
+    }
+    if (strcmp(what, "result") == 0)
+    {
+        step->type = STEP_EXPECT_RESULT;
+        step->value = strcmp(arg, "true") == 0 ? 1 : strcmp(arg, "false") == 0 ? 0 : -1;
+        return step->value >= 0 || parse_error(p, "result is true or false");
+    }
+    if (strcmp(what, "stat") == 0)
+    {
+        char *op = strtok_r(NULL, " \t", save);
+        char *count = strtok_r(NULL, " \t", save);
+        long number;
+        step->type = STEP_EXPECT_STAT;
+        step->value = find_name(stat_names, COUNT_OF(stat_names), arg);
+        int op_index = op ? find_name(op_names, COUNT_OF(op_names), op) : -1;
+        if (step->value < 0 || op_index < 0 || !count || !parse_int(count, 0, 1000000, &number))
+        {
+            return parse_error(p, "expect stat <name> <op> <count>");
+        }
+        step->op = (compare_op_t)op_index;
+        step->value2 = (int)number;
+        return true;
+    }
+    return parse_error(p, "unknown expectation \"%s\"", what);
+}
+
+// at <ms> <step ...>
+static bool parse_step(parser_t *p, char **save)
+{
+    scenario_t *scenario = p->scenario;
+    char *at = strtok_r(NULL, " \t", save);
+    char *what = strtok_r(NULL, " \t", save);
+    long at_ms;
+    if (!at || !parse_int(at, 0, 24L * 3600 * 1000, &at_ms) || !what)
+    {
+        return parse_error(p, "at needs <ms> <step>");
+    }
+    if (scenario->step_count == SCENARIO_MAX_STEPS)
+    {
+        return parse_error(p, "more than %d steps", SCENARIO_MAX_STEPS);
+    }
+    step_t *step = &scenario->steps[scenario->step_count];
+    memset(step, 0, sizeof(*step));
+    step->at_ms = (uint32_t)at_ms;
+    step->line = p->line;
+    step->ap = -1;
+
+    long number = 0;
+    bool ok;
+    if (strcmp(what, "rssi") == 0)
+    {
+        step->type = STEP_RSSI;
+        char *value = (ok = parse_ap_arg(p, strtok_r(NULL, " \t", save), &step->ap)) ? strtok_r(NULL, " \t", save)
+                                                                                    : NULL;
+        ok = ok && ((value && parse_int(value, -127, 0, &number)) || parse_error(p, "rssi needs <ap> <dBm>"));
+        step->value = ok ? (int)number : 0;
+    }
+    else if (strcmp(what, "down") == 0 || strcmp(what, "up") == 0)
+    {
+        step->type = what[0] == 'd' ? STEP_DOWN : STEP_UP;
+        ok = parse_ap_arg(p, strtok_r(NULL, " \t", save), &step->ap);
+    }
+    else if (strcmp(what, "drop") == 0)
+    {
+        step->type = STEP_DROP;
+        char *reason = strtok_r(NULL, " \t", save);
+        step->value2 = WIFI_REASON_AUTH_EXPIRE;
+        ok = !reason || parse_uint_arg(p, reason, 255, &number);
+        step->value2 = reason && ok ? (int)number : step->value2;
+    }
+    else if (strcmp(what, "fail_connects") == 0)
+    {
+        step->type = STEP_FAIL_CONNECTS;
+        char *count = strtok_r(NULL, " \t", save);
+        char *reason = strtok_r(NULL, " \t", save);
+        ok = parse_uint_arg(p, count, 1000, &number);
+        step->value = ok ? (int)number : 0;
+        step->value2 = WIFI_REASON_AUTH_FAIL;
+        if (ok && reason)
+        {
+            ok = parse_uint_arg(p, reason, 255, &number);
+            step->value2 = (int)number;
+        }
+    }
+    else if (strcmp(what, "dhcp") == 0)
+    {
+        step->type = STEP_DHCP;
+        char *state = (ok = parse_ap_arg(p, strtok_r(NULL, " \t", save), &step->ap)) ? strtok_r(NULL, " \t", save)
+                                                                                    : NULL;
+        step->value = state && strcmp(state, "on") == 0;
+        ok = ok && ((state && (step->value || strcmp(state, "off") == 0)) || parse_error(p, "dhcp <ap> on|off"));
+    }
+    else if (strcmp(what, "auto_connect") == 0)
+    {
+        step->type = STEP_AUTO_CONNECT;
+        ok = true;
+    }
+    else if (strcmp(what, "portal") == 0)
+    {
+        step->type = STEP_PORTAL;
+        ok = true;
+    }
+    else if (strcmp(what, "stop_portal") == 0)
+    {
+        step->type = STEP_STOP_PORTAL;
+        ok = true;
+    }
+    else if (strcmp(what, "roaming") == 0)
+    {
+        step->type = STEP_ROAMING;
+        ok = parse_roaming(p, save, step);
+    }
+    else if (strcmp(what, "expect") == 0)
+    {
+        ok = parse_expect(p, save, step);
+    }
+    else
+    {
+        ok = parse_error(p, "unknown step \"%s\"", what);
+    }
+    if (ok && strtok_r(NULL, " \t", save))
+    {
+        ok = parse_error(p, "unexpected text after \"%s\"", what);
+    }
+    if (ok && scenario->step_count > 0 && step->type >= STEP_AUTO_CONNECT)
+    {
+        // Component steps run in file order, so their times must not go back
+        for (int i = scenario->step_count - 1; i >= 0; i--)
+        {
+            if (scenario->steps[i].type >= STEP_AUTO_CONNECT)
+            {
+                ok = scenario->steps[i].at_ms <= step->at_ms || parse_error(p, "steps out of time order");
+                break;
+            }
+        }
+    }
+    scenario->step_count += ok;
+    return ok;
+}
+
+scenario_t *scenario_load(const char *path, char *err, size_t err_size)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        snprintf(err, err_size, "%s: cannot open", path);
+        return NULL;
+    }
+    scenario_t *scenario = calloc(1, sizeof(*scenario));
+    snprintf(scenario->path, sizeof(scenario->path), "%s", path);
+    fake_wifi_get_timing(&scenario->timing);
+
+    parser_t p = {.scenario = scenario, .err = err, .err_size = err_size};
+    char line[SCENARIO_LINE_LEN];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        p.line++;
+        char *comment = strchr(line, '#');
+        if (comment)
+        {
+            *comment = '\0';
+        }
+        char *save;
+        char *keyword = strtok_r(line, " \t\r\n", &save);
+        // The remaining words are split on blanks; line ends were cut with the keyword
+        char *end = save ? save + strcspn(save, "\r\n") : NULL;
+        if (end)
+        {
+            *end = '\0';
+        }
+        long number = 0;
+        if (!keyword)
+        {
+            continue;
+        }
+        else if (strcmp(keyword, "ap") == 0)
+        {
+            ok = parse_ap(&p, &save);
+        }
+        else if (strcmp(keyword, "network") == 0)
+        {
+            ok = parse_network(&p, &save);
+        }
+        else if (strcmp(keyword, "timing") == 0)
+        {
+            ok = parse_timing(&p, &save);
+        }
+        else if (strcmp(keyword, "portal_timeout") == 0)
+        {
+            ok = parse_uint_arg(&p, strtok_r(NULL, " \t", &save), 3600, &number);
+            scenario->portal_timeout_s = (uint32_t)number;
+        }
+        else if (strcmp(keyword, "nonblocking") == 0)
+        {
+            scenario->nonblocking = true;
+        }
+        else if (strcmp(keyword, "at") == 0)
+        {
+            ok = parse_step(&p, &save);
+        }
+        else if (strcmp(keyword, "end") == 0)
+        {
+            ok = parse_uint_arg(&p, strtok_r(NULL, " \t", &save), 24L * 3600 * 1000, &number);
+            scenario->end_ms = (uint32_t)number;
+        }
+        else
+        {
+            ok = parse_error(&p, "unknown keyword \"%s\"", keyword);
+        }
+    }
+    fclose(file);
+
+    for (int i = 0; ok && i < scenario->step_count; i++)
+    {
+        if (scenario->steps[i].at_ms > scenario->end_ms)
+        {
+            p.line = scenario->steps[i].line;
+            ok = parse_error(&p, "step after the end (%lu ms)", (unsigned long)scenario->end_ms);
+        }
+    }
+    if (!ok)
+    {
+        free(scenario);
+        return NULL;
+    }
+    return scenario;
+}
+
+void scenario_free(scenario_t *scenario)
+{
+    free(scenario);
+}
+
+// ------------------------------------------
+//   Replay
+// ------------------------------------------
+
+typedef struct
+{
+    const scenario_t *scenario;
+    FILE *trace;
+    wifi_manager_t *wm;
+    int64_t start_us;
+    wifi_status_t last_status;
+    bool last_result;
+    scenario_result_t *result;
+    uint32_t world_calls[SCENARIO_MAX_STEPS];
+} run_t;
+
+// One replay at a time: the driver task callbacks find it here
+static run_t *current_run;
+
+static void trace(run_t *run, const char *format, ...)
+{
+    if (!run->trace)
+    {
+        return;
+    }
+    int64_t ms = (fake_rtos_now_us() - run->start_us) / 1000;
+    fprintf(run->trace, "%4lld.%03lld  ", (long long)(ms / 1000), (long long)(ms % 1000));
+    va_list args;
+    va_start(args, format);
+    vfprintf(run->trace, format, args);
+    va_end(args);
+    fputc('\n', run->trace);
+}
+
+static void trace_status(run_t *run)
+{
+    wifi_status_t status = wifi_manager_get_status(run->wm);
+    if (status != run->last_status)
+    {
+        run->last_status = status;
+        trace(run, "status %s", status_names[status]);
+    }
+}
+
+static const char *ap_name(const run_t *run, int ap)
+{
+    return ap >= 0 ? run->scenario->aps[ap].name : "none";
+}
+
+static void trace_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    run_t *run = arg;
+    if (base == WIFI_EVENT)
+    {
+        switch (id)
+        {
+        case WIFI_EVENT_SCAN_DONE:
+        {
+            wifi_event_sta_scan_done_t *done = data;
+            trace(run, "WIFI_EVENT SCAN_DONE %s, %u found", done->status ? "aborted" : "ok", done->number);
+            break;
+        }
+        case WIFI_EVENT_STA_CONNECTED:
+        {
+            wifi_event_sta_connected_t *connected = data;
+            trace(run, "WIFI_EVENT STA_CONNECTED %.*s ch %u (%s)", connected->ssid_len, connected->ssid,
+                  connected->channel, ap_name(run, fake_wifi_connected_ap()));
+            break;
+        }
+        case WIFI_EVENT_STA_DISCONNECTED:
+        {
+            wifi_event_sta_disconnected_t *disconnected = data;
+            trace(run, "WIFI_EVENT STA_DISCONNECTED reason %u", disconnected->reason);
+            break;
+        }
+        case WIFI_EVENT_STA_START:
+            trace(run, "WIFI_EVENT STA_START");
+            break;
+        case WIFI_EVENT_STA_STOP:
+            trace(run, "WIFI_EVENT STA_STOP");
+            break;
+        case WIFI_EVENT_AP_START:
+            trace(run, "WIFI_EVENT AP_START");
+            break;
+        case WIFI_EVENT_AP_STOP:
+            trace(run, "WIFI_EVENT AP_STOP");
+            break;
+        default:
+            trace(run, "WIFI_EVENT %ld", (long)id);
+            break;
+        }
+    }
+    else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP)
+    {
+        ip_event_got_ip_t *got = data;
+        trace(run, "IP_EVENT STA_GOT_IP " IPSTR, IP2STR(&got->ip_info.ip));
+    }
+    else if (base == IP_EVENT && id == IP_EVENT_STA_LOST_IP)
+    {
+        trace(run, "IP_EVENT STA_LOST_IP");
+    }
+    // Registered after the component, so its handler has already run
+    trace_status(run);
+}
+
+static void world_step(void *arg)
+{
+    const step_t *step = arg;
+    run_t *run = current_run;
+    switch (step->type)
+    {
+    case STEP_RSSI:
+        trace(run, "> rssi %s %d", ap_name(run, step->ap), step->value);
+        fake_wifi_set_rssi(step->ap, (int8_t)step->value);
+        break;
+    case STEP_DOWN:
+    case STEP_UP:
+        trace(run, "> %s %s", step->type == STEP_UP ? "up" : "down", ap_name(run, step->ap));
+        fake_wifi_set_ap_up(step->ap, step->type == STEP_UP);
+        break;
+    case STEP_DROP:
+        trace(run, "> drop reason %d", step->value2);
+        fake_wifi_drop_link((wifi_err_reason_t)step->value2);
+        break;
+    case STEP_FAIL_CONNECTS:
+        trace(run, "> fail_connects %d reason %d", step->value, step->value2);
+        fake_wifi_fail_connects((unsigned)step->value, (wifi_err_reason_t)step->value2);
+        break;
+    case STEP_DHCP:
+        trace(run, "> dhcp %s %s", ap_name(run, step->ap), step->value ? "on" : "off");
+        fake_wifi_set_dhcp_up(step->ap, step->value);
+        break;
+    default:
+        break;
+    }
+}
+
+static bool compare(long long a, compare_op_t op, long long b)
+{
+    switch (op)
+    {
+    case OP_EQ:
+        return a == b;
+    case OP_NE:
+        return a != b;
+    case OP_LT:
+        return a < b;
+    case OP_LE:
+        return a <= b;
+    case OP_GT:
+        return a > b;
+    default:
+        return a >= b;
+    }
+}
+
+static void expect(run_t *run, const step_t *step, bool held, const char *format, ...)
+{
+    char detail[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(detail, sizeof(detail), format, args);
+    va_end(args);
+
+    run->result->expectations++;
+    if (!held)
+    {
+        run->result->failures++;
+    }
+    trace(run, "%s line %d: %s", held ? "ok" : "FAIL", step->line, detail);
+    if (!held && !run->trace)
+    {
+        fprintf(stderr, "%s:%d: expectation failed: %s\n", run->scenario->path, step->line, detail);
+    }
+}
+
+static void component_step(run_t *run, const step_t *step)
+{
+    wifi_manager_t *wm = run->wm;
+    switch (step->type)
+    {
+    case STEP_AUTO_CONNECT:
+        trace(run, "> auto_connect");
+        run->last_result = wifi_manager_auto_connect(wm, "WM-Sim", NULL);
+        trace_status(run);
+        trace(run, "< auto_connect %s", run->last_result ? "true" : "false");
+        break;
+    case STEP_PORTAL:
+        trace(run, "> portal");
+        run->last_result = wifi_manager_start_config_portal(wm, "WM-Sim", NULL);
+        trace_status(run);
+        trace(run, "< portal %s", run->last_result ? "true" : "false");
+        break;
+    case STEP_STOP_PORTAL:
+        trace(run, "> stop_portal");
+        wifi_manager_stop_config_portal(wm);
+        break;
+    case STEP_ROAMING:
+        trace(run, "> roaming");
+        CHECK(wifi_manager_enable_roaming(wm, step->roam_defaults ? NULL : &step->roam) == ESP_OK);
+        break;
+    case STEP_EXPECT_STATUS:
+    {
+        wifi_status_t status = wifi_manager_get_status(wm);
+        expect(run, step, (int)status == step->value, "status %s (is %s)", status_names[step->value],
+               status_names[status]);
+        break;
+    }
+    case STEP_EXPECT_AP:
+    {
+        int ap = fake_wifi_connected_ap();
+        expect(run, step, ap == step->ap, "ap %s (is %s)", ap_name(run, step->ap), ap_name(run, ap));
+        break;
+    }
+    case STEP_EXPECT_IP:
+    {
+        uint32_t ip = fake_netif_sta_ip();
+        uint32_t want = step->ap >= 0 ? fake_wifi_lease_ip(step->ap) : 0;
+        esp_ip4_addr_t is = {.addr = ip};
+        expect(run, step, ip == want, "ip of %s (is " IPSTR ")", ap_name(run, step->ap), IP2STR(&is));
+        break;
+    }
+    case STEP_EXPECT_RESULT:
+        expect(run, step, run->last_result == (step->value != 0), "result %s (is %s)",
+               step->value ? "true" : "false", run->last_result ? "true" : "false");
+        break;
+    case STEP_EXPECT_STAT:
+    {
+        fake_wifi_stats_t stats;
+        fake_wifi_get_stats(&stats);
+        const unsigned values[] = {stats.scans,       stats.connects,    stats.connected,
+                                   stats.disconnects, stats.dhcp_starts, stats.dhcp_leases};
+        unsigned value = values[step->value];
+        expect(run, step, compare(value, step->op, step->value2), "stat %s %s %d (is %u)", stat_names[step->value],
+               op_names[step->op], step->value2, value);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void run_until(run_t *run, uint32_t at_ms)
+{
+    int64_t due_us = run->start_us + (int64_t)at_ms * 1000;
+    int64_t now = fake_rtos_now_us();
+    if (due_us > now)
+    {
+        fake_rtos_run_for_ms((uint32_t)((due_us - now + 999) / 1000));
+    }
+}
+
+bool scenario_run(const scenario_t *scenario, FILE *trace_file, scenario_result_t *result)
+{
+    CHECK(fake_rtos_clock() == FAKE_CLOCK_VIRTUAL && fake_rtos_in_task());
+    memset(result, 0, sizeof(*result));
+    harness_reset();
+    fake_wifi_set_timing(&scenario->timing);
+
+    int ap_index[FAKE_WIFI_MAX_APS];
+    for (int i = 0; i < scenario->ap_count; i++)
+    {
+        fake_ap_config_t config = scenario->aps[i].config;
+        config.ssid = scenario->aps[i].ssid;
+        config.password = scenario->aps[i].password;
+        ap_index[i] = fake_wifi_add_ap(&config);
+        CHECK(ap_index[i] == i);
+    }
+
+    run_t run = {.scenario = scenario, .trace = trace_file, .result = result, .last_status = WIFI_STATUS_DISCONNECTED};
+    run.wm = wifi_manager_create();
+    CHECK(run.wm);
+    for (int i = 0; i < scenario->network_count; i++)
+    {
+        const scenario_network_t *network = &scenario->networks[i];
+        CHECK(wifi_manager_add_network(run.wm, network->ssid, network->password, network->priority) == ESP_OK);
+    }
+    wifi_manager_set_config_portal_blocking(run.wm, !scenario->nonblocking);
+    wifi_manager_set_config_portal_timeout(run.wm, scenario->portal_timeout_s);
+
+    esp_event_handler_instance_t wifi_handler;
+    esp_event_handler_instance_t ip_handler;
+    CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, trace_handler, &run, &wifi_handler) ==
+          ESP_OK);
+    CHECK(esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, trace_handler, &run, &ip_handler) ==
+          ESP_OK);
+
+    current_run = &run;
+    run.start_us = fake_rtos_now_us();
+    trace(&run, "start %s", scenario->path);
+    for (int i = 0; i < scenario->step_count; i++)
+    {
+        const step_t *step = &scenario->steps[i];
+        if (step->type < STEP_AUTO_CONNECT)
+        {
+            run.world_calls[i] = fake_rtos_call_later((int64_t)step->at_ms * 1000, world_step, (void *)step);
+        }
+    }
+
+    for (int i = 0; i < scenario->step_count; i++)
+    {
+        const step_t *step = &scenario->steps[i];
+        if (step->type < STEP_AUTO_CONNECT)
+        {
+            continue;
+        }
+        if (step->type < STEP_EXPECT_STATUS && fake_rtos_now_us() > run.start_us + (int64_t)step->at_ms * 1000)
+        {
+            result->late_steps++;
+        }
+        run_until(&run, step->at_ms);
+        component_step(&run, step);
+    }
+    run_until(&run, scenario->end_ms);
+    trace(&run, "end");
+
+    for (int i = 0; i < scenario->step_count; i++)
+    {
+        if (run.world_calls[i])
+        {
+            fake_rtos_cancel(run.world_calls[i]);
+        }
+    }
+    esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_handler);
+    esp_event_handler_instance_unregister(IP_EVENT, ESP_EVENT_ANY_ID, ip_handler);
+    wifi_manager_destroy(run.wm);
+    current_run = NULL;
+    return result->failures == 0;
+}
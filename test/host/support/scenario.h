@@ -0,0 +1,55 @@
+/**
+ * @file scenario.h
+ * @brief Scripted radio scenarios replayed on the virtual clock
+ *
+ * A scenario file declares access points and saved networks, then lists
+ * timed steps. World steps (signal changes, APs going down, deauths, DHCP
+ * outages) run in the driver task at their exact time; component steps
+ * (auto_connect, portal, roaming) and expectations run in order in the main
+ * task, each waiting for its time. Every WIFI_EVENT and IP_EVENT the
+ * component receives is written to the trace with its device time.
+ *
+ *   # Comment
+ *   timing assoc_ms=400 dhcp_ms=1500
+ *   ap office ssid=Office pass=secret123 rssi=-60 ch=6
+ *   network Office secret123 1
+ *   at 0 auto_connect
+ *   at 30000 expect status connected
+ *   at 40000 rssi office -90
+ *   end 60000
+ *
+ * See test/host/scenarios/README.md for all steps.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct scenario scenario_t;
+
+typedef struct
+{
+    unsigned expectations; // expect steps evaluated
+    unsigned failures;     // expect steps that did not hold
+    unsigned late_steps;   // Calls that started after their time because a blocking call ran over
+} scenario_result_t;
+
+/**
+ * @brief Parse a scenario file
+ * @param err Receives "file:line: message" on failure
+ * @return NULL on error
+ */
+scenario_t *scenario_load(const char *path, char *err, size_t err_size);
+
+void scenario_free(scenario_t *scenario);
+
+/**
+ * @brief Replay a scenario with a fresh component and radio world
+ *
+ * Requires harness_init(FAKE_CLOCK_VIRTUAL). Scenarios can be replayed one
+ * after the other in the same process.
+ * @param trace Receives the timeline (NULL for none)
+ * @return true when every expectation held
+ */
+bool scenario_run(const scenario_t *scenario, FILE *trace, scenario_result_t *result);
@@ -0,0 +1,271 @@
+/**
+ * @file test_dns.c
+ * @brief Captive DNS replies, and how many queries the responder answers per second
+ *
+ * build_dns_reply() is checked on hand-made queries and on random packets
+ * (run the ASan build to catch reads past the query). The loopback case
+ * starts the portal and sends queries to its responder one at a time over
+ * UDP, reporting queries per second and the latency percentiles.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "harness.h"
+#include "lwip/sockets.h"
+#include "samples.h"
+#include "wifi_manager_private.h"
+
+#define HEADER_SIZE 12
+#define TYPE_A 1
+#define TYPE_AAAA 28
+#define TYPE_ANY 255
+#define RANDOM_PACKETS 100000
+#define QPS_RUN_MS 1000
+#define REPLY_TIMEOUT_MS 1000
+#define MIN_QPS 200 // Far below the host rate, catches a responder that stalls between queries
+
+static const uint8_t answer[DNS_ANSWER_SIZE] = {
+    0xC0, HEADER_SIZE, 0x00, TYPE_A, 0x00, 0x01, 0x00, 0x00, 0x00, 60, 0x00, 0x04, 192, 168, 4, 1,
+};
+
+/**
+ * @brief Write a query for name (dotted) and qtype
+ * @return Query length
+ */
+static int make_query(uint8_t *packet, uint16_t id, const char *name, uint16_t qtype)
+{
+    memset(packet, 0, DNS_MAX_PACKET_SIZE);
+    packet[0] = id >> 8;
+    packet[1] = id & 0xFF;
+    packet[2] = 0x01; // RD
+    packet[5] = 1;    // QDCOUNT
+
+    int offset = HEADER_SIZE;
+    while (*name)
+    {
+        const char *dot = strchr(name, '.');
+        size_t label = dot ? (size_t)(dot - name) : strlen(name);
+        packet[offset++] = (uint8_t)label;
+        memcpy(&packet[offset], name, label);
+        offset += label;
+        name += label + (dot ? 1 : 0);
+    }
+    packet[offset++] = 0;
+    packet[offset++] = qtype >> 8;
+    packet[offset++] = qtype & 0xFF;
+    packet[offset++] = 0;
+    packet[offset++] = 1; // IN
+    return offset;
+}
+
+static void test_a_query_answered(void)
+{
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    int len = make_query(packet, 0x1234, "connectivitycheck.gstatic.com", TYPE_A);
+    uint8_t question[DNS_MAX_PACKET_SIZE];
+    memcpy(question, packet, len);
+
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, len + DNS_ANSWER_SIZE);
+    CHECK_INT(packet[0], ==, 0x12);
+    CHECK_INT(packet[1], ==, 0x34);
+    CHECK_INT(packet[2], ==, 0x85); // QR, AA, RD kept
+    CHECK_INT(packet[3], ==, 0x80); // RA, NOERROR
+    CHECK_INT(packet[5], ==, 1);    // QDCOUNT
+    CHECK_INT(packet[7], ==, 1);    // ANCOUNT
+    CHECK(memcmp(&packet[HEADER_SIZE], &question[HEADER_SIZE], len - HEADER_SIZE) == 0);
+    CHECK(memcmp(&packet[len], answer, DNS_ANSWER_SIZE) == 0);
+
+    // ANY is answered the same way; RD stays clear when the client did not set it
+    len = make_query(packet, 1, "example.com", TYPE_ANY);
+    packet[2] = 0;
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, len + DNS_ANSWER_SIZE);
+    CHECK_INT(packet[2], ==, 0x84);
+    CHECK_INT(packet[7], ==, 1);
+}
+
+static void test_other_types_get_empty_answer(void)
+{
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    int len = make_query(packet, 7, "example.com", TYPE_AAAA);
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, len);
+    CHECK_INT(packet[3], ==, 0x80);
+    CHECK_INT(packet[7], ==, 0);
+}
+
+static void test_extra_sections_dropped(void)
+{
+    // EDNS0 OPT record in the additional section, as most resolvers send
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    int len = make_query(packet, 9, "example.com", TYPE_A);
+    const uint8_t opt[] = {0x00, 0x00, 0x29, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    memcpy(&packet[len], opt, sizeof(opt));
+    packet[11] = 1; // ARCOUNT
+    int reply = build_dns_reply(packet, len + sizeof(opt), answer);
+    CHECK_INT(reply, ==, len + DNS_ANSWER_SIZE);
+    CHECK_INT(packet[11], ==, 0);
+    CHECK(memcmp(&packet[len], answer, DNS_ANSWER_SIZE) == 0);
+}
+
+static void test_invalid_packets_ignored(void)
+{
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    int len = make_query(packet, 1, "example.com", TYPE_A);
+
+    CHECK_INT(build_dns_reply(packet, HEADER_SIZE - 1, answer), ==, 0);
+
+    packet[2] = 0x81; // A response, not a query
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, 0);
+
+    make_query(packet, 1, "example.com", TYPE_A);
+    packet[2] = 0x10 | 0x01; // Opcode STATUS
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, 0);
+
+    make_query(packet, 1, "example.com", TYPE_A);
+    packet[5] = 0; // No question
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, 0);
+
+    // Name or QTYPE/QCLASS cut short
+    make_query(packet, 1, "example.com", TYPE_A);
+    CHECK_INT(build_dns_reply(packet, len - 1, answer), ==, 0);
+    CHECK_INT(build_dns_reply(packet, HEADER_SIZE + 4, answer), ==, 0);
+
+    // Compression pointer in the question
+    make_query(packet, 1, "example.com", TYPE_A);
+    packet[HEADER_SIZE] = 0xC0;
+    CHECK_INT(build_dns_reply(packet, len, answer), ==, 0);
+}
+
+static void test_reply_fits_packet(void)
+{
+    // Labels up to the 512 byte limit: the answer must not be appended past it
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    memset(packet, 0, sizeof(packet));
+    packet[2] = 0x01;
+    packet[5] = 1;
+    int offset = HEADER_SIZE;
+    while (offset + 64 + 5 <= DNS_MAX_PACKET_SIZE)
+    {
+        packet[offset] = 63;
+        memset(&packet[offset + 1], 'a', 63);
+        offset += 64;
+    }
+    int label = DNS_MAX_PACKET_SIZE - offset - 1 - 5;
+    packet[offset] = (uint8_t)label;
+    memset(&packet[offset + 1], 'b', label);
+    offset += label + 1;
+    packet[offset++] = 0;
+    packet[offset++] = 0;
+    packet[offset++] = TYPE_A;
+    packet[offset++] = 0;
+    packet[offset++] = 1;
+    CHECK_INT(offset, ==, DNS_MAX_PACKET_SIZE);
+    CHECK_INT(build_dns_reply(packet, offset, answer), ==, 0);
+}
+
+static void test_random_packets(void)
+{
+    srand(1);
+    uint8_t packet[DNS_MAX_PACKET_SIZE];
+    int answered = 0;
+    for (int i = 0; i < RANDOM_PACKETS; i++)
+    {
+        // Header of a query with random content after it
+        int len = rand() % (DNS_MAX_PACKET_SIZE + 1);
+        for (int j = 0; j < len; j++)
+        {
+            packet[j] = (uint8_t)rand();
+        }
+        if (len > 5 && i % 2)
+        {
+            packet[2] &= 0x07;
+            packet[4] = 0;
+            packet[5] = 1;
+        }
+        if (len > HEADER_SIZE && i % 4 == 1)
+        {
+            packet[HEADER_SIZE] &= 0x3F; // A label length, not a pointer
+        }
+
+        int reply = build_dns_reply(packet, len, answer);
+        CHECK(reply == 0 || (reply > HEADER_SIZE && reply <= DNS_MAX_PACKET_SIZE));
+        answered += reply > 0;
+    }
+    printf("  %d of %d random packets answered\n", answered, RANDOM_PACKETS);
+}
+
+// ------------------------------------------
+//   Loopback responder
+// ------------------------------------------
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void test_loopback_queries_per_second(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+    unsigned short port = fake_lwip_bound_port(53);
+    CHECK(port != 0);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    CHECK(sock >= 0);
+    struct sockaddr_in server = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    CHECK(connect(sock, (struct sockaddr *)&server, sizeof(server)) == 0);
+
+    samples_t latency = {0};
+    uint8_t query[DNS_MAX_PACKET_SIZE];
+    uint8_t reply[DNS_MAX_PACKET_SIZE];
+    int64_t start_us = now_us();
+    uint16_t id = 0;
+    while (now_us() - start_us < (int64_t)QPS_RUN_MS * 1000)
+    {
+        int len = make_query(query, ++id, "captive.apple.com", TYPE_A);
+        int64_t sent_us = now_us();
+        CHECK(send(sock, query, len, 0) == len);
+
+        struct pollfd pfd = {.fd = sock, .events = POLLIN};
+        CHECK(poll(&pfd, 1, REPLY_TIMEOUT_MS) == 1);
+        ssize_t got = recv(sock, reply, sizeof(reply), 0);
+        samples_add(&latency, (now_us() - sent_us) / 1000.0);
+
+        CHECK_INT(got, ==, len + DNS_ANSWER_SIZE);
+        CHECK_INT((reply[0] << 8) | reply[1], ==, id);
+        CHECK(memcmp(&reply[got - 4], (const uint8_t[]){192, 168, 4, 1}, 4) == 0);
+    }
+    double seconds = (now_us() - start_us) / 1e6;
+    double qps = latency.count / seconds;
+    printf("  %zu queries, %.0f q/s, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", latency.count, qps,
+           samples_percentile(&latency, 50), samples_percentile(&latency, 99), samples_max(&latency));
+    CHECK(qps > MIN_QPS);
+
+    samples_free(&latency);
+    close(sock);
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_a_query_answered);
+    RUN_TEST(test_other_types_get_empty_answer);
+    RUN_TEST(test_extra_sections_dropped);
+    RUN_TEST(test_invalid_packets_ignored);
+    RUN_TEST(test_reply_fits_packet);
+    RUN_TEST(test_random_packets);
+    RUN_TEST(test_loopback_queries_per_second);
+    return 0;
+}
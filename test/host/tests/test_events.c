@@ -0,0 +1,125 @@
+/**
+ * @file test_events.c
+ * @brief Status changes reach every /events client, and how fast
+ *
+ * Several event stream clients stay open on the portal while the status
+ * changes one update at a time; each update is timed from the status change
+ * to its arrival at each client. A connect through the portal then shows
+ * the status and address of an event come from the same state snapshot.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "harness.h"
+#include "http_client.h"
+#include "lwip/inet.h"
+#include "samples.h"
+#include "wifi_manager_private.h"
+
+#define UPDATES 200
+#define STREAM_TIMEOUT_MS 2000
+#define MAX_P99_MS 50.0 // Loose: a stalled or batched delivery takes seconds
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Read events until a status event arrives
+ * @return false on timeout
+ */
+static bool next_status(http_conn_t *stream, char *data, size_t size)
+{
+    char event[32];
+    while (sse_next_event(stream, event, sizeof(event), data, size))
+    {
+        if (strcmp(event, "status") == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_status_latency_across_clients(void)
+{
+    int ap = harness_add_ap("home", "secret123", -55, 6);
+
+    // Room for every event stream next to the reserved sockets
+    wifi_manager_http_config_t http_config = WIFI_MANAGER_HTTP_CONFIG_DEFAULT();
+    http_config.max_open_sockets = EVENTS_MAX_CLIENTS + HTTP_RESERVED_SOCKETS + 1;
+    wifi_manager_t *wm = wifi_manager_create_with_config(&http_config);
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+
+    http_conn_t streams[EVENTS_MAX_CLIENTS];
+    char data[256];
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+    {
+        CHECK(sse_open(&streams[i], fake_httpd_port(), "/events", STREAM_TIMEOUT_MS));
+        CHECK(next_status(&streams[i], data, sizeof(data))); // Current state on connect
+    }
+
+    // One more stream is refused, the page falls back to polling
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/events", NULL, &response));
+    CHECK_INT(response.status, ==, 503);
+    http_response_free(&response);
+
+    samples_t latency = {0};
+    for (int n = 0; n < UPDATES; n++)
+    {
+        wifi_status_t status = n % 2 ? WIFI_STATUS_AP_MODE : WIFI_STATUS_CONNECTING;
+        char expected[32];
+        snprintf(expected, sizeof(expected), "{\"status\":%d,", status);
+
+        int64_t changed_us = now_us();
+        update_status(wm, status);
+        for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+        {
+            CHECK(next_status(&streams[i], data, sizeof(data)));
+            samples_add(&latency, (now_us() - changed_us) / 1000.0);
+            CHECK(strncmp(data, expected, strlen(expected)) == 0);
+        }
+    }
+    printf("  %d updates to %d clients: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", UPDATES, EVENTS_MAX_CLIENTS,
+           samples_percentile(&latency, 50), samples_percentile(&latency, 99), samples_max(&latency));
+    CHECK(samples_percentile(&latency, 99) < MAX_P99_MS);
+    samples_free(&latency);
+
+    // Connect through the portal: the connected event carries the lease address
+    CHECK(http_fetch(fake_httpd_port(), "POST", "/connect", "ssid=home&password=secret123", &response));
+    CHECK_INT(response.status, ==, 200);
+    http_response_free(&response);
+
+    struct in_addr lease = {.s_addr = fake_wifi_lease_ip(ap)};
+    char connected[64];
+    snprintf(connected, sizeof(connected), "{\"status\":%d,\"ip\":\"%s\"}", WIFI_STATUS_CONNECTED, inet_ntoa(lease));
+    for (int i = 0; i < EVENTS_MAX_CLIENTS; i++)
+    {
+        bool seen = false;
+        while (!seen && next_status(&streams[i], data, sizeof(data)))
+        {
+            // Every event on the way is consistent: connected always comes with its address
+            char partial[32];
+            snprintf(partial, sizeof(partial), "{\"status\":%d,", WIFI_STATUS_CONNECTED);
+            CHECK(strncmp(data, partial, strlen(partial)) != 0 || strcmp(data, connected) == 0);
+            seen = strcmp(data, connected) == 0;
+        }
+        CHECK(seen);
+        http_close(&streams[i]);
+    }
+
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_status_latency_across_clients);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file test_http_load.c
+ * @brief Throughput and tail latency of the portal server under keep-alive clients
+ *
+ * Several clients each keep one connection open and send requests back to
+ * back while a restart is requested during the run. The restart replies at
+ * once and runs from a timer, so no client waits for it: the slowest request
+ * must stay well below the restart delay. Reports requests per second and
+ * the latency percentiles. /stats then reports the requests, and its
+ * response stays valid JSON.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "cJSON.h"
+#include "fake_system.h"
+#include "harness.h"
+#include "http_client.h"
+#include "samples.h"
+#include "wifi_manager_private.h"
+
+#define CLIENTS 8
+#define RUN_MS 2000
+#define REQUEST_TIMEOUT_MS 2000
+#define MAX_P99_MS 50.0 // Loose: the host answers in well under a millisecond
+#define STATS_REQUESTS 20
+
+typedef struct
+{
+    uint16_t port;
+    int64_t deadline_us;
+    samples_t ms;
+    unsigned failed;
+} client_t;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *client_main(void *arg)
+{
+    client_t *client = arg;
+    http_conn_t conn;
+    if (!http_connect(&conn, client->port, REQUEST_TIMEOUT_MS))
+    {
+        client->failed++;
+        return NULL;
+    }
+
+    while (now_us() < client->deadline_us)
+    {
+        http_response_t response;
+        int64_t start_us = now_us();
+        bool ok = http_request(&conn, "GET", "/status", NULL, NULL, 0, &response);
+        if (!ok || response.status != 200 || response.closed)
+        {
+            client->failed++;
+            if (ok)
+            {
+                http_response_free(&response);
+            }
+            break; // Keep-alive is the point: a closed connection is a failure
+        }
+        samples_add(&client->ms, (now_us() - start_us) / 1000.0);
+        http_response_free(&response);
+    }
+    http_close(&conn);
+    return NULL;
+}
+
+static void test_keep_alive_clients(void)
+{
+    // A socket per client and one for the restart request
+    wifi_manager_http_config_t http_config = WIFI_MANAGER_HTTP_CONFIG_DEFAULT();
+    http_config.max_open_sockets = CLIENTS + 1;
+    wifi_manager_t *wm = wifi_manager_create_with_config(&http_config);
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+    unsigned restarts = fake_system_restart_count();
+
+    client_t clients[CLIENTS];
+    pthread_t threads[CLIENTS];
+    int64_t start_us = now_us();
+    for (int i = 0; i < CLIENTS; i++)
+    {
+        clients[i] = (client_t){.port = fake_httpd_port(), .deadline_us = start_us + (int64_t)RUN_MS * 1000};
+        CHECK(pthread_create(&threads[i], NULL, client_main, &clients[i]) == 0);
+    }
+
+    // A restart request early on, so its timer also fires within the run
+    fake_rtos_run_for_ms(RUN_MS / 4);
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "POST", "/restart", NULL, &response));
+    CHECK_INT(response.status, ==, 200);
+    http_response_free(&response);
+
+    samples_t all = {0};
+    unsigned failed = 0;
+    for (int i = 0; i < CLIENTS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        for (size_t j = 0; j < clients[i].ms.count; j++)
+        {
+            samples_add(&all, clients[i].ms.values[j]);
+        }
+        failed += clients[i].failed;
+        samples_free(&clients[i].ms);
+    }
+    double seconds = (now_us() - start_us) / 1e6;
+    printf("  %d clients: %zu requests, %.0f req/s, p50 %.3f ms, p99 %.3f ms, max %.3f ms, %u failed\n", CLIENTS,
+           all.count, all.count / seconds, samples_percentile(&all, 50), samples_percentile(&all, 99),
+           samples_max(&all), failed);
+
+    CHECK_INT(failed, ==, 0);
+    CHECK_INT(all.count, >, 0);
+    CHECK(samples_percentile(&all, 99) < MAX_P99_MS);
+    CHECK(samples_max(&all) < WIFI_MANAGER_RESTART_DELAY_MS / 2);
+    CHECK_INT(fake_system_restart_count(), ==, restarts + 1);
+    samples_free(&all);
+
+    wifi_manager_destroy(wm);
+}
+
+static void test_stats_counts_requests(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+
+    http_conn_t conn;
+    CHECK(http_connect(&conn, fake_httpd_port(), REQUEST_TIMEOUT_MS));
+    http_response_t response;
+    for (int i = 0; i < STATS_REQUESTS; i++)
+    {
+        CHECK(http_request(&conn, "GET", "/status", NULL, NULL, 0, &response));
+        CHECK_INT(response.status, ==, 200);
+        http_response_free(&response);
+    }
+    CHECK(http_request(&conn, "GET", "/stats", NULL, NULL, 0, &response));
+    CHECK_INT(response.status, ==, 200);
+    http_close(&conn);
+
+    cJSON *root = cJSON_Parse(response.body);
+    CHECK(root);
+    CHECK_INT(cJSON_GetObjectItem(root, "status")->valueint, ==, WIFI_STATUS_AP_MODE);
+    CHECK(cJSON_IsObject(cJSON_GetObjectItem(root, "mem")));
+    cJSON *http = cJSON_GetObjectItem(root, "http");
+    CHECK(cJSON_IsObject(http));
+    CHECK_INT(cJSON_GetObjectItem(http, "requests")->valueint, >=, STATS_REQUESTS + 1);
+    CHECK_INT(cJSON_GetObjectItem(http, "connections")->valueint, >=, 1);
+    cJSON_Delete(root);
+    http_response_free(&response);
+
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_keep_alive_clients);
+    RUN_TEST(test_stats_counts_requests);
+    return 0;
+}
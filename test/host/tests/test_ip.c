@@ -0,0 +1,164 @@
+/**
+ * @file test_ip.c
+ * @brief Time to IP with DHCP, a static address and a cached lease
+ *
+ * Runs on the virtual clock with the default radio timings, so DHCP takes
+ * its full 1.5 s exchange. Each mode connects twice and the second connection
+ * is measured: the first one stores the lease and the last good BSSID, so all
+ * modes then reach the AP the same way and differ only in how the address is
+ * obtained.
+ */
+
+#include <string.h>
+#include "harness.h"
+
+#define CONNECT_TIMEOUT_MS 30000
+#define PROBE_SETTLE_MS 2000 // Well past the ARP probe wait
+#define RENEW_MS (30 * 60 * 1000)
+
+typedef struct
+{
+    int64_t to_ip_ms;
+    unsigned dhcp_starts;
+    uint32_t ip;
+} connect_result_t;
+
+static unsigned dhcp_starts(void)
+{
+    fake_wifi_stats_t stats;
+    fake_wifi_get_stats(&stats);
+    return stats.dhcp_starts;
+}
+
+static wifi_manager_t *create_in_mode(const char *mode)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_set_parameter(wm, "ip_mode", mode) == ESP_OK);
+    if (strcmp(mode, "static") == 0)
+    {
+        CHECK(wifi_manager_set_parameter(wm, "static_ip", "10.0.0.50") == ESP_OK);
+        CHECK(wifi_manager_set_parameter(wm, "static_gateway", "10.0.0.1") == ESP_OK);
+        CHECK(wifi_manager_set_parameter(wm, "static_netmask", "255.255.255.0") == ESP_OK);
+    }
+    return wm;
+}
+
+// Connect and keep the instance
+static wifi_manager_t *connect_in_mode(const char *mode, connect_result_t *result)
+{
+    wifi_manager_t *wm = create_in_mode(mode);
+    unsigned starts = dhcp_starts();
+    int64_t start_us = fake_rtos_now_us();
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, CONNECT_TIMEOUT_MS));
+    result->to_ip_ms = (fake_rtos_now_us() - start_us) / 1000;
+    result->ip = fake_netif_sta_ip();
+
+    // Whatever runs after GOT_IP (the ARP probe of a cached lease) has ended
+    fake_rtos_run_for_ms(PROBE_SETTLE_MS);
+    result->dhcp_starts = dhcp_starts() - starts;
+    return wm;
+}
+
+static connect_result_t measure_mode(const char *mode)
+{
+    connect_result_t result;
+    wifi_manager_destroy(connect_in_mode(mode, &result));
+    wifi_manager_destroy(connect_in_mode(mode, &result));
+    return result;
+}
+
+static void test_time_to_ip_by_mode(void)
+{
+    harness_add_ap("home", "secret123", -55, 6);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "home", "secret123", 1) == ESP_OK);
+    wifi_manager_destroy(wm);
+
+    fake_wifi_timing_t timing;
+    fake_wifi_get_timing(&timing);
+    const char *modes[] = {"dhcp", "static", "cached"};
+    connect_result_t results[3];
+    printf("  %-8s %10s %12s   (DHCP exchange %lu ms)\n", "mode", "to IP ms", "DHCP starts",
+           (unsigned long)timing.dhcp_ms);
+    for (int i = 0; i < 3; i++)
+    {
+        results[i] = measure_mode(modes[i]);
+        printf("  %-8s %10lld %12u\n", modes[i], (long long)results[i].to_ip_ms, results[i].dhcp_starts);
+    }
+
+    connect_result_t *dhcp = &results[0], *fixed = &results[1], *cached = &results[2];
+    CHECK_INT(dhcp->dhcp_starts, ==, 1);
+    CHECK_INT(fixed->dhcp_starts, ==, 0);
+    CHECK_INT(cached->dhcp_starts, ==, 0);
+    // The cached lease skips the exchange and nothing else
+    CHECK_INT(dhcp->to_ip_ms - cached->to_ip_ms, >=, (int64_t)timing.dhcp_ms);
+    CHECK_INT(cached->to_ip_ms, ==, fixed->to_ip_ms);
+    CHECK_INT(cached->ip, ==, dhcp->ip);
+}
+
+static void test_cached_lease_in_use_gets_new_lease(void)
+{
+    int ap = harness_add_ap("home", "secret123", -55, 6);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "home", "secret123", 1) == ESP_OK);
+    wifi_manager_destroy(wm);
+
+    connect_result_t result;
+    wifi_manager_destroy(connect_in_mode("cached", &result));
+    uint32_t cached_ip = result.ip;
+    CHECK_INT(cached_ip, ==, fake_wifi_lease_ip(ap));
+
+    // Another host took the address while the device was off
+    fake_netif_set_ip_in_use(cached_ip);
+    wm = connect_in_mode("cached", &result);
+    CHECK_INT(result.ip, ==, cached_ip); // Usable at once, the probe answer comes later
+    CHECK_INT(result.dhcp_starts, ==, 1);
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, CONNECT_TIMEOUT_MS));
+    uint32_t new_ip = fake_netif_sta_ip();
+    CHECK(new_ip != 0 && new_ip != cached_ip);
+    wifi_manager_destroy(wm);
+
+    // The new lease is the one cached from now on
+    wifi_manager_destroy(connect_in_mode("cached", &result));
+    CHECK_INT(result.ip, ==, new_ip);
+    CHECK_INT(result.dhcp_starts, ==, 0);
+}
+
+static void test_cached_lease_renewed_by_dhcp(void)
+{
+    harness_add_ap("home", "secret123", -55, 6);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "home", "secret123", 1) == ESP_OK);
+    wifi_manager_destroy(wm);
+
+    connect_result_t result;
+    wifi_manager_destroy(connect_in_mode("cached", &result));
+    wm = connect_in_mode("cached", &result);
+    CHECK_INT(result.dhcp_starts, ==, 0);
+
+    // The fixed address is kept until the renewal period is over
+    unsigned starts = dhcp_starts();
+    fake_rtos_run_for_ms(RENEW_MS - PROBE_SETTLE_MS - 1000);
+    CHECK_INT(dhcp_starts(), ==, starts);
+    CHECK_INT(fake_netif_sta_ip(), ==, result.ip);
+
+    fake_rtos_run_for_ms(2000);
+    CHECK_INT(dhcp_starts(), ==, starts + 1);
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, CONNECT_TIMEOUT_MS));
+    CHECK_INT(fake_netif_sta_ip(), ==, result.ip);
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_VIRTUAL);
+    RUN_TEST(test_time_to_ip_by_mode);
+    RUN_TEST(test_cached_lease_in_use_gets_new_lease);
+    RUN_TEST(test_cached_lease_renewed_by_dhcp);
+    return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file test_lifecycle.c
+ * @brief create/destroy leave nothing behind, also when create fails halfway
+ *
+ * Runs on the virtual clock so each cycle can connect for real in a few
+ * milliseconds. Every failure point of wifi_manager_create() is hit in turn
+ * by failing the n-th task, timer or semaphore creation, then the n-th
+ * allocation; each failed create must return NULL with the heap and the
+ * FreeRTOS object counts back where they were, and leave the shared driver
+ * usable for the next instance. Destroying the instance at any point of a
+ * scan joins the scan task, which frees the result buffer it holds.
+ */
+
+#include <string.h>
+#include "harness.h"
+
+#define CYCLES 1000
+#define MAX_FAILURE_POINTS 2000  // Far above what create does, stops a runaway sweep
+#define CONNECT_TIMEOUT_MS 10000
+#define SETTLE_MS 100
+#define SETTLE_ROUNDS 50 // Bounds the wait for a heap that keeps changing
+#define PORTAL_SCAN_START_MS 2000 // The portal scans once AP mode has settled
+#define SCAN_MS (13 * 300)        // 300 ms dwell on each channel
+#define SCAN_STEP_MS 150
+
+static void check_no_objects(void)
+{
+    harness_wait_tasks_exited();
+    fake_rtos_counts_t counts;
+    fake_rtos_get_counts(&counts);
+    CHECK_INT(counts.tasks, ==, 0);
+    CHECK_INT(counts.timers, ==, 0);
+    CHECK_INT(counts.semaphores, ==, 0);
+}
+
+/**
+ * @brief Heap in use once the fakes have caught up
+ *
+ * destroy joins every task of the instance, but deleted timers are freed by
+ * the timer task and driver events queued at stop are freed once delivered;
+ * both happen after destroy returns. The heap counts once it reads the same
+ * across a settle period.
+ */
+static size_t heap_settled(void)
+{
+    size_t used = fake_heap_used();
+    for (int i = 0; i < SETTLE_ROUNDS; i++)
+    {
+        fake_rtos_run_for_ms(SETTLE_MS);
+        size_t now = fake_heap_used();
+        if (now == used)
+        {
+            break;
+        }
+        used = now;
+    }
+    return used;
+}
+
+// Create, connect, destroy
+static void connect_cycle(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "home", "secret123", 1) == ESP_OK);
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, CONNECT_TIMEOUT_MS));
+    wifi_manager_destroy(wm);
+}
+
+static void test_create_destroy_cycles_keep_heap_flat(void)
+{
+    harness_add_ap("home", "secret123", -55, 6);
+
+    // The first cycle sets up what stays for the process (NVS pages, log tags)
+    connect_cycle();
+    size_t heap_before = heap_settled();
+
+    for (int i = 0; i < CYCLES; i++)
+    {
+        connect_cycle();
+        check_no_objects();
+    }
+
+    size_t heap_after = heap_settled();
+    printf("  %d cycles, heap %zu -> %zu bytes\n", CYCLES, heap_before, heap_after);
+    CHECK_INT(heap_after, ==, heap_before);
+}
+
+static void test_destroy_during_scan_keeps_heap_flat(void)
+{
+    harness_add_ap("home", "secret123", -55, 6);
+    connect_cycle();
+    size_t heap_before = heap_settled();
+    fake_wifi_stats_t stats;
+    fake_wifi_get_stats(&stats);
+    unsigned scans_before = stats.scans;
+
+    // From the portal's scan start to just after its results, when the task copies them
+    int cycles = 0;
+    for (int delay_ms = PORTAL_SCAN_START_MS; delay_ms <= PORTAL_SCAN_START_MS + SCAN_MS + SCAN_STEP_MS;
+         delay_ms += SCAN_STEP_MS, cycles++)
+    {
+        wifi_manager_t *wm = wifi_manager_create();
+        CHECK(wm);
+        wifi_manager_set_config_portal_blocking(wm, false);
+        CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+        fake_rtos_run_for_ms(delay_ms);
+        wifi_manager_destroy(wm);
+        check_no_objects();
+    }
+    fake_wifi_get_stats(&stats);
+    CHECK_INT(stats.scans - scans_before, >=, cycles - 1);
+
+    size_t heap_after = heap_settled();
+    printf("  %d destroys mid-scan, heap %zu -> %zu bytes\n", cycles, heap_before, heap_after);
+    CHECK_INT(heap_after, ==, heap_before);
+}
+
+typedef bool (*inject_t)(int countdown);
+
+static bool fail_rtos_create(int countdown)
+{
+    fake_rtos_fail_create_after(countdown);
+    return true;
+}
+
+/**
+ * @brief Fail the n-th operation of create for n = 0, 1, ... until create succeeds
+ * @return Number of failure points
+ */
+static int sweep_create_failures(inject_t inject)
+{
+    connect_cycle();
+    size_t heap_before = heap_settled();
+
+    int point = 0;
+    for (; point < MAX_FAILURE_POINTS; point++)
+    {
+        CHECK(inject(point));
+        wifi_manager_t *wm = wifi_manager_create();
+        inject(-1);
+        if (wm)
+        {
+            wifi_manager_destroy(wm);
+            break;
+        }
+        check_no_objects();
+        CHECK_INT(heap_settled(), ==, heap_before);
+    }
+    CHECK_INT(point, <, MAX_FAILURE_POINTS);
+
+    // The driver reference count survived every unwind
+    connect_cycle();
+    check_no_objects();
+    CHECK_INT(heap_settled(), ==, heap_before);
+    return point;
+}
+
+static void test_failed_rtos_creation_unwinds(void)
+{
+    harness_add_ap("home", "secret123", -55, 6);
+    int points = sweep_create_failures(fail_rtos_create);
+    printf("  %d task/timer/semaphore creations failed in turn\n", points);
+    CHECK_INT(points, >, 0);
+}
+
+static void test_failed_allocation_unwinds(void)
+{
+    if (!fake_heap_fail_after(-1))
+    {
+        printf("  skipped: allocations cannot be failed under AddressSanitizer\n");
+        return;
+    }
+    harness_add_ap("home", "secret123", -55, 6);
+    int points = sweep_create_failures(fake_heap_fail_after);
+    printf("  %d allocations failed in turn\n", points);
+    CHECK_INT(points, >, 0);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_VIRTUAL);
+    RUN_TEST(test_create_destroy_cycles_keep_heap_flat);
+    RUN_TEST(test_destroy_during_scan_keeps_heap_flat);
+    RUN_TEST(test_failed_rtos_creation_unwinds);
+    RUN_TEST(test_failed_allocation_unwinds);
+    return 0;
+}
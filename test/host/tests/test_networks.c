@@ -0,0 +1,222 @@
+/**
+ * @file test_networks.c
+ * @brief Ranking of saved networks, their connection history and failover
+ *
+ * select_network_candidates() and record_connection_result() are called
+ * directly with a hand-made store and scan; the failover cases go through
+ * wifi_manager_auto_connect() against the simulated APs.
+ */
+
+#include <string.h>
+#include "cJSON.h"
+#include "harness.h"
+#include "http_client.h"
+#include "wifi_manager_private.h"
+
+static void add_scanned(wifi_manager_t *wm, const char *ssid, int8_t rssi, uint8_t last_bssid_byte, uint8_t channel)
+{
+    scanned_network_t *ap = &wm->scanned_networks[wm->scanned_count++];
+    memset(ap, 0, sizeof(*ap));
+    snprintf(ap->ssid, sizeof(ap->ssid), "%s", ssid);
+    ap->rssi = rssi;
+    ap->authmode = WIFI_AUTH_WPA2_PSK;
+    ap->bssid[5] = last_bssid_byte;
+    ap->channel = channel;
+}
+
+static stored_network_t *add_stored(network_store_t *store, const char *ssid, uint8_t priority)
+{
+    stored_network_t *entry = &store->entries[store->count++];
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->ssid, sizeof(entry->ssid), "%s", ssid);
+    entry->priority = priority;
+    return entry;
+}
+
+static const char *candidate_ssid(const network_store_t *store, const network_candidate_t *candidate)
+{
+    return store->entries[candidate->store_index].ssid;
+}
+
+static void test_candidates_ranked(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    network_store_t store = {0};
+    add_stored(&store, "hidden", 9)->channel = 13; // Highest priority, but not in the scan
+    add_stored(&store, "low", 1);
+    add_stored(&store, "flaky", 5)->failure_count = 2;
+    add_stored(&store, "steady", 5);
+    add_stored(&store, "weak", 5);
+
+    add_scanned(wm, "low", -40, 0x01, 1);
+    add_scanned(wm, "flaky", -45, 0x02, 6);
+    add_scanned(wm, "steady", -80, 0x03, 6);
+    add_scanned(wm, "steady", -60, 0x04, 11); // Stronger AP of the same network
+    add_scanned(wm, "weak", -75, 0x05, 1);
+    add_scanned(wm, "stranger", -30, 0x06, 1);
+    wm->scan_completed = true;
+
+    network_candidate_t candidates[WIFI_MANAGER_MAX_NETWORKS];
+    CHECK_INT(select_network_candidates(wm, &store, candidates), ==, 5);
+
+    // Visible first, then priority, then fewer failures, then signal
+    const char *expected[] = {"steady", "weak", "flaky", "low", "hidden"};
+    for (int i = 0; i < 5; i++)
+    {
+        CHECK(strcmp(candidate_ssid(&store, &candidates[i]), expected[i]) == 0);
+    }
+    CHECK(candidates[0].visible);
+    CHECK_INT(candidates[0].rssi, ==, -60);
+    CHECK_INT(candidates[0].bssid[5], ==, 0x04);
+    CHECK_INT(candidates[0].channel, ==, 11);
+
+    // A network that was not seen is still tried on its last channel
+    CHECK(!candidates[4].visible);
+    CHECK_INT(candidates[4].channel, ==, 13);
+
+    // Equal on everything else: the more recent success goes first
+    memset(&store, 0, sizeof(store));
+    add_stored(&store, "old", 1)->last_success = 1000;
+    add_stored(&store, "recent", 1)->last_success = 2000;
+    wm->scanned_count = 0;
+    CHECK_INT(select_network_candidates(wm, &store, candidates), ==, 2);
+    CHECK(strcmp(candidate_ssid(&store, &candidates[0]), "recent") == 0);
+
+    wm->scanned_count = 0;
+    wifi_manager_destroy(wm);
+}
+
+static bool find_network(wifi_manager_t *wm, const char *ssid, wifi_manager_network_info_t *out)
+{
+    wifi_manager_network_info_t networks[WIFI_MANAGER_MAX_NETWORKS];
+    size_t count = 0;
+    CHECK(wifi_manager_list_networks(wm, networks, WIFI_MANAGER_MAX_NETWORKS, &count) == ESP_OK);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(networks[i].ssid, ssid) == 0)
+        {
+            *out = networks[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_connection_results_recorded(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "home", "secret123", 1) == ESP_OK);
+
+    record_connection_result("home", false, NULL, 0);
+    record_connection_result("home", false, NULL, 0);
+    record_connection_result("unknown", true, NULL, 0); // Not stored, ignored
+    wifi_manager_network_info_t info;
+    CHECK(find_network(wm, "home", &info));
+    CHECK_INT(info.failure_count, ==, 2);
+    CHECK_INT(info.success_count, ==, 0);
+
+    // Success clears the failures and remembers the AP
+    const uint8_t bssid[6] = {0x02, 0, 0, 0, 0, 0x42};
+    record_connection_result("home", true, bssid, 11);
+    CHECK(find_network(wm, "home", &info));
+    CHECK_INT(info.failure_count, ==, 0);
+    CHECK_INT(info.success_count, ==, 1);
+    CHECK_INT(info.channel, ==, 11);
+    CHECK(info.last_success != 0);
+    network_store_t store;
+    CHECK(load_network_store(&store) == ESP_OK);
+    CHECK(memcmp(store.entries[0].bssid, bssid, 6) == 0);
+
+    // A failure keeps the AP of the last success
+    record_connection_result("home", false, NULL, 0);
+    CHECK(load_network_store(&store) == ESP_OK);
+    CHECK(memcmp(store.entries[0].bssid, bssid, 6) == 0);
+    CHECK_INT(store.entries[0].failure_count, ==, 1);
+
+    wifi_manager_destroy(wm);
+}
+
+static unsigned connects(void)
+{
+    fake_wifi_stats_t stats;
+    fake_wifi_get_stats(&stats);
+    return stats.connects;
+}
+
+static void test_failover_and_history(void)
+{
+    int office = harness_add_ap("office", "secret123", -50, 1);
+    int cafe = harness_add_ap("cafe", "coffee123", -70, 6);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "office", "secret123", 1) == ESP_OK);
+    CHECK(wifi_manager_add_network(wm, "cafe", "coffee123", 1) == ESP_OK);
+
+    // The stronger network refuses every retry; the next candidate gets the station
+    fake_wifi_fail_connects(WIFI_MANAGER_MAX_RETRY, WIFI_REASON_AUTH_FAIL);
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK_INT(fake_wifi_connected_ap(), ==, cafe);
+    wifi_manager_network_info_t info;
+    CHECK(find_network(wm, "office", &info));
+    CHECK_INT(info.failure_count, ==, 1);
+    CHECK(find_network(wm, "cafe", &info));
+    CHECK_INT(info.success_count, ==, 1);
+    wifi_manager_destroy(wm);
+
+    // Next boot: same priority, so the network that failed is tried last
+    wm = wifi_manager_create();
+    CHECK(wm);
+    unsigned before = connects();
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK_INT(fake_wifi_connected_ap(), ==, cafe);
+    CHECK_INT(connects() - before, ==, 1);
+    wifi_manager_destroy(wm);
+
+    // A higher priority still wins over the failure count
+    wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "office", "secret123", 2) == ESP_OK);
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK_INT(fake_wifi_connected_ap(), ==, office);
+    CHECK(find_network(wm, "office", &info));
+    CHECK_INT(info.failure_count, ==, 0);
+    wifi_manager_destroy(wm);
+}
+
+static void test_networks_endpoint_escapes_ssid(void)
+{
+    const char *ssid = "a\"b<c\\d";
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, ssid, "secret123", 1) == ESP_OK);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/networks", NULL, &response));
+    CHECK_INT(response.status, ==, 200);
+    CHECK(strstr(response.body, "<") == NULL);
+    cJSON *root = cJSON_Parse(response.body);
+    CHECK(root);
+    cJSON *networks = cJSON_GetObjectItem(root, "networks");
+    CHECK_INT(cJSON_GetArraySize(networks), ==, 1);
+    cJSON *name = cJSON_GetObjectItem(cJSON_GetArrayItem(networks, 0), "ssid");
+    CHECK(name && strcmp(name->valuestring, ssid) == 0);
+    cJSON_Delete(root);
+    http_response_free(&response);
+
+    CHECK(wifi_manager_stop_config_portal(wm) == ESP_OK);
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_candidates_ranked);
+    RUN_TEST(test_connection_results_recorded);
+    RUN_TEST(test_failover_and_history);
+    RUN_TEST(test_networks_endpoint_escapes_ssid);
+    return 0;
+}
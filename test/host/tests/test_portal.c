@@ -0,0 +1,237 @@
+/**
+ * @file test_portal.c
+ * @brief A non-blocking portal runs beside the caller and ends cleanly
+ *
+ * The portal task owns the portal teardown. The caller keeps its own loop
+ * going while a browser connects through the portal, and destroying the
+ * instance mid-portal waits for the task to finish the teardown, done
+ * callback included, instead of killing it. The done callback runs in the
+ * portal task and may destroy the instance or start the next portal there.
+ * /status reports the attempt as valid JSON whatever the SSID contains.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "harness.h"
+#include "http_client.h"
+#include "lwip/inet.h"
+
+#define PORTAL_TIMEOUT_MS 10000
+#define LOOP_STEP_MS 10
+#define SLOW_CALLBACK_MS 200
+#define PORTAL_TIMEOUT_S 1
+
+typedef enum
+{
+    DONE_RETURN,
+    DONE_DESTROY, // Destroy the instance from the callback
+    DONE_RESTART, // Start the next portal from the first callback
+} done_action_t;
+
+typedef struct
+{
+    int calls;
+    bool connected;
+    bool returned; // The callback ran to its end
+    uint32_t delay_ms;
+    done_action_t action;
+} portal_done_t;
+
+static portal_done_t done;
+
+static void on_portal_done(wifi_manager_t *wm, bool connected)
+{
+    done.calls++;
+    done.connected = connected;
+    if (done.delay_ms)
+    {
+        vTaskDelay(pdMS_TO_TICKS(done.delay_ms));
+    }
+    if (done.action == DONE_DESTROY)
+    {
+        wifi_manager_destroy(wm);
+    }
+    else if (done.action == DONE_RESTART && done.calls == 1)
+    {
+        wifi_manager_set_config_portal_timeout(wm, 0);
+        CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+    }
+    done.returned = true;
+}
+
+static void check_no_leftovers(void)
+{
+    harness_wait_tasks_exited();
+    fake_rtos_counts_t counts;
+    fake_rtos_get_counts(&counts);
+    CHECK_INT(counts.tasks, ==, 0);
+    CHECK_INT(counts.timers, ==, 0);
+    CHECK_INT(counts.semaphores, ==, 0);
+    CHECK_INT(fake_httpd_port(), ==, 0);
+}
+
+static wifi_manager_t *start_portal(void)
+{
+    memset(&done, 0, sizeof(done));
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    wifi_manager_set_portal_done_callback(wm, on_portal_done);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+    CHECK_INT(wifi_manager_get_status(wm), ==, WIFI_STATUS_AP_MODE);
+    return wm;
+}
+
+static void test_caller_continues_during_portal(void)
+{
+    harness_add_ap("home", "secret123", -55, 6);
+    wifi_manager_t *wm = start_portal();
+
+    // The application loop keeps running while the portal is up
+    int iterations = 0;
+    bool submitted = false;
+    for (; done.calls == 0 && iterations * LOOP_STEP_MS < PORTAL_TIMEOUT_MS; iterations++)
+    {
+        wifi_manager_process(wm);
+        if (!submitted && iterations == 10)
+        {
+            http_response_t response;
+            CHECK(http_fetch(fake_httpd_port(), "POST", "/connect", "ssid=home&password=secret123", &response));
+            CHECK_INT(response.status, ==, 200);
+            http_response_free(&response);
+            submitted = true;
+        }
+        fake_rtos_run_for_ms(LOOP_STEP_MS);
+    }
+    printf("  portal ended after %d caller iterations\n", iterations);
+    CHECK(submitted);
+    CHECK_INT(done.calls, ==, 1);
+    CHECK(done.connected);
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, PORTAL_TIMEOUT_MS));
+
+    wifi_manager_destroy(wm);
+    CHECK_INT(done.calls, ==, 1);
+    check_no_leftovers();
+}
+
+static void test_destroy_waits_for_portal_task(void)
+{
+    wifi_manager_t *wm = start_portal();
+    done.delay_ms = SLOW_CALLBACK_MS;
+    fake_rtos_run_for_ms(100);
+
+    // The task finishes the portal, slow callback included, before destroy returns
+    wifi_manager_destroy(wm);
+    CHECK_INT(done.calls, ==, 1);
+    CHECK(!done.connected);
+    CHECK(done.returned);
+    check_no_leftovers();
+}
+
+static bool callback_returned(void *arg)
+{
+    return done.returned;
+}
+
+static void test_done_callback_destroys_instance(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    memset(&done, 0, sizeof(done));
+    done.action = DONE_DESTROY;
+    wifi_manager_set_config_portal_blocking(wm, false);
+    wifi_manager_set_config_portal_timeout(wm, PORTAL_TIMEOUT_S);
+    wifi_manager_set_portal_done_callback(wm, on_portal_done);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+
+    // The timeout ends the portal in its task, which must not wait for itself
+    CHECK(harness_wait(callback_returned, NULL, PORTAL_TIMEOUT_MS));
+    CHECK_INT(done.calls, ==, 1);
+    CHECK(!done.connected);
+    check_no_leftovers();
+}
+
+static void test_done_callback_starts_next_portal(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    memset(&done, 0, sizeof(done));
+    done.action = DONE_RESTART;
+    wifi_manager_set_config_portal_blocking(wm, false);
+    wifi_manager_set_config_portal_timeout(wm, PORTAL_TIMEOUT_S);
+    wifi_manager_set_portal_done_callback(wm, on_portal_done);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+
+    // The second portal is up and served by the same task
+    CHECK(harness_wait(callback_returned, NULL, PORTAL_TIMEOUT_MS));
+    CHECK_INT(wifi_manager_get_status(wm), ==, WIFI_STATUS_AP_MODE);
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/status", NULL, &response));
+    CHECK_INT(response.status, ==, 200);
+    http_response_free(&response);
+
+    wifi_manager_destroy(wm);
+    CHECK_INT(done.calls, ==, 2);
+    check_no_leftovers();
+}
+
+// application/x-www-form-urlencoded value
+static void form_encode(const char *in, char *out, size_t size)
+{
+    size_t len = 0;
+    for (; *in && len + 4 <= size; in++)
+    {
+        unsigned char c = (unsigned char)*in;
+        len += isalnum(c) ? (size_t)snprintf(out + len, size - len, "%c", c)
+                          : (size_t)snprintf(out + len, size - len, "%%%02X", c);
+    }
+    out[len] = '\0';
+}
+
+static void test_status_escapes_ssid(void)
+{
+    // 32 bytes, all of them legal in an SSID
+    const char *name = "Say \"hi\" \\ <b>caf\xc3\xa9</b> 2.4 GHz!";
+    CHECK_INT(strlen(name), ==, 32);
+    int ap = harness_add_ap(name, "secret123", -55, 6);
+    wifi_manager_t *wm = start_portal();
+
+    char ssid[3 * 32 + 1];
+    form_encode(name, ssid, sizeof(ssid));
+    char form[160];
+    snprintf(form, sizeof(form), "ssid=%s&password=secret123", ssid);
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "POST", "/connect", form, &response));
+    CHECK_INT(response.status, ==, 200);
+    http_response_free(&response);
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, PORTAL_TIMEOUT_MS));
+
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/status", NULL, &response));
+    CHECK_INT(response.status, ==, 200);
+    cJSON *root = cJSON_Parse(response.body);
+    CHECK(root);
+    CHECK(strcmp(cJSON_GetObjectItem(root, "state")->valuestring, "connected") == 0);
+    CHECK(strcmp(cJSON_GetObjectItem(root, "ssid")->valuestring, name) == 0);
+    struct in_addr lease = {.s_addr = fake_wifi_lease_ip(ap)};
+    CHECK(strcmp(cJSON_GetObjectItem(root, "ip")->valuestring, inet_ntoa(lease)) == 0);
+    CHECK(!strstr(response.body, "<b>"));
+    cJSON_Delete(root);
+    http_response_free(&response);
+
+    wifi_manager_destroy(wm);
+    check_no_leftovers();
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_caller_continues_during_portal);
+    RUN_TEST(test_destroy_waits_for_portal_task);
+    RUN_TEST(test_done_callback_destroys_instance);
+    RUN_TEST(test_done_callback_starts_next_portal);
+    RUN_TEST(test_status_escapes_ssid);
+    return 0;
+}
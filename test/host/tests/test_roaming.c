@@ -0,0 +1,195 @@
+/**
+ * @file test_roaming.c
+ * @brief Roaming decisions, and roams along recorded RSSI traces
+ *
+ * A trace gives the RSSI of two APs of one network once per second, as a
+ * station walking between them would see it. The test replays it on the
+ * virtual clock with roaming enabled and checks where the station ends up
+ * and how often it moved.
+ */
+
+#include <string.h>
+#include "harness.h"
+#include "wifi_manager_private.h"
+
+#define THRESHOLD -70
+#define HYSTERESIS 8
+#define SCAN_INTERVAL_MS 1000
+#define HOLD_DOWN_MS 30000
+#define TRACE_STEP_MS 1000
+
+typedef struct
+{
+    int8_t a;
+    int8_t b;
+} rssi_sample_t;
+
+typedef struct
+{
+    unsigned roams;       // Changes of AP while connected
+    size_t roam_step[4];  // Trace step at which the first roams were seen
+    unsigned disconnects; // STA_DISCONNECTED events
+    int final_ap;
+    wifi_manager_link_stats_t link; // At the end of the trace
+    bool bssid_locked;              // STA config pinned to one AP at the end of the trace
+    bool bssid_locked_disabled;     // ... and after roaming was disabled
+} trace_result_t;
+
+static void test_roam_should_switch(void)
+{
+    const struct
+    {
+        int current;
+        int candidate;
+        uint8_t hysteresis;
+        bool expected;
+    } cases[] = {
+        {-75, -67, 8, true},   // Wins by exactly the margin
+        {-75, -68, 8, false},  // One dB short
+        {-75, -40, 8, true},
+        {-60, -75, 8, false},  // Candidate weaker
+        {-75, -75, 0, true},   // No margin: equal is enough
+        {-90, -82, 8, true},
+        {-30, -20, 15, false},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        CHECK(roam_should_switch(cases[i].current, cases[i].candidate, cases[i].hysteresis) == cases[i].expected);
+    }
+}
+
+static unsigned disconnects(void)
+{
+    fake_wifi_stats_t stats;
+    fake_wifi_get_stats(&stats);
+    return stats.disconnects;
+}
+
+static trace_result_t replay(const char *ssid, const rssi_sample_t *trace, size_t count)
+{
+    int ap_a = harness_add_ap(ssid, "secret123", trace[0].a, 1);
+    int ap_b = harness_add_ap(ssid, "secret123", trace[0].b, 11);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, ssid, "secret123", 1) == ESP_OK);
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, 30000));
+
+    wifi_manager_roam_config_t config = {
+        .rssi_threshold = THRESHOLD,
+        .rssi_hysteresis = HYSTERESIS,
+        .scan_interval_ms = SCAN_INTERVAL_MS,
+        .min_roam_interval_ms = HOLD_DOWN_MS,
+    };
+    CHECK(wifi_manager_enable_roaming(wm, &config) == ESP_OK);
+
+    trace_result_t result = {0};
+    unsigned disconnects_before = disconnects();
+    int ap = fake_wifi_connected_ap();
+    for (size_t i = 0; i < count; i++)
+    {
+        fake_wifi_set_rssi(ap_a, trace[i].a);
+        fake_wifi_set_rssi(ap_b, trace[i].b);
+        fake_rtos_run_for_ms(TRACE_STEP_MS);
+        int now = fake_wifi_connected_ap();
+        if (now >= 0 && now != ap)
+        {
+            if (result.roams < 4)
+            {
+                result.roam_step[result.roams] = i;
+            }
+            result.roams++;
+            ap = now;
+        }
+    }
+
+    // Let a roam that is still underway finish
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, 10000));
+    result.final_ap = fake_wifi_connected_ap() == ap_a ? 0 : 1;
+    result.disconnects = disconnects() - disconnects_before;
+    CHECK(wifi_manager_get_link_stats(wm, &result.link) == ESP_OK);
+    wifi_config_t sta_config;
+    CHECK(esp_wifi_get_config(WIFI_IF_STA, &sta_config) == ESP_OK);
+    result.bssid_locked = sta_config.sta.bssid_set;
+    CHECK(wifi_manager_disable_roaming(wm) == ESP_OK);
+    CHECK(esp_wifi_get_config(WIFI_IF_STA, &sta_config) == ESP_OK);
+    result.bssid_locked_disabled = sta_config.sta.bssid_set;
+    wifi_manager_destroy(wm);
+    return result;
+}
+
+// Walk from A to B at 1 dB per second each way; the SSID takes all 32 bytes
+static void test_walk_roams_once(void)
+{
+    rssi_sample_t trace[60];
+    for (int i = 0; i < 60; i++)
+    {
+        trace[i].a = (int8_t)(-50 - i);
+        trace[i].b = (int8_t)(-95 + i);
+    }
+
+    trace_result_t result = replay("office-building-north-wing-floor", trace, 60);
+    printf("  walk: %u roam(s), %u disconnect(s)\n", result.roams, result.disconnects);
+    CHECK_INT(result.roams, ==, 1);
+    CHECK_INT(result.final_ap, ==, 1);
+    CHECK_INT(result.disconnects, ==, 1); // The one the roam asked for
+
+    // The RSSI window restarted with B, none of the samples of A are left
+    size_t samples_since_roam = (60 - result.roam_step[0]) * TRACE_STEP_MS / WIFI_MANAGER_LINK_SAMPLE_INTERVAL_MS + 1;
+    CHECK_INT(result.link.sample_count, <=, samples_since_roam);
+    CHECK_INT(result.link.rssi_min, >=, trace[result.roam_step[0]].b);
+
+    // The roam pinned the STA config to B until roaming was turned off
+    CHECK(result.bssid_locked);
+    CHECK(!result.bssid_locked_disabled);
+}
+
+// Both APs fade in and out around the threshold, never far enough apart
+static void test_close_aps_do_not_ping_pong(void)
+{
+    rssi_sample_t trace[60];
+    for (int i = 0; i < 60; i++)
+    {
+        int swing = (i / 5) % 2 ? -3 : 3;
+        trace[i].a = (int8_t)(-72 + swing);
+        trace[i].b = (int8_t)(-72 - swing);
+    }
+
+    trace_result_t result = replay("office", trace, 60);
+    printf("  close APs: %u roam(s)\n", result.roams);
+    CHECK_INT(result.roams, ==, 0);
+    CHECK_INT(result.final_ap, ==, 0);
+}
+
+// B takes over clearly, then A is clearly better again: the hold-down delays the way back
+static void test_hold_down_after_roam(void)
+{
+    rssi_sample_t trace[60];
+    for (int i = 0; i < 60; i++)
+    {
+        bool b_strong = i >= 5 && i < 25; // Long enough for the sweep to reach channel 11
+        trace[i].a = (int8_t)(b_strong ? -80 : -55);
+        trace[i].b = (int8_t)(b_strong ? -55 : -80);
+    }
+
+    trace_result_t result = replay("office", trace, 60);
+    printf("  swap: %u roam(s)", result.roams);
+    for (unsigned i = 0; i < result.roams && i < 4; i++)
+    {
+        printf(" at %zu s", result.roam_step[i] + 1);
+    }
+    printf("\n");
+    CHECK_INT(result.roams, ==, 2);
+    CHECK_INT(result.final_ap, ==, 0);
+    CHECK_INT((result.roam_step[1] - result.roam_step[0]) * TRACE_STEP_MS, >=, HOLD_DOWN_MS);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_VIRTUAL);
+    RUN_TEST(test_roam_should_switch);
+    RUN_TEST(test_walk_roams_once);
+    RUN_TEST(test_close_aps_do_not_ping_pong);
+    RUN_TEST(test_hold_down_after_roam);
+    return 0;
+}
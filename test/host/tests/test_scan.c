@@ -0,0 +1,166 @@
+/**
+ * @file test_scan.c
+ * @brief RSSI to quality and auth mode mapping, and the quality floor at scan ingest
+ *
+ * rssi_to_quality() is checked against tzapu's getRSSIasQuality() formula
+ * over the whole int8_t range the driver can report. The ingest case scans
+ * the simulated APs and reads the stored records and the /wifi JSON.
+ */
+
+#include <string.h>
+#include "cJSON.h"
+#include "harness.h"
+#include "wifi_manager_private.h"
+
+#define SCAN_TIMEOUT_MS 10000
+
+// getRSSIasQuality() of tzapu's WiFiManager
+static int reference_quality(int rssi)
+{
+    if (rssi <= -100)
+        return 0;
+    if (rssi >= -50)
+        return 100;
+    return 2 * (rssi + 100);
+}
+
+static void test_quality_matches_linear_scale(void)
+{
+    for (int rssi = INT8_MIN; rssi <= INT8_MAX; rssi++)
+    {
+        CHECK_INT(rssi_to_quality(rssi), ==, reference_quality(rssi));
+    }
+
+    // Never rises as the signal gets weaker
+    for (int rssi = INT8_MAX; rssi > INT8_MIN; rssi--)
+    {
+        CHECK_INT(rssi_to_quality(rssi - 1), <=, rssi_to_quality(rssi));
+    }
+}
+
+static void test_authmode_names(void)
+{
+    static const struct
+    {
+        wifi_auth_mode_t authmode;
+        const char *name;
+    } cases[] = {
+        {WIFI_AUTH_OPEN, "Open"},
+        {WIFI_AUTH_WEP, "WEP"},
+        {WIFI_AUTH_WPA_PSK, "WPA"},
+        {WIFI_AUTH_WPA2_PSK, "WPA2"},
+        {WIFI_AUTH_WPA_WPA2_PSK, "WPA/WPA2"},
+        {WIFI_AUTH_WPA2_ENTERPRISE, "WPA2-Enterprise"},
+        {WIFI_AUTH_WPA3_PSK, "WPA3"},
+        {WIFI_AUTH_WPA2_WPA3_PSK, "WPA2/WPA3"},
+        {WIFI_AUTH_WAPI_PSK, "WAPI"},
+        {WIFI_AUTH_OWE, "OWE"},
+        {WIFI_AUTH_MAX, "Unknown"},
+        {(wifi_auth_mode_t)(WIFI_AUTH_MAX + 7), "Unknown"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        CHECK(strcmp(authmode_to_string(cases[i].authmode), cases[i].name) == 0);
+    }
+
+    // Every mode the driver defines has a name
+    for (int authmode = 0; authmode < WIFI_AUTH_MAX; authmode++)
+    {
+        CHECK(strcmp(authmode_to_string((wifi_auth_mode_t)authmode), "Unknown") != 0);
+    }
+}
+
+static bool scan_done(void *arg)
+{
+    return ((wifi_manager_t *)arg)->scan_completed;
+}
+
+static void scan(wifi_manager_t *wm)
+{
+    wm->scan_completed = false;
+    trigger_wifi_scan(wm);
+    CHECK(harness_wait(scan_done, wm, SCAN_TIMEOUT_MS));
+}
+
+static const scanned_network_t *find_scanned(wifi_manager_t *wm, const char *ssid)
+{
+    for (int i = 0; i < wm->scanned_count; i++)
+    {
+        if (strcmp(wm->scanned_networks[i].ssid, ssid) == 0)
+        {
+            return &wm->scanned_networks[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_scan_drops_weak_networks(void)
+{
+    harness_add_ap("near", "secret123", -40, 1);
+    harness_add_ap("cafe", NULL, -75, 6);
+    harness_add_ap("street", "secret123", -90, 11);
+    harness_add_ap("edge", "secret123", -95, 11); // Weakest the driver reports
+
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(esp_wifi_set_mode(WIFI_MODE_STA) == ESP_OK);
+    CHECK(esp_wifi_start() == ESP_OK);
+
+    // The default floor of 8% keeps everything in range
+    scan(wm);
+    CHECK_INT(wm->scanned_count, ==, 4);
+    const scanned_network_t *near = find_scanned(wm, "near");
+    const scanned_network_t *cafe = find_scanned(wm, "cafe");
+    const scanned_network_t *street = find_scanned(wm, "street");
+    const scanned_network_t *edge = find_scanned(wm, "edge");
+    CHECK(near && cafe && street && edge);
+    CHECK_INT(near->quality, ==, 100);
+    CHECK_INT(cafe->quality, ==, 50);
+    CHECK_INT(street->quality, ==, 20);
+    CHECK_INT(edge->quality, ==, 10);
+    CHECK_INT(cafe->authmode, ==, WIFI_AUTH_OPEN);
+    CHECK_INT(street->authmode, ==, WIFI_AUTH_WPA2_PSK);
+
+    // The /wifi JSON carries the stored quality and the auth name
+    char *json = malloc(WIFI_LIST_JSON_SIZE);
+    CHECK(json);
+    format_wifi_list(wm, json, WIFI_LIST_JSON_SIZE);
+    cJSON *root = cJSON_Parse(json);
+    CHECK(root);
+    cJSON *networks = cJSON_GetObjectItem(root, "networks");
+    CHECK_INT(cJSON_GetArraySize(networks), ==, 4);
+    for (int i = 0; i < cJSON_GetArraySize(networks); i++)
+    {
+        cJSON *network = cJSON_GetArrayItem(networks, i);
+        const char *ssid = cJSON_GetObjectItem(network, "ssid")->valuestring;
+        const scanned_network_t *stored = find_scanned(wm, ssid);
+        CHECK(stored);
+        CHECK_INT(cJSON_GetObjectItem(network, "quality")->valueint, ==, stored->quality);
+        CHECK(strcmp(cJSON_GetObjectItem(network, "auth")->valuestring,
+                     stored->authmode == WIFI_AUTH_OPEN ? "Open" : "WPA2") == 0);
+    }
+    cJSON_Delete(root);
+    free(json);
+
+    // A raised floor takes effect at the next scan; equal to the floor is kept
+    wifi_manager_set_minimum_signal_quality(wm, 11);
+    scan(wm);
+    CHECK_INT(wm->scanned_count, ==, 3);
+    CHECK(!find_scanned(wm, "edge"));
+
+    wifi_manager_set_minimum_signal_quality(wm, 50);
+    scan(wm);
+    CHECK_INT(wm->scanned_count, ==, 2);
+    CHECK(find_scanned(wm, "cafe") && !find_scanned(wm, "street"));
+
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_VIRTUAL);
+    RUN_TEST(test_quality_matches_linear_scale);
+    RUN_TEST(test_authmode_names);
+    RUN_TEST(test_scan_drops_weak_networks);
+    return 0;
+}
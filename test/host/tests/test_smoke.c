@@ -0,0 +1,90 @@
+/**
+ * @file test_smoke.c
+ * @brief The component connects, serves its portal and shuts down on the host
+ */
+
+#include <string.h>
+#include "harness.h"
+#include "http_client.h"
+#include "lwip/inet.h"
+
+static void check_no_leftovers(void)
+{
+    harness_wait_tasks_exited();
+    fake_rtos_counts_t counts;
+    fake_rtos_get_counts(&counts);
+    CHECK_INT(counts.tasks, ==, 0);
+    CHECK_INT(counts.timers, ==, 0);
+    CHECK_INT(counts.semaphores, ==, 0);
+    CHECK_INT(fake_httpd_port(), ==, 0);
+}
+
+static void test_auto_connect_saved_network(void)
+{
+    int ap = harness_add_ap("home", "secret123", -55, 6);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "home", "secret123", 1) == ESP_OK);
+
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    CHECK_INT(wifi_manager_get_status(wm), ==, WIFI_STATUS_CONNECTED);
+    CHECK_INT(fake_wifi_connected_ap(), ==, ap);
+
+    wifi_manager_snapshot_t snapshot;
+    CHECK(wifi_manager_get_snapshot(wm, &snapshot) == ESP_OK);
+    CHECK_INT(snapshot.status, ==, WIFI_STATUS_CONNECTED);
+    CHECK_INT(snapshot.ip, ==, fake_wifi_lease_ip(ap));
+    CHECK_INT(snapshot.channel, ==, 6);
+    struct in_addr lease = {.s_addr = snapshot.ip};
+    CHECK(strcmp(wifi_manager_get_ip_address(wm), inet_ntoa(lease)) == 0);
+
+    wifi_manager_destroy(wm);
+    check_no_leftovers();
+}
+
+static void test_portal_serves_setup_page(void)
+{
+    harness_add_ap("neighbour", "whatever1", -70, 1);
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+    CHECK_INT(wifi_manager_get_status(wm), ==, WIFI_STATUS_AP_MODE);
+    CHECK(fake_httpd_port() != 0);
+
+    // The portal scans two seconds after it starts; /wifi lists the result once it is in
+    http_response_t response;
+    bool listed = false;
+    for (int i = 0; i < 200 && !listed; i++)
+    {
+        CHECK(http_fetch(fake_httpd_port(), "GET", "/wifi", NULL, &response));
+        CHECK_INT(response.status, ==, 200);
+        listed = strstr(response.body, "\"neighbour\"") != NULL;
+        http_response_free(&response);
+        fake_rtos_run_for_ms(20);
+    }
+    CHECK(listed);
+
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/", NULL, &response));
+    CHECK_INT(response.status, ==, 200);
+    CHECK(strstr(response.content_type, "text/html"));
+    CHECK(strstr(response.body, "neighbour"));
+    http_response_free(&response);
+
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/generate_204", NULL, &response));
+    CHECK_INT(response.status, ==, 302);
+    CHECK(strcmp(response.location, "http://192.168.4.1/") == 0);
+    http_response_free(&response);
+
+    CHECK(wifi_manager_stop_config_portal(wm) == ESP_OK);
+    wifi_manager_destroy(wm);
+    check_no_leftovers();
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_auto_connect_saved_network);
+    RUN_TEST(test_portal_serves_setup_page);
+    return 0;
+}
@@ -0,0 +1,303 @@
+/**
+ * @file test_state.c
+ * @brief The connection state snapshot is never torn by concurrent updates
+ *
+ * Writers publish states whose fields are all derived from one value, so a
+ * reader that mixes two updates is caught. A control reader copies the state
+ * without the sequence lock; the torn copies it counts show how often the
+ * threads met mid-update (on one CPU that depends on preemption, so it is
+ * reported, not checked). A second case reads wifi_manager_get_snapshot()
+ * while the component itself updates the state from a flapping link.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include "harness.h"
+#include "wifi_manager_private.h"
+
+#define STRESS_MS 1000
+#define WRITERS 2
+#define READERS 3
+#define FLAP_CYCLES 20
+
+typedef struct
+{
+    wifi_manager_t *wm;
+    int id;
+    volatile bool *stop;
+    unsigned long operations;
+    unsigned long torn;
+    unsigned long out_of_order;
+} worker_t;
+
+static uint32_t pattern_key(int writer, uint32_t count)
+{
+    return (uint32_t)writer << 28 | (count & 0x0fffffff);
+}
+
+static void pattern_fill(wifi_manager_state_t *state, uint32_t key)
+{
+    state->status = (wifi_status_t)(key % 4);
+    state->ip = key;
+    state->gateway = ~key;
+    state->netmask = key * 2654435761u;
+    state->rssi = (int8_t)(key >> 3);
+    for (int i = 0; i < 6; i++)
+    {
+        state->bssid[i] = (uint8_t)(key >> (i * 4));
+    }
+    state->channel = (uint8_t)(key % 13 + 1);
+    state->state_since_us = key;
+}
+
+static bool pattern_matches(const wifi_manager_state_t *state)
+{
+    wifi_manager_state_t expected;
+    pattern_fill(&expected, state->ip);
+    return state->status == expected.status && state->gateway == expected.gateway &&
+           state->netmask == expected.netmask && state->rssi == expected.rssi &&
+           memcmp(state->bssid, expected.bssid, sizeof(expected.bssid)) == 0 &&
+           state->channel == expected.channel && state->state_since_us == expected.state_since_us;
+}
+
+static void *writer_main(void *arg)
+{
+    worker_t *writer = arg;
+    wifi_manager_t *wm = writer->wm;
+    wifi_manager_state_t next;
+    for (uint32_t count = 1; !*writer->stop; count++)
+    {
+        pattern_fill(&next, pattern_key(writer->id, count));
+        state_write_begin(wm);
+        wm->state.ip = next.ip;
+        wm->state.gateway = next.gateway;
+        wm->state.status = next.status;
+        wm->state.netmask = next.netmask;
+        wm->state.rssi = next.rssi;
+        memcpy(wm->state.bssid, next.bssid, sizeof(next.bssid));
+        wm->state.channel = next.channel;
+        wm->state.state_since_us = next.state_since_us;
+        state_write_end(wm);
+        writer->operations++;
+    }
+    return NULL;
+}
+
+static void *reader_main(void *arg)
+{
+    worker_t *reader = arg;
+    uint32_t last[WRITERS + 1] = {0};
+    wifi_manager_state_t state;
+    while (!*reader->stop)
+    {
+        state_read(reader->wm, &state);
+        reader->operations++;
+        if (state.ip == 0)
+        {
+            continue; // Nothing published yet
+        }
+        if (!pattern_matches(&state))
+        {
+            reader->torn++;
+            continue;
+        }
+        // Updates of one writer are seen in the order they were made
+        int writer = (int)(state.ip >> 28);
+        uint32_t count = state.ip & 0x0fffffff;
+        if (writer > WRITERS || count < last[writer])
+        {
+            reader->out_of_order++;
+        }
+        last[writer] = count;
+    }
+    return NULL;
+}
+
+// Same workload without the sequence lock
+static void *unlocked_reader_main(void *arg)
+{
+    worker_t *reader = arg;
+    wifi_manager_state_t state;
+    while (!*reader->stop)
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        memcpy(&state, (const void *)&reader->wm->state, sizeof(state));
+        reader->operations++;
+        if (state.ip != 0 && !pattern_matches(&state))
+        {
+            reader->torn++;
+        }
+    }
+    return NULL;
+}
+
+// The public call converts the state; everything but the uptime still follows the pattern
+static void *snapshot_reader_main(void *arg)
+{
+    worker_t *reader = arg;
+    wifi_manager_snapshot_t snapshot;
+    while (!*reader->stop)
+    {
+        CHECK(wifi_manager_get_snapshot(reader->wm, &snapshot) == ESP_OK);
+        reader->operations++;
+        if (snapshot.ip == 0)
+        {
+            continue;
+        }
+        wifi_manager_state_t expected;
+        pattern_fill(&expected, snapshot.ip);
+        if (snapshot.status != expected.status || snapshot.gateway != expected.gateway ||
+            snapshot.netmask != expected.netmask || snapshot.rssi != expected.rssi ||
+            memcmp(snapshot.bssid, expected.bssid, sizeof(expected.bssid)) != 0 ||
+            snapshot.channel != expected.channel)
+        {
+            reader->torn++;
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent_readers_never_see_torn_state(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+
+    volatile bool stop = false;
+    worker_t writers[WRITERS];
+    worker_t readers[READERS + 1];
+    worker_t control = {.wm = wm, .stop = &stop};
+    pthread_t threads[WRITERS + READERS + 2];
+    int thread_count = 0;
+    for (int i = 0; i < WRITERS; i++)
+    {
+        writers[i] = (worker_t){.wm = wm, .id = i + 1, .stop = &stop};
+        CHECK(pthread_create(&threads[thread_count++], NULL, writer_main, &writers[i]) == 0);
+    }
+    for (int i = 0; i <= READERS; i++)
+    {
+        readers[i] = (worker_t){.wm = wm, .id = i, .stop = &stop};
+        CHECK(pthread_create(&threads[thread_count++], NULL, i < READERS ? reader_main : snapshot_reader_main,
+                             &readers[i]) == 0);
+    }
+    CHECK(pthread_create(&threads[thread_count++], NULL, unlocked_reader_main, &control) == 0);
+
+    fake_rtos_run_for_ms(STRESS_MS);
+    stop = true;
+    for (int i = 0; i < thread_count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    unsigned long writes = 0;
+    for (int i = 0; i < WRITERS; i++)
+    {
+        writes += writers[i].operations;
+    }
+    printf("  %lu updates,", writes);
+    for (int i = 0; i <= READERS; i++)
+    {
+        printf(" %lu", readers[i].operations);
+        CHECK_INT(readers[i].torn, ==, 0);
+        CHECK_INT(readers[i].out_of_order, ==, 0);
+        CHECK_INT(readers[i].operations, >, 1000);
+    }
+    printf(" reads, %lu of %lu unlocked copies torn\n", control.torn, control.operations);
+    CHECK_INT(writes, >, 1000);
+
+    // Leave a consistent state behind for destroy
+    state_write_begin(wm);
+    memset(&wm->state, 0, sizeof(wm->state));
+    state_write_end(wm);
+    wifi_manager_destroy(wm);
+}
+
+// ------------------------------------------
+//   Updates made by the component
+// ------------------------------------------
+
+static const uint8_t bssid_a[6] = {0x02, 0x00, 0x00, 0x00, 0x0a, 0x01};
+static const uint8_t bssid_b[6] = {0x02, 0x00, 0x00, 0x00, 0x0b, 0x0b};
+
+static void *link_reader_main(void *arg)
+{
+    worker_t *reader = arg;
+    wifi_manager_snapshot_t snapshot;
+    while (!*reader->stop)
+    {
+        CHECK(wifi_manager_get_snapshot(reader->wm, &snapshot) == ESP_OK);
+        reader->operations++;
+
+        // BSSID and channel are published together
+        bool pair_ok = snapshot.channel == 0 ||
+                       (snapshot.channel == 1 && memcmp(snapshot.bssid, bssid_a, 6) == 0) ||
+                       (snapshot.channel == 11 && memcmp(snapshot.bssid, bssid_b, 6) == 0);
+        // So are the address, gateway and netmask
+        bool ip_ok = snapshot.ip == 0 || (snapshot.netmask != 0 &&
+                                          (snapshot.ip & snapshot.netmask) == (snapshot.gateway & snapshot.netmask));
+        bool status_ok = snapshot.status != WIFI_STATUS_CONNECTED || snapshot.ip != 0;
+        if (!pair_ok || !ip_ok || !status_ok)
+        {
+            reader->torn++;
+        }
+    }
+    return NULL;
+}
+
+static bool new_lease(void *arg)
+{
+    fake_wifi_stats_t stats;
+    fake_wifi_get_stats(&stats);
+    return stats.dhcp_leases > *(unsigned *)arg;
+}
+
+static void test_snapshot_while_link_flaps(void)
+{
+    fake_ap_config_t config = {
+        .ssid = "office", .channel = 1, .authmode = WIFI_AUTH_WPA2_PSK, .password = "secret123", .rssi = -50,
+    };
+    memcpy(config.bssid, bssid_a, 6);
+    int ap_a = fake_wifi_add_ap(&config);
+    config.channel = 11;
+    config.rssi = -60;
+    memcpy(config.bssid, bssid_b, 6);
+    int ap_b = fake_wifi_add_ap(&config);
+
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    CHECK(wifi_manager_add_network(wm, "office", "secret123", 1) == ESP_OK);
+
+    volatile bool stop = false;
+    worker_t reader = {.wm = wm, .stop = &stop};
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, link_reader_main, &reader) == 0);
+
+    CHECK(wifi_manager_auto_connect(wm, "Setup", NULL));
+    for (int i = 0; i < FLAP_CYCLES; i++)
+    {
+        // Swap the stronger AP and drop the link; the reconnect lands on either
+        fake_wifi_set_rssi(ap_a, (int8_t)(i % 2 ? -50 : -65));
+        fake_wifi_set_rssi(ap_b, (int8_t)(i % 2 ? -65 : -50));
+        fake_wifi_stats_t stats;
+        fake_wifi_get_stats(&stats);
+        unsigned leases = stats.dhcp_leases;
+        fake_wifi_drop_link(WIFI_REASON_AUTH_EXPIRE);
+        CHECK(harness_wait(new_lease, &leases, 2000));
+        CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, 2000));
+    }
+
+    stop = true;
+    pthread_join(thread, NULL);
+    printf("  %lu snapshots over %d reconnects\n", reader.operations, FLAP_CYCLES);
+    CHECK_INT(reader.torn, ==, 0);
+    CHECK_INT(reader.operations, >, 0);
+
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_concurrent_readers_never_see_torn_state);
+    RUN_TEST(test_snapshot_while_link_flaps);
+    return 0;
+}
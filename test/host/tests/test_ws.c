@@ -0,0 +1,254 @@
+/**
+ * @file test_ws.c
+ * @brief The /ws control channel takes what the REST routes take
+ *
+ * A config save from the page is the full parameter form, percent-encoded,
+ * and goes well past a few hundred bytes; connect requests carry names and
+ * keys of full length in any bytes. Both are sent over /ws and, for connect,
+ * over POST /connect, which share one form parser. The parameter list the
+ * page loads, over /ws and GET /config, fits with every string at full length.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "harness.h"
+#include "http_client.h"
+#include "wifi_manager_private.h"
+
+#define TIMEOUT_MS 2000
+#define CONNECT_TIMEOUT_MS 10000
+
+// 32 bytes, all of them legal in an SSID
+#define LONG_SSID "Caf\xc3\xa9 \"Zum L\xc3\xb6wen\" & Bar #2/5GHz"
+// 64 hexadecimal digits: a raw PSK rather than a passphrase
+#define RAW_PSK "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+
+// application/x-www-form-urlencoded value, every byte but letters and digits escaped
+static void form_encode(const char *in, char *out, size_t size)
+{
+    size_t len = 0;
+    for (; *in && len + 4 <= size; in++)
+    {
+        unsigned char c = (unsigned char)*in;
+        len += isalnum(c) ? (size_t)snprintf(out + len, size - len, "%c", c)
+                          : (size_t)snprintf(out + len, size - len, "%%%02X", c);
+    }
+    out[len] = '\0';
+}
+
+static void form_add(char *form, size_t size, const char *key, const char *value)
+{
+    size_t len = strlen(form);
+    len += snprintf(form + len, size - len, "%s%s=", len ? "&" : "", key);
+    form_encode(value, form + len, size - len);
+}
+
+static wifi_manager_t *start_portal(void)
+{
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    CHECK(!wifi_manager_start_config_portal(wm, "Setup", NULL));
+    return wm;
+}
+
+/**
+ * @brief Receive until a message of the given type, skipping status and scan pushes
+ * @return Payload after "<type> ", NULL if the socket closed
+ */
+static const char *ws_expect(http_conn_t *conn, const char *type, char *text, size_t size)
+{
+    size_t type_len = strlen(type);
+    while (ws_recv_text(conn, text, size) >= 0)
+    {
+        if (strncmp(text, type, type_len) == 0 && text[type_len] == ' ')
+        {
+            return text + type_len + 1;
+        }
+    }
+    return NULL;
+}
+
+static void test_ws_saves_full_config_form(void)
+{
+    wifi_manager_t *wm = start_portal();
+    http_conn_t conn;
+    CHECK(ws_open(&conn, fake_httpd_port(), "/ws", TIMEOUT_MS));
+
+    static const char *const values[][2] = {
+        {"mqtt_broker", "mqtt.building-7.campus.example.org"},
+        {"mqtt_port", "8883"},
+        {"mqtt_username", "sensor/climate-02@building-7"},
+        {"mqtt_password", "Tr0ub4dor&3 / correct horse battery staple = 100% #secure?"},
+        {"mqtt_topic", "site/building-7/floor-3/room-42/sensors/climate/state"},
+        {"device_name", "Living Room - Climate Sensor #2 (north wall, above the radiator)"},
+        {"update_interval", "60"},
+        {"enable_debug", "true"},
+        {"ip_mode", "static"},
+        {"static_ip", "192.168.178.42"},
+        {"static_gateway", "192.168.178.1"},
+        {"static_netmask", "255.255.255.0"},
+    };
+    char *message = malloc(CONFIG_FORM_MAX_SIZE + 8);
+    CHECK(message);
+    strcpy(message, "save ");
+    char *form = message + 5;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        form_add(form, CONFIG_FORM_MAX_SIZE, values[i][0], values[i][1]);
+    }
+    printf("  save message of %zu bytes\n", strlen(message));
+    CHECK_INT(strlen(message), >, 512);
+
+    char reply[WIFI_LIST_JSON_SIZE];
+    CHECK(ws_send_text(&conn, message));
+    const char *result = ws_expect(&conn, "save", reply, sizeof(reply));
+    CHECK(result);
+    CHECK(strcmp(result, "{\"status\":\"success\"}") == 0);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        char value[MAX_CONFIG_STRING_LEN];
+        CHECK(wifi_manager_get_parameter(wm, values[i][0], value, sizeof(value)) == ESP_OK);
+        CHECK(strcmp(value, values[i][1]) == 0);
+    }
+
+    // The socket stays usable
+    CHECK(ws_send_text(&conn, "status"));
+    CHECK(ws_expect(&conn, "status", reply, sizeof(reply)));
+
+    // Past the limit the message is refused and the socket closed, as REST answers 400
+    memset(form, 'a', CONFIG_FORM_MAX_SIZE);
+    form[CONFIG_FORM_MAX_SIZE] = '\0';
+    CHECK(ws_send_text(&conn, message));
+    CHECK(!ws_expect(&conn, "save", reply, sizeof(reply)));
+
+    free(message);
+    http_close(&conn);
+    wifi_manager_destroy(wm);
+}
+
+static void check_connects(wifi_manager_t *wm, int ap)
+{
+    CHECK(harness_wait_status(wm, WIFI_STATUS_CONNECTED, CONNECT_TIMEOUT_MS));
+    CHECK_INT(fake_wifi_connected_ap(), ==, ap);
+}
+
+static void test_ws_connect_full_length_credentials(void)
+{
+    CHECK_INT(strlen(LONG_SSID), ==, 32);
+    int ap = harness_add_ap(LONG_SSID, RAW_PSK, -55, 6);
+    wifi_manager_t *wm = start_portal();
+    http_conn_t conn;
+    CHECK(ws_open(&conn, fake_httpd_port(), "/ws", TIMEOUT_MS));
+
+    char message[512] = "connect ";
+    form_add(message + 8, sizeof(message) - 8, "ssid", LONG_SSID);
+    form_add(message + 8, sizeof(message) - 8, "password", RAW_PSK);
+    char reply[WIFI_LIST_JSON_SIZE];
+    CHECK(ws_send_text(&conn, message));
+    const char *result = ws_expect(&conn, "connect", reply, sizeof(reply));
+    CHECK(result);
+    CHECK(strcmp(result, "{\"status\":\"success\"}") == 0);
+    check_connects(wm, ap);
+
+    // No SSID: refused
+    CHECK(ws_send_text(&conn, "connect password=secret123"));
+    result = ws_expect(&conn, "connect", reply, sizeof(reply));
+    CHECK(result);
+    CHECK(strcmp(result, "{\"status\":\"error\"}") == 0);
+
+    http_close(&conn);
+    wifi_manager_destroy(wm);
+}
+
+static void test_rest_connect_full_length_credentials(void)
+{
+    int ap = harness_add_ap(LONG_SSID, RAW_PSK, -55, 6);
+    wifi_manager_t *wm = start_portal();
+
+    char form[512] = "";
+    form_add(form, sizeof(form), "ssid", LONG_SSID);
+    form_add(form, sizeof(form), "password", RAW_PSK);
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "POST", "/connect", form, &response));
+    CHECK_INT(response.status, ==, 200);
+    http_response_free(&response);
+    check_connects(wm, ap);
+
+    CHECK(http_fetch(fake_httpd_port(), "POST", "/connect", "password=secret123", &response));
+    CHECK_INT(response.status, ==, 400);
+    http_response_free(&response);
+
+    wifi_manager_destroy(wm);
+}
+
+static void check_full_config_json(const char *json)
+{
+    cJSON *root = cJSON_Parse(json);
+    CHECK(root);
+    cJSON *params = cJSON_GetObjectItem(root, "parameters");
+    CHECK(cJSON_IsArray(params));
+    CHECK_INT(cJSON_GetArraySize(params), ==, MAX_CONFIG_PARAMS);
+    cJSON *last = cJSON_GetArrayItem(params, MAX_CONFIG_PARAMS - 1);
+    CHECK_INT(strlen(cJSON_GetObjectItem(last, "value")->valuestring), ==, MAX_CONFIG_STRING_LEN - 1);
+    CHECK_INT(strlen(cJSON_GetObjectItem(last, "placeholder")->valuestring), ==,
+              sizeof(((config_param_t *)0)->placeholder) - 1);
+    cJSON_Delete(root);
+}
+
+static void test_config_list_at_full_length(void)
+{
+    wifi_manager_t *wm = start_portal();
+
+    // Fill the remaining slots with every string at its longest
+    char key[sizeof(((config_param_t *)0)->key)];
+    char label[sizeof(((config_param_t *)0)->label)];
+    char placeholder[sizeof(((config_param_t *)0)->placeholder)];
+    char value[MAX_CONFIG_STRING_LEN];
+    memset(label, 'L', sizeof(label) - 1);
+    label[sizeof(label) - 1] = '\0';
+    memset(placeholder, 'P', sizeof(placeholder) - 1);
+    placeholder[sizeof(placeholder) - 1] = '\0';
+    memset(value, 'V', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    for (int i = 0;; i++)
+    {
+        snprintf(key, sizeof(key), "%0*d", (int)sizeof(key) - 1, i);
+        if (wifi_manager_add_parameter(wm, key, label, value, false, placeholder) != ESP_OK)
+        {
+            break;
+        }
+    }
+
+    http_response_t response;
+    CHECK(http_fetch(fake_httpd_port(), "GET", "/config", NULL, &response));
+    CHECK_INT(response.status, ==, 200);
+    printf("  /config of %zu bytes, buffer %zu\n", strlen(response.body), (size_t)CONFIG_JSON_SIZE);
+    check_full_config_json(response.body);
+    http_response_free(&response);
+
+    http_conn_t conn;
+    CHECK(ws_open(&conn, fake_httpd_port(), "/ws", TIMEOUT_MS));
+    char *reply = malloc(CONFIG_JSON_SIZE + 16);
+    CHECK(reply);
+    CHECK(ws_send_text(&conn, "config"));
+    const char *result = ws_expect(&conn, "config", reply, CONFIG_JSON_SIZE + 16);
+    CHECK(result);
+    check_full_config_json(result);
+    free(reply);
+
+    http_close(&conn);
+    wifi_manager_destroy(wm);
+}
+
+int main(void)
+{
+    harness_init(FAKE_CLOCK_REALTIME);
+    RUN_TEST(test_ws_saves_full_config_form);
+    RUN_TEST(test_ws_connect_full_length_credentials);
+    RUN_TEST(test_rest_connect_full_length_credentials);
+    RUN_TEST(test_config_list_at_full_length);
+    return 0;
+}
@@ -0,0 +1,317 @@
+/**
+ * @file wm_bench.c
+ * @brief Benchmark of the portal paths measured by the component's perf probes
+ *
+ * Runs the component against the host fakes, drives the portal over HTTP and
+ * collects the ESP_LOGD "perf:" lines (duration and heap delta of the /wifi
+ * and /config JSON, the template pages, the scan processing and the config
+ * save and load) through the log hook, next to the round trip the client saw.
+ *
+ *   wm_bench [--iterations N] [--require-all]
+ *
+ * --require-all fails when a probe did not report, so the probes cannot
+ * silently go stale.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "harness.h"
+#include "http_client.h"
+#include "samples.h"
+
+#define MAX_PROBES 16
+#define SCAN_WAIT_MS 3000
+
+typedef struct
+{
+    char name[32];
+    samples_t us;
+    long heap_max;
+} probe_t;
+
+static const char *const expected_probes[] = {
+    "/wifi JSON", "/config JSON", "template page", "scan processing", "config save", "config load",
+};
+
+static pthread_mutex_t probe_lock = PTHREAD_MUTEX_INITIALIZER;
+static probe_t probes[MAX_PROBES];
+static int probe_count;
+
+static probe_t *probe_find_locked(const char *name, bool create)
+{
+    for (int i = 0; i < probe_count; i++)
+    {
+        if (strcmp(probes[i].name, name) == 0)
+        {
+            return &probes[i];
+        }
+    }
+    if (!create || probe_count == MAX_PROBES)
+    {
+        return NULL;
+    }
+    probe_t *probe = &probes[probe_count++];
+    snprintf(probe->name, sizeof(probe->name), "%s", name);
+    probe->heap_max = -__LONG_MAX__;
+    return probe;
+}
+
+static size_t probe_reports(const char *name)
+{
+    pthread_mutex_lock(&probe_lock);
+    probe_t *probe = probe_find_locked(name, false);
+    size_t count = probe ? probe->us.count : 0;
+    pthread_mutex_unlock(&probe_lock);
+    return count;
+}
+
+// "D (123) wifi_manager: perf: <name> took <us> us, heap <+bytes> bytes"
+static void log_hook(const char *line, void *ctx)
+{
+    const char *perf = strstr(line, "perf: ");
+    if (!perf)
+    {
+        return;
+    }
+    perf += strlen("perf: ");
+    const char *took = strstr(perf, " took ");
+    long long us;
+    long heap;
+    if (!took || (size_t)(took - perf) >= sizeof(probes[0].name) ||
+        sscanf(took, " took %lld us, heap %ld bytes", &us, &heap) != 2)
+    {
+        return;
+    }
+    char name[sizeof(probes[0].name)];
+    memcpy(name, perf, (size_t)(took - perf));
+    name[took - perf] = '\0';
+
+    pthread_mutex_lock(&probe_lock);
+    probe_t *probe = probe_find_locked(name, true);
+    if (probe)
+    {
+        samples_add(&probe->us, (double)us);
+        if (heap > probe->heap_max)
+        {
+            probe->heap_max = heap;
+        }
+    }
+    pthread_mutex_unlock(&probe_lock);
+}
+
+// ------------------------------------------
+//   Workload
+// ------------------------------------------
+
+typedef struct
+{
+    const char *label;
+    samples_t ms;
+} round_trip_t;
+
+static bool timed_request(http_conn_t *conn, round_trip_t *rt, const char *method, const char *path,
+                          const char *form)
+{
+    http_response_t response;
+    int64_t start = fake_rtos_now_us();
+    bool ok = http_request(conn, method, path, form ? "application/x-www-form-urlencoded" : NULL, form,
+                           form ? strlen(form) : 0, &response);
+    samples_add(&rt->ms, (fake_rtos_now_us() - start) / 1000.0);
+    ok = ok && response.status == 200;
+    if (!ok)
+    {
+        fprintf(stderr, "%s %s failed (status %d)\n", method, path, response.status);
+    }
+    http_response_free(&response);
+    return ok;
+}
+
+static bool wait_reports(const char *name, size_t count)
+{
+    for (int waited = 0; probe_reports(name) < count; waited += 10)
+    {
+        if (waited >= SCAN_WAIT_MS)
+        {
+            return false;
+        }
+        fake_rtos_run_for_ms(10);
+    }
+    return true;
+}
+
+typedef struct
+{
+    int iterations;
+    round_trip_t *rt;
+    bool ok;
+} client_t;
+
+// Runs in its own thread, left out of the heap figures like a browser would be
+static void *client_main(void *arg)
+{
+    client_t *client = arg;
+    round_trip_t *rt = client->rt;
+    fake_heap_ignore_thread();
+
+    http_conn_t conn;
+    if (!http_connect(&conn, fake_httpd_port(), 5000))
+    {
+        fprintf(stderr, "cannot connect to the portal\n");
+        return NULL;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < client->iterations && ok; i++)
+    {
+        // The setup page starts a scan, the results arrive as "scan processing"
+        size_t scans = probe_reports("scan processing");
+        ok = timed_request(&conn, &rt[0], "GET", "/", NULL) && wait_reports("scan processing", scans + 1);
+        ok = ok && timed_request(&conn, &rt[1], "GET", "/wifi", NULL);
+        ok = ok && timed_request(&conn, &rt[2], "GET", "/config", NULL);
+        ok = ok && timed_request(&conn, &rt[3], "GET", "/config.html", NULL);
+
+        char form[64];
+        snprintf(form, sizeof(form), "mqtt_broker=bench%d.example.com&mqtt_port=%d", i, 1883 + i);
+        ok = ok && timed_request(&conn, &rt[4], "POST", "/config/save", form);
+    }
+    http_close(&conn);
+    client->ok = ok;
+    return NULL;
+}
+
+static bool run(wifi_manager_t *wm, int iterations, round_trip_t *rt)
+{
+    client_t client = {.iterations = iterations, .rt = rt};
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, client_main, &client) == 0);
+    pthread_join(thread, NULL);
+    if (!client.ok)
+    {
+        return false;
+    }
+
+    // The application side of the config: reading back what the portal saved
+    for (int i = 0; i < iterations; i++)
+    {
+        int64_t start = fake_rtos_now_us();
+        if (wifi_manager_load_config(wm) != ESP_OK)
+        {
+            return false;
+        }
+        samples_add(&rt[5].ms, (fake_rtos_now_us() - start) / 1000.0);
+    }
+    return true;
+}
+
+// ------------------------------------------
+//   Report
+// ------------------------------------------
+
+static void report(round_trip_t *rt, int rt_count)
+{
+    printf("\n%-18s %6s %10s %10s %10s %10s\n", "probe", "count", "mean us", "p50 us", "max us", "heap max");
+    pthread_mutex_lock(&probe_lock);
+    for (int i = 0; i < probe_count; i++)
+    {
+        probe_t *probe = &probes[i];
+        printf("%-18s %6zu %10.0f %10.0f %10.0f %+10ld\n", probe->name, probe->us.count, samples_mean(&probe->us),
+               samples_percentile(&probe->us, 50), samples_max(&probe->us), probe->heap_max);
+    }
+    pthread_mutex_unlock(&probe_lock);
+
+    printf("\n%-18s %6s %10s %10s %10s\n", "round trip", "count", "mean ms", "p50 ms", "p99 ms");
+    for (int i = 0; i < rt_count; i++)
+    {
+        printf("%-18s %6zu %10.2f %10.2f %10.2f\n", rt[i].label, rt[i].ms.count, samples_mean(&rt[i].ms),
+               samples_percentile(&rt[i].ms, 50), samples_percentile(&rt[i].ms, 99));
+    }
+}
+
+static bool all_probes_reported(void)
+{
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(expected_probes) / sizeof(expected_probes[0]); i++)
+    {
+        if (probe_reports(expected_probes[i]) == 0)
+        {
+            fprintf(stderr, "perf probe \"%s\" did not report\n", expected_probes[i]);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--iterations N] [--require-all]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 20;
+    bool require_all = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--require-all") == 0)
+        {
+            require_all = true;
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (iterations < 1)
+    {
+        usage(argv[0]);
+    }
+
+    harness_init(FAKE_CLOCK_REALTIME);
+    // A busy neighbourhood so the scan and /wifi paths have work to do
+    for (int i = 0; i < 12; i++)
+    {
+        char ssid[33];
+        snprintf(ssid, sizeof(ssid), i % 4 ? "Neighbour-%d" : "Office", i);
+        harness_add_ap(ssid, "password123", (int8_t)(-40 - i * 4), (uint8_t)(1 + i % 11));
+    }
+    fake_log_set_hook(log_hook, NULL);
+
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    wifi_manager_start_config_portal(wm, "WM-Bench", NULL);
+    CHECK(fake_httpd_port() != 0);
+
+    round_trip_t rt[] = {
+        {"GET /"}, {"GET /wifi"}, {"GET /config"}, {"GET /config.html"}, {"POST /config/save"}, {"load_config()"},
+    };
+    bool ok = run(wm, iterations, rt);
+
+    wifi_manager_stop_config_portal(wm);
+    wifi_manager_destroy(wm);
+    fake_log_set_hook(NULL, NULL);
+
+    int rt_count = (int)(sizeof(rt) / sizeof(rt[0]));
+    report(rt, rt_count);
+    if (require_all && !all_probes_reported())
+    {
+        ok = false;
+    }
+
+    for (int i = 0; i < rt_count; i++)
+    {
+        samples_free(&rt[i].ms);
+    }
+    for (int i = 0; i < probe_count; i++)
+    {
+        samples_free(&probes[i].us);
+    }
+    return ok ? 0 : 1;
+}
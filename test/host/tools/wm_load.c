@@ -0,0 +1,584 @@
+/**
+ * @file wm_load.c
+ * @brief Load generator for the portal web server
+ *
+ * Runs the component's portal against the host fakes and lets N phones use
+ * it at once the way the setup page does: load /, /style.css and /script.js,
+ * open the /ws control channel (or /events, or fall back to polling when the
+ * server refuses both), fetch /config, poll /wifi and save the configuration,
+ * then leave and come back as the next phone.
+ *
+ *   wm_load [--clients N] [--seconds S] [--save FILE] [--baseline FILE] [--max-failures N]
+ *
+ * Reports throughput, latency percentiles per route, failed requests, the
+ * streams refused or dropped by the server and the peak heap above the idle
+ * portal. --save writes the figures to a file and --baseline compares a run
+ * with such a file, e.g. one saved on the previous commit. Set WM_HOST_LOG to
+ * also see the component log.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "harness.h"
+#include "http_client.h"
+#include "samples.h"
+
+#define MAX_CLIENTS 32
+#define REQUEST_TIMEOUT_MS 2000  // A slower reply counts as failed: the phone gave up
+#define POLLS_PER_VISIT 5        // /wifi requests while the page is open
+#define POLL_INTERVAL_MS 100
+#define ARRIVAL_STAGGER_MS 20    // Between the first visits of the phones
+#define WS_SETTLE_MS 50           // A refused /ws client is closed right after the handshake
+#define WS_CLOSE_TRY_AGAIN 1013  // Close code that sends script.js on to /events
+#define HEAP_SAMPLE_US 1000
+#define BASELINE_NOISE 0.01      // Smaller relative changes are not called better or worse
+#define SCAN_WAIT_MS 3000
+
+typedef enum
+{
+    ROUTE_PAGE,
+    ROUTE_STYLE,
+    ROUTE_SCRIPT,
+    ROUTE_CONFIG,
+    ROUTE_WIFI,
+    ROUTE_SAVE,
+    ROUTE_COUNT
+} route_t;
+
+static const char *const route_names[ROUTE_COUNT] = {
+    "GET /", "GET /style.css", "GET /script.js", "GET /config", "GET /wifi", "POST /config/save",
+};
+
+typedef struct
+{
+    int index;
+    int64_t deadline_us;
+    uint16_t port;
+
+    // Results, merged after the run
+    samples_t ms[ROUTE_COUNT];
+    unsigned failed[ROUTE_COUNT];
+    samples_t page_load_ms;  // /, /style.css and /script.js of one visit
+    unsigned visits;
+    unsigned retried;        // Kept-alive connection closed under the request, sent again
+    unsigned ws_streams;
+    unsigned event_streams;
+    unsigned refused;        // Neither /ws nor /events was available: polling
+    unsigned dropped;        // Stream closed by the server while the page was open
+} phone_t;
+
+// ------------------------------------------
+//   One phone
+// ------------------------------------------
+
+static void sleep_ms(int ms)
+{
+    usleep((useconds_t)ms * 1000);
+}
+
+/**
+ * @brief One request on the page's keep-alive connection, reconnecting like a browser
+ *
+ * A browser sends a request again on a new connection when the server closed
+ * the kept-alive one under it (e.g. purged it for another client); only a
+ * request that fails on a fresh connection too is counted as failed.
+ */
+static bool phone_request(phone_t *phone, http_conn_t *conn, route_t route, const char *path, const char *form)
+{
+    const char *method = route == ROUTE_SAVE ? "POST" : "GET";
+    const char *content_type = form ? "application/x-www-form-urlencoded" : NULL;
+    size_t form_len = form ? strlen(form) : 0;
+    int64_t start = fake_rtos_now_us();
+    http_response_t response = {0};
+    bool reused = conn->fd >= 0;
+    bool sent = (reused || http_connect(conn, phone->port, REQUEST_TIMEOUT_MS)) &&
+                http_request(conn, method, path, content_type, form, form_len, &response);
+    if (!sent && reused)
+    {
+        phone->retried++;
+        http_close(conn);
+        http_response_free(&response);
+        response = (http_response_t){0};
+        sent = http_connect(conn, phone->port, REQUEST_TIMEOUT_MS) &&
+               http_request(conn, method, path, content_type, form, form_len, &response);
+    }
+    bool ok = sent && response.status == 200;
+    if (ok)
+    {
+        samples_add(&phone->ms[route], (fake_rtos_now_us() - start) / 1000.0);
+    }
+    else
+    {
+        phone->failed[route]++;
+    }
+    if (!ok || response.closed)
+    {
+        http_close(conn);
+    }
+    http_response_free(&response);
+    return ok;
+}
+
+/**
+ * @brief Whether the server closed a stream the phone never read from
+ */
+static bool stream_closed(http_conn_t *stream)
+{
+    char buf[512];
+    for (;;)
+    {
+        ssize_t n = recv(stream->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0)
+        {
+            continue; // Pushed events
+        }
+        return n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+}
+
+/**
+ * @brief What script.js sees right after its WebSocket opened
+ * @return 0 if the channel stays open, else the close code (-1 if closed without a close frame)
+ */
+static int ws_close_code(http_conn_t *stream)
+{
+    // The frame may already sit behind the handshake response in the client buffer
+    uint8_t frame[4];
+    size_t have = stream->end - stream->start;
+    have = have < sizeof(frame) ? have : sizeof(frame);
+    memcpy(frame, stream->buf + stream->start, have);
+    if (have == 0)
+    {
+        struct pollfd pfd = {.fd = stream->fd, .events = POLLIN};
+        if (poll(&pfd, 1, WS_SETTLE_MS) <= 0)
+        {
+            return 0;
+        }
+    }
+    if (have < sizeof(frame))
+    {
+        ssize_t n = recv(stream->fd, frame + have, sizeof(frame) - have, MSG_PEEK | MSG_WAITALL);
+        if (n <= 0 && have == 0)
+        {
+            return -1;
+        }
+        have += n > 0 ? (size_t)n : 0;
+    }
+    if ((frame[0] & 0x0f) != 0x8)
+    {
+        return 0; // A pushed message
+    }
+    return have == sizeof(frame) ? (frame[2] << 8 | frame[3]) : -1;
+}
+
+static void phone_visit(phone_t *phone)
+{
+    http_conn_t conn = {.fd = -1};
+    http_conn_t stream = {.fd = -1};
+
+    int64_t start = fake_rtos_now_us();
+    bool loaded = phone_request(phone, &conn, ROUTE_PAGE, "/", NULL);
+    loaded = phone_request(phone, &conn, ROUTE_STYLE, "/style.css", NULL) && loaded;
+    loaded = phone_request(phone, &conn, ROUTE_SCRIPT, "/script.js", NULL) && loaded;
+    if (loaded)
+    {
+        samples_add(&phone->page_load_ms, (fake_rtos_now_us() - start) / 1000.0);
+    }
+
+    // script.js: the control channel first, then server-sent events, then polling.
+    // A channel closed after it opened is lost, unless the server asked to try again.
+    bool try_events = true;
+    if (ws_open(&stream, phone->port, "/ws", REQUEST_TIMEOUT_MS))
+    {
+        int code = ws_close_code(&stream);
+        if (code == 0)
+        {
+            phone->ws_streams++;
+            try_events = false;
+        }
+        else
+        {
+            try_events = code == WS_CLOSE_TRY_AGAIN;
+            phone->dropped += !try_events;
+            http_close(&stream);
+        }
+    }
+    if (try_events)
+    {
+        if (sse_open(&stream, phone->port, "/events", REQUEST_TIMEOUT_MS))
+        {
+            phone->event_streams++;
+        }
+        else
+        {
+            phone->refused++;
+        }
+    }
+
+    phone_request(phone, &conn, ROUTE_CONFIG, "/config", NULL);
+    for (int i = 0; i < POLLS_PER_VISIT && fake_rtos_now_us() < phone->deadline_us; i++)
+    {
+        sleep_ms(POLL_INTERVAL_MS);
+        phone_request(phone, &conn, ROUTE_WIFI, "/wifi", NULL);
+    }
+
+    char form[64];
+    snprintf(form, sizeof(form), "mqtt_broker=phone%d.example.com&mqtt_port=%u", phone->index, 1883 + phone->visits);
+    phone_request(phone, &conn, ROUTE_SAVE, "/config/save", form);
+
+    if (stream.fd >= 0 && stream_closed(&stream))
+    {
+        phone->dropped++;
+    }
+    http_close(&stream);
+    http_close(&conn);
+    phone->visits++;
+}
+
+// Runs in its own thread, left out of the heap figures like a browser would be
+static void *phone_main(void *arg)
+{
+    phone_t *phone = arg;
+    fake_heap_ignore_thread();
+
+    sleep_ms(phone->index * ARRIVAL_STAGGER_MS);
+    while (fake_rtos_now_us() < phone->deadline_us)
+    {
+        phone_visit(phone);
+    }
+    return NULL;
+}
+
+// ------------------------------------------
+//   Results
+// ------------------------------------------
+
+typedef struct
+{
+    const char *key;
+    const char *label;
+    double value;
+    bool lower_is_better;
+} metric_t;
+
+enum
+{
+    METRIC_THROUGHPUT,
+    METRIC_FAILED,
+    METRIC_RETRIED,
+    METRIC_P50,
+    METRIC_P90,
+    METRIC_P99,
+    METRIC_PAGE_P99,
+    METRIC_REFUSED,
+    METRIC_DROPPED,
+    METRIC_PURGED,
+    METRIC_HEAP,
+    METRIC_COUNT
+};
+
+static metric_t metrics[METRIC_COUNT] = {
+    [METRIC_THROUGHPUT] = {"requests_per_s", "throughput (req/s)", 0, false},
+    [METRIC_FAILED] = {"failed_requests", "failed requests", 0, true},
+    [METRIC_RETRIED] = {"requests_sent_again", "requests sent again", 0, true},
+    [METRIC_P50] = {"p50_ms", "latency p50 (ms)", 0, true},
+    [METRIC_P90] = {"p90_ms", "latency p90 (ms)", 0, true},
+    [METRIC_P99] = {"p99_ms", "latency p99 (ms)", 0, true},
+    [METRIC_PAGE_P99] = {"page_load_p99_ms", "page load p99 (ms)", 0, true},
+    [METRIC_REFUSED] = {"streams_refused", "streams refused", 0, true},
+    [METRIC_DROPPED] = {"streams_dropped", "streams dropped", 0, true},
+    [METRIC_PURGED] = {"sessions_purged", "sessions purged", 0, true},
+    [METRIC_HEAP] = {"peak_heap_bytes", "peak heap (bytes)", 0, true},
+};
+
+static void report(phone_t *phones, int count, double seconds, const fake_httpd_stats_t *httpd, size_t peak_heap)
+{
+    samples_t all = {0};
+    samples_t page_load = {0};
+    unsigned failed = 0;
+    unsigned visits = 0;
+    unsigned retried = 0;
+    unsigned ws_streams = 0;
+    unsigned event_streams = 0;
+    unsigned refused = 0;
+    unsigned dropped = 0;
+
+    printf("\n%-18s %7s %6s %9s %9s %9s %9s\n", "route", "count", "failed", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (int route = 0; route < ROUTE_COUNT; route++)
+    {
+        samples_t merged = {0};
+        unsigned route_failed = 0;
+        for (int i = 0; i < count; i++)
+        {
+            for (size_t j = 0; j < phones[i].ms[route].count; j++)
+            {
+                samples_add(&merged, phones[i].ms[route].values[j]);
+                samples_add(&all, phones[i].ms[route].values[j]);
+            }
+            route_failed += phones[i].failed[route];
+        }
+        printf("%-18s %7zu %6u %9.2f %9.2f %9.2f %9.2f\n", route_names[route], merged.count, route_failed,
+               samples_percentile(&merged, 50), samples_percentile(&merged, 90), samples_percentile(&merged, 99),
+               samples_max(&merged));
+        failed += route_failed;
+        samples_free(&merged);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        for (size_t j = 0; j < phones[i].page_load_ms.count; j++)
+        {
+            samples_add(&page_load, phones[i].page_load_ms.values[j]);
+        }
+        visits += phones[i].visits;
+        retried += phones[i].retried;
+        ws_streams += phones[i].ws_streams;
+        event_streams += phones[i].event_streams;
+        refused += phones[i].refused;
+        dropped += phones[i].dropped;
+    }
+    printf("%-18s %7zu %6s %9.2f %9.2f %9.2f %9.2f\n", "page load", page_load.count, "",
+           samples_percentile(&page_load, 50), samples_percentile(&page_load, 90),
+           samples_percentile(&page_load, 99), samples_max(&page_load));
+
+    printf("\n%d phones, %.1f s: %u visits, %zu requests, %u failed, %u sent again\n", count, seconds, visits,
+           all.count + failed, failed, retried);
+    printf("streams: %u /ws, %u /events, %u refused (polling), %u dropped by the server\n", ws_streams,
+           event_streams, refused, dropped);
+    printf("httpd: %u connections, %u purged, %u open at most\n", httpd->sessions, httpd->purged, httpd->open_peak);
+
+    metrics[METRIC_THROUGHPUT].value = all.count / seconds;
+    metrics[METRIC_FAILED].value = failed;
+    metrics[METRIC_RETRIED].value = retried;
+    metrics[METRIC_P50].value = samples_percentile(&all, 50);
+    metrics[METRIC_P90].value = samples_percentile(&all, 90);
+    metrics[METRIC_P99].value = samples_percentile(&all, 99);
+    metrics[METRIC_PAGE_P99].value = samples_percentile(&page_load, 99);
+    metrics[METRIC_REFUSED].value = refused;
+    metrics[METRIC_DROPPED].value = dropped;
+    metrics[METRIC_PURGED].value = httpd->purged;
+    metrics[METRIC_HEAP].value = (double)peak_heap;
+    samples_free(&all);
+    samples_free(&page_load);
+}
+
+static bool save_metrics(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        fprintf(file, "%s %.3f\n", metrics[i].key, metrics[i].value);
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Print the run next to a saved one; metrics missing from the file are skipped
+ */
+static bool compare_baseline(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    double baseline[METRIC_COUNT];
+    bool present[METRIC_COUNT] = {false};
+    char key[64];
+    double value;
+    while (fscanf(file, "%63s %lf", key, &value) == 2)
+    {
+        for (int i = 0; i < METRIC_COUNT; i++)
+        {
+            if (strcmp(key, metrics[i].key) == 0)
+            {
+                baseline[i] = value;
+                present[i] = true;
+            }
+        }
+    }
+    fclose(file);
+
+    printf("\n%-20s %12s %12s %9s\n", "compared to", "baseline", "now", "change");
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (!present[i])
+        {
+            continue;
+        }
+        double now = metrics[i].value;
+        double delta = now - baseline[i];
+        const char *verdict = "";
+        if (fabs(delta) > fabs(baseline[i]) * BASELINE_NOISE)
+        {
+            verdict = (delta < 0) == metrics[i].lower_is_better ? "better" : "worse";
+        }
+        if (baseline[i] != 0)
+        {
+            printf("%-20s %12.2f %12.2f %+8.1f%% %s\n", metrics[i].label, baseline[i], now,
+                   100.0 * delta / baseline[i], verdict);
+        }
+        else
+        {
+            printf("%-20s %12.2f %12.2f %9s %s\n", metrics[i].label, baseline[i], now, "", verdict);
+        }
+    }
+    return true;
+}
+
+// ------------------------------------------
+//   Run
+// ------------------------------------------
+
+static bool scan_listed(void *arg)
+{
+    http_response_t response;
+    bool listed = http_fetch(fake_httpd_port(), "GET", "/wifi", NULL, &response) && response.status == 200 &&
+                  strstr(response.body, "\"ssid\"") != NULL;
+    http_response_free(&response);
+    return listed;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--clients N] [--seconds S] [--save FILE] [--baseline FILE] [--max-failures N]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int clients = 6;
+    double seconds = 5;
+    const char *save_path = NULL;
+    const char *baseline_path = NULL;
+    long max_failures = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc)
+        {
+            clients = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+        {
+            save_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-failures") == 0 && i + 1 < argc)
+        {
+            max_failures = atol(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (clients < 1 || clients > MAX_CLIENTS || seconds <= 0)
+    {
+        usage(argv[0]);
+    }
+
+    harness_init(FAKE_CLOCK_REALTIME);
+    if (!getenv("WM_HOST_LOG"))
+    {
+        esp_log_level_set("*", ESP_LOG_NONE); // Keep the report readable
+    }
+    for (int i = 0; i < 12; i++)
+    {
+        char ssid[33];
+        snprintf(ssid, sizeof(ssid), i % 4 ? "Neighbour-%d" : "Office", i);
+        harness_add_ap(ssid, "password123", (int8_t)(-40 - i * 4), (uint8_t)(1 + i % 11));
+    }
+
+    wifi_manager_t *wm = wifi_manager_create();
+    CHECK(wm);
+    wifi_manager_set_config_portal_blocking(wm, false);
+    wifi_manager_start_config_portal(wm, "WM-Load", NULL);
+    uint16_t port = fake_httpd_port();
+    CHECK(port != 0);
+    // Idle portal with its first scan: the heap figure is what the phones add
+    CHECK(harness_wait(scan_listed, NULL, SCAN_WAIT_MS));
+    size_t idle_heap = fake_heap_used();
+    fake_httpd_stats_t idle_httpd;
+    fake_httpd_get_stats(&idle_httpd);
+
+    static phone_t phones[MAX_CLIENTS];
+    int64_t start = fake_rtos_now_us();
+    int64_t deadline = start + (int64_t)(seconds * 1e6);
+    pthread_t threads[MAX_CLIENTS];
+    for (int i = 0; i < clients; i++)
+    {
+        phones[i] = (phone_t){.index = i, .deadline_us = deadline, .port = port};
+        CHECK(pthread_create(&threads[i], NULL, phone_main, &phones[i]) == 0);
+    }
+
+    size_t peak_heap = idle_heap;
+    while (fake_rtos_now_us() < deadline)
+    {
+        size_t used = fake_heap_used();
+        if (used > peak_heap)
+        {
+            peak_heap = used;
+        }
+        usleep(HEAP_SAMPLE_US);
+    }
+    for (int i = 0; i < clients; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (fake_rtos_now_us() - start) / 1e6;
+
+    fake_httpd_stats_t httpd;
+    fake_httpd_get_stats(&httpd);
+    httpd.sessions -= idle_httpd.sessions;
+    httpd.requests -= idle_httpd.requests;
+    httpd.purged -= idle_httpd.purged;
+    wifi_manager_stop_config_portal(wm);
+    wifi_manager_destroy(wm);
+
+    report(phones, clients, elapsed, &httpd, peak_heap - idle_heap);
+    for (int i = 0; i < clients; i++)
+    {
+        for (int route = 0; route < ROUTE_COUNT; route++)
+        {
+            samples_free(&phones[i].ms[route]);
+        }
+        samples_free(&phones[i].page_load_ms);
+    }
+
+    bool ok = true;
+    if (baseline_path && !compare_baseline(baseline_path))
+    {
+        ok = false;
+    }
+    if (save_path && !save_metrics(save_path))
+    {
+        ok = false;
+    }
+    if (max_failures >= 0 && metrics[METRIC_FAILED].value > max_failures)
+    {
+        fprintf(stderr, "%.0f failed requests, at most %ld allowed\n", metrics[METRIC_FAILED].value, max_failures);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
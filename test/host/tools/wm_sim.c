@@ -0,0 +1,124 @@
+/**
+ * @file wm_sim.c
+ * @brief Replay radio scenarios against the component on the virtual clock
+ *
+ *   wm_sim [--quiet] [--repeat N] scenario.wms...
+ *
+ * Prints the timeline of each scenario (steps, WIFI_EVENT / IP_EVENT with
+ * their device time, status changes, expectations) and exits non-zero when
+ * an expectation fails. With --repeat every scenario is replayed N times and
+ * the timelines must be identical, which checks that the simulation (and the
+ * component on top of it) is deterministic. Set WM_HOST_LOG to also see the
+ * component log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "harness.h"
+#include "scenario.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--quiet] [--repeat N] scenario...\n", prog);
+    exit(2);
+}
+
+// Replays once; the timeline is returned in a malloc'd string
+static char *replay(const scenario_t *scenario, scenario_result_t *result, bool *passed)
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *trace = open_memstream(&text, &size);
+    CHECK(trace);
+    *passed = scenario_run(scenario, trace, result);
+    fclose(trace);
+    return text;
+}
+
+static void report_difference(const char *path, int run, const char *first, const char *other)
+{
+    int line = 1;
+    while (*first && *first == *other)
+    {
+        line += *first == '\n';
+        first++;
+        other++;
+    }
+    fprintf(stderr, "%s: run %d differs from run 1 at timeline line %d\n", path, run, line);
+}
+
+int main(int argc, char **argv)
+{
+    bool quiet = false;
+    int repeat = 1;
+    int first_file = 1;
+    for (; first_file < argc && argv[first_file][0] == '-'; first_file++)
+    {
+        if (strcmp(argv[first_file], "--quiet") == 0)
+        {
+            quiet = true;
+        }
+        else if (strcmp(argv[first_file], "--repeat") == 0 && first_file + 1 < argc)
+        {
+            repeat = atoi(argv[++first_file]);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (first_file == argc || repeat < 1)
+    {
+        usage(argv[0]);
+    }
+
+    harness_init(FAKE_CLOCK_VIRTUAL);
+    if (!getenv("WM_HOST_LOG"))
+    {
+        esp_log_level_set("*", ESP_LOG_NONE); // Keep the timeline readable
+    }
+
+    int failed = 0;
+    for (int f = first_file; f < argc; f++)
+    {
+        char err[256];
+        scenario_t *scenario = scenario_load(argv[f], err, sizeof(err));
+        if (!scenario)
+        {
+            fprintf(stderr, "%s\n", err);
+            return 2;
+        }
+
+        scenario_result_t result;
+        bool passed;
+        char *first = replay(scenario, &result, &passed);
+        if (!quiet)
+        {
+            fputs(first, stdout);
+        }
+        for (int run = 2; run <= repeat && passed; run++)
+        {
+            scenario_result_t again;
+            char *other = replay(scenario, &again, &passed);
+            if (strcmp(first, other) != 0)
+            {
+                report_difference(argv[f], run, first, other);
+                passed = false;
+            }
+            free(other);
+        }
+        if (!passed && quiet)
+        {
+            fputs(first, stderr); // The timeline explains the failure
+        }
+        free(first);
+
+        printf("%s %s: %u expectations, %u failed%s\n", passed ? "PASS" : "FAIL", argv[f], result.expectations,
+               result.failures, result.late_steps ? " (some steps started late)" : "");
+        failed += !passed;
+        scenario_free(scenario);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Build-time compiler for the server-rendered portal pages.
+
+Pages in web/ mark dynamic sections with placeholders such as {{networks}}.
+For each page this writes a copy with the placeholders removed (the file that
+gets embedded) and one offset table per page into a C header:
+
+    static const tpl_slot_t setup_html_slots[] = {
+        {812, TPL_SLOT_NETWORKS},
+        ...
+        {4711, TPL_SLOT_NONE},   // End of the page
+    };
+
+The device streams the page from flash up to each offset and renders the slot
+in between (see wifi_manager_template.c), so nothing is searched or copied at
+run time. Unknown placeholder names fail the build.
+
+Author: Peter Stangsdal
+License: MIT
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# Placeholder name -> tpl_slot_id_t in wifi_manager_private.h
+SLOTS = {
+    'wifi': 'TPL_SLOT_WIFI',
+    'networks': 'TPL_SLOT_NETWORKS',
+    'params': 'TPL_SLOT_PARAMS',
+    'status': 'TPL_SLOT_STATUS',
+    'ip': 'TPL_SLOT_IP',
+}
+
+PLACEHOLDER_RE = re.compile(r'\{\{(\w+)\}\}')
+MAX_OFFSET = 0xFFFF  # tpl_slot_t.offset is 16 bits
+
+
+def compile_page(text):
+    """Return the page without placeholders and the (byte offset, slot) list."""
+    data = text.encode('utf-8')
+    out = bytearray()
+    slots = []
+    pos = 0
+    for match in PLACEHOLDER_RE.finditer(text):
+        # Offsets are in bytes of the embedded file, the page may hold UTF-8 emoji
+        start = len(text[:match.start()].encode('utf-8'))
+        end = len(text[:match.end()].encode('utf-8'))
+        name = match.group(1)
+        if name not in SLOTS:
+            raise ValueError('unknown placeholder {{%s}}' % name)
+        out += data[pos:start]
+        slots.append((len(out), SLOTS[name]))
+        pos = end
+    out += data[pos:]
+    slots.append((len(out), 'TPL_SLOT_NONE'))
+    if len(out) > MAX_OFFSET:
+        raise ValueError('page is %d bytes, offsets are limited to %d' % (len(out), MAX_OFFSET))
+    return bytes(out), slots
+
+
+def symbol(name):
+    return re.sub(r'\W', '_', name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    parser.add_argument('--out-dir', required=True, help='directory for the compiled pages')
+    parser.add_argument('--header', required=True, help='C header with the offset tables')
+    parser.add_argument('pages', nargs='+', help='template pages (.html)')
+    args = parser.parse_args()
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    lines = [
+        '// Generated by tools/compile_templates.py, do not edit',
+        '#pragma once',
+        '',
+    ]
+    for path in args.pages:
+        name = os.path.basename(path)
+        with open(path, encoding='utf-8') as f:
+            text = f.read()
+        try:
+            page, slots = compile_page(text)
+        except ValueError as e:
+            print('%s: %s' % (path, e), file=sys.stderr)
+            return 1
+
+        with open(os.path.join(args.out_dir, name), 'wb') as f:
+            f.write(page)
+
+        lines.append('static const tpl_slot_t %s_slots[] = {' % symbol(name))
+        lines.extend('    {%d, %s},' % slot for slot in slots)
+        lines.append('};')
+        lines.append('')
+        print('Template %s: %d bytes, %d slots' % (name, len(page), len(slots) - 1))
+
+    with open(args.header, 'w', encoding='utf-8', newline='\n') as f:
+        f.write('\n'.join(lines))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+"""
+Build-time minifier for the portal web assets.
+
+Shrinks the files in web/ before they are embedded with EMBED_FILES:
+
+  - CSS: comments and insignificant whitespace removed
+  - JS: comments, indentation and insignificant whitespace removed; line
+    breaks that automatic semicolon insertion may depend on are kept, so the
+    semicolon-free style of script.js survives. With --strip-logs,
+    console.log/console.debug statements are dropped as well.
+  - HTML: comments and indentation removed, inline <style> and <script>
+    minified as above, and stylesheets linked from the page inlined when the
+    minified stylesheet is at most --inline-css-max bytes (saves a request
+    per page over the soft-AP).
+
+With --bundle, a single-document portal page is written as well: setup.html
+with every stylesheet and script.js inlined. Its {{placeholders}} are kept for
+tools/compile_templates.py like those of the other pages, so the phone needs
+one request to show the network list.
+
+This is deliberately conservative: it never renames identifiers and leaves
+string, template and regular expression literals untouched.
+
+Author: Peter Stangsdal
+License: MIT
+"""
+
+import argparse
+import os
+import re
+import sys
+
+LOG_CALLS = ('console.log(', 'console.debug(')
+
+
+def minify_css(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'\s+', ' ', text)
+    text = re.sub(r'\s*([{};,>])\s*', r'\1', text)
+    text = re.sub(r':\s+', ':', text)
+    text = text.replace(';}', '}')
+    return text.strip()
+
+
+def _skip_string(text, i):
+    """Return the index after the string or template literal starting at text[i]."""
+    quote = text[i]
+    i += 1
+    while i < len(text) and text[i] != quote:
+        if text[i] == '\\':
+            i += 1
+        elif quote != '`' and text[i] == '\n':
+            break
+        i += 1
+    return i + 1
+
+
+def _skip_regex(text, i):
+    """Return the index after the regular expression literal starting at text[i]."""
+    i += 1
+    in_class = False
+    while i < len(text) and text[i] != '\n':
+        c = text[i]
+        if c == '\\':
+            i += 1
+        elif c == '[':
+            in_class = True
+        elif c == ']':
+            in_class = False
+        elif c == '/' and not in_class:
+            i += 1
+            while i < len(text) and (text[i].isalnum()):
+                i += 1
+            return i
+        i += 1
+    return i
+
+
+def _is_word(c):
+    return c.isalnum() or c in '_$\\' or ord(c) > 127
+
+
+def _space_needed(prev, nxt):
+    """Whitespace only matters between two word characters and in '+ +' / '- -'."""
+    if _is_word(prev):
+        return _is_word(nxt) or nxt == '`'  # No space before a template would make it a tagged one
+    return prev == nxt and prev in '+-'
+
+
+def _regex_allowed(out):
+    """A '/' starts a regular expression after an operator or keyword, not after a value."""
+    stripped = ''.join(out[-16:]).rstrip()
+    if not stripped:
+        return True
+    if stripped[-1] in '(,=:[!&|?{};+-*%<>~^':
+        return True
+    return re.search(r'\b(return|typeof|case|do|else|in|of)$', stripped) is not None
+
+
+def _skip_call(text, i):
+    """Return the index after the call whose '(' is the last char before text[i], plus a ';'."""
+    depth = 1
+    while i < len(text) and depth:
+        c = text[i]
+        if c in '\'"`':
+            i = _skip_string(text, i)
+            continue
+        if c == '(':
+            depth += 1
+        elif c == ')':
+            depth -= 1
+        i += 1
+    while i < len(text) and text[i] in ' \t':
+        i += 1
+    if i < len(text) and text[i] == ';':
+        i += 1
+    return i
+
+
+def minify_js(text, strip_logs=False):
+    out = []
+    i = 0
+    n = len(text)
+    while i < n:
+        c = text[i]
+        if c in '\'"`':
+            end = _skip_string(text, i)
+            out.append(text[i:end])
+            i = end
+        elif text.startswith('//', i):
+            while i < n and text[i] != '\n':
+                i += 1
+        elif text.startswith('/*', i):
+            end = text.find('*/', i + 2)
+            i = n if end < 0 else end + 2
+        elif c == '/' and _regex_allowed(out):
+            end = _skip_regex(text, i)
+            out.append(text[i:end])
+            i = end
+        elif strip_logs and text.startswith(LOG_CALLS, i) and (not out or out[-1] in '\n{;}'):
+            i = _skip_call(text, text.index('(', i) + 1)
+        elif c in ' \t\r':
+            while i < n and text[i] in ' \t\r':
+                i += 1
+            prev = out[-1][-1] if out else ''
+            nxt = text[i] if i < n else ''
+            if prev and nxt and prev != '\n' and nxt != '\n' and _space_needed(prev, nxt):
+                out.append(' ')
+        elif c == '\n':
+            while i < n and text[i] in ' \t\r\n':
+                i += 1
+            prev = out[-1][-1] if out else ''
+            nxt = text[i] if i < n else ''
+            # Keep the break unless it obviously cannot end a statement
+            if prev and nxt and prev not in '{;,([=&|?:<>*%' and nxt not in '})].':
+                out.append('\n')
+        else:
+            out.append(c)
+            i += 1
+    return ''.join(out).strip()
+
+
+def minify_html(text, stylesheets, strip_logs=False):
+    def style(match):
+        return '<style>' + minify_css(match.group(1)) + '</style>'
+
+    def script(match):
+        return match.group(1) + minify_js(match.group(2), strip_logs) + '</script>'
+
+    def link(match):
+        css = stylesheets.get(os.path.basename(match.group(1)))
+        return '<style>' + css + '</style>' if css is not None else match.group(0)
+
+    text = re.sub(r'<!--.*?-->', '', text, flags=re.S)
+    text = re.sub(r'<style>(.*?)</style>', style, text, flags=re.S)
+    text = re.sub(r'(<script>)(.*?)</script>', script, text, flags=re.S)
+    text = re.sub(r'<link rel="stylesheet" href="([^"]+)">', link, text)
+
+    # Indentation and line breaks between tags carry no meaning outside <script>, next to text they are one space
+    parts = re.split(r'(<script>.*?</script>)', text, flags=re.S)
+    for index in range(0, len(parts), 2):
+        lines = [line.strip() for line in parts[index].split('\n')]
+        joined = ''
+        for line in lines:
+            if not line:
+                continue
+            if joined and not (joined.endswith('>') and line.startswith('<')):
+                joined += ' '
+            joined += line
+        parts[index] = joined
+    return ''.join(parts)
+
+
+def bundle_page(html, stylesheets, scripts, strip_logs=False):
+    """setup.html with all linked stylesheets and scripts inlined."""
+    page = minify_html(html, stylesheets, strip_logs)
+
+    # After minify_html, so the script's line breaks are not joined
+    def script(match):
+        js = scripts.get(os.path.basename(match.group(1)))
+        if js is None:
+            return match.group(0)
+        return '<script>' + js.replace('</script', '<\\/script') + '</script>'
+
+    return re.sub(r'<script src="([^"]+)"></script>', script, page)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    parser.add_argument('--out-dir', required=True, help='directory for the minified files')
+    parser.add_argument('--inline-css-max', type=int, default=0,
+                        help='inline linked stylesheets up to this many bytes (0 = never)')
+    parser.add_argument('--strip-logs', action='store_true', help='drop console.log/console.debug calls')
+    parser.add_argument('--bundle', metavar='NAME',
+                        help='also write setup.html with all assets inlined under this name')
+    parser.add_argument('files', nargs='+', help='assets to minify (.html, .css, .js)')
+    args = parser.parse_args()
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    sources = {}
+    for path in args.files:
+        with open(path, encoding='utf-8') as f:
+            sources[os.path.basename(path)] = f.read()
+
+    stylesheets = {}
+    for name, text in sources.items():
+        if name.endswith('.css'):
+            css = minify_css(text)
+            if len(css.encode('utf-8')) <= args.inline_css_max:
+                stylesheets[name] = css
+
+    total_in = total_out = 0
+    for name, text in sources.items():
+        if name.endswith('.css'):
+            result = minify_css(text)
+        elif name.endswith('.js'):
+            result = minify_js(text, args.strip_logs)
+        elif name.endswith('.html'):
+            result = minify_html(text, stylesheets, args.strip_logs)
+        else:
+            result = text
+
+        with open(os.path.join(args.out_dir, name), 'w', encoding='utf-8', newline='\n') as f:
+            f.write(result)
+        total_in += len(text.encode('utf-8'))
+        total_out += len(result.encode('utf-8'))
+
+    print('Web assets minified: %d -> %d bytes' % (total_in, total_out))
+
+    if args.bundle:
+        inline = {name: minify_css(text) for name, text in sources.items() if name.endswith('.css')}
+        scripts = {name: minify_js(text, args.strip_logs) for name, text in sources.items() if name.endswith('.js')}
+        page = bundle_page(sources['setup.html'], inline, scripts, args.strip_logs)
+        with open(os.path.join(args.out_dir, args.bundle), 'w', encoding='utf-8', newline='\n') as f:
+            f.write(page)
+        print('Portal bundle %s: %d bytes' % (args.bundle, len(page.encode('utf-8'))))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
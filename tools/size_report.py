@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+"""
+Size report for the WiFi Manager component.
+
+Reads the linker map of an ESP-IDF application and reports what the component
+archive contributes: text/rodata/data/bss per object file and per symbol, plus
+the EMBED_FILES web assets. The result is written as JSON. With a flash or RAM
+budget set, the exit status is 1 when the component exceeds it.
+
+  report    One map file (the current build), used by the
+            wifi_manager_size_report CMake target.
+  profiles  Build the project once per profile in tools/size_profiles/ and
+            report each one, used by the wifi_manager_size_profiles target.
+
+Author: Peter Stangsdal
+License: MIT
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+
+PROFILE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'size_profiles')
+
+# Input section prefix -> category
+SECTION_CATEGORIES = (
+    ('.literal', 'text'),
+    ('.text', 'text'),
+    ('.iram1', 'text'),
+    ('.rodata', 'rodata'),
+    ('.srodata', 'rodata'),
+    ('.dram1', 'data'),
+    ('.data', 'data'),
+    ('.sdata', 'data'),
+    ('.bss', 'bss'),
+    ('.sbss', 'bss'),
+    ('COMMON', 'bss'),
+)
+
+# Output sections that are not loaded into the image
+SKIPPED_OUTPUT_SECTIONS = ('.debug', '.comment', '.xt.', '.xtensa.info', '.riscv.attributes', '.note')
+
+OUTPUT_RE = re.compile(r'^(\.\S+)(?:\s+0x[0-9a-f]+\s+0x[0-9a-f]+)?\s*$')
+INPUT_RE = re.compile(r'^ (\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$')
+INPUT_NAME_RE = re.compile(r'^ (\S+)$')
+INPUT_CONT_RE = re.compile(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$')
+OBJECT_RE = re.compile(r'([^/\\]+\.a)\(([^)]+)\)$')
+
+
+def classify(section):
+    for prefix, category in SECTION_CATEGORIES:
+        if section == prefix or section.startswith(prefix + '.') or section.startswith(prefix + '_'):
+            return category
+    return None
+
+
+def symbol_name(section):
+    """Function and data sections are named after their symbol (-ffunction-sections)."""
+    for prefix, _ in SECTION_CATEGORIES:
+        if section.startswith(prefix + '.') and not section[len(prefix) + 1:].isdigit():
+            return section[len(prefix) + 1:]
+    return section
+
+
+def empty_sizes():
+    return {'text': 0, 'iram': 0, 'rodata': 0, 'data': 0, 'bss': 0}
+
+
+def add_totals(sizes):
+    # IRAM code and initialized data are stored in flash and copied to RAM at boot
+    sizes['flash'] = sizes['text'] + sizes['iram'] + sizes['rodata'] + sizes['data']
+    sizes['ram'] = sizes['iram'] + sizes['data'] + sizes['bss']
+    return sizes
+
+
+def parse_map(path):
+    """Yield (output section, input section, size, object) for every input section of the archive."""
+    in_memory_map = False
+    output_section = None
+    pending_name = None
+
+    with open(path, encoding='utf-8', errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if not in_memory_map:
+                in_memory_map = line.startswith('Linker script and memory map')
+                continue
+
+            match = OUTPUT_RE.match(line)
+            if match:
+                output_section = match.group(1)
+                pending_name = None
+                continue
+
+            if pending_name:
+                match = INPUT_CONT_RE.match(line)
+                name, pending_name = pending_name, None
+                if match:
+                    yield output_section, name, int(match.group(2), 16), match.group(3)
+                    continue
+
+            match = INPUT_RE.match(line)
+            if match:
+                yield output_section, match.group(1), int(match.group(3), 16), match.group(4)
+                continue
+
+            match = INPUT_NAME_RE.match(line)
+            if match and not match.group(1).startswith('*'):
+                pending_name = match.group(1)
+
+
+def build_report(map_path, archive):
+    totals = empty_sizes()
+    objects = {}
+    symbols = {}
+    embedded = {}
+
+    for output_section, section, size, obj in parse_map(map_path):
+        if size == 0 or not output_section or output_section.startswith(SKIPPED_OUTPUT_SECTIONS):
+            continue
+        match = OBJECT_RE.search(obj)
+        if not match or match.group(1) != archive:
+            continue
+        category = classify(section)
+        if not category:
+            continue
+
+        object_name = match.group(2)
+        if category == 'text' and output_section.startswith('.iram'):
+            category = 'iram'
+
+        # EMBED_FILES blobs are assembled from generated <file>.S sources
+        name = symbol_name(section)
+        if object_name.endswith('.S.obj'):
+            name = object_name[:-len('.S.obj')]
+            embedded[name] = embedded.get(name, 0) + size
+
+        totals[category] += size
+        objects.setdefault(object_name, empty_sizes())[category] += size
+
+        key = (name, object_name)
+        entry = symbols.setdefault(key, {'name': key[0], 'object': object_name, 'category': category, 'size': 0})
+        entry['size'] += size
+
+    return {
+        'map': os.path.abspath(map_path),
+        'archive': archive,
+        'totals': add_totals(totals),
+        'embedded': dict(sorted(embedded.items(), key=lambda item: -item[1])),
+        'objects': {name: add_totals(sizes) for name, sizes in sorted(objects.items())},
+        'symbols': sorted(symbols.values(), key=lambda entry: -entry['size']),
+    }
+
+
+def check_budget(report, flash_budget, ram_budget, label):
+    """Print the totals (to stderr, stdout may carry the JSON) and return False if a budget is exceeded."""
+    totals = report['totals']
+    ok = True
+    for name, used, budget in (('flash', totals['flash'], flash_budget), ('RAM', totals['ram'], ram_budget)):
+        if budget and used > budget:
+            print('%s: %s %d bytes exceeds budget of %d bytes (+%d)' % (label, name, used, budget, used - budget),
+                  file=sys.stderr)
+            ok = False
+    print('%s: flash %d bytes (assets %d), RAM %d bytes' %
+          (label, totals['flash'], sum(report['embedded'].values()), totals['ram']), file=sys.stderr)
+    return ok
+
+
+def read_budgets(build_dir):
+    """Budgets of a profile build, from its generated sdkconfig.json."""
+    try:
+        with open(os.path.join(build_dir, 'config', 'sdkconfig.json'), encoding='utf-8') as f:
+            config = json.load(f)
+    except (OSError, ValueError):
+        return 0, 0
+    return config.get('WIFI_MANAGER_SIZE_BUDGET_FLASH', 0), config.get('WIFI_MANAGER_SIZE_BUDGET_RAM', 0)
+
+
+def write_json(data, path):
+    if path:
+        with open(path, 'w', encoding='utf-8') as f:
+            json.dump(data, f, indent=2)
+            f.write('\n')
+    else:
+        json.dump(data, sys.stdout, indent=2)
+        sys.stdout.write('\n')
+
+
+def cmd_report(args):
+    report = build_report(args.map, args.archive)
+    write_json(report, args.output)
+    return 0 if check_budget(report, args.flash_budget, args.ram_budget, args.archive) else 1
+
+
+def cmd_profiles(args):
+    profiles = args.profile or sorted(os.path.splitext(name)[0] for name in os.listdir(PROFILE_DIR)
+                                      if name.endswith('.defaults'))
+    project_defaults = os.path.join(args.project, 'sdkconfig.defaults')
+    results = {}
+    ok = True
+
+    for profile in profiles:
+        build_dir = os.path.join(args.build_root, profile)
+        defaults = [os.path.join(PROFILE_DIR, profile + '.defaults')]
+        if os.path.exists(project_defaults):
+            defaults.insert(0, project_defaults)
+
+        # Separate build directory and sdkconfig per profile, the project's own build is left alone
+        cmd = ['idf.py', '-C', args.project, '-B', build_dir,
+               '-D', 'SDKCONFIG=' + os.path.join(build_dir, 'sdkconfig'),
+               '-D', 'SDKCONFIG_DEFAULTS=' + ';'.join(defaults), 'build']
+        print('Building profile %s' % profile, file=sys.stderr)
+        if subprocess.call(cmd) != 0:
+            print('%s: build failed' % profile, file=sys.stderr)
+            return 1
+
+        maps = glob.glob(os.path.join(build_dir, '*.map'))
+        if not maps:
+            print('%s: no map file in %s' % (profile, build_dir), file=sys.stderr)
+            return 1
+
+        report = build_report(maps[0], args.archive)
+        flash_budget, ram_budget = read_budgets(build_dir)
+        ok = check_budget(report, args.flash_budget or flash_budget, args.ram_budget or ram_budget, profile) and ok
+        results[profile] = report
+
+    write_json({'profiles': results}, args.output)
+    return 0 if ok else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0].strip())
+    parser.add_argument('--archive', default='libwifi_manager.a', help='component archive name in the map file')
+    parser.add_argument('--flash-budget', type=int, default=0, help='fail above this many flash bytes (0 = none)')
+    parser.add_argument('--ram-budget', type=int, default=0, help='fail above this many RAM bytes (0 = none)')
+    parser.add_argument('--output', help='JSON output file (default: stdout)')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    report = sub.add_parser('report', help='report one linker map')
+    report.add_argument('--map', required=True, help='linker map of the application')
+    report.set_defaults(func=cmd_report)
+
+    profiles = sub.add_parser('profiles', help='build and report every profile')
+    profiles.add_argument('--project', required=True, help='ESP-IDF project that uses the component')
+    profiles.add_argument('--build-root', required=True, help='directory for the per-profile builds')
+    profiles.add_argument('--profile', action='append', help='profile name (default: all in size_profiles/)')
+    profiles.set_defaults(func=cmd_profiles)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,6 +1,7 @@
 // WiFi Manager JavaScript - ESP32 CYD WiFi Setup
 let selectedNetwork = null
 let networks = []
+let controlSocket = null
 
 function loadNetworks () {
   console.log('Starting to load networks...')
@@ -94,6 +95,97 @@ function escapeHtml (text) {
   return div.innerHTML
 }
 
+// Use the scan the device rendered into the page, if any
+function takeInitialScan () {
+  const element = document.getElementById('initialScan')
+  let data = null
+  try {
+    data = element ? JSON.parse(element.textContent) : null
+  } catch (e) {
+    return false // Not rendered by the device
+  }
+  if (!data || !data.scan_completed) {
+    return false
+  }
+  networks = data.networks || []
+  displayNetworks()
+  return true
+}
+
+// Poll /wifi when server-sent events are not available
+function startScanPolling () {
+  // Try multiple times to catch the scan completion
+  setTimeout(loadNetworks, 2000) // 2 seconds
+  setTimeout(loadNetworks, 5000) // 5 seconds
+  setTimeout(loadNetworks, 10000) // 10 seconds
+
+  // Refresh network list every 30 seconds
+  setInterval(loadNetworks, 30000)
+}
+
+// Subscribe to scan completions pushed on /events
+function subscribeScanEvents () {
+  if (!window.EventSource) {
+    return false
+  }
+
+  const events = new EventSource('/events')
+  let opened = false
+  events.onopen = function () {
+    opened = true
+  }
+  events.addEventListener('scan', loadNetworks)
+  events.onerror = function () {
+    // Server has no free stream slot - fall back to polling
+    if (!opened && events.readyState === EventSource.CLOSED) {
+      startScanPolling()
+    }
+  }
+  return true
+}
+
+// Open the /ws control channel; onFail runs if it cannot be used
+function openControlChannel (onOpen, onFail) {
+  if (!window.WebSocket) {
+    onFail()
+    return
+  }
+
+  const socket = new WebSocket('ws://' + window.location.host + '/ws')
+  let opened = false
+  socket.onopen = function () {
+    opened = true
+    controlSocket = socket
+    onOpen(socket)
+  }
+  socket.onmessage = function (event) {
+    handleControlMessage(event.data)
+  }
+  socket.onclose = function (event) {
+    controlSocket = null
+    // Not supported by this build, or no free slot (1013 Try Again Later) - use the REST routes
+    if (!opened || event.code === 1013) {
+      onFail()
+    }
+  }
+}
+
+// Control channel messages are "<type> <json>"
+function handleControlMessage (message) {
+  const split = message.indexOf(' ')
+  const type = split < 0 ? message : message.slice(0, split)
+  const data = split < 0 ? {} : JSON.parse(message.slice(split + 1))
+
+  if (type === 'wifi') {
+    networks = data.networks || []
+    displayNetworks()
+  } else if (type === 'config') {
+    displayConfiguration(data.parameters || [])
+  } else if (type === 'save') {
+    showSaveResult(data)
+  }
+}
+
 // Page initialization
 window.onload = function () {
   console.log('Page loaded, starting initialization...')
@@ -101,27 +193,50 @@ window.onload = function () {
 
   // Check if this is the setup page (has wifiList element)
   const wifiListElement = document.getElementById('wifiList')
-  if (wifiListElement) {
+  const haveScan = wifiListElement && takeInitialScan()
+  if (haveScan) {
+    console.log('Setup page detected - networks rendered by the device')
+  } else if (wifiListElement) {
     console.log('Setup page detected - starting network loading...')
     wifiListElement.innerHTML =
       '<div class="loading">Page loaded, scanning for networks...</div>'
-
-    // Try multiple times to catch the scan completion
-    setTimeout(loadNetworks, 2000) // 2 seconds
-    setTimeout(loadNetworks, 5000) // 5 seconds
-    setTimeout(loadNetworks, 10000) // 10 seconds
-
-    // Refresh network list every 30 seconds
-    setInterval(loadNetworks, 30000)
   } else {
     console.log('Configuration page detected - skipping network scan')
   }
 
-  // Load configuration parameters (available on both pages)
+  // Configuration parameters are available on both pages, usually rendered by the device
   const configFormElement = document.getElementById('configForm')
-  if (configFormElement) {
-    loadConfiguration()
+  const haveConfig =
+    configFormElement && configFormElement.querySelector('[data-rendered]')
+  if (haveConfig && haveConfig.classList.contains('config-params')) {
+    showSaveButton()
   }
+
+  // One socket for the list, finished scans and the configuration
+  openControlChannel(
+    function (socket) {
+      if (wifiListElement && !haveScan) {
+        socket.send('wifi')
+      }
+      if (configFormElement && !haveConfig) {
+        socket.send('config')
+      }
+    },
+    function () {
+      if (wifiListElement) {
+        // Reload the list whenever the device reports a finished scan
+        if (!haveScan) {
+          loadNetworks()
+        }
+        if (!subscribeScanEvents()) {
+          startScanPolling()
+        }
+      }
+      if (configFormElement && !haveConfig) {
+        loadConfiguration()
+      }
+    }
+  )
 }
 
 // Configuration management functions
@@ -200,8 +315,11 @@ function displayConfiguration (parameters) {
 
   html += '</div>'
   configForm.innerHTML = html
+  showSaveButton()
+}
 
-  // Show the save button (only if it exists - config page)
+// Show the save button (only if it exists - config page)
+function showSaveButton () {
   const saveBtn = document.getElementById('saveConfigBtn')
   if (saveBtn) {
     saveBtn.style.display = 'block'
@@ -225,6 +343,11 @@ function saveConfiguration () {
   // Convert FormData to URL-encoded string
   const urlEncoded = new URLSearchParams(formData).toString()
 
+  if (controlSocket) {
+    controlSocket.send('save ' + urlEncoded)
+    return
+  }
+
   fetch('/config/save', {
     method: 'POST',
     headers: {
@@ -239,20 +362,22 @@ function saveConfiguration () {
       }
       return response.json()
     })
-    .then(data => {
-      console.log('Save result:', data)
-      if (data.status === 'success') {
-        alert('Configuration saved successfully!')
-      } else {
-        alert('Configuration save result: ' + data.message)
-      }
-    })
+    .then(showSaveResult)
     .catch(error => {
       console.error('Error saving configuration:', error)
       alert('Failed to save configuration: ' + error.message)
     })
 }
 
+function showSaveResult (data) {
+  console.log('Save result:', data)
+  if (data.status === 'success') {
+    alert('Configuration saved successfully!')
+  } else {
+    alert('Configuration save result: ' + (data.message || data.status))
+  }
+}
+
 // Manual test function
 function testFetch () {
   console.log('Manual test triggered')
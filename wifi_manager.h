@@ -43,8 +43,30 @@
 
 #include "esp_err.h"
 #include "esp_event.h"
+#include "freertos/FreeRTOS.h"
 #include <stdbool.h>
 
+// Maximum number of saved networks
+#define WIFI_MANAGER_MAX_NETWORKS 5
+
+/**
+ * @brief Default portal web server settings, for wifi_manager_create_with_config()
+ *
+ * The stack is larger than HTTPD_DEFAULT_CONFIG() because the form handler
+ * keeps its receive buffer on it.
+ */
+#define WIFI_MANAGER_HTTP_CONFIG_DEFAULT() \
+    {                                      \
+        .stack_size = 6144,                \
+        .task_priority = 5,                \
+        .core_id = tskNO_AFFINITY,         \
+        .server_port = 80,                 \
+        .max_open_sockets = 7,             \
+        .backlog_conn = 5,                 \
+        .recv_wait_timeout = 5,            \
+        .send_wait_timeout = 5,            \
+    }
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -60,7 +82,8 @@ extern "C"
         WIFI_STATUS_CONNECTED,
         WIFI_STATUS_AP_MODE,
         WIFI_STATUS_CONFIG_PORTAL,
-        WIFI_STATUS_FAILED
+        WIFI_STATUS_FAILED,
+        WIFI_STATUS_NO_IP // Associated with the AP but the IP lease was lost, renewing
     } wifi_status_t;
 
     /**
@@ -86,12 +109,44 @@ extern "C"
      */
     typedef void (*save_config_callback_t)(void);
 
+    /**
+     * @brief Config portal finished callback
+     * @param wm WiFi Manager instance
+     * @param connected true if the station connected through the portal, false on timeout or stop
+     */
+    typedef void (*portal_done_callback_t)(wifi_manager_t *wm, bool connected);
+
+    /**
+     * @brief Portal web server (esp_http_server) settings
+     */
+    typedef struct
+    {
+        uint32_t stack_size;        // httpd task stack in bytes
+        uint8_t task_priority;      // httpd task priority
+        int core_id;                // Core for the httpd task, or tskNO_AFFINITY
+        uint16_t server_port;       // HTTP port of the portal
+        uint16_t max_open_sockets;  // Concurrent client sockets (each /events or /ws client keeps one)
+        uint16_t backlog_conn;      // Pending connections queued by the listening socket
+        uint16_t recv_wait_timeout; // Socket receive timeout in seconds
+        uint16_t send_wait_timeout; // Socket send timeout in seconds
+    } wifi_manager_http_config_t;
+
     /**
      * @brief Initialize WiFi Manager (like tzapu WiFiManager constructor)
      * @return wifi_manager_t* WiFi Manager instance
      */
     wifi_manager_t *wifi_manager_create(void);
 
+    /**
+     * @brief Initialize WiFi Manager with custom portal web server settings
+     *
+     * Start from WIFI_MANAGER_HTTP_CONFIG_DEFAULT() and change what is needed.
+     * The settings apply every time the portal web server is started.
+     * @param http_config Web server settings (NULL for WIFI_MANAGER_HTTP_CONFIG_DEFAULT())
+     * @return wifi_manager_t* WiFi Manager instance, NULL on failure
+     */
+    wifi_manager_t *wifi_manager_create_with_config(const wifi_manager_http_config_t *http_config);
+
     /**
      * @brief Destroy WiFi Manager instance
      * @param wm WiFi Manager instance
@@ -113,10 +168,53 @@ extern "C"
      * @param wm WiFi Manager instance
      * @param ap_name Access Point name
      * @param ap_password Access Point password (NULL for open)
-     * @return true if connected, false if timeout or aborted
+     * @return true if connected, false if timeout or aborted (always false in non-blocking mode
+     *         and when CONFIG_WIFI_MANAGER_PORTAL is disabled)
      */
     bool wifi_manager_start_config_portal(wifi_manager_t *wm, const char *ap_name, const char *ap_password);
 
+    /**
+     * @brief Stop a running configuration portal (like tzapu stopConfigPortal)
+     *
+     * Stops the web server and the soft-AP. A blocked wifi_manager_start_config_portal()
+     * returns false and the portal done callback is called with connected = false.
+     * @param wm WiFi Manager instance
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE if no portal is running
+     */
+    esp_err_t wifi_manager_stop_config_portal(wifi_manager_t *wm);
+
+    /**
+     * @brief Drive a non-blocking portal from the application loop (like tzapu process)
+     *
+     * Optional - the portal task finishes the portal on its own. Calling this from
+     * the application loop finishes it promptly, with the callbacks running in the
+     * caller's task.
+     * @param wm WiFi Manager instance
+     * @return true if connected
+     */
+    bool wifi_manager_process(wifi_manager_t *wm);
+
+    /**
+     * @brief Set whether the config portal blocks the caller (like tzapu setConfigPortalBlocking)
+     *
+     * In non-blocking mode wifi_manager_start_config_portal() and wifi_manager_auto_connect()
+     * return as soon as the portal is up; the portal runs in its own task and its end is
+     * reported through the portal done callback.
+     * @param wm WiFi Manager instance
+     * @param blocking true to block (default), false to return immediately
+     */
+    void wifi_manager_set_config_portal_blocking(wifi_manager_t *wm, bool blocking);
+
+    /**
+     * @brief Set callback called when the config portal ends
+     *
+     * In non-blocking mode the callback runs in the portal task. It may start the next
+     * portal or destroy the instance; wm must not be used after destroying it.
+     * @param wm WiFi Manager instance
+     * @param callback Callback function
+     */
+    void wifi_manager_set_portal_done_callback(wifi_manager_t *wm, portal_done_callback_t callback);
+
     /**
      * @brief Set config mode callback (like tzapu setAPCallback)
      * @param wm WiFi Manager instance
@@ -161,11 +259,45 @@ extern "C"
 
     /**
      * @brief Get current IP address (when connected)
+     * @note The returned buffer is owned by the manager and rewritten on the next lease.
+     *       Use wifi_manager_get_snapshot() when the address must be consistent with
+     *       the status and other link details.
      * @param wm WiFi Manager instance
      * @return IP address string or NULL if not connected
      */
     const char *wifi_manager_get_ip_address(wifi_manager_t *wm);
 
+    /**
+     * @brief Consistent snapshot of the connection state
+     *
+     * Addresses are IPv4 in network byte order (same layout as esp_ip4_addr_t::addr),
+     * so they can be printed with IPSTR/IP2STR after casting to esp_ip4_addr_t.
+     */
+    typedef struct
+    {
+        wifi_status_t status;        // Current WiFi status
+        uint32_t ip;                 // Station IPv4 address (0 when no lease)
+        uint32_t gateway;            // Default gateway
+        uint32_t netmask;            // Subnet mask
+        int8_t rssi;                 // RSSI of the associated AP in dBm (0 when not associated)
+        uint8_t bssid[6];            // BSSID of the associated AP
+        uint8_t channel;             // Primary channel of the associated AP
+        uint32_t uptime_in_state_ms; // Time spent in the current status
+    } wifi_manager_snapshot_t;
+
+    /**
+     * @brief Get a consistent snapshot of the connection state
+     *
+     * Safe to call from any task, including HTTP handlers. Readers never block the
+     * event loop: the state is published with a sequence lock and the read is retried
+     * if it raced with an update.
+     *
+     * @param wm WiFi Manager instance
+     * @param out Snapshot to fill
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG if wm or out is NULL
+     */
+    esp_err_t wifi_manager_get_snapshot(wifi_manager_t *wm, wifi_manager_snapshot_t *out);
+
     /**
      * @brief Get config portal SSID
      * @param wm WiFi Manager instance
@@ -180,6 +312,175 @@ extern "C"
      */
     esp_err_t wifi_manager_erase_config(wifi_manager_t *wm);
 
+    /* ==========================================
+     *          SAVED NETWORKS
+     * ========================================== */
+
+    /**
+     * @brief Information about a saved network (the password is never exposed)
+     */
+    typedef struct
+    {
+        char ssid[33];          // Network name
+        uint8_t priority;       // Higher is tried first
+        uint32_t last_success;  // time() of the last successful connection (0 = never)
+        uint16_t success_count; // Successful connections
+        uint16_t failure_count; // Failed attempts since the last success
+        uint8_t bssid[6];       // AP used for the last successful connection
+        uint8_t channel;        // Channel of that AP
+    } wifi_manager_network_info_t;
+
+    /**
+     * @brief Add a network to the saved networks, or update its password and priority
+     *
+     * Up to WIFI_MANAGER_MAX_NETWORKS networks are kept. When the store is full the
+     * lowest priority network (least recently used on a tie) is replaced.
+     * @param wm WiFi Manager instance
+     * @param ssid Network name
+     * @param password Network password (NULL or "" for open networks)
+     * @param priority Selection priority, higher is tried first
+     * @return ESP_OK on success
+     */
+    esp_err_t wifi_manager_add_network(wifi_manager_t *wm, const char *ssid, const char *password, uint8_t priority);
+
+    /**
+     * @brief Remove a saved network
+     * @param wm WiFi Manager instance
+     * @param ssid Network name
+     * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the network is not saved
+     */
+    esp_err_t wifi_manager_remove_network(wifi_manager_t *wm, const char *ssid);
+
+    /**
+     * @brief List saved networks
+     * @param wm WiFi Manager instance
+     * @param networks Array to fill
+     * @param max_networks Size of the array
+     * @param count Number of entries written
+     * @return ESP_OK on success
+     */
+    esp_err_t wifi_manager_list_networks(wifi_manager_t *wm, wifi_manager_network_info_t *networks,
+                                         size_t max_networks, size_t *count);
+
+    /* ==========================================
+     *          LINK QUALITY
+     * ========================================== */
+
+    /**
+     * @brief Smoothed link statistics of the station interface
+     *
+     * RSSI is sampled every WIFI_MANAGER_LINK_SAMPLE_INTERVAL_MS while connected.
+     * Window values cover the last 32 samples.
+     */
+    typedef struct
+    {
+        int8_t rssi_last;            // Latest sample (dBm)
+        int8_t rssi_avg;             // Exponentially weighted moving average (dBm)
+        int8_t rssi_min;             // Window minimum (dBm)
+        int8_t rssi_max;             // Window maximum (dBm)
+        int8_t rssi_p10;             // Window 10th percentile (dBm)
+        uint8_t link_quality;        // Score 0-100 from average, dips and beacon loss
+        uint16_t sample_count;       // Samples in the window
+        uint32_t connected_ms;       // Total time associated since create
+        uint32_t disconnect_count;   // Disconnects after a successful association
+        uint32_t beacon_loss_count;  // Of those, caused by beacon timeout
+        float beacon_loss_per_hour;  // Beacon loss disconnects per connected hour
+    } wifi_manager_link_stats_t;
+
+    /**
+     * @brief Get smoothed RSSI statistics and the link quality score
+     *
+     * Useful for health reporting and for deferring large transfers until the
+     * link is good. Safe to call from any task.
+     * @param wm WiFi Manager instance
+     * @param out Filled with the current statistics
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG on NULL arguments
+     */
+    esp_err_t wifi_manager_get_link_stats(wifi_manager_t *wm, wifi_manager_link_stats_t *out);
+
+    /* ==========================================
+     *          MEMORY USAGE
+     * ========================================== */
+
+    /**
+     * @brief Heap used by one subsystem of the component
+     */
+    typedef struct
+    {
+        uint32_t current_bytes; // Allocated right now
+        uint32_t peak_bytes;    // Highest value of current_bytes since boot
+        uint32_t alloc_count;   // Allocations since boot
+    } wifi_manager_mem_usage_t;
+
+    /**
+     * @brief RAM used by the manager
+     *
+     * Subsystem counters are shared by all instances. cJSON's own tree nodes are
+     * not counted, only the buffers the component allocates or receives from it.
+     * Stack values are the least free stack a task has had (bytes), 0 while the
+     * task does not exist.
+     */
+    typedef struct
+    {
+        uint32_t instance_bytes;               // The wifi_manager_t allocation
+        wifi_manager_mem_usage_t scan;         // Scan result processing
+        wifi_manager_mem_usage_t web;          // HTTP, WebSocket and event stream buffers
+        wifi_manager_mem_usage_t config;       // Configuration parameter load/save
+        uint32_t scan_task_stack_free;         // Scan task stack high-water mark
+        uint32_t portal_task_stack_free;       // Non-blocking portal task
+        uint32_t dns_task_stack_free;          // Captive DNS task
+        uint32_t httpd_task_stack_free;        // Web server task (known after its first connection)
+        uint32_t heap_free;                    // Free heap now
+        uint32_t heap_min_free;                // Lowest free heap since boot
+    } wifi_manager_mem_stats_t;
+
+    /**
+     * @brief Get heap and stack usage of the manager
+     *
+     * Also served as "mem" in the /stats endpoint. Safe to call from any task.
+     * @param wm WiFi Manager instance
+     * @param out Filled with the current numbers
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG on NULL arguments
+     */
+    esp_err_t wifi_manager_get_mem_stats(wifi_manager_t *wm, wifi_manager_mem_stats_t *out);
+
+    /* ==========================================
+     *          ROAMING
+     * ========================================== */
+
+    /**
+     * @brief Roaming engine settings
+     */
+    typedef struct
+    {
+        int8_t rssi_threshold;         // Look for a better AP while RSSI is below this (dBm)
+        uint8_t rssi_hysteresis;       // A new AP must be this many dB stronger than the current one
+        uint32_t scan_interval_ms;     // One channel is scanned per interval while below the threshold
+        uint32_t min_roam_interval_ms; // Hold-down time after a roam
+    } wifi_manager_roam_config_t;
+
+    /**
+     * @brief Enable background scanning and roaming between APs of the connected SSID
+     *
+     * While connected and the RSSI is below the threshold, one channel is scanned per
+     * interval. When an AP of the same SSID is found that is stronger by the hysteresis
+     * margin, the station reassociates to that BSSID.
+     * @param wm WiFi Manager instance
+     * @param config Roaming settings (NULL for defaults: -70 dBm, 8 dB, 5 s, 60 s)
+     * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED without CONFIG_WIFI_MANAGER_SCAN_TASK
+     */
+    esp_err_t wifi_manager_enable_roaming(wifi_manager_t *wm, const wifi_manager_roam_config_t *config);
+
+    /**
+     * @brief Disable background scanning and roaming
+     *
+     * Also lifts the BSSID a roam pinned the station to, later reconnects may
+     * use any AP of the network again.
+     * @param wm WiFi Manager instance
+     * @return ESP_OK on success
+     */
+    esp_err_t wifi_manager_disable_roaming(wifi_manager_t *wm);
+
     /* ==========================================
      *          CONFIGURATION MANAGEMENT
      * ========================================== */
@@ -192,7 +493,7 @@ extern "C"
      * @param default_value Default value for the parameter
      * @param required Whether the parameter is required
      * @param placeholder Placeholder text for web UI
-     * @return ESP_OK on success
+     * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED without CONFIG_WIFI_MANAGER_CUSTOM_PARAMS
      */
     esp_err_t wifi_manager_add_parameter(wifi_manager_t *wm, const char *key, const char *label,
                                          const char *default_value, bool required, const char *placeholder);
@@ -255,7 +556,7 @@ extern "C"
      */
     esp_err_t wifi_manager_reset_config(wifi_manager_t *wm);
 
-    // Legacy API compatibility (your original functions)
+    // Legacy API compatibility (your original functions), only built with CONFIG_WIFI_MANAGER_LEGACY_API
     esp_err_t wifi_manager_init(wifi_event_callback_t callback);
     esp_err_t wifi_manager_start(void);
     wifi_status_t wifi_manager_get_current_status(void);